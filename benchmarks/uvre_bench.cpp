@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#if defined(UVRE_BENCH_EGL)
+#include <uvre/egl.hpp>
+#endif
+#include <uvre/uvre.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+constexpr const int TARGET_SIZE = 64;
+constexpr const int NUM_RUNS = 5;
+constexpr const size_t NUM_RECORDED = 10000;
+constexpr const size_t NUM_DRAWS = 10000;
+
+using vec2_t = float[2];
+struct vertex final {
+    vec2_t position;
+};
+
+static const char *vert_source = R"(
+layout(location = 0) in vec2 position;
+void main()
+{
+    gl_Position = vec4(position, 0.0, 1.0);
+})";
+
+static const char *frag_source = R"(
+layout(location = 0) out vec4 target;
+void main()
+{
+    target = vec4(1.0, 1.0, 1.0, 1.0);
+})";
+
+// The same shaders for the SW implementation
+static void swVertex(const uvre::SwResources &, const void *vertex, uint32_t, uint32_t, uvre::SwVertex &out)
+{
+    const float *position = reinterpret_cast<const float *>(vertex);
+    out.position[0] = position[0];
+    out.position[1] = position[1];
+    out.position[2] = 0.0f;
+    out.position[3] = 1.0f;
+}
+
+static bool swFragment(const uvre::SwResources &, const uvre::SwFragment &, float color[4])
+{
+    color[0] = color[1] = color[2] = color[3] = 1.0f;
+    return true;
+}
+
+static void onDebugMessage(const uvre::DebugMessageInfo &msg)
+{
+    // stdout is for the results
+    if(msg.level == uvre::DebugMessageLevel::ERROR)
+        std::fprintf(stderr, "%s\n", msg.text);
+}
+
+struct BenchContext final {
+#if defined(UVRE_BENCH_EGL)
+    uvre::HeadlessContext *egl { nullptr };
+#endif
+};
+
+static bool prepareDevice(void *user_data, const uvre::ImplInfo &impl_info, uvre::DeviceCreateInfo &info)
+{
+    info.onDebugMessage = &onDebugMessage;
+
+    switch(impl_info.family) {
+        case uvre::ImplFamily::OPENGL:
+#if defined(UVRE_BENCH_EGL)
+            reinterpret_cast<BenchContext *>(user_data)->egl = uvre::createHeadlessContext(info);
+            return reinterpret_cast<BenchContext *>(user_data)->egl != nullptr;
+#else
+            return false;
+#endif
+        case uvre::ImplFamily::SOFTWARE:
+        case uvre::ImplFamily::NONE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void releaseDevice(void *user_data, const uvre::ImplInfo &)
+{
+#if defined(UVRE_BENCH_EGL)
+    BenchContext *context = reinterpret_cast<BenchContext *>(user_data);
+    if(context->egl)
+        uvre::destroyHeadlessContext(context->egl);
+    context->egl = nullptr;
+#else
+    static_cast<void>(user_data);
+#endif
+}
+
+static const char *getBackendName(uvre::ImplBackend backend)
+{
+    switch(backend) {
+        case uvre::ImplBackend::GL_33:
+            return "gl33";
+        case uvre::ImplBackend::GL_46:
+            return "gl46";
+        case uvre::ImplBackend::SOFTWARE:
+            return "sw";
+        case uvre::ImplBackend::NONE:
+            return "null";
+        default:
+            return "unknown";
+    }
+}
+
+struct Result final {
+    std::string name;
+    size_t iterations;
+    double min_ns;
+    double median_ns;
+    size_t bytes; // per iteration, zero if it's not an upload
+};
+
+struct Bench final {
+    uvre::IRenderDevice *device;
+    uvre::ICommandList *commands;
+    uvre::PipelineCreateInfo pipeline_info;
+    uvre::Pipeline pipelines[2];
+    uvre::Buffer vbo;
+    uvre::Buffer ubo;
+    uvre::Texture texture;
+    uvre::Sampler sampler;
+    uvre::RenderTarget target;
+    std::vector<Result> results;
+};
+
+// Makes sure nothing is left in flight
+static void finish(Bench &bench)
+{
+    bench.device->waitFence(bench.device->createFence(), UINT64_MAX);
+    bench.device->endFrame();
+    bench.device->beginFrame();
+}
+
+// Runs the function NUM_RUNS times, the setup part
+// of it goes into the untimed callback if needed.
+static void measure(Bench &bench, const std::string &name, size_t iterations, size_t bytes, const std::function<void()> &setup, const std::function<void()> &func)
+{
+    std::vector<double> times;
+    for(int i = 0; i < NUM_RUNS; i++) {
+        if(setup)
+            setup();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        func();
+        const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+        finish(bench);
+    }
+
+    std::sort(times.begin(), times.end());
+    bench.results.push_back(Result { name, iterations, times.front(), times[times.size() / 2], bytes });
+}
+
+static void startList(Bench &bench)
+{
+    bench.device->startRecording(bench.commands);
+    bench.commands->bindRenderTarget(bench.target);
+    bench.commands->setViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+    bench.commands->bindPipeline(bench.pipelines[0]);
+    bench.commands->bindVertexBuffer(bench.vbo);
+}
+
+static void benchRecording(Bench &bench)
+{
+    const std::pair<const char *, std::function<void(size_t)>> commands[] = {
+        { "record/draw", [&bench](size_t) { bench.commands->draw(3, 1, 0, 0); } },
+        { "record/bind_pipeline", [&bench](size_t i) { bench.commands->bindPipeline(bench.pipelines[i % 2]); } },
+        { "record/bind_vertex_buffer", [&bench](size_t) { bench.commands->bindVertexBuffer(bench.vbo); } },
+        { "record/bind_uniform_buffer", [&bench](size_t i) { bench.commands->bindUniformBuffer(bench.ubo, static_cast<uint32_t>(i % 4)); } },
+        { "record/bind_texture", [&bench](size_t i) { bench.commands->bindTexture(bench.texture, static_cast<uint32_t>(i % 4)); } },
+        { "record/bind_sampler", [&bench](size_t i) { bench.commands->bindSampler(bench.sampler, static_cast<uint32_t>(i % 4)); } },
+        { "record/set_viewport", [&bench](size_t i) { bench.commands->setViewport(0, 0, TARGET_SIZE - static_cast<int>(i % 2), TARGET_SIZE); } },
+        { "record/write_buffer_16", [&bench](size_t i) { const float value[4] = { static_cast<float>(i) }; bench.commands->writeBuffer(bench.ubo, 0, sizeof(value), value); } },
+    };
+
+    // Only the recording is timed, the
+    // lists are never submitted at all.
+    for(const auto &command : commands) {
+        const std::function<void(size_t)> &func = command.second;
+        measure(bench, command.first, NUM_RECORDED, 0, [&bench]() { startList(bench); }, [&func]() {
+            for(size_t i = 0; i < NUM_RECORDED; i++)
+                func(i);
+        });
+    }
+}
+
+static void benchSubmit(Bench &bench)
+{
+    // Same draws, once with the same pipeline
+    // and once switching it before every draw.
+    for(int switching = 0; switching < 2; switching++) {
+        const char *name = switching ? "submit/draws_pipeline_switch" : "submit/draws";
+        measure(bench, name, NUM_DRAWS, 0, [&bench, switching]() {
+            startList(bench);
+            for(size_t i = 0; i < NUM_DRAWS; i++) {
+                if(switching)
+                    bench.commands->bindPipeline(bench.pipelines[i % 2]);
+                bench.commands->draw(3, 1, 0, 0);
+            } }, [&bench]() { bench.device->submit(bench.commands); });
+    }
+}
+
+static void benchResources(Bench &bench)
+{
+    const size_t counts[3] = { 100, 1000, 10000 };
+    for(size_t count : counts) {
+        std::vector<uvre::Buffer> buffers;
+        measure(bench, "create/buffer/" + std::to_string(count), count, 0, [&buffers]() { buffers.clear(); }, [&bench, &buffers, count]() {
+            uvre::BufferCreateInfo info = {};
+            info.type = uvre::BufferType::DATA_BUFFER;
+            info.size = 256;
+            for(size_t i = 0; i < count; i++)
+                buffers.push_back(bench.device->createBuffer(info));
+        });
+
+        measure(bench, "destroy/buffer/" + std::to_string(count), count, 0, [&bench, &buffers, count]() {
+            uvre::BufferCreateInfo info = {};
+            info.type = uvre::BufferType::DATA_BUFFER;
+            info.size = 256;
+            buffers.clear();
+            for(size_t i = 0; i < count; i++)
+                buffers.push_back(bench.device->createBuffer(info));
+        }, [&buffers]() { buffers.clear(); });
+    }
+
+    // Pipelines are deduplicated, so every one of them
+    // gets a different stride (within the GL limit).
+    const size_t pipeline_counts[2] = { 100, 1000 };
+    for(size_t count : pipeline_counts) {
+        std::vector<uvre::Pipeline> pipelines;
+        measure(bench, "create/pipeline/" + std::to_string(count), count, 0, [&pipelines]() { pipelines.clear(); }, [&bench, &pipelines, count]() {
+            uvre::PipelineCreateInfo info = bench.pipeline_info;
+            for(size_t i = 0; i < count; i++) {
+                info.vertex_stride = sizeof(vertex) + (i % 500 + 1) * 4;
+                info.scissor_test = (i / 500) != 0;
+                pipelines.push_back(bench.device->createPipeline(info));
+            }
+        });
+    }
+}
+
+static void benchUploads(Bench &bench)
+{
+    const size_t buffer_sizes[4] = { 4096, 65536, 1048576, 16777216 };
+    for(size_t size : buffer_sizes) {
+        uvre::BufferCreateInfo info = {};
+        info.type = uvre::BufferType::DATA_BUFFER;
+        info.size = size;
+
+        uvre::Buffer buffer = bench.device->createBuffer(info);
+        std::vector<uint8_t> data(size, 0x55);
+        const size_t iterations = std::max<size_t>(1, 16777216 / size);
+
+        // The fence is part of it: a copy
+        // that never happens is not an upload.
+        measure(bench, "upload/write_buffer/" + std::to_string(size), iterations, size, nullptr, [&bench, &buffer, &data, iterations]() {
+            for(size_t i = 0; i < iterations; i++)
+                bench.device->writeBuffer(buffer, 0, data.size(), data.data());
+            bench.device->waitFence(bench.device->createFence(), UINT64_MAX);
+        });
+    }
+
+    const int texture_sizes[3] = { 256, 1024, 2048 };
+    for(int size : texture_sizes) {
+        uvre::TextureCreateInfo info = {};
+        info.type = uvre::TextureType::TEXTURE_2D;
+        info.format = uvre::PixelFormat::R8G8B8A8_UNORM;
+        info.width = size;
+        info.height = size;
+
+        uvre::Texture texture = bench.device->createTexture(info);
+        std::vector<uint8_t> data(static_cast<size_t>(size) * static_cast<size_t>(size) * 4, 0x55);
+        const size_t iterations = std::max<size_t>(1, 16777216 / data.size());
+
+        measure(bench, "upload/write_texture_2d/" + std::to_string(size), iterations, data.size(), nullptr, [&bench, &texture, &data, iterations, size]() {
+            for(size_t i = 0; i < iterations; i++)
+                bench.device->writeTexture2D(texture, 0, 0, size, size, uvre::PixelFormat::R8G8B8A8_UNORM, data.data());
+            bench.device->waitFence(bench.device->createFence(), UINT64_MAX);
+        });
+    }
+}
+
+static void printResults(const Bench &bench, uvre::ImplBackend backend)
+{
+    const uvre::DeviceInfo &info = bench.device->getInfo();
+    std::printf("{\n");
+    std::printf("  \"backend\": \"%s\",\n", getBackendName(backend));
+    std::printf("  \"impl_version\": \"%d.%d\",\n", info.impl_version_major, info.impl_version_minor);
+    std::printf("  \"runs\": %d,\n", NUM_RUNS);
+    std::printf("  \"results\": [\n");
+    for(size_t i = 0; i < bench.results.size(); i++) {
+        const Result &result = bench.results[i];
+        std::printf("    { \"name\": \"%s\", \"iterations\": %zu, \"min_ns\": %.0f, \"median_ns\": %.0f, \"ns_per_op\": %.2f", result.name.c_str(), result.iterations, result.min_ns, result.median_ns, result.median_ns / static_cast<double>(result.iterations));
+        if(result.bytes)
+            std::printf(", \"mb_per_s\": %.2f", static_cast<double>(result.bytes * result.iterations) / (result.median_ns * 1.0e-9) / 1048576.0);
+        std::printf(" }%s\n", (i + 1 < bench.results.size()) ? "," : "");
+    }
+    std::printf("  ]\n");
+    std::printf("}\n");
+}
+
+int main(int argc, char **argv)
+{
+    BenchContext context = {};
+    uvre::IRenderDevice *device = nullptr;
+
+    // Either the named backend or
+    // whatever the probe ends up with.
+    if(argc > 1) {
+        uvre::ImplBackend backends[static_cast<int>(uvre::ImplBackend::NUM_IMPL_BACKENDS)];
+        const size_t num_backends = uvre::enumerateBackends(backends, static_cast<size_t>(uvre::ImplBackend::NUM_IMPL_BACKENDS));
+        for(size_t i = 0; i < num_backends; i++) {
+            if(!std::strcmp(argv[1], getBackendName(backends[i])))
+                uvre::selectBackend(backends[i]);
+        }
+
+        if(std::strcmp(argv[1], getBackendName(uvre::getSelectedBackend()))) {
+            std::fprintf(stderr, "%s: backend %s is not built in\n", argv[0], argv[1]);
+            return 1;
+        }
+
+        uvre::ImplInfo impl_info = {};
+        uvre::DeviceCreateInfo device_info = {};
+        uvre::pollImplInfo(impl_info);
+        if(prepareDevice(&context, impl_info, device_info)) {
+            device = uvre::createDevice(device_info);
+            if(!device)
+                releaseDevice(&context, impl_info);
+        }
+    }
+    else {
+        uvre::ProbeInfo probe_info = {};
+        probe_info.user_data = &context;
+        probe_info.prepare = &prepareDevice;
+        probe_info.release = &releaseDevice;
+        device = uvre::probeDevice(probe_info);
+    }
+
+    if(!device) {
+        std::fprintf(stderr, "%s: unable to create a device\n", argv[0]);
+        return 1;
+    }
+
+    uvre::ICommandList *commands = device->createCommandList();
+
+    {
+        Bench bench = {};
+        bench.device = device;
+        bench.commands = commands;
+
+        uvre::ShaderCreateInfo vert_info = {};
+        vert_info.stage = uvre::ShaderStage::VERTEX;
+        vert_info.format = uvre::ShaderFormat::SOURCE_GLSL;
+        vert_info.code = vert_source;
+        vert_info.sw.vertex = &swVertex;
+
+        uvre::ShaderCreateInfo frag_info = {};
+        frag_info.stage = uvre::ShaderStage::FRAGMENT;
+        frag_info.format = uvre::ShaderFormat::SOURCE_GLSL;
+        frag_info.code = frag_source;
+        frag_info.sw.fragment = &swFragment;
+
+        uvre::Shader shaders[2];
+        shaders[0] = device->createShader(vert_info);
+        shaders[1] = device->createShader(frag_info);
+
+        uvre::VertexAttrib attribute = uvre::VertexAttrib { 0, uvre::VertexAttribType::FLOAT32, 2, offsetof(vertex, position), false };
+
+        uvre::PipelineCreateInfo &pipeline_info = bench.pipeline_info;
+        pipeline_info.index_type = uvre::IndexType::INDEX16;
+        pipeline_info.primitive_mode = uvre::PrimitiveMode::TRIANGLES;
+        pipeline_info.fill_mode = uvre::FillMode::FILLED;
+        pipeline_info.vertex_stride = sizeof(vertex);
+        pipeline_info.num_vertex_attribs = 1;
+        pipeline_info.vertex_attribs = &attribute;
+        pipeline_info.num_shaders = 2;
+        pipeline_info.shaders = shaders;
+        bench.pipelines[0] = device->createPipeline(pipeline_info);
+
+        // Different enough not to be deduplicated
+        pipeline_info.blending.enabled = true;
+        pipeline_info.blending.equation = uvre::BlendEquation::ADD;
+        pipeline_info.blending.sfactor = uvre::BlendFunc::SRC_ALPHA;
+        pipeline_info.blending.dfactor = uvre::BlendFunc::ONE_MINUS_SRC_ALPHA;
+        bench.pipelines[1] = device->createPipeline(pipeline_info);
+        pipeline_info.blending.enabled = false;
+
+        // Tiny triangle: fill rate is not the point
+        const vertex vertices[3] = {
+            vertex { { -0.1f, -0.1f } },
+            vertex { { 0.0f, 0.1f } },
+            vertex { { 0.1f, -0.1f } },
+        };
+
+        uvre::BufferCreateInfo vbo_info = {};
+        vbo_info.type = uvre::BufferType::VERTEX_BUFFER;
+        vbo_info.size = sizeof(vertices);
+        vbo_info.data = vertices;
+        bench.vbo = device->createBuffer(vbo_info);
+
+        uvre::BufferCreateInfo ubo_info = {};
+        ubo_info.type = uvre::BufferType::DATA_BUFFER;
+        ubo_info.size = 256;
+        bench.ubo = device->createBuffer(ubo_info);
+
+        uvre::TextureCreateInfo texture_info = {};
+        texture_info.type = uvre::TextureType::TEXTURE_2D;
+        texture_info.format = uvre::PixelFormat::R8G8B8A8_UNORM;
+        texture_info.width = TARGET_SIZE;
+        texture_info.height = TARGET_SIZE;
+        bench.texture = device->createTexture(texture_info);
+
+        uvre::ColorAttachment color_attachment = {};
+        color_attachment.id = 0;
+        color_attachment.color = device->createTexture(texture_info);
+
+        uvre::RenderTargetCreateInfo target_info = {};
+        target_info.num_color_attachments = 1;
+        target_info.color_attachments = &color_attachment;
+        bench.target = device->createRenderTarget(target_info);
+
+        uvre::SamplerCreateInfo sampler_info = {};
+        bench.sampler = device->createSampler(sampler_info);
+
+        if(!bench.pipelines[0] || !bench.pipelines[1] || !bench.vbo || !bench.ubo || !bench.texture || !bench.target || !bench.sampler) {
+            std::fprintf(stderr, "%s: unable to create benchmark resources\n", argv[0]);
+            return 1;
+        }
+
+        device->beginFrame();
+        benchRecording(bench);
+        benchSubmit(bench);
+        benchResources(bench);
+        benchUploads(bench);
+        device->endFrame();
+
+        printResults(bench, uvre::getSelectedBackend());
+    }
+
+    device->destroyCommandList(commands);
+    uvre::destroyDevice(device);
+
+    uvre::ImplInfo impl_info = {};
+    uvre::pollImplInfo(impl_info);
+    releaseDevice(&context, impl_info);
+
+    return 0;
+}
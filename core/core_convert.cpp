@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <uvre/convert.hpp>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UVRE_CORE_SSE2 1
+#endif
+
+// Channel count and whether they're floats,
+// zero channels for everything we can't read.
+static inline size_t getChannels(uvre::PixelFormat format, bool &is_float)
+{
+    is_float = false;
+    switch(format) {
+        case uvre::PixelFormat::R8_UNORM:
+            return 1;
+        case uvre::PixelFormat::R8G8_UNORM:
+            return 2;
+        case uvre::PixelFormat::R8G8B8_UNORM:
+            return 3;
+        case uvre::PixelFormat::R8G8B8A8_UNORM:
+            return 4;
+        case uvre::PixelFormat::R32_FLOAT:
+        case uvre::PixelFormat::D32_FLOAT:
+            is_float = true;
+            return 1;
+        case uvre::PixelFormat::R32G32_FLOAT:
+            is_float = true;
+            return 2;
+        case uvre::PixelFormat::R32G32B32_FLOAT:
+            is_float = true;
+            return 3;
+        case uvre::PixelFormat::R32G32B32A32_FLOAT:
+            is_float = true;
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+// NaN ends up as zero, same as with SSE
+static inline uint8_t toUnorm8(float value)
+{
+    const float clamped = (value > 0.0f) ? ((value < 1.0f) ? value : 1.0f) : 0.0f;
+    return static_cast<uint8_t>(clamped * 255.0f + 0.5f);
+}
+
+bool uvre::convertToRGBA8(const void *src, uvre::PixelFormat format, size_t count, uint8_t *dst)
+{
+    bool is_float;
+    const size_t channels = getChannels(format, is_float);
+    if(!channels)
+        return false;
+
+    size_t i = 0;
+    if(!is_float) {
+        const uint8_t *pixels = reinterpret_cast<const uint8_t *>(src);
+        if(channels == 4) {
+            std::memcpy(dst, pixels, count * 4);
+            return true;
+        }
+
+        for(; i < count; i++) {
+            for(size_t j = 0; j < 4; j++)
+                dst[i * 4 + j] = (j < channels) ? pixels[i * channels + j] : ((j == 3) ? 255 : 0);
+        }
+
+        return true;
+    }
+
+    const float *pixels = reinterpret_cast<const float *>(src);
+
+#if defined(UVRE_CORE_SSE2)
+    // Four pixels at a time: clamp, scale, round and
+    // then saturate down to bytes, sixteen at once.
+    if(channels == 4) {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 scale = _mm_set1_ps(255.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        for(; i + 4 <= count; i += 4) {
+            __m128i v[4];
+            for(int k = 0; k < 4; k++) {
+                const __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(pixels + (i + k) * 4), zero), one);
+                v[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, scale), half));
+            }
+
+            const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), packed);
+        }
+    }
+#endif
+
+    for(; i < count; i++) {
+        for(size_t j = 0; j < 4; j++)
+            dst[i * 4 + j] = (j < channels) ? toUnorm8(pixels[i * channels + j]) : ((j == 3) ? 255 : 0);
+    }
+
+    return true;
+}
+
+bool uvre::convertToRGBA32F(const void *src, uvre::PixelFormat format, size_t count, float *dst)
+{
+    bool is_float;
+    const size_t channels = getChannels(format, is_float);
+    if(!channels)
+        return false;
+
+    size_t i = 0;
+    if(is_float) {
+        const float *pixels = reinterpret_cast<const float *>(src);
+        if(channels == 4) {
+            std::memcpy(dst, pixels, count * 4 * sizeof(float));
+            return true;
+        }
+
+        for(; i < count; i++) {
+            for(size_t j = 0; j < 4; j++)
+                dst[i * 4 + j] = (j < channels) ? pixels[i * channels + j] : ((j == 3) ? 1.0f : 0.0f);
+        }
+
+        return true;
+    }
+
+    const uint8_t *pixels = reinterpret_cast<const uint8_t *>(src);
+
+#if defined(UVRE_CORE_SSE2)
+    // Sixteen bytes widened to words, then to
+    // dwords and floats: four pixels a round.
+    if(channels == 4) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+        for(; i + 4 <= count; i += 4) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i * 4));
+            const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+            const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_ps(dst + i * 4 + 0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+            _mm_storeu_ps(dst + i * 4 + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+            _mm_storeu_ps(dst + i * 4 + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+            _mm_storeu_ps(dst + i * 4 + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+        }
+    }
+#endif
+
+    for(; i < count; i++) {
+        for(size_t j = 0; j < 4; j++)
+            dst[i * 4 + j] = (j < channels) ? static_cast<float>(pixels[i * channels + j]) / 255.0f : ((j == 3) ? 1.0f : 0.0f);
+    }
+
+    return true;
+}
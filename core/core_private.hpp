@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include <uvre/uvre.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if !defined(UVRE_IMPL_GL_33) && !defined(UVRE_IMPL_GL_46) && !defined(UVRE_IMPL_SW) && !defined(UVRE_IMPL_NULL)
+#error No UVRE implementations are built
+#endif
+
+// Every implementation lives in its own
+// namespace and only exposes these two.
+#if defined(UVRE_IMPL_GL_33)
+namespace uvre::gl33
+{
+void pollImplInfo(ImplInfo &info);
+IRenderDevice *createDevice(const DeviceCreateInfo &info);
+} // namespace uvre::gl33
+#endif
+
+#if defined(UVRE_IMPL_GL_46)
+namespace uvre::gl46
+{
+void pollImplInfo(ImplInfo &info);
+IRenderDevice *createDevice(const DeviceCreateInfo &info);
+} // namespace uvre::gl46
+#endif
+
+#if defined(UVRE_IMPL_SW)
+namespace uvre::sw
+{
+void pollImplInfo(ImplInfo &info);
+IRenderDevice *createDevice(const DeviceCreateInfo &info);
+} // namespace uvre::sw
+#endif
+
+#if defined(UVRE_IMPL_NULL)
+namespace uvre::null
+{
+void pollImplInfo(ImplInfo &info);
+IRenderDevice *createDevice(const DeviceCreateInfo &info);
+} // namespace uvre::null
+#endif
+
+namespace uvre
+{
+struct Backend final {
+    ImplBackend id;
+    void (*pollImplInfo)(ImplInfo &info);
+    IRenderDevice *(*createDevice)(const DeviceCreateInfo &info);
+};
+} // namespace uvre
+
+namespace uvre
+{
+// Single producer (the client), single consumer
+// (the render thread): the slots are only ever
+// touched by the side that owns them at the time.
+class TaskQueue final {
+public:
+    TaskQueue(size_t capacity);
+
+    bool push(std::function<void()> &task);
+    bool pop(std::function<void()> &task);
+    bool empty() const;
+
+public:
+    std::vector<std::function<void()>> tasks;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+};
+
+class ThreadedDevice;
+
+// Handles can outlive the device, so their deleters
+// reach it through this: it's null once the device
+// is gone and the backend's objects are then let go
+// right on the thread that dropped them.
+struct ThreadedLink final {
+    std::mutex mutex;
+    ThreadedDevice *device;
+};
+
+class ThreadedDevice final : public IRenderDevice {
+public:
+    ThreadedDevice(const DeviceCreateInfo &info, IRenderDevice *(*createDevice)(const DeviceCreateInfo &info));
+    virtual ~ThreadedDevice();
+
+    const DeviceInfo &getInfo() const override;
+    MemoryStats getMemoryStats() override;
+    uint64_t getLastUsedFrame(const Texture &texture) override;
+
+    Shader createShader(const ShaderCreateInfo &info) override;
+    Pipeline createPipeline(const PipelineCreateInfo &info) override;
+    Buffer createBuffer(const BufferCreateInfo &info) override;
+    Sampler createSampler(const SamplerCreateInfo &info) override;
+    Texture createTexture(const TextureCreateInfo &info) override;
+    Texture createTextureView(const TextureViewCreateInfo &info) override;
+    RenderTarget createRenderTarget(const RenderTargetCreateInfo &info) override;
+    ResourceSet createResourceSet(const ResourceSetCreateInfo &info) override;
+
+    Shader createShaderAsync(const ShaderCreateInfo &info) override;
+    Pipeline createPipelineAsync(const PipelineCreateInfo &info) override;
+    bool isReady(const Shader &shader) override;
+    bool isReady(const Pipeline &pipeline) override;
+
+    Buffer createBufferAsync(const BufferCreateInfo &info) override;
+    void writeBufferAsync(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2DAsync(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCubeAsync(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArrayAsync(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    bool isReady(const Buffer &buffer) override;
+    bool isReady(const Texture &texture) override;
+
+    void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2D(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCube(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArray(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    void setTextureBaseLevel(const Texture &texture, int level) override;
+
+    ICommandList *createCommandList() override;
+    void destroyCommandList(ICommandList *commands) override;
+    void startRecording(ICommandList *commands) override;
+    void submit(ICommandList *commands) override;
+
+    Fence createFence() override;
+    bool waitFence(const Fence &fence, uint64_t timeout) override;
+
+    Query createQuery(QueryType type) override;
+    bool getQueryResult(const Query &query, uint64_t &result) override;
+
+    Readback readRenderTargetAsync(const RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, PixelFormat format) override;
+    Readback readTextureAsync(const Texture &texture, int level, int x, int y, int w, int h, PixelFormat format) override;
+    const void *getReadbackData(const Readback &readback) override;
+
+    void beginFrame() override;
+    void endFrame() override;
+    size_t getFrameIndex() const override;
+
+    void prepare() override;
+    void present() override;
+    void vsync(bool enable) override;
+    void mode(int width, int height) override;
+
+    void push(std::function<void()> task);
+    void call(const std::function<void()> &task);
+    void waitCompleted(uint64_t serial);
+
+public:
+    IRenderDevice *device;
+    TaskQueue queue;
+    uint64_t submitted;
+    std::atomic<uint64_t> completed;
+    size_t max_frames_in_flight;
+    uint64_t frame_number;
+
+    // Any thread can drop the last reference
+    std::shared_ptr<ThreadedLink> link;
+    std::mutex drop_mutex;
+    std::vector<std::shared_ptr<void>> dropped;
+
+    // Both sides only go to sleep after
+    // raising their flag, the other side
+    // only locks the mutex if it sees it.
+    std::mutex mutex;
+    std::condition_variable client_cv;
+    std::condition_variable render_cv;
+    std::atomic<bool> client_waiting;
+    std::atomic<bool> render_waiting;
+    std::thread thread;
+};
+} // namespace uvre
+
+// Streaming, residency and the threaded device
+// all size pixels the same way.
+static inline size_t getPixelSize(uvre::PixelFormat format)
+{
+    switch(format) {
+        case uvre::PixelFormat::R8_UNORM:
+        case uvre::PixelFormat::R8_SINT:
+        case uvre::PixelFormat::R8_UINT:
+        case uvre::PixelFormat::S8_UINT:
+            return 1;
+        case uvre::PixelFormat::R8G8_UNORM:
+        case uvre::PixelFormat::R8G8_SINT:
+        case uvre::PixelFormat::R8G8_UINT:
+        case uvre::PixelFormat::R16_UNORM:
+        case uvre::PixelFormat::R16_SINT:
+        case uvre::PixelFormat::R16_UINT:
+        case uvre::PixelFormat::R16_FLOAT:
+        case uvre::PixelFormat::D16_UNORM:
+            return 2;
+        case uvre::PixelFormat::R8G8B8_UNORM:
+        case uvre::PixelFormat::R8G8B8_SINT:
+        case uvre::PixelFormat::R8G8B8_UINT:
+            return 3;
+        case uvre::PixelFormat::R8G8B8A8_UNORM:
+        case uvre::PixelFormat::R8G8B8A8_SINT:
+        case uvre::PixelFormat::R8G8B8A8_UINT:
+        case uvre::PixelFormat::R16G16_UNORM:
+        case uvre::PixelFormat::R16G16_SINT:
+        case uvre::PixelFormat::R16G16_UINT:
+        case uvre::PixelFormat::R16G16_FLOAT:
+        case uvre::PixelFormat::R32_SINT:
+        case uvre::PixelFormat::R32_UINT:
+        case uvre::PixelFormat::R32_FLOAT:
+        case uvre::PixelFormat::D32_FLOAT:
+            return 4;
+        case uvre::PixelFormat::R16G16B16_UNORM:
+        case uvre::PixelFormat::R16G16B16_SINT:
+        case uvre::PixelFormat::R16G16B16_UINT:
+        case uvre::PixelFormat::R16G16B16_FLOAT:
+            return 6;
+        case uvre::PixelFormat::R16G16B16A16_UNORM:
+        case uvre::PixelFormat::R16G16B16A16_SINT:
+        case uvre::PixelFormat::R16G16B16A16_UINT:
+        case uvre::PixelFormat::R16G16B16A16_FLOAT:
+        case uvre::PixelFormat::R32G32_SINT:
+        case uvre::PixelFormat::R32G32_UINT:
+        case uvre::PixelFormat::R32G32_FLOAT:
+            return 8;
+        case uvre::PixelFormat::R32G32B32_SINT:
+        case uvre::PixelFormat::R32G32B32_UINT:
+        case uvre::PixelFormat::R32G32B32_FLOAT:
+            return 12;
+        case uvre::PixelFormat::R32G32B32A32_SINT:
+        case uvre::PixelFormat::R32G32B32A32_UINT:
+        case uvre::PixelFormat::R32G32B32A32_FLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
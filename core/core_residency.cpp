@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "core_private.hpp"
+#include <algorithm>
+
+// Cube maps have six faces and arrays
+// have the same layer count on every level.
+static size_t getTextureSize(const uvre::TextureCreateInfo &info)
+{
+    size_t layers = 1;
+    if(info.type == uvre::TextureType::TEXTURE_CUBE)
+        layers = 6;
+    else if(info.type == uvre::TextureType::TEXTURE_ARRAY)
+        layers = static_cast<size_t>(std::max(0, info.depth));
+
+    size_t pixels = 0;
+    int width = std::max(1, info.width);
+    int height = std::max(1, info.height);
+    for(size_t i = 0; i < std::max<size_t>(1, info.mip_levels); i++) {
+        pixels += static_cast<size_t>(width) * static_cast<size_t>(height);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    return pixels * layers * getPixelSize(info.format);
+}
+
+// The texture without its top levels,
+// the last level stays no matter what.
+static uvre::TextureCreateInfo getStreamInfo(const uvre::TextureCreateInfo &info, size_t &dropped_levels)
+{
+    const size_t levels = std::max<size_t>(1, info.mip_levels);
+    dropped_levels = std::min(dropped_levels, levels - 1);
+
+    uvre::TextureCreateInfo stream_info = info;
+    for(size_t i = 0; i < dropped_levels; i++) {
+        stream_info.width = std::max(1, stream_info.width / 2);
+        stream_info.height = std::max(1, stream_info.height / 2);
+    }
+
+    if(dropped_levels)
+        stream_info.mip_levels = levels - dropped_levels;
+    return stream_info;
+}
+
+uvre::ResidencyManager::ResidencyManager(const uvre::ResidencyCreateInfo &info)
+    : create_info(info), entries(), last_id(uvre::NULL_RESIDENT_TEXTURE), released(), released_bytes(0), frame(0)
+{
+}
+
+uvre::ResidentTexture uvre::ResidencyManager::registerTexture(const uvre::ResidentTextureInfo &info)
+{
+    // Nothing is created until it's needed
+    Entry entry = {};
+    entry.info = info;
+    entry.texture = nullptr;
+    entry.dropped_levels = 0;
+    entry.size = 0;
+    entry.last_used = 0;
+
+    // Wrapping around takes four billion
+    // registrations, never going to happen.
+    const uvre::ResidentTexture id = ++last_id;
+    entries.emplace(id, std::move(entry));
+    return id;
+}
+
+void uvre::ResidencyManager::unregisterTexture(uvre::ResidentTexture id)
+{
+    auto it = entries.find(id);
+    if(it == entries.end())
+        return;
+
+    release(&it->second);
+    entries.erase(it);
+}
+
+const uvre::Texture &uvre::ResidencyManager::getTexture(uvre::ResidentTexture id)
+{
+    static const uvre::Texture null_texture = nullptr;
+
+    auto it = entries.find(id);
+    if(it == entries.end())
+        return null_texture;
+
+    Entry *entry = &it->second;
+    if(!entry->texture)
+        stream(entry, entry->dropped_levels);
+    return entry->texture;
+}
+
+void uvre::ResidencyManager::update()
+{
+    frame++;
+    while(!released.empty() && released.front().first + create_info.release_frames <= frame) {
+        released_bytes -= released.front().second;
+        released.pop_front();
+    }
+
+    const uvre::MemoryStats stats = create_info.device->getMemoryStats();
+    const size_t total = stats.total_bytes - std::min(stats.total_bytes, released_bytes);
+    // Released bytes are a guess, growing
+    // back waits for the stats to settle.
+    if(total > create_info.budget)
+        evict(total - create_info.budget);
+    else if(released.empty())
+        restore(create_info.budget - total);
+}
+
+bool uvre::ResidencyManager::stream(Entry *entry, size_t dropped_levels)
+{
+    const uvre::TextureCreateInfo info = getStreamInfo(entry->info.texture, dropped_levels);
+    uvre::Texture texture = create_info.device->createTexture(info);
+    if(!texture)
+        return false;
+
+    if(entry->info.onStream)
+        entry->info.onStream(entry->info.user_data, create_info.device, texture, dropped_levels);
+
+    release(entry);
+    entry->texture = std::move(texture);
+    entry->dropped_levels = dropped_levels;
+    entry->size = getTextureSize(info);
+    return true;
+}
+
+void uvre::ResidencyManager::release(Entry *entry)
+{
+    if(!entry->texture)
+        return;
+
+    released.emplace_back(frame, entry->size);
+    released_bytes += entry->size;
+    entry->texture = nullptr;
+}
+
+void uvre::ResidencyManager::evict(size_t excess)
+{
+    uint64_t newest = 0;
+    std::vector<Entry *> candidates;
+    for(auto &it : entries) {
+        Entry *entry = &it.second;
+        if(!entry->texture)
+            continue;
+        entry->last_used = create_info.device->getLastUsedFrame(entry->texture);
+        newest = std::max(newest, entry->last_used);
+        candidates.push_back(entry);
+    }
+
+    // Whatever the last frame used stays,
+    // evicting it would only thrash things.
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [newest](const Entry *entry) { return newest && entry->last_used == newest; }), candidates.end());
+    std::sort(candidates.begin(), candidates.end(), [](const Entry *a, const Entry *b) {
+        if(a->info.priority != b->info.priority)
+            return a->info.priority < b->info.priority;
+        return a->last_used < b->last_used;
+    });
+
+    // The top level is three quarters of a texture
+    // and what's left is still usable; if dropping it
+    // everywhere won't do, the oldest ones go whole.
+    std::vector<size_t> savings;
+    size_t reducible = 0;
+    for(const Entry *entry : candidates) {
+        size_t dropped_levels = entry->dropped_levels + 1;
+        const uvre::TextureCreateInfo info = getStreamInfo(entry->info.texture, dropped_levels);
+        savings.push_back((dropped_levels > entry->dropped_levels) ? entry->size - std::min(entry->size, getTextureSize(info)) : 0);
+        reducible += savings.back();
+    }
+
+    for(size_t i = 0; i < candidates.size() && excess; i++) {
+        Entry *entry = candidates[i];
+        if(excess > reducible) {
+            excess -= std::min(excess, entry->size);
+            release(entry);
+        }
+        else if(savings[i] && stream(entry, entry->dropped_levels + 1)) {
+            excess -= std::min(excess, savings[i]);
+        }
+
+        reducible -= savings[i];
+    }
+}
+
+void uvre::ResidencyManager::restore(size_t room)
+{
+    uint64_t newest = 0;
+    std::vector<Entry *> candidates;
+    for(auto &it : entries) {
+        Entry *entry = &it.second;
+        if(!entry->texture)
+            continue;
+        entry->last_used = create_info.device->getLastUsedFrame(entry->texture);
+        newest = std::max(newest, entry->last_used);
+        if(entry->dropped_levels)
+            candidates.push_back(entry);
+    }
+
+    // Only what's in use gets its levels back,
+    // one at a time so that nothing stalls.
+    std::sort(candidates.begin(), candidates.end(), [](const Entry *a, const Entry *b) {
+        return a->info.priority > b->info.priority;
+    });
+
+    for(Entry *entry : candidates) {
+        if(entry->last_used != newest)
+            continue;
+
+        size_t dropped_levels = entry->dropped_levels - 1;
+        const size_t size = getTextureSize(getStreamInfo(entry->info.texture, dropped_levels));
+        if(size - entry->size > room)
+            continue;
+
+        const size_t old_size = entry->size;
+        if(stream(entry, dropped_levels))
+            room -= entry->size - old_size;
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "core_private.hpp"
+
+// Fastest first: it's the default and
+// the order probeDevice tries them in.
+static const uvre::Backend backends[] = {
+#if defined(UVRE_IMPL_GL_46)
+    { uvre::ImplBackend::GL_46, uvre::gl46::pollImplInfo, uvre::gl46::createDevice },
+#endif
+#if defined(UVRE_IMPL_GL_33)
+    { uvre::ImplBackend::GL_33, uvre::gl33::pollImplInfo, uvre::gl33::createDevice },
+#endif
+#if defined(UVRE_IMPL_SW)
+    { uvre::ImplBackend::SOFTWARE, uvre::sw::pollImplInfo, uvre::sw::createDevice },
+#endif
+#if defined(UVRE_IMPL_NULL)
+    { uvre::ImplBackend::NONE, uvre::null::pollImplInfo, uvre::null::createDevice },
+#endif
+};
+
+static const uvre::Backend *selected = backends;
+
+static const uvre::Backend *findBackend(uvre::ImplBackend id)
+{
+    for(const uvre::Backend &backend : backends) {
+        if(backend.id == id)
+            return &backend;
+    }
+
+    return nullptr;
+}
+
+// Threaded devices wrap the backend's one,
+// which is created on the render thread.
+static uvre::IRenderDevice *createBackendDevice(const uvre::Backend &backend, const uvre::DeviceCreateInfo &info)
+{
+    if(!info.threaded.enabled)
+        return backend.createDevice(info);
+
+    uvre::ThreadedDevice *device = new uvre::ThreadedDevice(info, backend.createDevice);
+    if(device->device)
+        return device;
+
+    delete device;
+    return nullptr;
+}
+
+UVRE_API size_t uvre::enumerateBackends(uvre::ImplBackend *ids, size_t max_ids)
+{
+    const size_t count = sizeof(backends) / sizeof(backends[0]);
+    if(ids) {
+        for(size_t i = 0; i < count && i < max_ids; i++)
+            ids[i] = backends[i].id;
+    }
+
+    return count;
+}
+
+UVRE_API bool uvre::selectBackend(uvre::ImplBackend id)
+{
+    const uvre::Backend *backend = findBackend(id);
+    if(!backend)
+        return false;
+    selected = backend;
+    return true;
+}
+
+UVRE_API uvre::ImplBackend uvre::getSelectedBackend()
+{
+    return selected->id;
+}
+
+UVRE_API uvre::IRenderDevice *uvre::probeDevice(const uvre::ProbeInfo &info)
+{
+    const uvre::Backend *previous = selected;
+    for(const uvre::Backend &backend : backends) {
+        // The NULL implementation would always
+        // win and it doesn't render anything.
+        if(backend.id == uvre::ImplBackend::NONE)
+            continue;
+
+        // Selected up front: helpers like the
+        // EGL one poll the selected backend.
+        selected = &backend;
+
+        uvre::ImplInfo impl_info = {};
+        backend.pollImplInfo(impl_info);
+        impl_info.backend = backend.id;
+
+        uvre::DeviceCreateInfo create_info = {};
+        if(!info.prepare(info.user_data, impl_info, create_info))
+            continue;
+
+        uvre::IRenderDevice *device = createBackendDevice(backend, create_info);
+        if(device)
+            return device;
+
+        if(info.release)
+            info.release(info.user_data, impl_info);
+    }
+
+    selected = previous;
+    return nullptr;
+}
+
+UVRE_API void uvre::pollImplInfo(uvre::ImplInfo &info)
+{
+    selected->pollImplInfo(info);
+    info.backend = selected->id;
+}
+
+UVRE_API uvre::IRenderDevice *uvre::createDevice(const uvre::DeviceCreateInfo &info)
+{
+    return createBackendDevice(*selected, info);
+}
+
+UVRE_API void uvre::destroyDevice(uvre::IRenderDevice *device)
+{
+    delete device;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "core_private.hpp"
+#include <algorithm>
+
+uvre::TextureStreamer::TextureStreamer(const uvre::TextureStreamerCreateInfo &info)
+    : create_info(info), uploads()
+{
+}
+
+void uvre::TextureStreamer::stream(const uvre::StreamedTextureInfo &info)
+{
+    cancel(info.texture);
+    if(!info.texture || !info.num_levels || !info.levels)
+        return;
+
+    Upload upload = {};
+    upload.info = info;
+    upload.remaining_levels = info.num_levels;
+    writeLevel(upload);
+
+    if(upload.remaining_levels)
+        uploads.push_back(upload);
+    else if(info.onComplete)
+        info.onComplete(info.user_data, info.texture);
+}
+
+void uvre::TextureStreamer::cancel(const uvre::Texture &texture)
+{
+    uploads.erase(std::remove_if(uploads.begin(), uploads.end(), [&texture](const Upload &upload) { return upload.info.texture == texture; }), uploads.end());
+}
+
+size_t uvre::TextureStreamer::getPendingCount() const
+{
+    return uploads.size();
+}
+
+void uvre::TextureStreamer::update()
+{
+    size_t budget = create_info.frame_budget;
+    bool written = false;
+    while(!uploads.empty()) {
+        // The smallest level pending anywhere, ties
+        // go to whatever was queued up first.
+        std::vector<Upload>::iterator it = std::min_element(uploads.begin(), uploads.end(), [this](const Upload &a, const Upload &b) {
+            return getLevelSize(a) < getLevelSize(b);
+        });
+
+        // One level always goes in, even if it
+        // doesn't fit into the budget on its own.
+        const size_t size = getLevelSize(*it);
+        if(written && size > budget)
+            break;
+
+        writeLevel(*it);
+        budget -= std::min(budget, size);
+        written = true;
+
+        if(!it->remaining_levels) {
+            const uvre::StreamedTextureInfo info = it->info;
+            uploads.erase(it);
+            if(info.onComplete)
+                info.onComplete(info.user_data, info.texture);
+        }
+    }
+}
+
+size_t uvre::TextureStreamer::getLevelSize(const Upload &upload) const
+{
+    const int level = static_cast<int>(upload.remaining_levels - 1);
+    const size_t width = static_cast<size_t>(std::max(1, upload.info.width >> level));
+    const size_t height = static_cast<size_t>(std::max(1, upload.info.height >> level));
+    return width * height * getPixelSize(upload.info.format);
+}
+
+void uvre::TextureStreamer::writeLevel(Upload &upload)
+{
+    // Raising the base level only after the write
+    // keeps the unwritten levels out of sampling.
+    const int level = static_cast<int>(--upload.remaining_levels);
+    const int width = std::max(1, upload.info.width >> level);
+    const int height = std::max(1, upload.info.height >> level);
+    create_info.device->writeTexture2D(upload.info.texture, 0, 0, width, height, upload.info.format, upload.info.levels[level], level);
+    create_info.device->setTextureBaseLevel(upload.info.texture, level);
+}
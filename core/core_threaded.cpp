@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "core_private.hpp"
+#include <algorithm>
+#include <cstdint>
+
+uvre::TaskQueue::TaskQueue(size_t capacity)
+    : tasks(std::max<size_t>(2, capacity)), head(0), tail(0)
+{
+}
+
+bool uvre::TaskQueue::push(std::function<void()> &task)
+{
+    const size_t index = tail.load(std::memory_order_relaxed);
+    if(index - head.load() >= tasks.size())
+        return false;
+    tasks[index % tasks.size()] = std::move(task);
+    tail.store(index + 1);
+    return true;
+}
+
+bool uvre::TaskQueue::pop(std::function<void()> &task)
+{
+    const size_t index = head.load(std::memory_order_relaxed);
+    if(index == tail.load())
+        return false;
+    task = std::move(tasks[index % tasks.size()]);
+    head.store(index + 1);
+    return true;
+}
+
+bool uvre::TaskQueue::empty() const
+{
+    return head.load() == tail.load();
+}
+
+static void renderMain(uvre::ThreadedDevice *threaded)
+{
+    std::function<void()> task;
+    for(;;) {
+        if(!threaded->queue.pop(task)) {
+            std::unique_lock<std::mutex> lock(threaded->mutex);
+            threaded->render_waiting = true;
+            threaded->render_cv.wait(lock, [threaded]() { return !threaded->queue.empty(); });
+            threaded->render_waiting = false;
+            continue;
+        }
+
+        // An empty task is the way out
+        if(!task)
+            break;
+
+        // Reset here as well: whatever the task
+        // captured must be released on this thread.
+        task();
+        task = nullptr;
+
+        threaded->completed.fetch_add(1);
+        if(threaded->client_waiting) {
+            std::lock_guard<std::mutex> lock(threaded->mutex);
+            threaded->client_cv.notify_all();
+        }
+    }
+}
+
+// Objects are destroyed through the backend which
+// has to happen on the render thread. The wrapper
+// shares the pointer (so impl() still works) and
+// the real reference is parked until the next
+// submit or frame, from whatever thread drops it.
+template<typename T>
+static std::shared_ptr<T> wrap(uvre::ThreadedDevice *threaded, std::shared_ptr<T> object)
+{
+    if(!object)
+        return nullptr;
+
+    T *pointer = object.get();
+    std::shared_ptr<uvre::ThreadedLink> link = threaded->link;
+    return std::shared_ptr<T>(pointer, [link, object](T *) mutable {
+        std::unique_lock<std::mutex> lock(link->mutex);
+        if(!link->device || std::this_thread::get_id() == link->device->thread.get_id()) {
+            lock.unlock();
+            object = nullptr;
+            return;
+        }
+
+        std::lock_guard<std::mutex> drop_lock(link->device->drop_mutex);
+        link->device->dropped.push_back(std::move(object));
+    });
+}
+
+static void releaseDropped(uvre::ThreadedDevice *threaded)
+{
+    std::vector<std::shared_ptr<void>> objects;
+    {
+        std::lock_guard<std::mutex> lock(threaded->drop_mutex);
+        objects.swap(threaded->dropped);
+    }
+}
+
+// The caller's pixels are copied so the write can
+// be queued; OpenGL reads rows 4-byte aligned.
+static std::vector<uint8_t> copyPixels(const uvre::ThreadedDevice *threaded, int w, int h, int d, uvre::PixelFormat format, const void *data)
+{
+    const size_t row = static_cast<size_t>(w) * getPixelSize(format);
+    const size_t rows = static_cast<size_t>(h) * static_cast<size_t>(d);
+    const size_t stride = (threaded->device->getInfo().impl_family == uvre::ImplFamily::OPENGL) ? ((row + 3) & ~static_cast<size_t>(3)) : row;
+    if(!data || !rows)
+        return std::vector<uint8_t>();
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    return std::vector<uint8_t>(bytes, bytes + stride * (rows - 1) + row);
+}
+
+uvre::ThreadedDevice::ThreadedDevice(const uvre::DeviceCreateInfo &info, uvre::IRenderDevice *(*createDevice)(const uvre::DeviceCreateInfo &info))
+    : device(nullptr), queue(info.threaded.queue_depth), submitted(0), completed(0), max_frames_in_flight(std::max<size_t>(1, info.max_frames_in_flight)), frame_number(0), link(std::make_shared<uvre::ThreadedLink>()), drop_mutex(), dropped(), mutex(), client_cv(), render_cv(), client_waiting(false), render_waiting(false), thread()
+{
+    link->device = this;
+    thread = std::thread(renderMain, this);
+
+    // The backend makes its context current
+    // on the thread that creates the device.
+    call([this, &info, createDevice]() { device = createDevice(info); });
+}
+
+uvre::ThreadedDevice::~ThreadedDevice()
+{
+    // Handles dropped after this go straight
+    // to the backend, which may be gone too.
+    call([this]() {
+        {
+            std::lock_guard<std::mutex> lock(link->mutex);
+            link->device = nullptr;
+        }
+
+        releaseDropped(this);
+        delete device;
+    });
+    push(std::function<void()>());
+    thread.join();
+}
+
+const uvre::DeviceInfo &uvre::ThreadedDevice::getInfo() const
+{
+    // Never changes after creation
+    return device->getInfo();
+}
+
+uvre::MemoryStats uvre::ThreadedDevice::getMemoryStats()
+{
+    // Implementations lock the stats on their
+    // own, no need to wait for the render thread.
+    return device->getMemoryStats();
+}
+
+uint64_t uvre::ThreadedDevice::getLastUsedFrame(const uvre::Texture &texture)
+{
+    uint64_t result = 0;
+    call([this, &texture, &result]() { result = device->getLastUsedFrame(texture); });
+    return result;
+}
+
+uvre::Shader uvre::ThreadedDevice::createShader(const uvre::ShaderCreateInfo &info)
+{
+    uvre::Shader shader;
+    call([this, &info, &shader]() { shader = device->createShader(info); });
+    return wrap(this, shader);
+}
+
+uvre::Pipeline uvre::ThreadedDevice::createPipeline(const uvre::PipelineCreateInfo &info)
+{
+    uvre::Pipeline pipeline;
+    call([this, &info, &pipeline]() { pipeline = device->createPipeline(info); });
+    return wrap(this, pipeline);
+}
+
+uvre::Buffer uvre::ThreadedDevice::createBuffer(const uvre::BufferCreateInfo &info)
+{
+    uvre::Buffer buffer;
+    call([this, &info, &buffer]() { buffer = device->createBuffer(info); });
+    return wrap(this, buffer);
+}
+
+uvre::Sampler uvre::ThreadedDevice::createSampler(const uvre::SamplerCreateInfo &info)
+{
+    uvre::Sampler sampler;
+    call([this, &info, &sampler]() { sampler = device->createSampler(info); });
+    return wrap(this, sampler);
+}
+
+uvre::Texture uvre::ThreadedDevice::createTexture(const uvre::TextureCreateInfo &info)
+{
+    uvre::Texture texture;
+    call([this, &info, &texture]() { texture = device->createTexture(info); });
+    return wrap(this, texture);
+}
+
+uvre::Texture uvre::ThreadedDevice::createTextureView(const uvre::TextureViewCreateInfo &info)
+{
+    uvre::Texture texture;
+    call([this, &info, &texture]() { texture = device->createTextureView(info); });
+    return wrap(this, texture);
+}
+
+uvre::RenderTarget uvre::ThreadedDevice::createRenderTarget(const uvre::RenderTargetCreateInfo &info)
+{
+    uvre::RenderTarget target;
+    call([this, &info, &target]() { target = device->createRenderTarget(info); });
+    return wrap(this, target);
+}
+
+uvre::ResourceSet uvre::ThreadedDevice::createResourceSet(const uvre::ResourceSetCreateInfo &info)
+{
+    uvre::ResourceSet set;
+    call([this, &info, &set]() { set = device->createResourceSet(info); });
+    return wrap(this, set);
+}
+
+uvre::Shader uvre::ThreadedDevice::createShaderAsync(const uvre::ShaderCreateInfo &info)
+{
+    uvre::Shader shader;
+    call([this, &info, &shader]() { shader = device->createShaderAsync(info); });
+    return wrap(this, shader);
+}
+
+uvre::Pipeline uvre::ThreadedDevice::createPipelineAsync(const uvre::PipelineCreateInfo &info)
+{
+    uvre::Pipeline pipeline;
+    call([this, &info, &pipeline]() { pipeline = device->createPipelineAsync(info); });
+    return wrap(this, pipeline);
+}
+
+bool uvre::ThreadedDevice::isReady(const uvre::Shader &shader)
+{
+    bool result = false;
+    call([this, &shader, &result]() { result = device->isReady(shader); });
+    return result;
+}
+
+bool uvre::ThreadedDevice::isReady(const uvre::Pipeline &pipeline)
+{
+    bool result = false;
+    call([this, &pipeline, &result]() { result = device->isReady(pipeline); });
+    return result;
+}
+
+void uvre::ThreadedDevice::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    // Size-only writes pass no data along
+    std::vector<uint8_t> copy;
+    if(data)
+        copy.assign(reinterpret_cast<const uint8_t *>(data), reinterpret_cast<const uint8_t *>(data) + size);
+    push([this, buffer, offset, size, copy = std::move(copy)]() {
+        device->writeBuffer(buffer, offset, size, copy.empty() ? nullptr : copy.data());
+    });
+}
+
+void uvre::ThreadedDevice::writeTexture2D(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    push([this, texture, level, x, y, w, h, format, copy = copyPixels(this, w, h, 1, format, data)]() {
+        device->writeTexture2D(texture, x, y, w, h, format, copy.data(), level);
+    });
+}
+
+void uvre::ThreadedDevice::writeTextureCube(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    push([this, texture, level, face, x, y, w, h, format, copy = copyPixels(this, w, h, 1, format, data)]() {
+        device->writeTextureCube(texture, face, x, y, w, h, format, copy.data(), level);
+    });
+}
+
+void uvre::ThreadedDevice::writeTextureArray(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
+{
+    push([this, texture, level, x, y, z, w, h, d, format, copy = copyPixels(this, w, h, d, format, data)]() {
+        device->writeTextureArray(texture, x, y, z, w, h, d, format, copy.data(), level);
+    });
+}
+
+void uvre::ThreadedDevice::setTextureBaseLevel(const uvre::Texture &texture, int level)
+{
+    push([this, texture, level]() { device->setTextureBaseLevel(texture, level); });
+}
+
+uvre::Buffer uvre::ThreadedDevice::createBufferAsync(const uvre::BufferCreateInfo &info)
+{
+    uvre::Buffer buffer;
+    call([this, &info, &buffer]() { buffer = device->createBufferAsync(info); });
+    return wrap(this, buffer);
+}
+
+void uvre::ThreadedDevice::writeBufferAsync(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    push([this, buffer, offset, copy = std::vector<uint8_t>(bytes, bytes + size)]() {
+        device->writeBufferAsync(buffer, offset, copy.size(), copy.data());
+    });
+}
+
+void uvre::ThreadedDevice::writeTexture2DAsync(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    push([this, texture, level, x, y, w, h, format, copy = copyPixels(this, w, h, 1, format, data)]() {
+        device->writeTexture2DAsync(texture, x, y, w, h, format, copy.data(), level);
+    });
+}
+
+void uvre::ThreadedDevice::writeTextureCubeAsync(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    push([this, texture, level, face, x, y, w, h, format, copy = copyPixels(this, w, h, 1, format, data)]() {
+        device->writeTextureCubeAsync(texture, face, x, y, w, h, format, copy.data(), level);
+    });
+}
+
+void uvre::ThreadedDevice::writeTextureArrayAsync(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
+{
+    push([this, texture, level, x, y, z, w, h, d, format, copy = copyPixels(this, w, h, d, format, data)]() {
+        device->writeTextureArrayAsync(texture, x, y, z, w, h, d, format, copy.data(), level);
+    });
+}
+
+bool uvre::ThreadedDevice::isReady(const uvre::Buffer &buffer)
+{
+    bool result = false;
+    call([this, &buffer, &result]() { result = device->isReady(buffer); });
+    return result;
+}
+
+bool uvre::ThreadedDevice::isReady(const uvre::Texture &texture)
+{
+    bool result = false;
+    call([this, &texture, &result]() { result = device->isReady(texture); });
+    return result;
+}
+
+uvre::ICommandList *uvre::ThreadedDevice::createCommandList()
+{
+    uvre::ICommandList *commands = nullptr;
+    call([this, &commands]() { commands = device->createCommandList(); });
+    return commands;
+}
+
+void uvre::ThreadedDevice::destroyCommandList(uvre::ICommandList *commands)
+{
+    push([this, commands]() { device->destroyCommandList(commands); });
+}
+
+void uvre::ThreadedDevice::startRecording(uvre::ICommandList *commands)
+{
+    // Lists are recorded right here, so the
+    // render thread must be done with this one,
+    // which it is once it has reset it for us.
+    call([this, commands]() { device->startRecording(commands); });
+}
+
+void uvre::ThreadedDevice::submit(uvre::ICommandList *commands)
+{
+    push([this, commands]() {
+        releaseDropped(this);
+        device->submit(commands);
+    });
+}
+
+uvre::Fence uvre::ThreadedDevice::createFence()
+{
+    uvre::Fence fence;
+    call([this, &fence]() { fence = device->createFence(); });
+    return wrap(this, fence);
+}
+
+bool uvre::ThreadedDevice::waitFence(const uvre::Fence &fence, uint64_t timeout)
+{
+    bool result = false;
+    call([this, &fence, timeout, &result]() { result = device->waitFence(fence, timeout); });
+    return result;
+}
+
+uvre::Query uvre::ThreadedDevice::createQuery(uvre::QueryType type)
+{
+    uvre::Query query;
+    call([this, type, &query]() { query = device->createQuery(type); });
+    return wrap(this, query);
+}
+
+bool uvre::ThreadedDevice::getQueryResult(const uvre::Query &query, uint64_t &result)
+{
+    bool available = false;
+    call([this, &query, &result, &available]() { available = device->getQueryResult(query, result); });
+    return available;
+}
+
+uvre::Readback uvre::ThreadedDevice::readRenderTargetAsync(const uvre::RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    uvre::Readback readback;
+    call([this, &target, attachment, x, y, w, h, format, &readback]() { readback = device->readRenderTargetAsync(target, attachment, x, y, w, h, format); });
+    return wrap(this, readback);
+}
+
+uvre::Readback uvre::ThreadedDevice::readTextureAsync(const uvre::Texture &texture, int level, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    uvre::Readback readback;
+    call([this, &texture, level, x, y, w, h, format, &readback]() { readback = device->readTextureAsync(texture, level, x, y, w, h, format); });
+    return wrap(this, readback);
+}
+
+const void *uvre::ThreadedDevice::getReadbackData(const uvre::Readback &readback)
+{
+    const void *data = nullptr;
+    call([this, &readback, &data]() { data = device->getReadbackData(readback); });
+    return data;
+}
+
+void uvre::ThreadedDevice::beginFrame()
+{
+    push([this]() { device->beginFrame(); });
+}
+
+void uvre::ThreadedDevice::endFrame()
+{
+    push([this]() {
+        releaseDropped(this);
+        device->endFrame();
+    });
+    frame_number++;
+}
+
+size_t uvre::ThreadedDevice::getFrameIndex() const
+{
+    // The backend's counter is a few frames
+    // behind, this one is what the client sees.
+    return static_cast<size_t>(frame_number % max_frames_in_flight);
+}
+
+void uvre::ThreadedDevice::prepare()
+{
+    push([this]() { device->prepare(); });
+}
+
+void uvre::ThreadedDevice::present()
+{
+    push([this]() { device->present(); });
+}
+
+void uvre::ThreadedDevice::vsync(bool enable)
+{
+    push([this, enable]() { device->vsync(enable); });
+}
+
+void uvre::ThreadedDevice::mode(int width, int height)
+{
+    push([this, width, height]() { device->mode(width, height); });
+}
+
+void uvre::ThreadedDevice::push(std::function<void()> task)
+{
+    // Back-pressure: the client waits for the
+    // render thread to catch up with the queue.
+    if(!queue.push(task)) {
+        std::unique_lock<std::mutex> lock(mutex);
+        client_waiting = true;
+        client_cv.wait(lock, [this, &task]() { return queue.push(task); });
+        client_waiting = false;
+    }
+
+    submitted++;
+    if(render_waiting) {
+        std::lock_guard<std::mutex> lock(mutex);
+        render_cv.notify_one();
+    }
+}
+
+void uvre::ThreadedDevice::call(const std::function<void()> &task)
+{
+    push([&task]() { task(); });
+    waitCompleted(submitted);
+}
+
+void uvre::ThreadedDevice::waitCompleted(uint64_t serial)
+{
+    if(completed >= serial)
+        return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    client_waiting = true;
+    client_cv.wait(lock, [this, serial]() { return completed >= serial; });
+    client_waiting = false;
+}
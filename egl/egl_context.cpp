@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <uvre/egl.hpp>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+
+struct uvre::HeadlessContext final {
+    EGLDisplay display;
+    EGLContext context;
+    EGLContext worker_context;
+    EGLSurface surface;
+    EGLSurface worker_surface;
+};
+
+static bool hasExtension(const char *extensions, const char *name)
+{
+    const size_t length = std::strlen(name);
+    for(const char *str = extensions; str && (str = std::strstr(str, name)); str += length) {
+        // Make sure we don't match a prefix of another name
+        if((str == extensions || str[-1] == ' ') && (str[length] == ' ' || str[length] == 0))
+            return true;
+    }
+
+    return false;
+}
+
+static EGLDisplay getDisplay()
+{
+    // Mesa's surfaceless platform needs neither
+    // a display server nor a GPU (llvmpipe).
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if(hasExtension(client_extensions, "EGL_EXT_platform_base") && hasExtension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if(getPlatformDisplay) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if(display != EGL_NO_DISPLAY)
+                return display;
+        }
+    }
+
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+static void *getProcAddr(void *, const char *procname)
+{
+    return reinterpret_cast<void *>(eglGetProcAddress(procname));
+}
+
+static void makeContextCurrent(void *user_data)
+{
+    uvre::HeadlessContext *context = reinterpret_cast<uvre::HeadlessContext *>(user_data);
+    eglMakeCurrent(context->display, context->surface, context->surface, context->context);
+}
+
+static void makeWorkerContextCurrent(void *user_data)
+{
+    uvre::HeadlessContext *context = reinterpret_cast<uvre::HeadlessContext *>(user_data);
+    eglMakeCurrent(context->display, context->worker_surface, context->worker_surface, context->worker_context);
+}
+
+static void setSwapInterval(void *, int)
+{
+    // Nothing to sync with
+}
+
+static void swapBuffers(void *)
+{
+    // Nothing to present
+}
+
+UVRE_API uvre::HeadlessContext *uvre::createHeadlessContext(uvre::DeviceCreateInfo &info)
+{
+    uvre::ImplInfo impl_info;
+    uvre::pollImplInfo(impl_info);
+    if(impl_info.family != uvre::ImplFamily::OPENGL)
+        return nullptr;
+
+    EGLDisplay display = getDisplay();
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_API))
+        return nullptr;
+
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    const bool surfaceless = hasExtension(extensions, "EGL_KHR_surfaceless_context");
+
+    EGLint num_configs = 0;
+    EGLConfig config = nullptr;
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    if(!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || !num_configs) {
+        // The surfaceless platform may expose no configs at all
+        if(!surfaceless || !hasExtension(extensions, "EGL_KHR_no_config_context"))
+            return nullptr;
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, impl_info.gl.version_major,
+        EGL_CONTEXT_MINOR_VERSION, impl_info.gl.version_minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, impl_info.gl.core_profile ? EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT : EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    uvre::HeadlessContext *context = new uvre::HeadlessContext;
+    context->display = display;
+    context->context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    context->worker_context = EGL_NO_CONTEXT;
+    context->surface = EGL_NO_SURFACE;
+    context->worker_surface = EGL_NO_SURFACE;
+
+    if(context->context == EGL_NO_CONTEXT) {
+        destroyHeadlessContext(context);
+        return nullptr;
+    }
+
+    if(!surfaceless) {
+        // Pbuffers are never shown anywhere
+        // so there's no point in making them big.
+        const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        context->surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+        context->worker_surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+        if(context->surface == EGL_NO_SURFACE) {
+            destroyHeadlessContext(context);
+            return nullptr;
+        }
+    }
+
+    // The worker context is optional, the
+    // device simply does everything itself
+    // if it could not be created.
+    context->worker_context = eglCreateContext(display, config, context->context, context_attribs);
+
+    info.gl.user_data = context;
+    info.gl.getProcAddr = &getProcAddr;
+    info.gl.makeContextCurrent = &makeContextCurrent;
+    info.gl.setSwapInterval = &setSwapInterval;
+    info.gl.swapBuffers = &swapBuffers;
+    info.gl.worker_user_data = nullptr;
+    info.gl.makeWorkerContextCurrent = nullptr;
+
+    if(context->worker_context != EGL_NO_CONTEXT && (surfaceless || context->worker_surface != EGL_NO_SURFACE)) {
+        info.gl.worker_user_data = context;
+        info.gl.makeWorkerContextCurrent = &makeWorkerContextCurrent;
+    }
+
+    return context;
+}
+
+UVRE_API void uvre::destroyHeadlessContext(uvre::HeadlessContext *context)
+{
+    if(!context)
+        return;
+
+    eglMakeCurrent(context->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context->worker_context != EGL_NO_CONTEXT)
+        eglDestroyContext(context->display, context->worker_context);
+    if(context->context != EGL_NO_CONTEXT)
+        eglDestroyContext(context->display, context->context);
+    if(context->worker_surface != EGL_NO_SURFACE)
+        eglDestroySurface(context->display, context->worker_surface);
+    if(context->surface != EGL_NO_SURFACE)
+        eglDestroySurface(context->display, context->surface);
+
+    // The display is not terminated since
+    // EGL displays are shared process-wide.
+    delete context;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <uvre/egl.hpp>
+#include <uvre/uvre.hpp>
+#include <chrono>
+#include <exception>
+#include <iostream>
+
+using vec2_t = float[2];
+struct vertex final {
+    vec2_t position;
+    vec2_t texcoord;
+};
+
+// Vertex shader source
+static const char *vert_source = R"(
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 texcoord;
+out VS_OUTPUT {
+    vec2 texcoord;
+} vert;
+void main()
+{
+    vert.texcoord = texcoord;
+    gl_Position = vec4(position, 0.0, 1.0);
+})";
+
+// Fragment shader source
+static const char *frag_source = R"(
+layout(location = 0) out vec4 target;
+in VS_OUTPUT {
+    vec2 texcoord;
+} vert;
+void main()
+{
+    target = vec4(vert.texcoord, 1.0, 1.0);
+})";
+
+// Debug callback
+static void onDebugMessage(const uvre::DebugMessageInfo &msg)
+{
+    std::cout << msg.text << std::endl;
+}
+
+// Only the GL backends take GLSL like this. There
+// is no window to ask for a context, so the helper
+// creates one through EGL for every backend tried
+// and fills the device callbacks on its own.
+static bool prepareDevice(void *user_data, const uvre::ImplInfo &impl_info, uvre::DeviceCreateInfo &info)
+{
+    if(impl_info.family != uvre::ImplFamily::OPENGL)
+        return false;
+
+    // Message callback
+    info.onDebugMessage = &onDebugMessage;
+
+    uvre::HeadlessContext **context = reinterpret_cast<uvre::HeadlessContext **>(user_data);
+    *context = uvre::createHeadlessContext(info);
+    return *context != nullptr;
+}
+
+static void releaseDevice(void *user_data, const uvre::ImplInfo &)
+{
+    uvre::HeadlessContext **context = reinterpret_cast<uvre::HeadlessContext **>(user_data);
+    uvre::destroyHeadlessContext(*context);
+    *context = nullptr;
+}
+
+int main()
+{
+    constexpr const int TARGET_WIDTH = 640;
+    constexpr const int TARGET_HEIGHT = 480;
+    constexpr const int NUM_FRAMES = 100;
+
+    // The newest GL goes first and whatever the
+    // driver can't do is skipped: on GPU-less
+    // machines this ends up on llvmpipe's GL 3.3.
+    uvre::HeadlessContext *context = nullptr;
+    uvre::ProbeInfo probe_info = {};
+    probe_info.user_data = &context;
+    probe_info.prepare = &prepareDevice;
+    probe_info.release = &releaseDevice;
+
+    uvre::IRenderDevice *device = uvre::probeDevice(probe_info);
+    if(!device)
+        std::terminate();
+
+    uvre::ICommandList *commands = device->createCommandList();
+
+    {
+        uvre::ShaderCreateInfo vert_info = {};
+        vert_info.stage = uvre::ShaderStage::VERTEX;
+        vert_info.format = uvre::ShaderFormat::SOURCE_GLSL;
+        vert_info.code = vert_source;
+
+        uvre::ShaderCreateInfo frag_info = {};
+        frag_info.stage = uvre::ShaderStage::FRAGMENT;
+        frag_info.format = uvre::ShaderFormat::SOURCE_GLSL;
+        frag_info.code = frag_source;
+
+        uvre::Shader shaders[2];
+        shaders[0] = device->createShader(vert_info);
+        shaders[1] = device->createShader(frag_info);
+
+        uvre::VertexAttrib attributes[2];
+        attributes[0] = uvre::VertexAttrib { 0, uvre::VertexAttribType::FLOAT32, 2, offsetof(vertex, position), false };
+        attributes[1] = uvre::VertexAttrib { 1, uvre::VertexAttribType::FLOAT32, 2, offsetof(vertex, texcoord), false };
+
+        uvre::PipelineCreateInfo pipeline_info = {};
+        pipeline_info.blending.enabled = false;
+        pipeline_info.depth_testing.enabled = false;
+        pipeline_info.face_culling.enabled = false;
+        pipeline_info.index_type = uvre::IndexType::INDEX16;
+        pipeline_info.primitive_mode = uvre::PrimitiveMode::TRIANGLES;
+        pipeline_info.fill_mode = uvre::FillMode::FILLED;
+        pipeline_info.vertex_stride = sizeof(vertex);
+        pipeline_info.num_vertex_attribs = 2;
+        pipeline_info.vertex_attribs = attributes;
+        pipeline_info.num_shaders = 2;
+        pipeline_info.shaders = shaders;
+
+        uvre::Pipeline pipeline = device->createPipeline(pipeline_info);
+
+        const vertex vertices[3] = {
+            vertex { { -0.8f, -0.8f }, { 0.0f, 1.0f } },
+            vertex { { 0.0f, 0.8f }, { 0.5f, 0.0f } },
+            vertex { { 0.8f, -0.8f }, { 1.0f, 1.0f } },
+        };
+
+        uvre::BufferCreateInfo vbo_info = {};
+        vbo_info.type = uvre::BufferType::VERTEX_BUFFER;
+        vbo_info.size = sizeof(vertices);
+        vbo_info.data = vertices;
+
+        uvre::Buffer vbo = device->createBuffer(vbo_info);
+
+        uvre::TextureCreateInfo color_info = {};
+        color_info.type = uvre::TextureType::TEXTURE_2D;
+        color_info.format = uvre::PixelFormat::R8G8B8A8_UNORM;
+        color_info.width = TARGET_WIDTH;
+        color_info.height = TARGET_HEIGHT;
+
+        uvre::ColorAttachment color_attachment = {};
+        color_attachment.id = 0;
+        color_attachment.color = device->createTexture(color_info);
+
+        uvre::RenderTargetCreateInfo target_info = {};
+        target_info.num_color_attachments = 1;
+        target_info.color_attachments = &color_attachment;
+
+        // Headless contexts have no usable default
+        // framebuffer so a render target is a must.
+        uvre::RenderTarget target = device->createRenderTarget(target_info);
+
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        for(int i = 0; i < NUM_FRAMES; i++) {
+            device->beginFrame();
+            device->prepare();
+            device->startRecording(commands);
+
+            commands->bindRenderTarget(target);
+            commands->setViewport(0, 0, TARGET_WIDTH, TARGET_HEIGHT);
+            commands->setClearColor3f(0.0f, 0.0f, 0.0f);
+            commands->clear(uvre::RT_COLOR_BUFFER);
+
+            commands->bindPipeline(pipeline);
+            commands->bindVertexBuffer(vbo);
+            commands->draw(3, 1, 0, 0);
+
+            device->submit(commands);
+
+            // This does nothing here
+            device->present();
+
+            device->endFrame();
+        }
+
+        // Wait for the GPU to catch up
+        device->waitFence(device->createFence(), UINT64_MAX);
+
+        const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "Rendered " << NUM_FRAMES << " frames in " << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() << " ms" << std::endl;
+    }
+
+    device->destroyCommandList(commands);
+    uvre::destroyDevice(device);
+
+    // The context goes after the device
+    uvre::destroyHeadlessContext(context);
+
+    return 0;
+}
@@ -8,15 +8,15 @@
  */
 #include "gl33_private.hpp"
 
-static inline void pushCommand(std::vector<uvre::Command> &commands, const uvre::Command &cmd, size_t index)
+static inline void pushCommand(std::vector<uvre::gl33::Command> &commands, const uvre::gl33::Command &cmd, size_t index)
 {
     if(commands.size() <= index) {
         commands.push_back(cmd);
         return;
     }
 
-    std::vector<uvre::Command>::iterator it = commands.begin() + index;
-    if(it->type == uvre::CommandType::WRITE_BUFFER)
+    std::vector<uvre::gl33::Command>::iterator it = commands.begin() + index;
+    if(it->type == uvre::gl33::CommandType::WRITE_BUFFER)
         delete[] it->buffer_write.data_ptr;
     *it = cmd;
 }
@@ -33,15 +33,15 @@ static inline uint32_t getTargetMask(uvre::RenderTargetMask mask)
     return result;
 }
 
-uvre::CommandListImpl::CommandListImpl()
-    : commands(), num_commands(0)
+uvre::gl33::CommandListImpl::CommandListImpl()
+    : commands(), num_commands(0), used_textures()
 {
 }
 
-void uvre::CommandListImpl::setScissor(int x, int y, int width, int height)
+void uvre::gl33::CommandListImpl::setScissor(int x, int y, int width, int height)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_SCISSOR;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::SET_SCISSOR;
     cmd.scvp.x = x;
     cmd.scvp.y = y;
     cmd.scvp.w = width;
@@ -49,10 +49,10 @@ void uvre::CommandListImpl::setScissor(int x, int y, int width, int height)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setViewport(int x, int y, int width, int height)
+void uvre::gl33::CommandListImpl::setViewport(int x, int y, int width, int height)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_VIEWPORT;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::SET_VIEWPORT;
     cmd.scvp.x = x;
     cmd.scvp.y = y;
     cmd.scvp.w = width;
@@ -60,18 +60,18 @@ void uvre::CommandListImpl::setViewport(int x, int y, int width, int height)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setClearDepth(float d)
+void uvre::gl33::CommandListImpl::setClearDepth(float d)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_CLEAR_DEPTH;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::SET_CLEAR_DEPTH;
     cmd.depth = d;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setClearColor3f(float r, float g, float b)
+void uvre::gl33::CommandListImpl::setClearColor3f(float r, float g, float b)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_CLEAR_COLOR;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::SET_CLEAR_COLOR;
     cmd.color[0] = r;
     cmd.color[1] = g;
     cmd.color[2] = b;
@@ -79,10 +79,10 @@ void uvre::CommandListImpl::setClearColor3f(float r, float g, float b)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
+void uvre::gl33::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_CLEAR_COLOR;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::SET_CLEAR_COLOR;
     cmd.color[0] = r;
     cmd.color[1] = g;
     cmd.color[2] = b;
@@ -90,90 +90,108 @@ void uvre::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::clear(uvre::RenderTargetMask mask)
+void uvre::gl33::CommandListImpl::clear(uvre::RenderTargetMask mask)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::CLEAR;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::CLEAR;
     cmd.clear_mask = getTargetMask(mask);
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindPipeline(uvre::Pipeline pipeline)
+void uvre::gl33::CommandListImpl::bindPipeline(const uvre::Pipeline &pipeline)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_PIPELINE;
-    cmd.pipeline = *pipeline;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_PIPELINE;
+    cmd.pipeline = uvre::gl33::impl(pipeline);
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindStorageBuffer(uvre::Buffer buffer, uint32_t index)
+void uvre::gl33::CommandListImpl::bindStorageBuffer(const uvre::Buffer &buffer, uint32_t index)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_STORAGE_BUFFER;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_STORAGE_BUFFER;
     cmd.bind_index = index;
-    cmd.object = buffer ? buffer->bufobj : 0;
+    cmd.object = buffer ? uvre::gl33::impl(buffer)->bufobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindUniformBuffer(uvre::Buffer buffer, uint32_t index)
+void uvre::gl33::CommandListImpl::bindUniformBuffer(const uvre::Buffer &buffer, uint32_t index)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_UNIFORM_BUFFER;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_UNIFORM_BUFFER;
     cmd.bind_index = index;
-    cmd.object = buffer ? buffer->bufobj : 0;
+    cmd.object = buffer ? uvre::gl33::impl(buffer)->bufobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindIndexBuffer(uvre::Buffer buffer)
+void uvre::gl33::CommandListImpl::bindIndexBuffer(const uvre::Buffer &buffer)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_INDEX_BUFFER;
-    cmd.object = buffer ? buffer->bufobj : 0;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_INDEX_BUFFER;
+    cmd.object = buffer ? uvre::gl33::impl(buffer)->bufobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindVertexBuffer(uvre::Buffer buffer)
+void uvre::gl33::CommandListImpl::bindVertexBuffer(const uvre::Buffer &buffer)
 {
     if(buffer) {
-        uvre::Command cmd = {};
-        cmd.type = uvre::CommandType::BIND_VERTEX_BUFFER;
-        cmd.buffer = *buffer;
+        uvre::gl33::Command cmd = {};
+        cmd.type = uvre::gl33::CommandType::BIND_VERTEX_BUFFER;
+        cmd.buffer = *uvre::gl33::impl(buffer);
         pushCommand(commands, cmd, num_commands++);
     }
 }
 
-void uvre::CommandListImpl::bindSampler(uvre::Sampler sampler, uint32_t index)
+void uvre::gl33::CommandListImpl::bindSampler(const uvre::Sampler &sampler, uint32_t index)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_SAMPLER;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_SAMPLER;
     cmd.bind_index = index;
-    cmd.object = sampler ? sampler->ssobj : 0;
+    cmd.object = sampler ? uvre::gl33::impl(sampler)->ssobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindTexture(uvre::Texture texture, uint32_t index)
+void uvre::gl33::CommandListImpl::bindTexture(const uvre::Texture &texture, uint32_t index)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_TEXTURE;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_TEXTURE;
     cmd.bind_index = index;
-    cmd.tex_target = texture->target;
-    cmd.object = texture ? texture->texobj : 0;
+    cmd.tex_target = texture ? uvre::gl33::impl(texture)->target : GL_TEXTURE_2D;
+    cmd.object = texture ? uvre::gl33::impl(texture)->texobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+
+    if(texture)
+        used_textures.push_back(uvre::gl33::impl(texture));
+}
+
+void uvre::gl33::CommandListImpl::bindStorageImage(const uvre::Texture &, uint32_t, int, uvre::ImageAccess)
+{
+    // Not supported: no GL_ARB_shader_image_load_store
+}
+
+void uvre::gl33::CommandListImpl::bindRenderTarget(const uvre::RenderTarget &target)
+{
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_RENDER_TARGET;
+    cmd.object = target ? uvre::gl33::impl(target)->fbobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindRenderTarget(uvre::RenderTarget target)
+void uvre::gl33::CommandListImpl::bindResourceSet(const uvre::ResourceSet &set, uint32_t first)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_RENDER_TARGET;
-    cmd.object = target ? target->fbobj : 0;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BIND_RESOURCE_SET;
+    cmd.bind_index = first;
+    cmd.set = uvre::gl33::impl(set);
     pushCommand(commands, cmd, num_commands++);
+    used_textures.insert(used_textures.end(), cmd.set->texture_objects.cbegin(), cmd.set->texture_objects.cend());
 }
 
-void uvre::CommandListImpl::writeBuffer(uvre::Buffer buffer, size_t offset, size_t size, const void *data)
+void uvre::gl33::CommandListImpl::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::WRITE_BUFFER;
-    cmd.buffer_write.buffer = buffer->bufobj;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::WRITE_BUFFER;
+    cmd.buffer_write.buffer = uvre::gl33::impl(buffer)->bufobj;
     cmd.buffer_write.offset = offset;
     cmd.buffer_write.size = size;
     cmd.buffer_write.data_ptr = new uint8_t[size];
@@ -181,12 +199,12 @@ void uvre::CommandListImpl::writeBuffer(uvre::Buffer buffer, size_t offset, size
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::copyRenderTarget(uvre::RenderTarget src, uvre::RenderTarget dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, uvre::RenderTargetMask mask, bool filter)
+void uvre::gl33::CommandListImpl::copyRenderTarget(const uvre::RenderTarget &src, const uvre::RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, uvre::RenderTargetMask mask, bool filter)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::COPY_RENDER_TARGET;
-    cmd.rt_copy.src = src ? src->fbobj : 0;
-    cmd.rt_copy.dst = dst ? dst->fbobj : 0;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::COPY_RENDER_TARGET;
+    cmd.rt_copy.src = src ? uvre::gl33::impl(src)->fbobj : 0;
+    cmd.rt_copy.dst = dst ? uvre::gl33::impl(dst)->fbobj : 0;
     cmd.rt_copy.sx0 = sx0;
     cmd.rt_copy.sy0 = sy0;
     cmd.rt_copy.sx1 = sx1;
@@ -200,10 +218,65 @@ void uvre::CommandListImpl::copyRenderTarget(uvre::RenderTarget src, uvre::Rende
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance)
+void uvre::gl33::CommandListImpl::generateMipmaps(const uvre::Texture &texture)
+{
+    // No texture, no mipmaps
+    if(!texture)
+        return;
+
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::GENERATE_MIPMAPS;
+    cmd.tex_target = uvre::gl33::impl(texture)->target;
+    cmd.object = uvre::gl33::impl(texture)->texobj;
+    pushCommand(commands, cmd, num_commands++);
+
+    used_textures.push_back(uvre::gl33::impl(texture));
+}
+
+void uvre::gl33::CommandListImpl::memoryBarrier(uvre::BarrierFlags)
+{
+    // Nothing in GL 3.3 writes memory
+    // in an incoherent way. Lucky us.
+}
+
+void uvre::gl33::CommandListImpl::beginQuery(const uvre::Query &query)
+{
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BEGIN_QUERY;
+    cmd.query.qobj = uvre::gl33::impl(query)->qobj;
+    cmd.query.target = uvre::gl33::impl(query)->target;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl33::CommandListImpl::endQuery(const uvre::Query &query)
+{
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::END_QUERY;
+    cmd.query.qobj = uvre::gl33::impl(query)->qobj;
+    cmd.query.target = uvre::gl33::impl(query)->target;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl33::CommandListImpl::beginConditionalRender(const uvre::Query &query, bool wait)
+{
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::BEGIN_CONDITIONAL_RENDER;
+    cmd.cond.qobj = uvre::gl33::impl(query)->qobj;
+    cmd.cond.mode = wait ? GL_QUERY_WAIT : GL_QUERY_NO_WAIT;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl33::CommandListImpl::endConditionalRender()
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::DRAW;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::END_CONDITIONAL_RENDER;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl33::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance)
+{
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::DRAW;
     cmd.draw.a.vertices = static_cast<int32_t>(vertices);
     cmd.draw.a.instances = static_cast<int32_t>(instances);
     cmd.draw.a.base_vertex = static_cast<int32_t>(base_vertex);
@@ -211,10 +284,10 @@ void uvre::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance)
+void uvre::gl33::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::IDRAW;
+    uvre::gl33::Command cmd = {};
+    cmd.type = uvre::gl33::CommandType::IDRAW;
     cmd.draw.e.indices = static_cast<int32_t>(indices);
     cmd.draw.e.instances = static_cast<int32_t>(instances);
     cmd.draw.e.base_index = static_cast<int32_t>(base_index);
@@ -222,3 +295,13 @@ void uvre::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_
     cmd.draw.e.base_instance = static_cast<int32_t>(base_instance);
     pushCommand(commands, cmd, num_commands++);
 }
+
+void uvre::gl33::CommandListImpl::dispatch(size_t, size_t, size_t)
+{
+    // Not supported: no compute shaders
+}
+
+void uvre::gl33::CommandListImpl::dispatchIndirect(const uvre::Buffer &, size_t)
+{
+    // Not supported: no compute shaders
+}
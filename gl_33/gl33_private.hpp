@@ -8,14 +8,25 @@
  */
 #include <uvre/uvre.hpp>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <glad/gl.h>
 #include <limits>
-#include <sstream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
-namespace uvre
+namespace uvre::gl33
 {
+// GL_KHR_parallel_shader_compile is not a part
+// of the GL 3.3 core and the loader doesn't have it.
+static constexpr const uint32_t KHR_COMPLETION_STATUS = 0x91B1;
+using PFN_glMaxShaderCompilerThreadsKHR = void(GLAPIENTRY *)(GLuint count);
+
 struct VertexArray_S final {
     uint32_t index;
     uint32_t vaobj;
@@ -29,12 +40,36 @@ struct VBOBinding final {
     VBOBinding *next;
 };
 
-struct Shader_S final {
+struct Shader_S final : public uvre::Shader_S {
     uint32_t shader;
+    uint64_t key;
+    uint64_t id;
+    std::string cache_key;
     ShaderStage stage;
+    std::string source;
+    bool pending;
+};
+
+struct PendingPipeline_S final {
+    uint64_t key;
+    std::vector<Shader> shaders;
+    bool threaded;
+    std::atomic<GLsync> fence;
+};
+
+// Dedupe cache entries remember the object they were
+// made for: a duplicate still waiting to be destroyed
+// must leave the entry of its replacement alone. The
+// objects point at the key, so an entry stays around
+// until the last of them is gone.
+template<typename T>
+struct CacheEntry final {
+    const T *object;
+    std::weak_ptr<T> handle;
+    size_t users;
 };
 
-struct Pipeline_S final {
+struct Pipeline_S final : public uvre::Pipeline_S {
     uint32_t bound_ibo; // OPTIMIZE
     uint32_t bound_vao; // OPTIMIZE
     uint32_t program;
@@ -62,29 +97,78 @@ struct Pipeline_S final {
     size_t num_attributes;
     VertexAttrib *attributes;
     VertexArray_S *vaos;
+    PendingPipeline_S *pending;
+    const std::string *cache_key; // null if not cached
 };
 
-struct Buffer_S final {
+struct Buffer_S final : public uvre::Buffer_S {
     uint32_t bufobj;
     VBOBinding *vbo;
     size_t size;
+    uint64_t upload_serial;
 };
 
-struct Texture_S final {
+struct Texture_S final : public uvre::Texture_S {
     uint32_t texobj;
     uint32_t format;
     uint32_t target;
     int width;
     int height;
     int depth;
+    size_t mip_levels;
+    size_t memory_size;
+    uint64_t upload_serial;
+    uint64_t last_used_frame;
 };
 
-struct Sampler_S final {
+struct Sampler_S final : public uvre::Sampler_S {
     uint32_t ssobj;
+    const std::string *cache_key; // null if not cached
+};
+
+struct ResourceSet_S final : public uvre::ResourceSet_S {
+    std::vector<Texture_S *> texture_objects;
+    std::vector<uint32_t> textures;
+    std::vector<uint32_t> texture_targets;
+    std::vector<uint32_t> samplers;
+    std::vector<uint32_t> uniform_buffers;
+    std::vector<GLintptr> uniform_offsets;
+    std::vector<GLsizeiptr> uniform_sizes;
+    std::vector<uint32_t> storage_buffers;
+    std::vector<GLintptr> storage_offsets;
+    std::vector<GLsizeiptr> storage_sizes;
+    std::vector<std::shared_ptr<void>> objects; // keeps them alive
+};
+
+struct Fence_S final : public uvre::Fence_S {
+    GLsync sync;
+};
+
+struct Query_S final : public uvre::Query_S {
+    uint32_t qobj;
+    uint32_t target;
+};
+
+struct Readback_S final : public uvre::Readback_S {
+    uint32_t bufobj;
+    size_t capacity;
+    size_t size;
+    GLsync sync;
+    const void *mapped;
 };
 
-struct RenderTarget_S final {
+// Pack buffers of finished readbacks wait here for
+// later ones, only so many and only for so long.
+static constexpr const size_t MAX_PACK_BUFFERS = 8;
+struct PackBuffer final {
+    uint32_t bufobj;
+    size_t capacity;
+    uint64_t released;
+};
+
+struct RenderTarget_S final : public uvre::RenderTarget_S {
     uint32_t fbobj;
+    size_t memory_size;
 };
 
 enum class CommandType {
@@ -101,8 +185,14 @@ enum class CommandType {
     BIND_SAMPLER,
     BIND_TEXTURE,
     BIND_RENDER_TARGET,
+    BIND_RESOURCE_SET,
     WRITE_BUFFER,
     COPY_RENDER_TARGET,
+    GENERATE_MIPMAPS,
+    BEGIN_QUERY,
+    END_QUERY,
+    BEGIN_CONDITIONAL_RENDER,
+    END_CONDITIONAL_RENDER,
     DRAW,
     IDRAW
 };
@@ -135,7 +225,8 @@ struct Command final {
         float color[4];
         float depth;
         uint32_t clear_mask;
-        Pipeline_S pipeline;
+        Pipeline_S *pipeline;
+        ResourceSet_S *set;
         Buffer_S buffer;
         uint32_t object;
         struct {
@@ -151,10 +242,36 @@ struct Command final {
             uint32_t mask;
             uint32_t filter;
         } rt_copy;
+        struct {
+            uint32_t qobj;
+            uint32_t target;
+        } query;
+        struct {
+            uint32_t qobj;
+            uint32_t mode;
+        } cond;
         DrawCmd draw;
     };
 };
 
+class Worker final {
+public:
+    Worker(void *user_data, void (*makeContextCurrent)(void *user_data));
+    ~Worker();
+
+    void push(std::function<void()> job);
+    void wait();
+
+public:
+    std::mutex mutex;
+    std::condition_variable job_cv;
+    std::condition_variable idle_cv;
+    std::deque<std::function<void()>> jobs;
+    bool busy;
+    bool quit;
+    std::thread thread;
+};
+
 class RenderDeviceImpl;
 class CommandListImpl final : public ICommandList {
 public:
@@ -168,24 +285,44 @@ public:
     void setClearColor4f(float r, float g, float b, float a) override;
     void clear(RenderTargetMask mask) override;
 
-    void bindPipeline(Pipeline pipeline) override;
-    void bindStorageBuffer(Buffer buffer, uint32_t index) override;
-    void bindUniformBuffer(Buffer buffer, uint32_t index) override;
-    void bindIndexBuffer(Buffer buffer) override;
-    void bindVertexBuffer(Buffer buffer) override;
-    void bindSampler(Sampler sampler, uint32_t index) override;
-    void bindTexture(Texture texture, uint32_t index) override;
-    void bindRenderTarget(RenderTarget target) override;
+    void bindPipeline(const Pipeline &pipeline) override;
+    void bindStorageBuffer(const Buffer &buffer, uint32_t index) override;
+    void bindUniformBuffer(const Buffer &buffer, uint32_t index) override;
+    void bindIndexBuffer(const Buffer &buffer) override;
+    void bindVertexBuffer(const Buffer &buffer) override;
+    void bindSampler(const Sampler &sampler, uint32_t index) override;
+    void bindTexture(const Texture &texture, uint32_t index) override;
+    void bindStorageImage(const Texture &texture, uint32_t index, int level, ImageAccess access) override;
+    void bindRenderTarget(const RenderTarget &target) override;
+    void bindResourceSet(const ResourceSet &set, uint32_t first) override;
+
+    void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void copyRenderTarget(const RenderTarget &src, const RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, RenderTargetMask mask, bool filter) override;
+    void generateMipmaps(const Texture &texture) override;
+    void memoryBarrier(BarrierFlags flags) override;
 
-    void writeBuffer(Buffer buffer, size_t offset, size_t size, const void *data) override;
-    void copyRenderTarget(RenderTarget src, RenderTarget dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, RenderTargetMask mask, bool filter) override;
+    void beginQuery(const Query &query) override;
+    void endQuery(const Query &query) override;
+    void beginConditionalRender(const Query &query, bool wait) override;
+    void endConditionalRender() override;
 
     void draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance) override;
     void idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance) override;
+    void dispatch(size_t x, size_t y, size_t z) override;
+    void dispatchIndirect(const Buffer &buffer, size_t offset) override;
 
 public:
     std::vector<Command> commands;
     size_t num_commands;
+    std::vector<Texture_S *> used_textures;
+};
+
+// Handles can outlive the device, so their deleters
+// reach it through this: it's null once the device
+// is gone and the objects are then simply freed.
+struct DeviceLink final {
+    std::mutex mutex;
+    RenderDeviceImpl *device;
 };
 
 class RenderDeviceImpl final : public IRenderDevice {
@@ -194,24 +331,56 @@ public:
     virtual ~RenderDeviceImpl();
 
     const DeviceInfo &getInfo() const;
+    MemoryStats getMemoryStats() override;
+    uint64_t getLastUsedFrame(const Texture &texture) override;
 
     Shader createShader(const ShaderCreateInfo &info) override;
     Pipeline createPipeline(const PipelineCreateInfo &info) override;
     Buffer createBuffer(const BufferCreateInfo &info) override;
     Sampler createSampler(const SamplerCreateInfo &info) override;
     Texture createTexture(const TextureCreateInfo &info) override;
+    Texture createTextureView(const TextureViewCreateInfo &info) override;
     RenderTarget createRenderTarget(const RenderTargetCreateInfo &info) override;
+    ResourceSet createResourceSet(const ResourceSetCreateInfo &info) override;
+
+    Shader createShaderAsync(const ShaderCreateInfo &info) override;
+    Pipeline createPipelineAsync(const PipelineCreateInfo &info) override;
+    bool isReady(const Shader &shader) override;
+    bool isReady(const Pipeline &pipeline) override;
 
-    void writeBuffer(Buffer buffer, size_t offset, size_t size, const void *data) override;
-    void writeTexture2D(Texture texture, int x, int y, int w, int h, PixelFormat format, const void *data) override;
-    void writeTextureCube(Texture texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data) override;
-    void writeTextureArray(Texture texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data) override;
+    Buffer createBufferAsync(const BufferCreateInfo &info) override;
+    void writeBufferAsync(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2DAsync(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCubeAsync(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArrayAsync(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    bool isReady(const Buffer &buffer) override;
+    bool isReady(const Texture &texture) override;
+
+    void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2D(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCube(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArray(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    void setTextureBaseLevel(const Texture &texture, int level) override;
 
     ICommandList *createCommandList() override;
     void destroyCommandList(ICommandList *commands) override;
     void startRecording(ICommandList *commands) override;
     void submit(ICommandList *commands) override;
 
+    Fence createFence() override;
+    bool waitFence(const Fence &fence, uint64_t timeout) override;
+
+    Query createQuery(QueryType type) override;
+    bool getQueryResult(const Query &query, uint64_t &result) override;
+
+    Readback readRenderTargetAsync(const RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, PixelFormat format) override;
+    Readback readTextureAsync(const Texture &texture, int level, int x, int y, int w, int h, PixelFormat format) override;
+    const void *getReadbackData(const Readback &readback) override;
+
+    void beginFrame() override;
+    void endFrame() override;
+    size_t getFrameIndex() const override;
+
     void prepare() override;
     void present() override;
     void vsync(bool enable) override;
@@ -219,6 +388,11 @@ public:
 
 public:
     DeviceCreateInfo create_info;
+    std::string shader_cache_dir;
+    uint64_t driver_hash;
+    uint64_t next_shader_id;
+    bool parallel_compile;
+    Worker *worker;
     int32_t max_vbo_bindings;
     DeviceInfo info;
     VBOBinding *vbos;
@@ -227,5 +401,97 @@ public:
     std::vector<Pipeline_S *> pipelines;
     std::vector<Buffer_S *> buffers;
     std::vector<CommandListImpl *> commandlists;
+    std::vector<GLsync> frame_fences;
+    uint64_t frame_number;
+
+    // Async uploads are numbered, the worker
+    // publishes them in order once the GPU is
+    // done, so the objects keep the last one.
+    uint64_t uploads_queued;
+    std::atomic<uint64_t> uploads_done;
+
+    // Oldest first, beginFrame lets go
+    // of the ones idle for too long.
+    std::vector<PackBuffer> pack_buffers;
+    uint32_t readback_fbo;
+
+    // Deleters can run on any thread, they only
+    // queue the objects: endFrame hands them over
+    // to the frame and the GL thread destroys them
+    // once the GPU is done with it.
+    std::shared_ptr<DeviceLink> link;
+    std::mutex drop_mutex;
+    std::vector<std::function<void()>> dropped;
+    std::vector<std::vector<std::function<void()>>> frame_garbage;
+    std::unordered_map<std::string, std::weak_ptr<Shader_S>> shader_cache;
+    std::unordered_map<std::string, CacheEntry<Pipeline_S>> pipeline_cache;
+    std::unordered_map<std::string, CacheEntry<Sampler_S>> sampler_cache;
+
+    // Objects are counted as they are created
+    // and destroyed: the stats may be read on
+    // another thread in the meantime.
+    std::mutex memory_mutex;
+    MemoryStats memory_stats;
 };
-} // namespace uvre
+
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size);
+bool loadProgramBinary(const RenderDeviceImpl *device, uint64_t key, uint32_t prog);
+void storeProgramBinary(const RenderDeviceImpl *device, uint64_t key, uint32_t prog);
+bool preprocessShader(const RenderDeviceImpl *device, const ShaderCreateInfo &info, std::string &source);
+
+// Handles only ever reach the device that
+// made them, so downcasting them is safe.
+static inline Shader_S *impl(const Shader &shader)
+{
+    return static_cast<Shader_S *>(shader.get());
+}
+
+static inline Pipeline_S *impl(const Pipeline &pipeline)
+{
+    return static_cast<Pipeline_S *>(pipeline.get());
+}
+
+static inline Buffer_S *impl(const Buffer &buffer)
+{
+    return static_cast<Buffer_S *>(buffer.get());
+}
+
+static inline Sampler_S *impl(const Sampler &sampler)
+{
+    return static_cast<Sampler_S *>(sampler.get());
+}
+
+static inline Texture_S *impl(const Texture &texture)
+{
+    return static_cast<Texture_S *>(texture.get());
+}
+
+static inline RenderTarget_S *impl(const RenderTarget &target)
+{
+    return static_cast<RenderTarget_S *>(target.get());
+}
+
+static inline ResourceSet_S *impl(const ResourceSet &set)
+{
+    return static_cast<ResourceSet_S *>(set.get());
+}
+
+static inline Fence_S *impl(const Fence &fence)
+{
+    return static_cast<Fence_S *>(fence.get());
+}
+
+static inline Query_S *impl(const Query &query)
+{
+    return static_cast<Query_S *>(query.get());
+}
+
+static inline Readback_S *impl(const Readback &readback)
+{
+    return static_cast<Readback_S *>(readback.get());
+}
+
+// gl33_rmain.cpp
+void pollImplInfo(ImplInfo &info);
+IRenderDevice *createDevice(const DeviceCreateInfo &info);
+} // namespace uvre::gl33
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <cstdio>
+#include <fstream>
+#include "gl33_private.hpp"
+
+static constexpr const uint32_t BINARY_MAGIC = 0x45525655; // 'UVRE'
+
+struct BinaryHeader final {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+};
+
+static std::string getBinaryPath(const uvre::gl33::RenderDeviceImpl *device, uint64_t key)
+{
+    char filename[32] = { 0 };
+    std::snprintf(filename, sizeof(filename), "/%016llx.bin", static_cast<unsigned long long>(key));
+    return device->shader_cache_dir + filename;
+}
+
+uint64_t uvre::gl33::hashBytes(uint64_t hash, const void *data, size_t size)
+{
+    // FNV-1a. Good enough for cache keys.
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    for(size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= UINT64_C(0x100000001B3);
+    }
+
+    return hash;
+}
+
+bool uvre::gl33::loadProgramBinary(const uvre::gl33::RenderDeviceImpl *device, uint64_t key, uint32_t prog)
+{
+    if(device->shader_cache_dir.empty())
+        return false;
+
+    std::ifstream file(getBinaryPath(device, key), std::ios::in | std::ios::binary);
+    if(!file.is_open())
+        return false;
+
+    BinaryHeader header = {};
+    if(!file.read(reinterpret_cast<char *>(&header), sizeof(BinaryHeader)) || header.magic != BINARY_MAGIC)
+        return false;
+
+    std::vector<char> binary(header.length);
+    if(!file.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+        return false;
+
+    // The driver is free to reject the binary
+    // for any reason (even with the same driver
+    // string), the caller then falls back to the
+    // good old compilation.
+    int32_t status;
+    glProgramBinary(prog, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    glGetProgramiv(prog, GL_LINK_STATUS, &status);
+    return status == GL_TRUE;
+}
+
+void uvre::gl33::storeProgramBinary(const uvre::gl33::RenderDeviceImpl *device, uint64_t key, uint32_t prog)
+{
+    if(device->shader_cache_dir.empty())
+        return;
+
+    int32_t length;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    BinaryHeader header = {};
+    std::vector<char> binary(static_cast<size_t>(length));
+    glGetProgramBinary(prog, length, nullptr, &header.format, binary.data());
+    header.magic = BINARY_MAGIC;
+    header.length = static_cast<uint32_t>(length);
+
+    // Write to a temporary file first so that
+    // a concurrently starting process never sees
+    // a half-written binary.
+    const std::string path = getBinaryPath(device, key);
+    const std::string temp_path = path + ".tmp";
+    std::ofstream file(temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+        return;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(BinaryHeader));
+    file.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+    file.close();
+
+    if(file.fail() || std::rename(temp_path.c_str(), path.c_str()))
+        std::remove(temp_path.c_str());
+}
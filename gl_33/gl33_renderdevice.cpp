@@ -10,11 +10,11 @@
 #include <functional>
 #include "gl33_private.hpp"
 
-static uvre::VertexArray_S dummy_vao = { 0, 0, 0, nullptr };
+static uvre::gl33::VertexArray_S dummy_vao = { 0, 0, 0, nullptr };
 
 static void GLAPIENTRY debugCallback(GLenum, GLenum, GLuint, GLenum severity, GLsizei, const char *message, const void *arg)
 {
-    const uvre::RenderDeviceImpl *device = reinterpret_cast<const uvre::RenderDeviceImpl *>(arg);
+    const uvre::gl33::RenderDeviceImpl *device = reinterpret_cast<const uvre::gl33::RenderDeviceImpl *>(arg);
         if(device && device->create_info.onDebugMessage) {
 
         uvre::DebugMessageInfo msg = {};
@@ -39,16 +39,201 @@ static void GLAPIENTRY debugCallback(GLenum, GLenum, GLuint, GLenum severity, GL
     }
 }
 
-static void destroyShader(uvre::Shader_S *shader)
+static void waitUpload(uvre::gl33::RenderDeviceImpl *device, uint64_t upload_serial)
 {
+    // The worker might still be writing
+    // the object, let it finish first.
+    if(upload_serial > device->uploads_done)
+        device->worker->wait();
+}
+
+static void trackMemory(uvre::gl33::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryStats &stats = device->memory_stats;
+    uvre::MemoryUsage &usage = stats.*member;
+    usage.bytes += bytes;
+    usage.peak_bytes = std::max(usage.peak_bytes, usage.bytes);
+    usage.peak_count = std::max(usage.peak_count, ++usage.count);
+
+    // Attachments are already counted as textures
+    if(member == &uvre::MemoryStats::render_targets)
+        return;
+
+    stats.total_bytes += bytes;
+    stats.peak_total_bytes = std::max(stats.peak_total_bytes, stats.total_bytes);
+
+    // Don't call back with the lock held
+    const uvre::DeviceCreateInfo &info = device->create_info;
+    if(info.memory.budget && info.memory.onBudgetExceeded && stats.total_bytes > info.memory.budget) {
+        const uvre::MemoryStats snapshot = stats;
+        lock.unlock();
+        info.memory.onBudgetExceeded(info.memory.user_data, snapshot);
+    }
+}
+
+static void untrackMemory(uvre::gl33::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryUsage &usage = device->memory_stats.*member;
+    usage.bytes -= bytes;
+    usage.count--;
+    if(member != &uvre::MemoryStats::render_targets)
+        device->memory_stats.total_bytes -= bytes;
+}
+
+static void destroyShader(uvre::gl33::Shader_S *shader, uvre::gl33::RenderDeviceImpl *device)
+{
+    // Remove ourselves from the dedupe cache.
+    std::unordered_map<std::string, std::weak_ptr<uvre::gl33::Shader_S>>::const_iterator it = device->shader_cache.find(shader->cache_key);
+    if(it != device->shader_cache.cend() && it->second.expired())
+        device->shader_cache.erase(it);
+
     glDeleteShader(shader->shader);
     delete shader;
 }
 
-static void destroyPipeline(uvre::Pipeline_S *pipeline, uvre::RenderDeviceImpl *device)
+template<typename T>
+static std::function<void(T *)> deferDestroy(uvre::gl33::RenderDeviceImpl *device, void (*destroy)(T *, uvre::gl33::RenderDeviceImpl *))
+{
+    std::shared_ptr<uvre::gl33::DeviceLink> link = device->link;
+    return [link, destroy](T *object) {
+        std::unique_lock<std::mutex> lock(link->mutex);
+        if(!link->device) {
+            // The context went away with the device,
+            // there's nothing left to destroy in GL.
+            lock.unlock();
+            delete object;
+            return;
+        }
+
+        std::lock_guard<std::mutex> drop_lock(link->device->drop_mutex);
+        link->device->dropped.push_back(std::bind(destroy, object, link->device));
+    };
+}
+
+static void collectGarbage(std::vector<std::function<void()>> &garbage)
+{
+    // Destroying an object may drop others
+    std::vector<std::function<void()>> objects;
+    objects.swap(garbage);
+    for(const std::function<void()> &destroy : objects)
+        destroy();
+}
+
+static void collectDropped(uvre::gl33::RenderDeviceImpl *device)
+{
+    for(;;) {
+        std::vector<std::function<void()>> objects;
+        {
+            std::lock_guard<std::mutex> lock(device->drop_mutex);
+            objects.swap(device->dropped);
+        }
+
+        if(objects.empty())
+            break;
+        collectGarbage(objects);
+    }
+}
+
+static bool hasExtension(const char *name)
+{
+    int32_t num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for(int32_t i = 0; i < num_extensions; i++) {
+        if(!std::strcmp(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i))), name))
+            return true;
+    }
+
+    return false;
+}
+
+static void startShader(uvre::gl33::Shader_S *shader)
+{
+    uint32_t stage = 0;
+    switch(shader->stage) {
+        case uvre::ShaderStage::VERTEX:
+            stage = GL_VERTEX_SHADER;
+            break;
+        case uvre::ShaderStage::FRAGMENT:
+            stage = GL_FRAGMENT_SHADER;
+            break;
+        default:
+            // prepareShader never lets these
+            // through, fail it just in case.
+            shader->source = std::string();
+            return;
+    }
+
+    // Not querying anything here allows
+    // the driver to do its job in background.
+    const char *source_cstr = shader->source.c_str();
+    shader->shader = glCreateShader(stage);
+    glShaderSource(shader->shader, 1, &source_cstr, nullptr);
+    glCompileShader(shader->shader);
+    shader->source = std::string();
+    shader->pending = true;
+}
+
+static bool finishShader(const uvre::gl33::RenderDeviceImpl *device, uvre::gl33::Shader_S *shader, bool wait)
 {
+    if(!shader->pending)
+        return true;
+
+    if(!wait && device->parallel_compile) {
+        int32_t completed;
+        glGetShaderiv(shader->shader, uvre::gl33::KHR_COMPLETION_STATUS, &completed);
+        if(!completed)
+            return false;
+    }
+
+    int32_t status, info_log_length;
+    std::string info_log;
+
+    if(device->create_info.onDebugMessage) {
+        glGetShaderiv(shader->shader, GL_INFO_LOG_LENGTH, &info_log_length);
+        if(info_log_length > 1) {
+            info_log.resize(info_log_length);
+            glGetShaderInfoLog(shader->shader, static_cast<GLsizei>(info_log.size()), nullptr, &info_log[0]);
+
+            uvre::DebugMessageInfo msg = {};
+            msg.level = uvre::DebugMessageLevel::INFO;
+            msg.text = info_log.c_str();
+            device->create_info.onDebugMessage(msg);
+        }
+    }
+
+    glGetShaderiv(shader->shader, GL_COMPILE_STATUS, &status);
+    if(!status) {
+        glDeleteShader(shader->shader);
+        shader->shader = 0;
+    }
+
+    shader->pending = false;
+    return true;
+}
+
+static bool compileShader(const uvre::gl33::RenderDeviceImpl *device, uvre::gl33::Shader_S *shader)
+{
+    if(!shader->shader && !shader->source.empty())
+        startShader(shader);
+    finishShader(device, shader, true);
+    return shader->shader != 0;
+}
+
+static void destroyPipeline(uvre::gl33::Pipeline_S *pipeline, uvre::gl33::RenderDeviceImpl *device)
+{
+    // Remove ourselves from the dedupe cache.
+    if(pipeline->cache_key) {
+        std::unordered_map<std::string, uvre::gl33::CacheEntry<uvre::gl33::Pipeline_S>>::iterator it = device->pipeline_cache.find(*pipeline->cache_key);
+        if(it->second.object == pipeline)
+            it->second.object = nullptr;
+        if(!--it->second.users)
+            device->pipeline_cache.erase(it);
+    }
+
     // Remove ourselves from the notify list.
-    for(std::vector<uvre::Pipeline_S *>::const_iterator it = device->pipelines.cbegin(); it != device->pipelines.cend(); it++) {
+    for(std::vector<uvre::gl33::Pipeline_S *>::const_iterator it = device->pipelines.cbegin(); it != device->pipelines.cend(); it++) {
         if(*it != pipeline)
             continue;
         device->pipelines.erase(it);
@@ -56,21 +241,29 @@ static void destroyPipeline(uvre::Pipeline_S *pipeline, uvre::RenderDeviceImpl *
     }
 
     // Chain-free the VAO list
-    for(uvre::VertexArray_S *node = pipeline->vaos; node;) {
-        uvre::VertexArray_S *next = node->next;
+    for(uvre::gl33::VertexArray_S *node = pipeline->vaos; node;) {
+        uvre::gl33::VertexArray_S *next = node->next;
         glDeleteVertexArrays(1, &node->vaobj);
         delete node;
         node = next;
     }
 
+    // Make sure the worker is done with us
+    if(pipeline->pending && pipeline->pending->threaded)
+        device->worker->wait();
+    if(pipeline->pending && pipeline->pending->fence)
+        glDeleteSync(pipeline->pending->fence);
+
     glDeleteProgram(pipeline->program);
+    delete[] pipeline->attributes;
+    delete pipeline->pending;
     delete pipeline;
 }
 
-static void destroyBuffer(uvre::Buffer_S *buffer, uvre::RenderDeviceImpl *device)
+static void destroyBuffer(uvre::gl33::Buffer_S *buffer, uvre::gl33::RenderDeviceImpl *device)
 {
     // Remove ourselves from the notify list.
-    for(std::vector<uvre::Buffer_S *>::const_iterator it = device->buffers.cbegin(); it != device->buffers.cend(); it++) {
+    for(std::vector<uvre::gl33::Buffer_S *>::const_iterator it = device->buffers.cbegin(); it != device->buffers.cend(); it++) {
         if(*it != buffer)
             continue;
         device->buffers.erase(it);
@@ -78,39 +271,132 @@ static void destroyBuffer(uvre::Buffer_S *buffer, uvre::RenderDeviceImpl *device
         break;
     }
 
+    waitUpload(device, buffer->upload_serial);
+    untrackMemory(device, &uvre::MemoryStats::buffers, buffer->size);
     glDeleteBuffers(1, &buffer->bufobj);
     delete buffer;
 }
 
-static void destroySampler(uvre::Sampler_S *sampler)
+static void destroySampler(uvre::gl33::Sampler_S *sampler, uvre::gl33::RenderDeviceImpl *device)
 {
+    // Remove ourselves from the dedupe cache.
+    std::unordered_map<std::string, uvre::gl33::CacheEntry<uvre::gl33::Sampler_S>>::iterator it = device->sampler_cache.find(*sampler->cache_key);
+    if(it->second.object == sampler)
+        it->second.object = nullptr;
+    if(!--it->second.users)
+        device->sampler_cache.erase(it);
+
     glDeleteSamplers(1, &sampler->ssobj);
     delete sampler;
 }
 
-static void destroyTexture(uvre::Texture_S *texture)
+static void destroyTexture(uvre::gl33::Texture_S *texture, uvre::gl33::RenderDeviceImpl *device)
 {
+    waitUpload(device, texture->upload_serial);
+    untrackMemory(device, &uvre::MemoryStats::textures, texture->memory_size);
     glDeleteTextures(1, &texture->texobj);
     delete texture;
 }
 
-static void destroyRenderTarget(uvre::RenderTarget_S *target)
+static void destroyRenderTarget(uvre::gl33::RenderTarget_S *target, uvre::gl33::RenderDeviceImpl *device)
 {
+    untrackMemory(device, &uvre::MemoryStats::render_targets, target->memory_size);
     glDeleteFramebuffers(1, &target->fbobj);
     delete target;
 }
 
-uvre::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_info)
-    : create_info(create_info), vbos(nullptr), bound_pipeline(), null_pipeline(), pipelines(), buffers(), commandlists()
+static void destroyResourceSet(uvre::gl33::ResourceSet_S *set, uvre::gl33::RenderDeviceImpl *)
+{
+    delete set;
+}
+
+static void destroyFence(uvre::gl33::Fence_S *fence, uvre::gl33::RenderDeviceImpl *)
+{
+    glDeleteSync(fence->sync);
+    delete fence;
+}
+
+static void destroyQuery(uvre::gl33::Query_S *query, uvre::gl33::RenderDeviceImpl *)
+{
+    glDeleteQueries(1, &query->qobj);
+    delete query;
+}
+
+static void deletePackBuffer(uvre::gl33::RenderDeviceImpl *device, const uvre::gl33::PackBuffer &pack_buffer)
+{
+    glDeleteBuffers(1, &pack_buffer.bufobj);
+    untrackMemory(device, &uvre::MemoryStats::buffers, pack_buffer.capacity);
+}
+
+static void destroyReadback(uvre::gl33::Readback_S *readback, uvre::gl33::RenderDeviceImpl *device)
 {
+    if(readback->mapped) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->bufobj);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    glDeleteSync(readback->sync);
+
+    // The oldest one makes room
+    if(device->pack_buffers.size() >= uvre::gl33::MAX_PACK_BUFFERS) {
+        deletePackBuffer(device, device->pack_buffers.front());
+        device->pack_buffers.erase(device->pack_buffers.begin());
+    }
+
+    device->pack_buffers.push_back(uvre::gl33::PackBuffer { readback->bufobj, readback->capacity, device->frame_number });
+    delete readback;
+}
+
+uvre::gl33::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_info)
+    : create_info(create_info), shader_cache_dir(), driver_hash(UINT64_C(0xCBF29CE484222325)), next_shader_id(0), parallel_compile(false), worker(nullptr), vbos(nullptr), bound_pipeline(), null_pipeline(), pipelines(), buffers(), commandlists(), frame_fences(), frame_number(0), uploads_queued(0), uploads_done(0), pack_buffers(), readback_fbo(0), link(std::make_shared<uvre::gl33::DeviceLink>()), drop_mutex(), dropped(), frame_garbage(), shader_cache(), pipeline_cache(), sampler_cache(), memory_mutex(), memory_stats()
+{
+    link->device = this;
     glGetIntegerv(GL_MAX_VERTEX_ATTRIB_BINDINGS, &max_vbo_bindings);
 
+    // Program binaries are only valid for the exact
+    // driver that produced them, so the driver strings
+    // become a part of every program cache key.
+    const GLenum driver_strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for(GLenum name : driver_strings) {
+        const char *str = reinterpret_cast<const char *>(glGetString(name));
+        if(str)
+            driver_hash = uvre::gl33::hashBytes(driver_hash, str, std::strlen(str));
+    }
+
+    // The loader only has the program binary calls
+    // when the context is 4.1 or newer, a plain 3.3
+    // context simply goes without the cache.
+    if(create_info.shader_cache_dir && glGetProgramBinary && glProgramBinary && glProgramParameteri) {
+        int32_t num_binary_formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats);
+        if(num_binary_formats > 0)
+            shader_cache_dir = create_info.shader_cache_dir;
+    }
+
+    // Let the driver compile things in the background
+    // when it can, otherwise fall back to linking
+    // on our own worker thread with a shared context.
+    if(hasExtension("GL_KHR_parallel_shader_compile") || hasExtension("GL_ARB_parallel_shader_compile")) {
+        uvre::gl33::PFN_glMaxShaderCompilerThreadsKHR maxShaderCompilerThreads = reinterpret_cast<uvre::gl33::PFN_glMaxShaderCompilerThreadsKHR>(create_info.gl.getProcAddr(create_info.gl.user_data, "glMaxShaderCompilerThreadsKHR"));
+        if(!maxShaderCompilerThreads)
+            maxShaderCompilerThreads = reinterpret_cast<uvre::gl33::PFN_glMaxShaderCompilerThreadsKHR>(create_info.gl.getProcAddr(create_info.gl.user_data, "glMaxShaderCompilerThreadsARB"));
+        if(maxShaderCompilerThreads) {
+            maxShaderCompilerThreads(0xFFFFFFFF);
+            parallel_compile = true;
+        }
+    }
+
+    if(create_info.gl.makeWorkerContextCurrent)
+        worker = new uvre::gl33::Worker(create_info.gl.worker_user_data, create_info.gl.makeWorkerContextCurrent);
+
     std::memset(&info, 0, sizeof(uvre::DeviceInfo));
     info.impl_family = uvre::ImplFamily::OPENGL;
     info.impl_version_major = 3;
     info.impl_version_minor = 3;
     info.supports_anisotropic = false;
     info.supports_storage_buffers = false;
+    info.supports_compute = false;
     info.supports_shader_format[static_cast<int>(uvre::ShaderFormat::SOURCE_GLSL)] = true;
 
     null_pipeline.blending.enabled = false;
@@ -123,9 +409,15 @@ uvre::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_in
     null_pipeline.num_attributes = 0;
     null_pipeline.attributes = 0;
     null_pipeline.vaos = nullptr;
+    null_pipeline.pending = nullptr;
+    null_pipeline.cache_key = nullptr;
     bound_pipeline = null_pipeline;
 
-    vbos = new uvre::VBOBinding;
+    // A zero would mean no frames at all
+    frame_fences.resize(std::max<size_t>(1, create_info.max_frames_in_flight), nullptr);
+    frame_garbage.resize(frame_fences.size());
+
+    vbos = new uvre::gl33::VBOBinding;
     vbos->index = 0;
     vbos->is_free = true;
     vbos->next = nullptr;
@@ -145,88 +437,138 @@ uvre::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_in
     }
 }
 
-uvre::RenderDeviceImpl::~RenderDeviceImpl()
+uvre::gl33::RenderDeviceImpl::~RenderDeviceImpl()
 {
-    for(uvre::CommandListImpl *commandlist : commandlists)
+    // Whatever is dropped by now goes right
+    // away, shaders might need the worker.
+    for(std::vector<std::function<void()>> &garbage : frame_garbage)
+        collectGarbage(garbage);
+    collectDropped(this);
+
+    // Handles dropped after this are only freed,
+    // the ones that got in just before still go.
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->device = nullptr;
+    }
+    collectDropped(this);
+
+    delete worker;
+
+    for(uvre::gl33::CommandListImpl *commandlist : commandlists)
         delete commandlist;
+    for(GLsync fence : frame_fences)
+        glDeleteSync(fence);
+    for(const uvre::gl33::PackBuffer &pack_buffer : pack_buffers)
+        deletePackBuffer(this, pack_buffer);
+    if(readback_fbo)
+        glDeleteFramebuffers(1, &readback_fbo);
 
     pipelines.clear();
     buffers.clear();
     commandlists.clear();
+    shader_cache.clear();
+    pipeline_cache.clear();
+    sampler_cache.clear();
 
     // Make sure that the GL context doesn't use it anymore
     glDisable(GL_DEBUG_OUTPUT);
     glDebugMessageCallback(nullptr, nullptr);
 }
 
-const uvre::DeviceInfo &uvre::RenderDeviceImpl::getInfo() const
+const uvre::DeviceInfo &uvre::gl33::RenderDeviceImpl::getInfo() const
 {
     return info;
 }
 
-uvre::Shader uvre::RenderDeviceImpl::createShader(const uvre::ShaderCreateInfo &info)
+uvre::MemoryStats uvre::gl33::RenderDeviceImpl::getMemoryStats()
 {
-    std::stringstream ss;
-    ss << "#version 330 core" << std::endl;
-    ss << "#define _UVRE_ 1" << std::endl;
+    std::lock_guard<std::mutex> lock(memory_mutex);
+    return memory_stats;
+}
+
+uint64_t uvre::gl33::RenderDeviceImpl::getLastUsedFrame(const uvre::Texture &texture)
+{
+    return texture ? uvre::gl33::impl(texture)->last_used_frame : 0;
+}
+
+static uvre::Shader prepareShader(uvre::gl33::RenderDeviceImpl *device, const uvre::ShaderCreateInfo &info)
+{
+    std::string source = "#version 330 core\n#define _UVRE_ 1\n";
 
-    uint32_t stage = 0;
     switch(info.stage) {
         case uvre::ShaderStage::VERTEX:
-            stage = GL_VERTEX_SHADER;
-            ss << "#define _VERTEX_SHADER_ 1" << std::endl;
+            source += "#define _VERTEX_SHADER_ 1\n";
             break;
         case uvre::ShaderStage::FRAGMENT:
-            stage = GL_FRAGMENT_SHADER;
-            ss << "#define _FRAGMENT_SHADER_ 1" << std::endl;
+            source += "#define _FRAGMENT_SHADER_ 1\n";
             break;
+        default:
+            // Compute shaders are GL 4.3+
+            return nullptr;
     }
 
-    int32_t status, info_log_length;
-    std::string info_log;
-    uint32_t shobj = glCreateShader(stage);
-    const char *source_cstr;
-    std::string source;
-
     switch(info.format) {
         case uvre::ShaderFormat::SOURCE_GLSL:
-            ss << "#define _GLSL_ 1" << std::endl;
-            source = ss.str() + reinterpret_cast<const char *>(info.code);
-            source_cstr = source.c_str();
-            glShaderSource(shobj, 1, &source_cstr, nullptr);
-            glCompileShader(shobj);
+            source += "#define _GLSL_ 1\n";
+            if(!uvre::gl33::preprocessShader(device, info, source))
+                return nullptr;
             break;
         default:
-            glDeleteShader(shobj);
             return nullptr;
     }
 
-    if(create_info.onDebugMessage) {
-        glGetShaderiv(shobj, GL_INFO_LOG_LENGTH, &info_log_length);
-        if(info_log_length > 1) {
-            info_log.resize(info_log_length);
-            glGetShaderInfoLog(shobj, static_cast<GLsizei>(info_log.size()), nullptr, &info_log[0]);
+    uint64_t key = uvre::gl33::hashBytes(device->driver_hash, &info.stage, sizeof(info.stage));
+    key = uvre::gl33::hashBytes(key, source.data(), source.size());
 
-            uvre::DebugMessageInfo msg = {};
-            msg.level = uvre::DebugMessageLevel::INFO;
-            msg.text = info_log.c_str();
-            create_info.onDebugMessage(msg);
-        }
-    }
+    // The hash only names the program binaries, the
+    // dedupe goes by the source (the stage is in it).
+    std::string cache_key = source;
 
-    glGetShaderiv(shobj, GL_COMPILE_STATUS, &status);
-    if(!status) {
-        glDeleteShader(shobj);
-        return nullptr;
+    // Identical requests share the same object
+    std::unordered_map<std::string, std::weak_ptr<uvre::gl33::Shader_S>>::const_iterator it = device->shader_cache.find(cache_key);
+    if(it != device->shader_cache.cend()) {
+        uvre::Shader existing = it->second.lock();
+        if(existing)
+            return existing;
     }
 
-    uvre::Shader shader(new uvre::Shader_S, destroyShader);
-    shader->shader = shobj;
+    std::shared_ptr<uvre::gl33::Shader_S> shader(new uvre::gl33::Shader_S, deferDestroy(device, destroyShader));
+    shader->shader = 0;
+    shader->key = key;
+    shader->id = ++device->next_shader_id;
+    shader->cache_key = std::move(cache_key);
     shader->stage = info.stage;
+    shader->source = std::move(source);
+    shader->pending = false;
+    device->shader_cache[shader->cache_key] = shader;
+    return shader;
+}
+
+uvre::Shader uvre::gl33::RenderDeviceImpl::createShader(const uvre::ShaderCreateInfo &info)
+{
+    // With the program cache enabled the compilation
+    // is deferred until a pipeline actually misses
+    // the cache. Otherwise we compile right away.
+    uvre::Shader shader = prepareShader(this, info);
+    if(!shader || (shader_cache_dir.empty() && !compileShader(this, uvre::gl33::impl(shader))))
+        return nullptr;
+    return shader;
+}
 
+uvre::Shader uvre::gl33::RenderDeviceImpl::createShaderAsync(const uvre::ShaderCreateInfo &info)
+{
+    uvre::Shader shader = prepareShader(this, info);
+    if(shader && shader_cache_dir.empty() && !uvre::gl33::impl(shader)->shader && !uvre::gl33::impl(shader)->source.empty())
+        startShader(uvre::gl33::impl(shader));
     return shader;
 }
 
+bool uvre::gl33::RenderDeviceImpl::isReady(const uvre::Shader &shader)
+{
+    return !shader || finishShader(this, uvre::gl33::impl(shader), false);
+}
+
 static inline uint32_t getBlendEquation(uvre::BlendEquation equation)
 {
     switch(equation) {
@@ -382,7 +724,7 @@ static inline uint32_t getFillMode(uvre::FillMode mode)
     }
 }
 
-static inline void setVertexFormat(uvre::VertexArray_S *vao, const uvre::Pipeline_S *pipeline)
+static inline void setVertexFormat(uvre::gl33::VertexArray_S *vao, const uvre::gl33::Pipeline_S *pipeline)
 {
     if(vao && vao != &dummy_vao) {
         glBindVertexArray(vao->vaobj);
@@ -403,15 +745,15 @@ static inline void setVertexFormat(uvre::VertexArray_S *vao, const uvre::Pipelin
     }
 }
 
-static inline uvre::VertexArray_S *getVertexArray(uvre::VertexArray_S **head, uint32_t index, const uvre::Pipeline_S *pipeline)
+static inline uvre::gl33::VertexArray_S *getVertexArray(uvre::gl33::VertexArray_S **head, uint32_t index, const uvre::gl33::Pipeline_S *pipeline)
 {
-    for(uvre::VertexArray_S *node = *head; node; node = node->next) {
+    for(uvre::gl33::VertexArray_S *node = *head; node; node = node->next) {
         if(index != node->index)
             continue;
         return node;
     }
 
-    uvre::VertexArray_S *next = new uvre::VertexArray_S;
+    uvre::gl33::VertexArray_S *next = new uvre::gl33::VertexArray_S;
     next->index = (*head)->index + 1;
     glGenVertexArrays(1, &next->vaobj);
     next->vbobj = 0;
@@ -421,16 +763,33 @@ static inline uvre::VertexArray_S *getVertexArray(uvre::VertexArray_S **head, ui
     return next;
 }
 
-uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreateInfo &info)
+static bool finishPipeline(uvre::gl33::RenderDeviceImpl *device, uvre::gl33::Pipeline_S *pipeline, bool wait)
 {
-    uvre::Pipeline pipeline(new uvre::Pipeline_S, std::bind(destroyPipeline, std::placeholders::_1, this));
+    uvre::gl33::PendingPipeline_S *pending = pipeline->pending;
+    if(!pending)
+        return true;
+
+    if(pending->threaded) {
+        if(wait)
+            device->worker->wait();
+        GLsync fence = pending->fence;
+        if(!fence || glClientWaitSync(fence, 0, wait ? GL_TIMEOUT_IGNORED : 0) == GL_TIMEOUT_EXPIRED)
+            return false;
+        glDeleteSync(fence);
+        pending->fence = nullptr;
+    }
+    else if(!wait && device->parallel_compile) {
+        int32_t completed;
+        glGetProgramiv(pipeline->program, uvre::gl33::KHR_COMPLETION_STATUS, &completed);
+        if(!completed)
+            return false;
+    }
 
-    pipeline->program = glCreateProgram();
-    for(size_t i = 0; i < info.num_shaders; i++)
-        glAttachShader(pipeline->program, info.shaders[i]->shader);
-    glLinkProgram(pipeline->program);
+    // Report compilation errors if any
+    for(const uvre::Shader &shader : pending->shaders)
+        finishShader(device, uvre::gl33::impl(shader), true);
 
-    if(create_info.onDebugMessage) {
+    if(device->create_info.onDebugMessage) {
         int info_log_length;
         std::string info_log;
         glGetProgramiv(pipeline->program, GL_INFO_LOG_LENGTH, &info_log_length);
@@ -441,17 +800,152 @@ uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreate
             uvre::DebugMessageInfo msg = {};
             msg.level = uvre::DebugMessageLevel::INFO;
             msg.text = info_log.c_str();
-            create_info.onDebugMessage(msg);
+            device->create_info.onDebugMessage(msg);
         }
     }
 
+    // A failed pipeline stays alive with
+    // no program so that it renders nothing.
     int status;
     glGetProgramiv(pipeline->program, GL_LINK_STATUS, &status);
     if(!status) {
-        pipeline = nullptr;
+        glDeleteProgram(pipeline->program);
+        pipeline->program = 0;
+    }
+    else {
+        uvre::gl33::storeProgramBinary(device, pending->key, pipeline->program);
+    }
+
+    delete pending;
+    pipeline->pending = nullptr;
+    return true;
+}
+
+template<typename T>
+static inline void appendKey(std::string &key, const T &value)
+{
+    key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// Exact keys: a hash collision here
+// would silently hand out a wrong object.
+static std::string getPipelineKey(const uvre::PipelineCreateInfo &info)
+{
+    std::string key;
+    appendKey(key, info.blending.enabled);
+    appendKey(key, info.blending.equation);
+    appendKey(key, info.blending.sfactor);
+    appendKey(key, info.blending.dfactor);
+    appendKey(key, info.depth_testing.enabled);
+    appendKey(key, info.depth_testing.func);
+    appendKey(key, info.face_culling.enabled);
+    appendKey(key, info.face_culling.flags);
+    appendKey(key, info.scissor_test);
+    appendKey(key, info.index_type);
+    appendKey(key, info.primitive_mode);
+    appendKey(key, info.fill_mode);
+    appendKey(key, info.vertex_stride);
+
+    appendKey(key, info.num_vertex_attribs);
+    for(size_t i = 0; i < info.num_vertex_attribs; i++) {
+        appendKey(key, info.vertex_attribs[i].id);
+        appendKey(key, info.vertex_attribs[i].type);
+        appendKey(key, info.vertex_attribs[i].count);
+        appendKey(key, info.vertex_attribs[i].offset);
+        appendKey(key, info.vertex_attribs[i].normalized);
+    }
+
+    // Shader objects are identified by their unique
+    // id rather than by address which can be reused.
+    appendKey(key, info.num_shaders);
+    for(size_t i = 0; i < info.num_shaders; i++)
+        appendKey(key, info.shaders[i] ? uvre::gl33::impl(info.shaders[i])->id : UINT64_C(0));
+
+    return key;
+}
+
+uvre::Pipeline uvre::gl33::RenderDeviceImpl::createPipeline(const uvre::PipelineCreateInfo &info)
+{
+    uvre::Pipeline pipeline = createPipelineAsync(info);
+    if(!pipeline || !finishPipeline(this, uvre::gl33::impl(pipeline), true) || !uvre::gl33::impl(pipeline)->program)
         return nullptr;
+    return pipeline;
+}
+
+uvre::Pipeline uvre::gl33::RenderDeviceImpl::createPipelineAsync(const uvre::PipelineCreateInfo &info)
+{
+    std::string cache_key = getPipelineKey(info);
+    std::unordered_map<std::string, uvre::gl33::CacheEntry<uvre::gl33::Pipeline_S>>::iterator it = pipeline_cache.find(cache_key);
+    if(it != pipeline_cache.end()) {
+        uvre::Pipeline existing = it->second.handle.lock();
+        if(existing)
+            return existing;
+    }
+    else {
+        it = pipeline_cache.emplace(std::move(cache_key), uvre::gl33::CacheEntry<uvre::gl33::Pipeline_S>()).first;
     }
 
+    uint64_t key = driver_hash;
+    for(size_t i = 0; i < info.num_shaders; i++)
+        key = uvre::gl33::hashBytes(key, &uvre::gl33::impl(info.shaders[i])->key, sizeof(uvre::gl33::impl(info.shaders[i])->key));
+
+    uvre::gl33::PendingPipeline_S *pending = nullptr;
+    uint32_t program = glCreateProgram();
+    if(!uvre::gl33::loadProgramBinary(this, key, program)) {
+        // A program which binary has been rejected
+        // can still be linked the usual way.
+        if(!shader_cache_dir.empty())
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+        pending = new uvre::gl33::PendingPipeline_S;
+        pending->key = key;
+        pending->threaded = false;
+        pending->fence = nullptr;
+
+        for(size_t i = 0; i < info.num_shaders; i++) {
+            uvre::gl33::Shader_S *shader = uvre::gl33::impl(info.shaders[i]);
+            if(!shader->shader && !shader->source.empty())
+                startShader(shader);
+
+            if(!shader->shader) {
+                // Failed to compile earlier
+                glDeleteProgram(program);
+                delete pending;
+                return nullptr;
+            }
+
+            glAttachShader(program, shader->shader);
+            pending->shaders.push_back(info.shaders[i]);
+        }
+
+        if(worker && !parallel_compile) {
+            // The worker context won't see the objects
+            // until the commands creating them are flushed.
+            glFlush();
+
+            pending->threaded = true;
+            worker->push([program, pending]() {
+                glLinkProgram(program);
+                GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                glFlush();
+                pending->fence = fence;
+            });
+        }
+        else {
+            // Not querying anything here allows
+            // the driver to do its job in background.
+            glLinkProgram(program);
+        }
+    }
+
+    std::shared_ptr<uvre::gl33::Pipeline_S> pipeline(new uvre::gl33::Pipeline_S, deferDestroy(this, destroyPipeline));
+    pipeline->cache_key = &it->first;
+    it->second.users++;
+    it->second.object = pipeline.get();
+    it->second.handle = pipeline;
+    pipeline->program = program;
+    pipeline->pending = pending;
+
     pipeline->bound_ibo = 0;
     pipeline->bound_vao = 0;
     pipeline->blending.enabled = info.blending.enabled;
@@ -463,6 +957,7 @@ uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreate
     pipeline->face_culling.enabled = info.face_culling.enabled;
     pipeline->face_culling.front_face = (info.face_culling.flags & uvre::CULL_CLOCKWISE) ? GL_CW : GL_CCW;
     pipeline->face_culling.cull_face = getCullFace(info.face_culling.flags & uvre::CULL_BACK, info.face_culling.flags & uvre::CULL_FRONT);
+    pipeline->scissor_test = info.scissor_test;
     pipeline->index_size = getIndexSize(info.index_type);
     pipeline->index_type = getIndexType(info.index_type);
     pipeline->primitive_mode = getPrimitiveType(info.primitive_mode);
@@ -472,14 +967,14 @@ uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreate
     pipeline->attributes = new uvre::VertexAttrib[pipeline->num_attributes];
     std::copy(info.vertex_attribs, info.vertex_attribs + info.num_vertex_attribs, pipeline->attributes);
 
-    pipeline->vaos = new uvre::VertexArray_S;
+    pipeline->vaos = new uvre::gl33::VertexArray_S;
     pipeline->vaos->index = 0;
     glGenVertexArrays(1, &pipeline->vaos->vaobj);
     pipeline->vaos->next = nullptr;
     setVertexFormat(pipeline->vaos, pipeline.get());
 
     // Notify the buffers
-    for(uvre::Buffer_S *buffer : buffers) {
+    for(uvre::gl33::Buffer_S *buffer : buffers) {
         // offset is zero and that is hardcoded
         glBindVertexArray(getVertexArray(&pipeline->vaos, buffer->vbo->index / max_vbo_bindings, pipeline.get())->vaobj);
         glBindVertexBuffer(buffer->vbo->index % max_vbo_bindings, buffer->bufobj, 0, static_cast<GLsizei>(pipeline->vertex_stride));
@@ -491,15 +986,20 @@ uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreate
     return pipeline;
 }
 
-static uvre::VBOBinding *getFreeVBOBinding(uvre::VBOBinding **head)
+bool uvre::gl33::RenderDeviceImpl::isReady(const uvre::Pipeline &pipeline)
+{
+    return !pipeline || finishPipeline(this, uvre::gl33::impl(pipeline), false);
+}
+
+static uvre::gl33::VBOBinding *getFreeVBOBinding(uvre::gl33::VBOBinding **head)
 {
-    for(uvre::VBOBinding *node = *head; node; node = node->next) {
+    for(uvre::gl33::VBOBinding *node = *head; node; node = node->next) {
         if(!node->is_free)
             continue;
         return node;
     }
 
-    uvre::VBOBinding *next = new uvre::VBOBinding;
+    uvre::gl33::VBOBinding *next = new uvre::gl33::VBOBinding;
     next->index = (*head)->index + 1;
     next->is_free = true;
     next->next = *head;
@@ -507,21 +1007,22 @@ static uvre::VBOBinding *getFreeVBOBinding(uvre::VBOBinding **head)
     return next;
 }
 
-uvre::Buffer uvre::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &info)
+uvre::Buffer uvre::gl33::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &info)
 {
-    uvre::Buffer buffer(new uvre::Buffer_S, std::bind(destroyBuffer, std::placeholders::_1, this));
+    std::shared_ptr<uvre::gl33::Buffer_S> buffer(new uvre::gl33::Buffer_S, deferDestroy(this, destroyBuffer));
 
     glGenBuffers(1, &buffer->bufobj);
 
     buffer->size = info.size;
     buffer->vbo = nullptr;
+    buffer->upload_serial = 0;
 
     if(info.type == uvre::BufferType::VERTEX_BUFFER) {
         buffer->vbo = getFreeVBOBinding(&vbos);
         buffer->vbo->is_free = false;
 
         // Notify the pipeline objects
-        for(uvre::Pipeline_S *pipeline : pipelines) {
+        for(uvre::gl33::Pipeline_S *pipeline : pipelines) {
             // offset is zero and that is hardcoded
             glBindVertexArray(getVertexArray(&pipeline->vaos, buffer->vbo->index / max_vbo_bindings, pipeline)->vaobj);
             glBindVertexBuffer(buffer->vbo->index % max_vbo_bindings, buffer->bufobj, 0, static_cast<GLsizei>(pipeline->vertex_stride));
@@ -533,19 +1034,43 @@ uvre::Buffer uvre::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &
 
     glBindBuffer(GL_COPY_READ_BUFFER, buffer->bufobj);
     glBufferData(GL_COPY_READ_BUFFER, static_cast<GLsizeiptr>(buffer->size), info.data, GL_DYNAMIC_DRAW);
+    trackMemory(this, &uvre::MemoryStats::buffers, buffer->size);
     return buffer;
 }
 
-void uvre::RenderDeviceImpl::writeBuffer(uvre::Buffer buffer, size_t offset, size_t size, const void *data)
+void uvre::gl33::RenderDeviceImpl::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
 {
-    if(offset + size > buffer->size)
+    if(offset + size > uvre::gl33::impl(buffer)->size)
         return;
-    glBindBuffer(GL_COPY_READ_BUFFER, buffer->bufobj);
+    waitUpload(this, uvre::gl33::impl(buffer)->upload_serial);
+    glBindBuffer(GL_COPY_READ_BUFFER, uvre::gl33::impl(buffer)->bufobj);
     glBufferSubData(GL_COPY_READ_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
 }
 
-uvre::Sampler uvre::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInfo &info)
+static std::string getSamplerKey(const uvre::SamplerCreateInfo &info)
 {
+    std::string key;
+    appendKey(key, info.flags);
+    appendKey(key, info.aniso_level);
+    appendKey(key, info.min_lod);
+    appendKey(key, info.max_lod);
+    appendKey(key, info.lod_bias);
+    return key;
+}
+
+uvre::Sampler uvre::gl33::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInfo &info)
+{
+    std::string key = getSamplerKey(info);
+    std::unordered_map<std::string, uvre::gl33::CacheEntry<uvre::gl33::Sampler_S>>::iterator it = sampler_cache.find(key);
+    if(it != sampler_cache.end()) {
+        uvre::Sampler existing = it->second.handle.lock();
+        if(existing)
+            return existing;
+    }
+    else {
+        it = sampler_cache.emplace(std::move(key), uvre::gl33::CacheEntry<uvre::gl33::Sampler_S>()).first;
+    }
+
     uint32_t ssobj;
     glGenSamplers(1, &ssobj);
 
@@ -566,8 +1091,12 @@ uvre::Sampler uvre::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInf
     glSamplerParameterf(ssobj, GL_TEXTURE_MAX_LOD, info.max_lod);
     glSamplerParameterf(ssobj, GL_TEXTURE_LOD_BIAS, info.lod_bias);
 
-    uvre::Sampler sampler(new uvre::Sampler_S, destroySampler);
+    std::shared_ptr<uvre::gl33::Sampler_S> sampler(new uvre::gl33::Sampler_S, deferDestroy(this, destroySampler));
     sampler->ssobj = ssobj;
+    sampler->cache_key = &it->first;
+    it->second.users++;
+    it->second.object = sampler.get();
+    it->second.handle = sampler;
 
     return sampler;
 }
@@ -666,47 +1195,155 @@ static inline uint32_t getInternalFormat(uvre::PixelFormat format)
     }
 }
 
-uvre::Texture uvre::RenderDeviceImpl::createTexture(const uvre::TextureCreateInfo &info)
+static inline size_t getPixelSize(uvre::PixelFormat format)
+{
+    switch(format) {
+        case uvre::PixelFormat::R8_UNORM:
+        case uvre::PixelFormat::R8_SINT:
+        case uvre::PixelFormat::R8_UINT:
+        case uvre::PixelFormat::S8_UINT:
+            return 1;
+        case uvre::PixelFormat::R8G8_UNORM:
+        case uvre::PixelFormat::R8G8_SINT:
+        case uvre::PixelFormat::R8G8_UINT:
+        case uvre::PixelFormat::R16_UNORM:
+        case uvre::PixelFormat::R16_SINT:
+        case uvre::PixelFormat::R16_UINT:
+        case uvre::PixelFormat::R16_FLOAT:
+        case uvre::PixelFormat::D16_UNORM:
+            return 2;
+        case uvre::PixelFormat::R8G8B8_UNORM:
+        case uvre::PixelFormat::R8G8B8_SINT:
+        case uvre::PixelFormat::R8G8B8_UINT:
+            return 3;
+        case uvre::PixelFormat::R8G8B8A8_UNORM:
+        case uvre::PixelFormat::R8G8B8A8_SINT:
+        case uvre::PixelFormat::R8G8B8A8_UINT:
+        case uvre::PixelFormat::R16G16_UNORM:
+        case uvre::PixelFormat::R16G16_SINT:
+        case uvre::PixelFormat::R16G16_UINT:
+        case uvre::PixelFormat::R16G16_FLOAT:
+        case uvre::PixelFormat::R32_SINT:
+        case uvre::PixelFormat::R32_UINT:
+        case uvre::PixelFormat::R32_FLOAT:
+        case uvre::PixelFormat::D32_FLOAT:
+            return 4;
+        case uvre::PixelFormat::R16G16B16_UNORM:
+        case uvre::PixelFormat::R16G16B16_SINT:
+        case uvre::PixelFormat::R16G16B16_UINT:
+        case uvre::PixelFormat::R16G16B16_FLOAT:
+            return 6;
+        case uvre::PixelFormat::R16G16B16A16_UNORM:
+        case uvre::PixelFormat::R16G16B16A16_SINT:
+        case uvre::PixelFormat::R16G16B16A16_UINT:
+        case uvre::PixelFormat::R16G16B16A16_FLOAT:
+        case uvre::PixelFormat::R32G32_SINT:
+        case uvre::PixelFormat::R32G32_UINT:
+        case uvre::PixelFormat::R32G32_FLOAT:
+            return 8;
+        case uvre::PixelFormat::R32G32B32_SINT:
+        case uvre::PixelFormat::R32G32B32_UINT:
+        case uvre::PixelFormat::R32G32B32_FLOAT:
+            return 12;
+        case uvre::PixelFormat::R32G32B32A32_SINT:
+        case uvre::PixelFormat::R32G32B32A32_UINT:
+        case uvre::PixelFormat::R32G32B32A32_FLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+
+// Cube maps have six faces and arrays
+// have the same layer count on every level.
+static size_t getTextureSize(const uvre::TextureCreateInfo &info, size_t mip_levels)
+{
+    size_t layers = 1;
+    if(info.type == uvre::TextureType::TEXTURE_CUBE)
+        layers = 6;
+    else if(info.type == uvre::TextureType::TEXTURE_ARRAY)
+        layers = static_cast<size_t>(std::max(0, info.depth));
+
+    size_t pixels = 0;
+    int width = std::max(1, info.width);
+    int height = std::max(1, info.height);
+    for(size_t i = 0; i < mip_levels; i++) {
+        pixels += static_cast<size_t>(width) * static_cast<size_t>(height);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    return pixels * layers * getPixelSize(info.format);
+}
+
+uvre::Texture uvre::gl33::RenderDeviceImpl::createTexture(const uvre::TextureCreateInfo &info)
 {
     uint32_t texobj;
     uint32_t format = getInternalFormat(info.format);
     uint32_t target;
     int32_t mip_levels = std::max<int32_t>(1, static_cast<int32_t>(info.mip_levels));
 
-    // TODO: account mip levels somehow
-
+    // Every level is allocated up front
+    // so each of them can be written later.
     glGenTextures(1, &texobj);
     switch(info.type) {
         case uvre::TextureType::TEXTURE_2D:
             target = GL_TEXTURE_2D;
             glBindTexture(target, texobj);
-            glTexImage2D(target, 0, format, info.width, info.height, 0, GL_RED, GL_FLOAT, nullptr);
+            for(int32_t i = 0; i < mip_levels; i++)
+                glTexImage2D(target, i, format, std::max(1, info.width >> i), std::max(1, info.height >> i), 0, GL_RED, GL_FLOAT, nullptr);
             break;
         case uvre::TextureType::TEXTURE_CUBE:
             target = GL_TEXTURE_CUBE_MAP;
             glBindTexture(target, texobj);
-            glTexImage2D(target, 0, format, info.width, info.height, 0, GL_RED, GL_FLOAT, nullptr);
+            for(int32_t i = 0; i < mip_levels; i++) {
+                for(uint32_t face = 0; face < 6; face++)
+                    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, i, format, std::max(1, info.width >> i), std::max(1, info.height >> i), 0, GL_RED, GL_FLOAT, nullptr);
+            }
             break;
         case uvre::TextureType::TEXTURE_ARRAY:
             target = GL_TEXTURE_2D_ARRAY;
             glBindTexture(target, texobj);
-            glTexImage3D(target, 0, format, info.width, info.height, info.depth, 0, GL_RED, GL_FLOAT, nullptr);
+            for(int32_t i = 0; i < mip_levels; i++)
+                glTexImage3D(target, i, format, std::max(1, info.width >> i), std::max(1, info.height >> i), info.depth, 0, GL_RED, GL_FLOAT, nullptr);
             break;
         default:
             return nullptr;
     }
 
-    uvre::Texture texture(new uvre::Texture_S, destroyTexture);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, mip_levels - 1);
+
+    std::shared_ptr<uvre::gl33::Texture_S> texture(new uvre::gl33::Texture_S, deferDestroy(this, destroyTexture));
     texture->texobj = texobj;
     texture->format = format;
     texture->target = target;
     texture->width = info.width;
     texture->height = info.height;
     texture->depth = info.depth;
+    texture->upload_serial = 0;
+    texture->last_used_frame = 0;
+    texture->mip_levels = static_cast<size_t>(mip_levels);
+    texture->memory_size = getTextureSize(info, texture->mip_levels);
+    trackMemory(this, &uvre::MemoryStats::textures, texture->memory_size);
 
     return texture;
 }
 
+uvre::Texture uvre::gl33::RenderDeviceImpl::createTextureView(const uvre::TextureViewCreateInfo &)
+{
+    // Views are GL 4.3 and need immutable
+    // storage which GL 3.3 textures lack.
+    if(create_info.onDebugMessage) {
+        uvre::DebugMessageInfo msg = {};
+        msg.level = uvre::DebugMessageLevel::ERROR;
+        msg.text = "GL33: texture views are not supported";
+        create_info.onDebugMessage(msg);
+    }
+
+    return nullptr;
+}
+
 static bool getExternalFormat(uvre::PixelFormat format, uint32_t &fmt, uint32_t &type)
 {
     switch(format) {
@@ -820,34 +1457,173 @@ static bool getExternalFormat(uvre::PixelFormat format, uint32_t &fmt, uint32_t
     return true;
 }
 
-void uvre::RenderDeviceImpl::writeTexture2D(uvre::Texture texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data)
+void uvre::gl33::RenderDeviceImpl::writeTexture2D(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
 {
     uint32_t fmt, type;
     if(!getExternalFormat(format, fmt, type))
         return;
-    glBindTexture(GL_TEXTURE_2D, texture->texobj);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, fmt, type, data);
+    waitUpload(this, uvre::gl33::impl(texture)->upload_serial);
+    glBindTexture(GL_TEXTURE_2D, uvre::gl33::impl(texture)->texobj);
+    glTexSubImage2D(GL_TEXTURE_2D, level, x, y, w, h, fmt, type, data);
 }
 
-void uvre::RenderDeviceImpl::writeTextureCube(uvre::Texture texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data)
+void uvre::gl33::RenderDeviceImpl::writeTextureCube(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
 {
     uint32_t fmt, type;
     if(!getExternalFormat(format, fmt, type))
         return;
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture->texobj);
-    glTexSubImage3D(GL_TEXTURE_CUBE_MAP, 0, x, y, face, w, h, 1, fmt, type, data);
+    waitUpload(this, uvre::gl33::impl(texture)->upload_serial);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, uvre::gl33::impl(texture)->texobj);
+    glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, x, y, w, h, fmt, type, data);
 }
 
-void uvre::RenderDeviceImpl::writeTextureArray(uvre::Texture texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data)
+void uvre::gl33::RenderDeviceImpl::writeTextureArray(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
 {
     uint32_t fmt, type;
     if(!getExternalFormat(format, fmt, type))
         return;
-    glBindTexture(GL_TEXTURE_2D_ARRAY, texture->texobj);
-    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, z, w, h, d, fmt, type, data);
+    waitUpload(this, uvre::gl33::impl(texture)->upload_serial);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, uvre::gl33::impl(texture)->texobj);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x, y, z, w, h, d, fmt, type, data);
+}
+
+void uvre::gl33::RenderDeviceImpl::setTextureBaseLevel(const uvre::Texture &texture, int level)
+{
+    glBindTexture(uvre::gl33::impl(texture)->target, uvre::gl33::impl(texture)->texobj);
+    glTexParameteri(uvre::gl33::impl(texture)->target, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+// The worker publishes an upload once the
+// GPU is done with it, after the ones before.
+static void queueUpload(uvre::gl33::RenderDeviceImpl *device, uint64_t &upload_serial, std::function<void()> upload)
+{
+    // The worker context won't see the objects
+    // until the commands creating them are flushed.
+    glFlush();
+
+    const uint64_t serial = ++device->uploads_queued;
+    upload_serial = serial;
+    device->worker->push([device, serial, upload = std::move(upload)]() {
+        upload();
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        device->uploads_done = serial;
+    });
+}
+
+// Rows are read 4-byte aligned, the
+// padding after the last one is not.
+static std::vector<uint8_t> copyPixels(uint32_t fmt, uint32_t type, int w, int h, int d, const void *data)
+{
+    const size_t components = (fmt == GL_RED) ? 1 : ((fmt == GL_RG) ? 2 : ((fmt == GL_RGB) ? 3 : 4));
+    const size_t component_size = (type == GL_BYTE || type == GL_UNSIGNED_BYTE) ? 1 : ((type == GL_SHORT || type == GL_UNSIGNED_SHORT) ? 2 : 4);
+    const size_t row = static_cast<size_t>(std::max(0, w)) * components * component_size;
+    const size_t rows = static_cast<size_t>(std::max(0, h)) * static_cast<size_t>(std::max(0, d));
+    if(!data || !row || !rows)
+        return std::vector<uint8_t>();
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    return std::vector<uint8_t>(bytes, bytes + ((row + 3) & ~static_cast<size_t>(3)) * (rows - 1) + row);
 }
 
-uvre::RenderTarget uvre::RenderDeviceImpl::createRenderTarget(const uvre::RenderTargetCreateInfo &info)
+uvre::Buffer uvre::gl33::RenderDeviceImpl::createBufferAsync(const uvre::BufferCreateInfo &info)
+{
+    if(!worker || !info.data)
+        return createBuffer(info);
+
+    uvre::BufferCreateInfo storage_info = info;
+    storage_info.data = nullptr;
+
+    uvre::Buffer buffer = createBuffer(storage_info);
+    writeBufferAsync(buffer, 0, info.size, info.data);
+    return buffer;
+}
+
+void uvre::gl33::RenderDeviceImpl::writeBufferAsync(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    uvre::gl33::Buffer_S *glbuffer = uvre::gl33::impl(buffer);
+    if(!worker || offset + size > glbuffer->size) {
+        writeBuffer(buffer, offset, size, data);
+        return;
+    }
+
+    const uint32_t bufobj = glbuffer->bufobj;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    queueUpload(this, glbuffer->upload_serial, [bufobj, offset, copy = std::vector<uint8_t>(bytes, bytes + size)]() {
+        glBindBuffer(GL_COPY_READ_BUFFER, bufobj);
+        glBufferSubData(GL_COPY_READ_BUFFER, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(copy.size()), copy.data());
+    });
+}
+
+void uvre::gl33::RenderDeviceImpl::writeTexture2DAsync(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    uint32_t fmt, type;
+    if(!worker || !getExternalFormat(format, fmt, type)) {
+        writeTexture2D(texture, x, y, w, h, format, data, level);
+        return;
+    }
+
+    const uint32_t texobj = uvre::gl33::impl(texture)->texobj;
+    queueUpload(this, uvre::gl33::impl(texture)->upload_serial, [texobj, level, x, y, w, h, fmt, type, copy = copyPixels(fmt, type, w, h, 1, data)]() {
+        glBindTexture(GL_TEXTURE_2D, texobj);
+        glTexSubImage2D(GL_TEXTURE_2D, level, x, y, w, h, fmt, type, copy.data());
+    });
+}
+
+void uvre::gl33::RenderDeviceImpl::writeTextureCubeAsync(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    uint32_t fmt, type;
+    if(!worker || !getExternalFormat(format, fmt, type)) {
+        writeTextureCube(texture, face, x, y, w, h, format, data, level);
+        return;
+    }
+
+    const uint32_t texobj = uvre::gl33::impl(texture)->texobj;
+    queueUpload(this, uvre::gl33::impl(texture)->upload_serial, [texobj, level, face, x, y, w, h, fmt, type, copy = copyPixels(fmt, type, w, h, 1, data)]() {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, texobj);
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, x, y, w, h, fmt, type, copy.data());
+    });
+}
+
+void uvre::gl33::RenderDeviceImpl::writeTextureArrayAsync(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
+{
+    uint32_t fmt, type;
+    if(!worker || !getExternalFormat(format, fmt, type)) {
+        writeTextureArray(texture, x, y, z, w, h, d, format, data, level);
+        return;
+    }
+
+    const uint32_t texobj = uvre::gl33::impl(texture)->texobj;
+    queueUpload(this, uvre::gl33::impl(texture)->upload_serial, [texobj, level, x, y, z, w, h, d, fmt, type, copy = copyPixels(fmt, type, w, h, d, data)]() {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texobj);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, x, y, z, w, h, d, fmt, type, copy.data());
+    });
+}
+
+bool uvre::gl33::RenderDeviceImpl::isReady(const uvre::Buffer &buffer)
+{
+    return !buffer || uvre::gl33::impl(buffer)->upload_serial <= uploads_done;
+}
+
+bool uvre::gl33::RenderDeviceImpl::isReady(const uvre::Texture &texture)
+{
+    return !texture || uvre::gl33::impl(texture)->upload_serial <= uploads_done;
+}
+
+static size_t getAttachmentSize(const uvre::RenderTargetCreateInfo &info)
+{
+    size_t size = 0;
+    if(info.depth_attachment)
+        size += uvre::gl33::impl(info.depth_attachment)->memory_size;
+    if(info.stencil_attachment && info.stencil_attachment != info.depth_attachment)
+        size += uvre::gl33::impl(info.stencil_attachment)->memory_size;
+    for(size_t i = 0; i < info.num_color_attachments; i++)
+        size += uvre::gl33::impl(info.color_attachments[i].color)->memory_size;
+    return size;
+}
+
+uvre::RenderTarget uvre::gl33::RenderDeviceImpl::createRenderTarget(const uvre::RenderTargetCreateInfo &info)
 {
     uint32_t fbobj;
     glGenFramebuffers(1, &fbobj);
@@ -855,33 +1631,72 @@ uvre::RenderTarget uvre::RenderDeviceImpl::createRenderTarget(const uvre::Render
     glBindFramebuffer(GL_FRAMEBUFFER, fbobj);
 
     if(info.depth_attachment)
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, info.depth_attachment->texobj, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, uvre::gl33::impl(info.depth_attachment)->texobj, 0);
     if(info.stencil_attachment)
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, info.stencil_attachment->texobj, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_TEXTURE_2D, uvre::gl33::impl(info.stencil_attachment)->texobj, 0);
     for(size_t i = 0; i < info.num_color_attachments; i++)
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + info.color_attachments[i].id, GL_TEXTURE_2D, info.color_attachments[i].color->texobj, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + info.color_attachments[i].id, GL_TEXTURE_2D, uvre::gl33::impl(info.color_attachments[i].color)->texobj, 0);
 
     if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         glDeleteFramebuffers(1, &fbobj);
         return nullptr;
     }
 
-    uvre::RenderTarget target(new uvre::RenderTarget_S, destroyRenderTarget);
+    std::shared_ptr<uvre::gl33::RenderTarget_S> target(new uvre::gl33::RenderTarget_S, deferDestroy(this, destroyRenderTarget));
     target->fbobj = fbobj;
+    target->memory_size = getAttachmentSize(info);
+    trackMemory(this, &uvre::MemoryStats::render_targets, target->memory_size);
 
     return target;
 }
 
-uvre::ICommandList *uvre::RenderDeviceImpl::createCommandList()
+static void addBufferRanges(uvre::gl33::ResourceSet_S *set, size_t count, const uvre::BufferRange *ranges, std::vector<uint32_t> &buffers, std::vector<GLintptr> &offsets, std::vector<GLsizeiptr> &sizes)
+{
+    for(size_t i = 0; i < count; i++) {
+        const uvre::Buffer &buffer = ranges[i].buffer;
+        const size_t size = (buffer && !ranges[i].size) ? uvre::gl33::impl(buffer)->size - ranges[i].offset : ranges[i].size;
+        buffers.push_back(buffer ? uvre::gl33::impl(buffer)->bufobj : 0);
+        offsets.push_back(static_cast<GLintptr>(ranges[i].offset));
+        sizes.push_back(static_cast<GLsizeiptr>(size));
+        set->objects.push_back(buffer);
+    }
+}
+
+uvre::ResourceSet uvre::gl33::RenderDeviceImpl::createResourceSet(const uvre::ResourceSetCreateInfo &info)
 {
-    uvre::CommandListImpl *commands = new uvre::CommandListImpl();
+    std::shared_ptr<uvre::gl33::ResourceSet_S> set(new uvre::gl33::ResourceSet_S, deferDestroy(this, destroyResourceSet));
+
+    for(size_t i = 0; i < info.num_textures; i++) {
+        const uvre::Texture &texture = info.textures[i];
+        set->textures.push_back(texture ? uvre::gl33::impl(texture)->texobj : 0);
+        set->texture_targets.push_back(texture ? uvre::gl33::impl(texture)->target : GL_TEXTURE_2D);
+        set->objects.push_back(texture);
+        if(texture)
+            set->texture_objects.push_back(uvre::gl33::impl(texture));
+    }
+
+    for(size_t i = 0; i < info.num_samplers; i++) {
+        const uvre::Sampler &sampler = info.samplers[i];
+        set->samplers.push_back(sampler ? uvre::gl33::impl(sampler)->ssobj : 0);
+        set->objects.push_back(sampler);
+    }
+
+    addBufferRanges(set.get(), info.num_uniform_buffers, info.uniform_buffers, set->uniform_buffers, set->uniform_offsets, set->uniform_sizes);
+    addBufferRanges(set.get(), info.num_storage_buffers, info.storage_buffers, set->storage_buffers, set->storage_offsets, set->storage_sizes);
+
+    return set;
+}
+
+uvre::ICommandList *uvre::gl33::RenderDeviceImpl::createCommandList()
+{
+    uvre::gl33::CommandListImpl *commands = new uvre::gl33::CommandListImpl();
     commandlists.push_back(commands);
     return commands;
 }
 
-void uvre::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
+void uvre::gl33::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
 {
-    for(std::vector<uvre::CommandListImpl *>::const_iterator it = commandlists.cbegin(); it != commandlists.cend(); it++) {
+    for(std::vector<uvre::gl33::CommandListImpl *>::const_iterator it = commandlists.cbegin(); it != commandlists.cend(); it++) {
         if(*it == commands) {
             commandlists.erase(it);
             delete commands;
@@ -890,37 +1705,43 @@ void uvre::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
     }
 }
 
-void uvre::RenderDeviceImpl::startRecording(uvre::ICommandList *commands)
+void uvre::gl33::RenderDeviceImpl::startRecording(uvre::ICommandList *commands)
 {
-    uvre::CommandListImpl *glcommands = static_cast<uvre::CommandListImpl *>(commands);
+    uvre::gl33::CommandListImpl *glcommands = static_cast<uvre::gl33::CommandListImpl *>(commands);
     glcommands->num_commands = 0;
+    glcommands->used_textures.clear();
 }
 
-void uvre::RenderDeviceImpl::submit(uvre::ICommandList *commands)
+void uvre::gl33::RenderDeviceImpl::submit(uvre::ICommandList *commands)
 {
     int32_t last_binding;
-    uvre::CommandListImpl *glcommands = static_cast<uvre::CommandListImpl *>(commands);
+    uvre::gl33::CommandListImpl *glcommands = static_cast<uvre::gl33::CommandListImpl *>(commands);
+    // Residency managers want to know this
+    for(uvre::gl33::Texture_S *texture : glcommands->used_textures)
+        texture->last_used_frame = frame_number + 1;
+
     for(size_t i = 0; i < glcommands->num_commands; i++) {
-        const uvre::Command &cmd = glcommands->commands[i];
-        uvre::VertexArray_S *vaonode = nullptr;
+        const uvre::gl33::Command &cmd = glcommands->commands[i];
+        uvre::gl33::VertexArray_S *vaonode = nullptr;
         switch(cmd.type) {
-            case uvre::CommandType::SET_SCISSOR:
+            case uvre::gl33::CommandType::SET_SCISSOR:
                 glScissor(cmd.scvp.x, cmd.scvp.y, cmd.scvp.w, cmd.scvp.h);
                 break;
-            case uvre::CommandType::SET_VIEWPORT:
+            case uvre::gl33::CommandType::SET_VIEWPORT:
                 glViewport(cmd.scvp.x, cmd.scvp.y, cmd.scvp.w, cmd.scvp.h);
                 break;
-            case uvre::CommandType::SET_CLEAR_DEPTH:
+            case uvre::gl33::CommandType::SET_CLEAR_DEPTH:
                 glClearDepth(static_cast<GLdouble>(cmd.depth));
                 break;
-            case uvre::CommandType::SET_CLEAR_COLOR:
+            case uvre::gl33::CommandType::SET_CLEAR_COLOR:
                 glClearColor(cmd.color[0], cmd.color[1], cmd.color[2], cmd.color[3]);
                 break;
-            case uvre::CommandType::CLEAR:
+            case uvre::gl33::CommandType::CLEAR:
                 glClear(cmd.clear_mask);
                 break;
-            case uvre::CommandType::BIND_PIPELINE:
-                bound_pipeline = cmd.pipeline;
+            case uvre::gl33::CommandType::BIND_PIPELINE:
+                finishPipeline(this, cmd.pipeline, true);
+                bound_pipeline = *cmd.pipeline;
                 glDisable(GL_BLEND);
                 glDisable(GL_DEPTH_TEST);
                 glDisable(GL_CULL_FACE);
@@ -944,13 +1765,13 @@ void uvre::RenderDeviceImpl::submit(uvre::ICommandList *commands)
                 glPolygonMode(GL_FRONT_AND_BACK, bound_pipeline.fill_mode);
                 glUseProgram(bound_pipeline.program);
                 break;
-            case uvre::CommandType::BIND_UNIFORM_BUFFER:
+            case uvre::gl33::CommandType::BIND_UNIFORM_BUFFER:
                 glBindBufferBase(GL_UNIFORM_BUFFER, cmd.bind_index, cmd.object);
                 break;
-            case uvre::CommandType::BIND_INDEX_BUFFER: // OPTIMIZE
+            case uvre::gl33::CommandType::BIND_INDEX_BUFFER: // OPTIMIZE
                 bound_pipeline.bound_ibo = cmd.object;
                 break;
-            case uvre::CommandType::BIND_VERTEX_BUFFER: // OPTIMIZE
+            case uvre::gl33::CommandType::BIND_VERTEX_BUFFER: // OPTIMIZE
                 vaonode = getVertexArray(&bound_pipeline.vaos, cmd.buffer.vbo->index / max_vbo_bindings, &bound_pipeline);
                 if(vaonode->vaobj != bound_pipeline.bound_vao) {
                     bound_pipeline.bound_vao = vaonode->vaobj;
@@ -963,55 +1784,293 @@ void uvre::RenderDeviceImpl::submit(uvre::ICommandList *commands)
                     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bound_pipeline.bound_ibo);
                 }
                 break;
-            case uvre::CommandType::BIND_SAMPLER:
+            case uvre::gl33::CommandType::BIND_SAMPLER:
                 glBindSampler(cmd.bind_index, cmd.object);
                 break;
-            case uvre::CommandType::BIND_TEXTURE:
+            case uvre::gl33::CommandType::BIND_TEXTURE:
                 glActiveTexture(GL_TEXTURE0 + cmd.bind_index);
                 glBindTexture(cmd.tex_target, cmd.object);
                 break;
-            case uvre::CommandType::BIND_RENDER_TARGET:
+            case uvre::gl33::CommandType::BIND_RENDER_TARGET:
                 glBindFramebuffer(GL_FRAMEBUFFER, cmd.object);
                 break;
-            case uvre::CommandType::WRITE_BUFFER:
+            case uvre::gl33::CommandType::BIND_RESOURCE_SET:
+                // No GL_ARB_multi_bind here, so do it the hard way.
+                // Storage buffers are not supported at all.
+                for(size_t j = 0; j < cmd.set->textures.size(); j++) {
+                    glActiveTexture(static_cast<GLenum>(GL_TEXTURE0 + cmd.bind_index + j));
+                    glBindTexture(cmd.set->texture_targets[j], cmd.set->textures[j]);
+                }
+                for(size_t j = 0; j < cmd.set->samplers.size(); j++)
+                    glBindSampler(static_cast<GLuint>(cmd.bind_index + j), cmd.set->samplers[j]);
+                for(size_t j = 0; j < cmd.set->uniform_buffers.size(); j++) {
+                    if(cmd.set->uniform_buffers[j])
+                        glBindBufferRange(GL_UNIFORM_BUFFER, static_cast<GLuint>(cmd.bind_index + j), cmd.set->uniform_buffers[j], cmd.set->uniform_offsets[j], cmd.set->uniform_sizes[j]);
+                    else
+                        glBindBufferBase(GL_UNIFORM_BUFFER, static_cast<GLuint>(cmd.bind_index + j), 0);
+                }
+                break;
+            case uvre::gl33::CommandType::WRITE_BUFFER:
                 glBindBuffer(GL_COPY_READ_BUFFER, cmd.buffer_write.buffer);
                 glBufferSubData(GL_COPY_READ_BUFFER, static_cast<GLintptr>(cmd.buffer_write.offset), static_cast<GLsizeiptr>(cmd.buffer_write.size), cmd.buffer_write.data_ptr);
                 break;
-            case uvre::CommandType::COPY_RENDER_TARGET:
+            case uvre::gl33::CommandType::COPY_RENDER_TARGET:
                 glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_binding);
                 glBindFramebuffer(GL_READ_FRAMEBUFFER, cmd.rt_copy.src);
                 glBindFramebuffer(GL_DRAW_FRAMEBUFFER, cmd.rt_copy.dst);
                 glBlitFramebuffer(cmd.rt_copy.sx0, cmd.rt_copy.sy0, cmd.rt_copy.sx1, cmd.rt_copy.sy1, cmd.rt_copy.dx0, cmd.rt_copy.dy0, cmd.rt_copy.dx1, cmd.rt_copy.dy1, cmd.rt_copy.mask, cmd.rt_copy.filter);
                 glBindFramebuffer(GL_FRAMEBUFFER, static_cast<uint32_t>(last_binding));
                 break;
-            case uvre::CommandType::DRAW:
+            case uvre::gl33::CommandType::GENERATE_MIPMAPS:
+                glGetIntegerv((cmd.tex_target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_BINDING_CUBE_MAP : ((cmd.tex_target == GL_TEXTURE_2D_ARRAY) ? GL_TEXTURE_BINDING_2D_ARRAY : GL_TEXTURE_BINDING_2D), &last_binding);
+                glBindTexture(cmd.tex_target, cmd.object);
+                glGenerateMipmap(cmd.tex_target);
+                glBindTexture(cmd.tex_target, static_cast<uint32_t>(last_binding));
+                break;
+            case uvre::gl33::CommandType::BEGIN_QUERY:
+                glBeginQuery(cmd.query.target, cmd.query.qobj);
+                break;
+            case uvre::gl33::CommandType::END_QUERY:
+                glEndQuery(cmd.query.target);
+                break;
+            case uvre::gl33::CommandType::BEGIN_CONDITIONAL_RENDER:
+                glBeginConditionalRender(cmd.cond.qobj, cmd.cond.mode);
+                break;
+            case uvre::gl33::CommandType::END_CONDITIONAL_RENDER:
+                glEndConditionalRender();
+                break;
+            case uvre::gl33::CommandType::DRAW:
                 glDrawArraysInstancedBaseInstance(bound_pipeline.primitive_mode, cmd.draw.a.base_vertex, cmd.draw.a.vertices, cmd.draw.a.instances, cmd.draw.a.base_instance);
                 break;
-            case uvre::CommandType::IDRAW:
+            case uvre::gl33::CommandType::IDRAW:
                 glDrawElementsInstancedBaseVertexBaseInstance(bound_pipeline.primitive_mode, cmd.draw.e.indices, bound_pipeline.index_type, reinterpret_cast<const void *>(static_cast<uintptr_t>(bound_pipeline.index_size * cmd.draw.e.base_index)), cmd.draw.e.instances, cmd.draw.e.base_vertex, cmd.draw.e.base_instance);
                 break;
         }
     }
+
+    // Without frames there's nothing to wait
+    // for: GL keeps objects alive while the
+    // commands using them are still running.
+    // The list still points at whatever was
+    // dropped while recording it, hence after.
+    if(!frame_number)
+        collectDropped(this);
+}
+
+uvre::Fence uvre::gl33::RenderDeviceImpl::createFence()
+{
+    std::shared_ptr<uvre::gl33::Fence_S> fence(new uvre::gl33::Fence_S, deferDestroy(this, destroyFence));
+    fence->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return fence;
+}
+
+bool uvre::gl33::RenderDeviceImpl::waitFence(const uvre::Fence &fence, uint64_t timeout)
+{
+    // Flushing makes sure we don't wait
+    // for something that never reaches the GPU.
+    GLenum result = glClientWaitSync(uvre::gl33::impl(fence)->sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+uvre::Query uvre::gl33::RenderDeviceImpl::createQuery(uvre::QueryType type)
+{
+    uint32_t target;
+    switch(type) {
+        case uvre::QueryType::OCCLUSION:
+            target = GL_SAMPLES_PASSED;
+            break;
+        case uvre::QueryType::ANY_SAMPLES:
+            target = GL_ANY_SAMPLES_PASSED;
+            break;
+        default:
+            return nullptr;
+    }
+
+    std::shared_ptr<uvre::gl33::Query_S> query(new uvre::gl33::Query_S, deferDestroy(this, destroyQuery));
+    glGenQueries(1, &query->qobj);
+    query->target = target;
+
+    return query;
+}
+
+bool uvre::gl33::RenderDeviceImpl::getQueryResult(const uvre::Query &query, uint64_t &result)
+{
+    int32_t available;
+    glGetQueryObjectiv(uvre::gl33::impl(query)->qobj, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+        return false;
+    glGetQueryObjectui64v(uvre::gl33::impl(query)->qobj, GL_QUERY_RESULT, &result);
+    return true;
+}
+
+static std::shared_ptr<uvre::gl33::Readback_S> createReadback(uvre::gl33::RenderDeviceImpl *device, size_t size)
+{
+    std::shared_ptr<uvre::gl33::Readback_S> readback(new uvre::gl33::Readback_S, deferDestroy(device, destroyReadback));
+    readback->size = size;
+    readback->sync = nullptr;
+    readback->mapped = nullptr;
+
+    // The smallest free buffer that fits, a new
+    // one only if none of them is large enough.
+    std::vector<uvre::gl33::PackBuffer>::iterator best = device->pack_buffers.end();
+    for(std::vector<uvre::gl33::PackBuffer>::iterator it = device->pack_buffers.begin(); it != device->pack_buffers.end(); it++) {
+        if(it->capacity >= size && (best == device->pack_buffers.end() || it->capacity < best->capacity))
+            best = it;
+    }
+
+    if(best != device->pack_buffers.end()) {
+        readback->bufobj = best->bufobj;
+        readback->capacity = best->capacity;
+        device->pack_buffers.erase(best);
+        return readback;
+    }
+
+    glGenBuffers(1, &readback->bufobj);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->bufobj);
+    glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STREAM_READ);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback->capacity = size;
+    trackMemory(device, &uvre::MemoryStats::buffers, size);
+    return readback;
+}
+
+static void readPixels(uvre::gl33::Readback_S *readback, uint32_t fbobj, uint32_t read_buffer, int x, int y, int w, int h, uint32_t fmt, uint32_t type)
+{
+    int32_t read_fbo;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbobj);
+    if(fbobj)
+        glReadBuffer(read_buffer);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->bufobj);
+    int32_t pack_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(x, y, w, h, fmt, type, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(read_fbo));
+
+    readback->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+uvre::Readback uvre::gl33::RenderDeviceImpl::readRenderTargetAsync(const uvre::RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    uint32_t fmt, type;
+    const size_t size = static_cast<size_t>(w) * static_cast<size_t>(h) * getPixelSize(format);
+    if(!size || !getExternalFormat(format, fmt, type))
+        return nullptr;
+
+    std::shared_ptr<uvre::gl33::Readback_S> readback = createReadback(this, size);
+    readPixels(readback.get(), target ? uvre::gl33::impl(target)->fbobj : 0, GL_COLOR_ATTACHMENT0 + attachment, x, y, w, h, fmt, type);
+    return readback;
+}
+
+uvre::Readback uvre::gl33::RenderDeviceImpl::readTextureAsync(const uvre::Texture &texture, int level, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    uint32_t fmt, type;
+    const size_t size = static_cast<size_t>(w) * static_cast<size_t>(h) * getPixelSize(format);
+    if(!texture || !size || !getExternalFormat(format, fmt, type))
+        return nullptr;
+
+    // There's no glGetTextureSubImage before 4.5 so
+    // the level goes through a scratch framebuffer;
+    // layered textures are read from the first layer.
+    if(!readback_fbo)
+        glGenFramebuffers(1, &readback_fbo);
+
+    const uint32_t point = (fmt == GL_DEPTH_COMPONENT) ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0;
+    int32_t read_fbo;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readback_fbo);
+    glFramebufferTexture(GL_READ_FRAMEBUFFER, point, uvre::gl33::impl(texture)->texobj, level);
+
+    std::shared_ptr<uvre::gl33::Readback_S> readback = createReadback(this, size);
+    readPixels(readback.get(), readback_fbo, GL_COLOR_ATTACHMENT0, x, y, w, h, fmt, type);
+
+    glFramebufferTexture(GL_READ_FRAMEBUFFER, point, 0, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(read_fbo));
+    return readback;
+}
+
+const void *uvre::gl33::RenderDeviceImpl::getReadbackData(const uvre::Readback &readback)
+{
+    uvre::gl33::Readback_S *readback_s = uvre::gl33::impl(readback);
+    if(!readback_s)
+        return nullptr;
+
+    // Polling with a zero timeout still flushes,
+    // so the fence is guaranteed to come around.
+    if(!readback_s->mapped) {
+        const GLenum status = glClientWaitSync(readback_s->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return nullptr;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_s->bufobj);
+        readback_s->mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(readback_s->size), GL_MAP_READ_BIT);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    return readback_s->mapped;
+}
+
+void uvre::gl33::RenderDeviceImpl::beginFrame()
+{
+    GLsync &fence = frame_fences[frame_number % frame_fences.size()];
+    if(fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    collectGarbage(frame_garbage[frame_number % frame_garbage.size()]);
+
+    // Nothing read back for a whole round of
+    // frames, the buffers can go for now.
+    std::vector<uvre::gl33::PackBuffer>::iterator it = pack_buffers.begin();
+    for(; it != pack_buffers.end() && it->released + frame_fences.size() < frame_number; it++)
+        deletePackBuffer(this, *it);
+    pack_buffers.erase(pack_buffers.begin(), it);
+}
+
+void uvre::gl33::RenderDeviceImpl::endFrame()
+{
+    {
+        std::lock_guard<std::mutex> lock(drop_mutex);
+        std::vector<std::function<void()>> &garbage = frame_garbage[frame_number % frame_garbage.size()];
+        garbage.insert(garbage.end(), std::make_move_iterator(dropped.begin()), std::make_move_iterator(dropped.end()));
+        dropped.clear();
+    }
+
+    GLsync &fence = frame_fences[frame_number % frame_fences.size()];
+    if(fence)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_number++;
+}
+
+size_t uvre::gl33::RenderDeviceImpl::getFrameIndex() const
+{
+    return static_cast<size_t>(frame_number % frame_fences.size());
 }
 
-void uvre::RenderDeviceImpl::prepare()
+void uvre::gl33::RenderDeviceImpl::prepare()
 {
     // Third-party overlay applications
     // can cause mayhem if this is not called.
     glUseProgram(0);
 }
 
-void uvre::RenderDeviceImpl::present()
+void uvre::gl33::RenderDeviceImpl::present()
 {
     create_info.gl.swapBuffers(create_info.gl.user_data);
 }
 
-void uvre::RenderDeviceImpl::vsync(bool enable)
+void uvre::gl33::RenderDeviceImpl::vsync(bool enable)
 {
     create_info.gl.setSwapInterval(create_info.gl.user_data, enable ? 1 : 0);
 }
 
-void uvre::RenderDeviceImpl::mode(int, int)
+void uvre::gl33::RenderDeviceImpl::mode(int, int)
 {
     // Nothing in OpenGL
 }
@@ -18,7 +18,7 @@ static void pushErrorMessage(const uvre::DeviceCreateInfo &info, const char *tex
     }
 }
 
-UVRE_API void uvre::pollImplInfo(uvre::ImplInfo &info)
+void uvre::gl33::pollImplInfo(uvre::ImplInfo &info)
 {
     info.family = uvre::ImplFamily::OPENGL;
     info.gl.core_profile = true;
@@ -26,33 +26,32 @@ UVRE_API void uvre::pollImplInfo(uvre::ImplInfo &info)
     info.gl.version_minor = 3;
 }
 
-UVRE_API uvre::IRenderDevice *uvre::createDevice(const uvre::DeviceCreateInfo &info)
+uvre::IRenderDevice *uvre::gl33::createDevice(const uvre::DeviceCreateInfo &info)
 {
     if(!info.gl.setSwapInterval || !info.gl.swapBuffers || !info.gl.makeContextCurrent || !info.gl.getProcAddr)
         return nullptr;
 
     info.gl.makeContextCurrent(info.gl.user_data);
     if(gladLoadGLUserPtr(reinterpret_cast<GLADuserptrloadfunc>(info.gl.getProcAddr), info.gl.user_data)) {
-        if(!GLAD_GL_ARB_base_instance || !GLAD_GL_ARB_vertex_attrib_binding) {
+        // Both extensions are core in newer
+        // versions that the loader knows about.
+        const bool base_instance = GLAD_GL_ARB_base_instance || GLAD_GL_VERSION_4_2;
+        const bool vertex_attrib_binding = GLAD_GL_ARB_vertex_attrib_binding || GLAD_GL_VERSION_4_3;
+        if(!base_instance || !vertex_attrib_binding) {
             // Unfortunately we still require some extensions
             // to be present in order for UVRE to completely
             // work and be cool. And some of these extensions
             // are required to be here.
-            if(!GLAD_GL_ARB_base_instance)
+            if(!base_instance)
                 pushErrorMessage(info, "GL_ARB_base_instance is required");
-            if(!GLAD_GL_ARB_vertex_attrib_binding)
+            if(!vertex_attrib_binding)
                 pushErrorMessage(info, "GL_ARB_vertex_attrib_binding is required");
             return nullptr;
         }
 
-        return new uvre::RenderDeviceImpl(info);
+        return new uvre::gl33::RenderDeviceImpl(info);
     }
 
     // We are doomed!!!
     return nullptr;
 }
-
-UVRE_API void uvre::destroyDevice(uvre::IRenderDevice *device)
-{
-    delete device;
-}
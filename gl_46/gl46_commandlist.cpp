@@ -8,15 +8,15 @@
  */
 #include "gl46_private.hpp"
 
-static inline void pushCommand(std::vector<uvre::Command> &commands, const uvre::Command &cmd, size_t index)
+static inline void pushCommand(std::vector<uvre::gl46::Command> &commands, const uvre::gl46::Command &cmd, size_t index)
 {
     if(commands.size() <= index) {
         commands.push_back(cmd);
         return;
     }
 
-    std::vector<uvre::Command>::iterator it = commands.begin() + index;
-    if(it->type == uvre::CommandType::WRITE_BUFFER)
+    std::vector<uvre::gl46::Command>::iterator it = commands.begin() + index;
+    if(it->type == uvre::gl46::CommandType::WRITE_BUFFER)
         delete[] it->buffer_write.data_ptr;
     *it = cmd;
 }
@@ -33,15 +33,56 @@ static inline uint32_t getTargetMask(uvre::RenderTargetMask mask)
     return result;
 }
 
-uvre::CommandListImpl::CommandListImpl()
-    : commands(), num_commands(0)
+uvre::gl46::CommandListImpl::CommandListImpl()
+    : commands(), num_commands(0), used_textures()
 {
 }
 
-void uvre::CommandListImpl::setScissor(int x, int y, int width, int height)
+static inline uint32_t getBarrierMask(uvre::BarrierFlags flags)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_SCISSOR;
+    if(flags == uvre::BARRIER_ALL)
+        return GL_ALL_BARRIER_BITS;
+
+    uint32_t result = 0;
+    if(flags & uvre::BARRIER_VERTEX_BUFFER)
+        result |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+    if(flags & uvre::BARRIER_INDEX_BUFFER)
+        result |= GL_ELEMENT_ARRAY_BARRIER_BIT;
+    if(flags & uvre::BARRIER_UNIFORM_BUFFER)
+        result |= GL_UNIFORM_BARRIER_BIT;
+    if(flags & uvre::BARRIER_STORAGE_BUFFER)
+        result |= GL_SHADER_STORAGE_BARRIER_BIT;
+    if(flags & uvre::BARRIER_INDIRECT_BUFFER)
+        result |= GL_COMMAND_BARRIER_BIT;
+    if(flags & uvre::BARRIER_BUFFER_UPDATE)
+        result |= GL_BUFFER_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT;
+    if(flags & uvre::BARRIER_TEXTURE_FETCH)
+        result |= GL_TEXTURE_FETCH_BARRIER_BIT;
+    if(flags & uvre::BARRIER_TEXTURE_UPDATE)
+        result |= GL_TEXTURE_UPDATE_BARRIER_BIT;
+    if(flags & uvre::BARRIER_STORAGE_IMAGE)
+        result |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+    if(flags & uvre::BARRIER_RENDER_TARGET)
+        result |= GL_FRAMEBUFFER_BARRIER_BIT;
+    return result;
+}
+
+static inline uint32_t getImageAccess(uvre::ImageAccess access)
+{
+    switch(access) {
+        case uvre::ImageAccess::READ_ONLY:
+            return GL_READ_ONLY;
+        case uvre::ImageAccess::WRITE_ONLY:
+            return GL_WRITE_ONLY;
+        default:
+            return GL_READ_WRITE;
+    }
+}
+
+void uvre::gl46::CommandListImpl::setScissor(int x, int y, int width, int height)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::SET_SCISSOR;
     cmd.scvp.x = x;
     cmd.scvp.y = y;
     cmd.scvp.w = width;
@@ -49,10 +90,10 @@ void uvre::CommandListImpl::setScissor(int x, int y, int width, int height)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setViewport(int x, int y, int width, int height)
+void uvre::gl46::CommandListImpl::setViewport(int x, int y, int width, int height)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_VIEWPORT;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::SET_VIEWPORT;
     cmd.scvp.x = x;
     cmd.scvp.y = y;
     cmd.scvp.w = width;
@@ -60,18 +101,18 @@ void uvre::CommandListImpl::setViewport(int x, int y, int width, int height)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setClearDepth(float d)
+void uvre::gl46::CommandListImpl::setClearDepth(float d)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_CLEAR_DEPTH;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::SET_CLEAR_DEPTH;
     cmd.depth = d;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setClearColor3f(float r, float g, float b)
+void uvre::gl46::CommandListImpl::setClearColor3f(float r, float g, float b)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_CLEAR_COLOR;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::SET_CLEAR_COLOR;
     cmd.color[0] = r;
     cmd.color[1] = g;
     cmd.color[2] = b;
@@ -79,10 +120,10 @@ void uvre::CommandListImpl::setClearColor3f(float r, float g, float b)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
+void uvre::gl46::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::SET_CLEAR_COLOR;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::SET_CLEAR_COLOR;
     cmd.color[0] = r;
     cmd.color[1] = g;
     cmd.color[2] = b;
@@ -90,89 +131,115 @@ void uvre::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::clear(uvre::RenderTargetMask mask)
+void uvre::gl46::CommandListImpl::clear(uvre::RenderTargetMask mask)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::CLEAR;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::CLEAR;
     cmd.clear_mask = getTargetMask(mask);
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindPipeline(uvre::Pipeline pipeline)
+void uvre::gl46::CommandListImpl::bindPipeline(const uvre::Pipeline &pipeline)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_PIPELINE;
-    cmd.pipeline = *pipeline;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_PIPELINE;
+    cmd.pipeline = uvre::gl46::impl(pipeline);
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindStorageBuffer(uvre::Buffer buffer, uint32_t index)
+void uvre::gl46::CommandListImpl::bindStorageBuffer(const uvre::Buffer &buffer, uint32_t index)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_STORAGE_BUFFER;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_STORAGE_BUFFER;
     cmd.bind_index = index;
-    cmd.object = buffer ? buffer->bufobj : 0;
+    cmd.object = buffer ? uvre::gl46::impl(buffer)->bufobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindUniformBuffer(uvre::Buffer buffer, uint32_t index)
+void uvre::gl46::CommandListImpl::bindUniformBuffer(const uvre::Buffer &buffer, uint32_t index)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_UNIFORM_BUFFER;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_UNIFORM_BUFFER;
     cmd.bind_index = index;
-    cmd.object = buffer ? buffer->bufobj : 0;
+    cmd.object = buffer ? uvre::gl46::impl(buffer)->bufobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindIndexBuffer(uvre::Buffer buffer)
+void uvre::gl46::CommandListImpl::bindIndexBuffer(const uvre::Buffer &buffer)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_INDEX_BUFFER;
-    cmd.object = buffer ? buffer->bufobj : 0;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_INDEX_BUFFER;
+    cmd.object = buffer ? uvre::gl46::impl(buffer)->bufobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindVertexBuffer(uvre::Buffer buffer)
+void uvre::gl46::CommandListImpl::bindVertexBuffer(const uvre::Buffer &buffer)
 {
     if(buffer) {
-        uvre::Command cmd = {};
-        cmd.type = uvre::CommandType::BIND_VERTEX_BUFFER;
-        cmd.buffer = *buffer;
+        uvre::gl46::Command cmd = {};
+        cmd.type = uvre::gl46::CommandType::BIND_VERTEX_BUFFER;
+        cmd.buffer = *uvre::gl46::impl(buffer);
         pushCommand(commands, cmd, num_commands++);
     }
 }
 
-void uvre::CommandListImpl::bindSampler(uvre::Sampler sampler, uint32_t index)
+void uvre::gl46::CommandListImpl::bindSampler(const uvre::Sampler &sampler, uint32_t index)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_SAMPLER;
+    cmd.bind_index = index;
+    cmd.object = sampler ? uvre::gl46::impl(sampler)->ssobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl46::CommandListImpl::bindTexture(const uvre::Texture &texture, uint32_t index)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_SAMPLER;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_TEXTURE;
     cmd.bind_index = index;
-    cmd.object = sampler ? sampler->ssobj : 0;
+    cmd.object = texture ? uvre::gl46::impl(texture)->texobj : 0;
     pushCommand(commands, cmd, num_commands++);
+
+    if(texture)
+        used_textures.push_back(uvre::gl46::impl(texture));
 }
 
-void uvre::CommandListImpl::bindTexture(uvre::Texture texture, uint32_t index)
+void uvre::gl46::CommandListImpl::bindStorageImage(const uvre::Texture &texture, uint32_t index, int level, uvre::ImageAccess access)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_TEXTURE;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_STORAGE_IMAGE;
     cmd.bind_index = index;
-    cmd.object = texture ? texture->texobj : 0;
+    cmd.image.texture = texture ? uvre::gl46::impl(texture)->texobj : 0;
+    cmd.image.level = level;
+    cmd.image.layered = (texture && uvre::gl46::impl(texture)->target != GL_TEXTURE_2D) ? GL_TRUE : GL_FALSE;
+    cmd.image.access = getImageAccess(access);
+    cmd.image.format = texture ? uvre::gl46::impl(texture)->format : GL_RGBA8;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::bindRenderTarget(uvre::RenderTarget target)
+void uvre::gl46::CommandListImpl::bindRenderTarget(const uvre::RenderTarget &target)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::BIND_RENDER_TARGET;
-    cmd.object = target ? target->fbobj : 0;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_RENDER_TARGET;
+    cmd.object = target ? uvre::gl46::impl(target)->fbobj : 0;
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::writeBuffer(uvre::Buffer buffer, size_t offset, size_t size, const void *data)
+void uvre::gl46::CommandListImpl::bindResourceSet(const uvre::ResourceSet &set, uint32_t first)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::WRITE_BUFFER;
-    cmd.buffer_write.buffer = buffer->bufobj;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BIND_RESOURCE_SET;
+    cmd.bind_index = first;
+    cmd.set = uvre::gl46::impl(set);
+    pushCommand(commands, cmd, num_commands++);
+    used_textures.insert(used_textures.end(), cmd.set->texture_objects.cbegin(), cmd.set->texture_objects.cend());
+}
+
+void uvre::gl46::CommandListImpl::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::WRITE_BUFFER;
+    cmd.buffer_write.buffer = uvre::gl46::impl(buffer)->bufobj;
     cmd.buffer_write.offset = offset;
     cmd.buffer_write.size = size;
     cmd.buffer_write.data_ptr = new uint8_t[size];
@@ -180,12 +247,12 @@ void uvre::CommandListImpl::writeBuffer(uvre::Buffer buffer, size_t offset, size
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::copyRenderTarget(uvre::RenderTarget src, uvre::RenderTarget dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, uvre::RenderTargetMask mask, bool filter)
+void uvre::gl46::CommandListImpl::copyRenderTarget(const uvre::RenderTarget &src, const uvre::RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, uvre::RenderTargetMask mask, bool filter)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::COPY_RENDER_TARGET;
-    cmd.rt_copy.src = src ? src->fbobj : 0;
-    cmd.rt_copy.dst = dst ? dst->fbobj : 0;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::COPY_RENDER_TARGET;
+    cmd.rt_copy.src = src ? uvre::gl46::impl(src)->fbobj : 0;
+    cmd.rt_copy.dst = dst ? uvre::gl46::impl(dst)->fbobj : 0;
     cmd.rt_copy.sx0 = sx0;
     cmd.rt_copy.sy0 = sy0;
     cmd.rt_copy.sx1 = sx1;
@@ -199,10 +266,66 @@ void uvre::CommandListImpl::copyRenderTarget(uvre::RenderTarget src, uvre::Rende
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance)
+void uvre::gl46::CommandListImpl::generateMipmaps(const uvre::Texture &texture)
+{
+    // No texture, no mipmaps
+    if(!texture)
+        return;
+
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::GENERATE_MIPMAPS;
+    cmd.object = uvre::gl46::impl(texture)->texobj;
+    pushCommand(commands, cmd, num_commands++);
+
+    used_textures.push_back(uvre::gl46::impl(texture));
+}
+
+void uvre::gl46::CommandListImpl::memoryBarrier(uvre::BarrierFlags flags)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::DRAW;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::MEMORY_BARRIER;
+    cmd.barrier_mask = getBarrierMask(flags);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl46::CommandListImpl::beginQuery(const uvre::Query &query)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BEGIN_QUERY;
+    cmd.query.qobj = uvre::gl46::impl(query)->qobj;
+    cmd.query.target = uvre::gl46::impl(query)->target;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl46::CommandListImpl::endQuery(const uvre::Query &query)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::END_QUERY;
+    cmd.query.qobj = uvre::gl46::impl(query)->qobj;
+    cmd.query.target = uvre::gl46::impl(query)->target;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl46::CommandListImpl::beginConditionalRender(const uvre::Query &query, bool wait)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::BEGIN_CONDITIONAL_RENDER;
+    cmd.cond.qobj = uvre::gl46::impl(query)->qobj;
+    cmd.cond.mode = wait ? GL_QUERY_WAIT : GL_QUERY_NO_WAIT;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl46::CommandListImpl::endConditionalRender()
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::END_CONDITIONAL_RENDER;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl46::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::DRAW;
     cmd.draw.a.vertices = static_cast<int32_t>(vertices);
     cmd.draw.a.instances = static_cast<int32_t>(instances);
     cmd.draw.a.base_vertex = static_cast<int32_t>(base_vertex);
@@ -210,10 +333,10 @@ void uvre::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_
     pushCommand(commands, cmd, num_commands++);
 }
 
-void uvre::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance)
+void uvre::gl46::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance)
 {
-    uvre::Command cmd = {};
-    cmd.type = uvre::CommandType::IDRAW;
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::IDRAW;
     cmd.draw.e.indices = static_cast<int32_t>(indices);
     cmd.draw.e.instances = static_cast<int32_t>(instances);
     cmd.draw.e.base_index = static_cast<int32_t>(base_index);
@@ -221,3 +344,22 @@ void uvre::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_
     cmd.draw.e.base_instance = static_cast<int32_t>(base_instance);
     pushCommand(commands, cmd, num_commands++);
 }
+
+void uvre::gl46::CommandListImpl::dispatch(size_t x, size_t y, size_t z)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::DISPATCH;
+    cmd.dispatch.x = static_cast<uint32_t>(x);
+    cmd.dispatch.y = static_cast<uint32_t>(y);
+    cmd.dispatch.z = static_cast<uint32_t>(z);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::gl46::CommandListImpl::dispatchIndirect(const uvre::Buffer &buffer, size_t offset)
+{
+    uvre::gl46::Command cmd = {};
+    cmd.type = uvre::gl46::CommandType::DISPATCH_INDIRECT;
+    cmd.indirect.buffer = uvre::gl46::impl(buffer)->bufobj;
+    cmd.indirect.offset = offset;
+    pushCommand(commands, cmd, num_commands++);
+}
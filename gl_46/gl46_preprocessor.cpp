@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <cstring>
+#include "gl46_private.hpp"
+
+// Anything nested deeper than this
+// is most likely an include loop.
+static constexpr const int MAX_INCLUDE_DEPTH = 32;
+
+struct PreprocessState final {
+    const uvre::gl46::RenderDeviceImpl *device;
+    const uvre::ShaderCreateInfo *info;
+    int num_strings;
+};
+
+static void reportError(const PreprocessState &state, const std::string &text)
+{
+    if(state.device->create_info.onDebugMessage) {
+        uvre::DebugMessageInfo msg = {};
+        msg.level = uvre::DebugMessageLevel::ERROR;
+        msg.text = text.c_str();
+        state.device->create_info.onDebugMessage(msg);
+    }
+}
+
+static inline const char *skipBlanks(const char *str, const char *end)
+{
+    while(str < end && (*str == ' ' || *str == '\t'))
+        str++;
+    return str;
+}
+
+// Returns the path if the line is an #include directive.
+static bool parseInclude(const char *line, const char *end, std::string &path)
+{
+    line = skipBlanks(line, end);
+    if(line == end || *line++ != '#')
+        return false;
+
+    line = skipBlanks(line, end);
+    if(static_cast<size_t>(end - line) < 7 || std::strncmp(line, "include", 7))
+        return false;
+
+    line = skipBlanks(line + 7, end);
+    if(line == end || (*line != '"' && *line != '<'))
+        return false;
+
+    const char terminator = (*line++ == '"') ? '"' : '>';
+    const char *path_end = line;
+    while(path_end < end && *path_end != terminator)
+        path_end++;
+    if(path_end == end)
+        return false;
+
+    path.assign(line, path_end);
+    return true;
+}
+
+static bool expandSource(PreprocessState &state, const char *code, int string_number, int depth, std::string &source)
+{
+    std::string path;
+    int line_number = 1;
+    for(const char *line = code; *line; line_number++) {
+        const char *end = std::strchr(line, '\n');
+        if(!end)
+            end = line + std::strlen(line);
+
+        if(parseInclude(line, end, path)) {
+            if(!state.info->onInclude) {
+                reportError(state, "#include without an include resolver: " + path);
+                return false;
+            }
+
+            if(depth >= MAX_INCLUDE_DEPTH) {
+                reportError(state, "#include nested too deep: " + path);
+                return false;
+            }
+
+            const char *included = state.info->onInclude(state.info->include_user_data, path.c_str());
+            if(!included) {
+                reportError(state, "#include not found: " + path);
+                return false;
+            }
+
+            // Each included file gets its own source
+            // string number so compiler errors can be
+            // traced back to the file they came from.
+            const int included_number = ++state.num_strings;
+            source += "#line 1 " + std::to_string(included_number) + '\n';
+            if(!expandSource(state, included, included_number, depth + 1, source))
+                return false;
+            if(!source.empty() && source.back() != '\n')
+                source += '\n';
+            source += "#line " + std::to_string(line_number + 1) + ' ' + std::to_string(string_number) + '\n';
+        }
+        else {
+            source.append(line, end);
+            if(*end)
+                source += '\n';
+        }
+
+        line = *end ? end + 1 : end;
+    }
+
+    return true;
+}
+
+bool uvre::gl46::preprocessShader(const uvre::gl46::RenderDeviceImpl *device, const uvre::ShaderCreateInfo &info, std::string &source)
+{
+    for(size_t i = 0; i < info.num_defines; i++) {
+        source += "#define ";
+        source += info.defines[i].name;
+        if(info.defines[i].value) {
+            source += ' ';
+            source += info.defines[i].value;
+        }
+        source += '\n';
+    }
+
+    // Keep compiler messages in sync
+    // with the line numbers of the file.
+    source += "#line 1 0\n";
+
+    PreprocessState state = { device, &info, 0 };
+    return expandSource(state, reinterpret_cast<const char *>(info.code), 0, 0, source);
+}
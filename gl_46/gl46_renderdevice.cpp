@@ -10,11 +10,11 @@
 #include <functional>
 #include "gl46_private.hpp"
 
-static uvre::VertexArray_S dummy_vao = { 0, 0, 0, nullptr };
+static uvre::gl46::VertexArray_S dummy_vao = { 0, 0, 0, nullptr };
 
 static void GLAPIENTRY debugCallback(GLenum, GLenum, GLuint, GLenum severity, GLsizei, const char *message, const void *arg)
 {
-    const uvre::RenderDeviceImpl *device = reinterpret_cast<const uvre::RenderDeviceImpl *>(arg);
+    const uvre::gl46::RenderDeviceImpl *device = reinterpret_cast<const uvre::gl46::RenderDeviceImpl *>(arg);
         if(device && device->create_info.onDebugMessage) {
 
         uvre::DebugMessageInfo msg = {};
@@ -39,16 +39,134 @@ static void GLAPIENTRY debugCallback(GLenum, GLenum, GLuint, GLenum severity, GL
     }
 }
 
-static void destroyShader(uvre::Shader_S *shader)
+template<typename T>
+static std::function<void(T *)> deferDestroy(uvre::gl46::RenderDeviceImpl *device, void (*destroy)(T *, uvre::gl46::RenderDeviceImpl *))
 {
+    std::shared_ptr<uvre::gl46::DeviceLink> link = device->link;
+    return [link, destroy](T *object) {
+        std::unique_lock<std::mutex> lock(link->mutex);
+        if(!link->device) {
+            // The context went away with the device,
+            // there's nothing left to destroy in GL.
+            lock.unlock();
+            delete object;
+            return;
+        }
+
+        std::lock_guard<std::mutex> drop_lock(link->device->drop_mutex);
+        link->device->dropped.push_back(std::bind(destroy, object, link->device));
+    };
+}
+
+static void collectGarbage(std::vector<std::function<void()>> &garbage)
+{
+    // Destroying an object may drop others
+    std::vector<std::function<void()>> objects;
+    objects.swap(garbage);
+    for(const std::function<void()> &destroy : objects)
+        destroy();
+}
+
+static void collectDropped(uvre::gl46::RenderDeviceImpl *device)
+{
+    for(;;) {
+        std::vector<std::function<void()>> objects;
+        {
+            std::lock_guard<std::mutex> lock(device->drop_mutex);
+            objects.swap(device->dropped);
+        }
+
+        if(objects.empty())
+            break;
+        collectGarbage(objects);
+    }
+}
+
+static bool hasExtension(const char *name)
+{
+    int32_t num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for(int32_t i = 0; i < num_extensions; i++) {
+        if(!std::strcmp(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i))), name))
+            return true;
+    }
+
+    return false;
+}
+
+static void waitUpload(uvre::gl46::RenderDeviceImpl *device, uint64_t upload_serial)
+{
+    // The worker might still be writing
+    // the object, let it finish first.
+    if(upload_serial > device->uploads_done)
+        device->worker->wait();
+}
+
+static void trackMemory(uvre::gl46::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryStats &stats = device->memory_stats;
+    uvre::MemoryUsage &usage = stats.*member;
+    usage.bytes += bytes;
+    usage.peak_bytes = std::max(usage.peak_bytes, usage.bytes);
+    usage.peak_count = std::max(usage.peak_count, ++usage.count);
+
+    // Attachments are already counted as textures
+    if(member == &uvre::MemoryStats::render_targets)
+        return;
+
+    stats.total_bytes += bytes;
+    stats.peak_total_bytes = std::max(stats.peak_total_bytes, stats.total_bytes);
+
+    // Don't call back with the lock held
+    const uvre::DeviceCreateInfo &info = device->create_info;
+    if(info.memory.budget && info.memory.onBudgetExceeded && stats.total_bytes > info.memory.budget) {
+        const uvre::MemoryStats snapshot = stats;
+        lock.unlock();
+        info.memory.onBudgetExceeded(info.memory.user_data, snapshot);
+    }
+}
+
+static void untrackMemory(uvre::gl46::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryUsage &usage = device->memory_stats.*member;
+    usage.bytes -= bytes;
+    usage.count--;
+    if(member != &uvre::MemoryStats::render_targets)
+        device->memory_stats.total_bytes -= bytes;
+}
+
+static void destroyShader(uvre::gl46::Shader_S *shader, uvre::gl46::RenderDeviceImpl *device)
+{
+    // Remove ourselves from the dedupe cache.
+    std::unordered_map<std::string, std::weak_ptr<uvre::gl46::Shader_S>>::const_iterator it = device->shader_cache.find(shader->cache_key);
+    if(it != device->shader_cache.cend() && it->second.expired())
+        device->shader_cache.erase(it);
+
+    // Make sure the worker is done with us
+    if(shader->threaded && shader->shobj)
+        device->worker->wait();
+    if(shader->fence)
+        glDeleteSync(shader->fence);
+    glDeleteShader(shader->shobj);
     glDeleteProgram(shader->prog);
     delete shader;
 }
 
-static void destroyPipeline(uvre::Pipeline_S *pipeline, uvre::RenderDeviceImpl *device)
+static void destroyPipeline(uvre::gl46::Pipeline_S *pipeline, uvre::gl46::RenderDeviceImpl *device)
 {
+    // Remove ourselves from the dedupe cache.
+    if(pipeline->cache_key) {
+        std::unordered_map<std::string, uvre::gl46::CacheEntry<uvre::gl46::Pipeline_S>>::iterator it = device->pipeline_cache.find(*pipeline->cache_key);
+        if(it->second.object == pipeline)
+            it->second.object = nullptr;
+        if(!--it->second.users)
+            device->pipeline_cache.erase(it);
+    }
+
     // Remove ourselves from the notify list.
-    for(std::vector<uvre::Pipeline_S *>::const_iterator it = device->pipelines.cbegin(); it != device->pipelines.cend(); it++) {
+    for(std::vector<uvre::gl46::Pipeline_S *>::const_iterator it = device->pipelines.cbegin(); it != device->pipelines.cend(); it++) {
         if(*it != pipeline)
             continue;
         device->pipelines.erase(it);
@@ -56,21 +174,23 @@ static void destroyPipeline(uvre::Pipeline_S *pipeline, uvre::RenderDeviceImpl *
     }
 
     // Chain-free the VAO list
-    for(uvre::VertexArray_S *node = pipeline->vaos; node;) {
-        uvre::VertexArray_S *next = node->next;
+    for(uvre::gl46::VertexArray_S *node = pipeline->vaos; node;) {
+        uvre::gl46::VertexArray_S *next = node->next;
         glDeleteVertexArrays(1, &node->vaobj);
         delete node;
         node = next;
     }
 
     glDeleteProgramPipelines(1, &pipeline->ppobj);
+    delete[] pipeline->attributes;
+    delete pipeline->pending;
     delete pipeline;
 }
 
-static void destroyBuffer(uvre::Buffer_S *buffer, uvre::RenderDeviceImpl *device)
+static void destroyBuffer(uvre::gl46::Buffer_S *buffer, uvre::gl46::RenderDeviceImpl *device)
 {
     // Remove ourselves from the notify list.
-    for(std::vector<uvre::Buffer_S *>::const_iterator it = device->buffers.cbegin(); it != device->buffers.cend(); it++) {
+    for(std::vector<uvre::gl46::Buffer_S *>::const_iterator it = device->buffers.cbegin(); it != device->buffers.cend(); it++) {
         if(*it != buffer)
             continue;
         device->buffers.erase(it);
@@ -78,39 +198,123 @@ static void destroyBuffer(uvre::Buffer_S *buffer, uvre::RenderDeviceImpl *device
         break;
     }
 
+    waitUpload(device, buffer->upload_serial);
+    untrackMemory(device, &uvre::MemoryStats::buffers, buffer->size);
     glDeleteBuffers(1, &buffer->bufobj);
     delete buffer;
 }
 
-static void destroySampler(uvre::Sampler_S *sampler)
+static void destroySampler(uvre::gl46::Sampler_S *sampler, uvre::gl46::RenderDeviceImpl *device)
 {
+    // Remove ourselves from the dedupe cache.
+    std::unordered_map<std::string, uvre::gl46::CacheEntry<uvre::gl46::Sampler_S>>::iterator it = device->sampler_cache.find(*sampler->cache_key);
+    if(it->second.object == sampler)
+        it->second.object = nullptr;
+    if(!--it->second.users)
+        device->sampler_cache.erase(it);
+
     glDeleteSamplers(1, &sampler->ssobj);
     delete sampler;
 }
 
-static void destroyTexture(uvre::Texture_S *texture)
+static void destroyTexture(uvre::gl46::Texture_S *texture, uvre::gl46::RenderDeviceImpl *device)
 {
+    waitUpload(device, texture->upload_serial);
+    untrackMemory(device, &uvre::MemoryStats::textures, texture->memory_size);
     glDeleteTextures(1, &texture->texobj);
     delete texture;
 }
 
-static void destroyRenderTarget(uvre::RenderTarget_S *target)
+static void destroyRenderTarget(uvre::gl46::RenderTarget_S *target, uvre::gl46::RenderDeviceImpl *device)
 {
+    untrackMemory(device, &uvre::MemoryStats::render_targets, target->memory_size);
     glDeleteFramebuffers(1, &target->fbobj);
     delete target;
 }
 
-uvre::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_info)
-    : create_info(create_info), vbos(nullptr), bound_pipeline(), null_pipeline(), pipelines(), buffers(), commandlists()
+static void destroyResourceSet(uvre::gl46::ResourceSet_S *set, uvre::gl46::RenderDeviceImpl *)
+{
+    delete set;
+}
+
+static void destroyFence(uvre::gl46::Fence_S *fence, uvre::gl46::RenderDeviceImpl *)
+{
+    glDeleteSync(fence->sync);
+    delete fence;
+}
+
+static void destroyQuery(uvre::gl46::Query_S *query, uvre::gl46::RenderDeviceImpl *)
+{
+    glDeleteQueries(1, &query->qobj);
+    delete query;
+}
+
+static void deletePackBuffer(uvre::gl46::RenderDeviceImpl *device, const uvre::gl46::PackBuffer &pack_buffer)
+{
+    glDeleteBuffers(1, &pack_buffer.bufobj);
+    untrackMemory(device, &uvre::MemoryStats::buffers, pack_buffer.capacity);
+}
+
+static void destroyReadback(uvre::gl46::Readback_S *readback, uvre::gl46::RenderDeviceImpl *device)
 {
+    if(readback->mapped)
+        glUnmapNamedBuffer(readback->bufobj);
+    glDeleteSync(readback->sync);
+
+    // The oldest one makes room
+    if(device->pack_buffers.size() >= uvre::gl46::MAX_PACK_BUFFERS) {
+        deletePackBuffer(device, device->pack_buffers.front());
+        device->pack_buffers.erase(device->pack_buffers.begin());
+    }
+
+    device->pack_buffers.push_back(uvre::gl46::PackBuffer { readback->bufobj, readback->capacity, device->frame_number });
+    delete readback;
+}
+
+uvre::gl46::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_info)
+    : create_info(create_info), shader_cache_dir(), driver_hash(UINT64_C(0xCBF29CE484222325)), next_shader_id(0), parallel_compile(false), worker(nullptr), vbos(nullptr), bound_pipeline(), null_pipeline(), pipelines(), buffers(), commandlists(), frame_fences(), frame_number(0), uploads_queued(0), uploads_done(0), pack_buffers(), link(std::make_shared<uvre::gl46::DeviceLink>()), drop_mutex(), dropped(), frame_garbage(), shader_cache(), pipeline_cache(), sampler_cache(), memory_mutex(), memory_stats()
+{
+    link->device = this;
     glGetIntegerv(GL_MAX_VERTEX_ATTRIB_BINDINGS, &max_vbo_bindings);
 
+    // Program binaries are only valid for the exact
+    // driver that produced them, so the driver strings
+    // become a part of every program cache key.
+    const GLenum driver_strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for(GLenum name : driver_strings) {
+        const char *str = reinterpret_cast<const char *>(glGetString(name));
+        if(str)
+            driver_hash = uvre::gl46::hashBytes(driver_hash, str, std::strlen(str));
+    }
+
+    int32_t num_binary_formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_binary_formats);
+    if(create_info.shader_cache_dir && num_binary_formats > 0)
+        shader_cache_dir = create_info.shader_cache_dir;
+
+    // Let the driver compile things in the background
+    // when it can, otherwise fall back to compiling
+    // on our own worker thread with a shared context.
+    if(hasExtension("GL_KHR_parallel_shader_compile") || hasExtension("GL_ARB_parallel_shader_compile")) {
+        uvre::gl46::PFN_glMaxShaderCompilerThreadsKHR maxShaderCompilerThreads = reinterpret_cast<uvre::gl46::PFN_glMaxShaderCompilerThreadsKHR>(create_info.gl.getProcAddr(create_info.gl.user_data, "glMaxShaderCompilerThreadsKHR"));
+        if(!maxShaderCompilerThreads)
+            maxShaderCompilerThreads = reinterpret_cast<uvre::gl46::PFN_glMaxShaderCompilerThreadsKHR>(create_info.gl.getProcAddr(create_info.gl.user_data, "glMaxShaderCompilerThreadsARB"));
+        if(maxShaderCompilerThreads) {
+            maxShaderCompilerThreads(0xFFFFFFFF);
+            parallel_compile = true;
+        }
+    }
+
+    if(create_info.gl.makeWorkerContextCurrent)
+        worker = new uvre::gl46::Worker(create_info.gl.worker_user_data, create_info.gl.makeWorkerContextCurrent);
+
     std::memset(&info, 0, sizeof(uvre::DeviceInfo));
     info.impl_family = uvre::ImplFamily::OPENGL;
     info.impl_version_major = 4;
     info.impl_version_minor = 5;
     info.supports_anisotropic = true;
     info.supports_storage_buffers = true;
+    info.supports_compute = true;
     info.supports_shader_format[static_cast<int>(uvre::ShaderFormat::BINARY_SPIRV)] = true;
     info.supports_shader_format[static_cast<int>(uvre::ShaderFormat::SOURCE_GLSL)] = true;
 
@@ -124,9 +328,15 @@ uvre::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_in
     null_pipeline.num_attributes = 0;
     null_pipeline.attributes = 0;
     null_pipeline.vaos = nullptr;
+    null_pipeline.pending = nullptr;
+    null_pipeline.cache_key = nullptr;
     bound_pipeline = null_pipeline;
 
-    vbos = new uvre::VBOBinding;
+    // A zero would mean no frames at all
+    frame_fences.resize(std::max<size_t>(1, create_info.max_frames_in_flight), nullptr);
+    frame_garbage.resize(frame_fences.size());
+
+    vbos = new uvre::gl46::VBOBinding;
     vbos->index = 0;
     vbos->is_free = true;
     vbos->next = nullptr;
@@ -138,30 +348,99 @@ uvre::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_in
     }
 }
 
-uvre::RenderDeviceImpl::~RenderDeviceImpl()
+uvre::gl46::RenderDeviceImpl::~RenderDeviceImpl()
 {
-    for(uvre::CommandListImpl *commandlist : commandlists)
+    // Whatever is dropped by now goes right
+    // away, shaders might need the worker.
+    for(std::vector<std::function<void()>> &garbage : frame_garbage)
+        collectGarbage(garbage);
+    collectDropped(this);
+
+    // Handles dropped after this are only freed,
+    // the ones that got in just before still go.
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->device = nullptr;
+    }
+    collectDropped(this);
+
+    delete worker;
+
+    for(uvre::gl46::CommandListImpl *commandlist : commandlists)
         delete commandlist;
+    for(GLsync fence : frame_fences)
+        glDeleteSync(fence);
+    for(const uvre::gl46::PackBuffer &pack_buffer : pack_buffers)
+        deletePackBuffer(this, pack_buffer);
 
     pipelines.clear();
     buffers.clear();
     commandlists.clear();
+    shader_cache.clear();
+    pipeline_cache.clear();
+    sampler_cache.clear();
 
     // Make sure that the GL context doesn't use it anymore
     glDisable(GL_DEBUG_OUTPUT);
     glDebugMessageCallback(nullptr, nullptr);
 }
 
-const uvre::DeviceInfo &uvre::RenderDeviceImpl::getInfo() const
+const uvre::DeviceInfo &uvre::gl46::RenderDeviceImpl::getInfo() const
 {
     return info;
 }
 
-uvre::Shader uvre::RenderDeviceImpl::createShader(const uvre::ShaderCreateInfo &info)
+uvre::MemoryStats uvre::gl46::RenderDeviceImpl::getMemoryStats()
+{
+    std::lock_guard<std::mutex> lock(memory_mutex);
+    return memory_stats;
+}
+
+uint64_t uvre::gl46::RenderDeviceImpl::getLastUsedFrame(const uvre::Texture &texture)
+{
+    return texture ? uvre::gl46::impl(texture)->last_used_frame : 0;
+}
+
+struct Specialization final {
+    std::string entry_point;
+    std::vector<uint32_t> constant_ids;
+    std::vector<uint32_t> constant_values;
+};
+
+static void compileShader(uvre::gl46::Shader_S *shader, uvre::ShaderFormat format, const void *code, size_t code_size, const Specialization &spec)
+{
+    const char *source_cstr;
+    GLint source_length;
+    switch(format) {
+        case uvre::ShaderFormat::BINARY_SPIRV:
+            glShaderBinary(1, &shader->shobj, GL_SHADER_BINARY_FORMAT_SPIR_V, code, static_cast<GLsizei>(code_size));
+            glSpecializeShader(shader->shobj, spec.entry_point.c_str(), static_cast<GLuint>(spec.constant_ids.size()), spec.constant_ids.data(), spec.constant_values.data());
+            break;
+        case uvre::ShaderFormat::SOURCE_GLSL:
+            source_cstr = reinterpret_cast<const char *>(code);
+            source_length = static_cast<GLint>(code_size);
+            glShaderSource(shader->shobj, 1, &source_cstr, &source_length);
+            glCompileShader(shader->shobj);
+            break;
+        default:
+            break;
+    }
+
+    // Not querying anything here allows
+    // the driver to do its job in background.
+    glAttachShader(shader->prog, shader->shobj);
+    glLinkProgram(shader->prog);
+}
+
+template<typename T>
+static inline void appendKey(std::string &key, const T &value)
+{
+    key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static uvre::Shader startShader(uvre::gl46::RenderDeviceImpl *device, const uvre::ShaderCreateInfo &info, bool async)
 {
-    std::stringstream ss;
-    ss << "#version 460 core" << std::endl;
-    ss << "#define _UVRE_ 1" << std::endl;
+    std::string code = "#version 460 core\n#define _UVRE_ 1\n";
 
     uint32_t stage = 0;
     uint32_t stage_bit = 0;
@@ -169,100 +448,205 @@ uvre::Shader uvre::RenderDeviceImpl::createShader(const uvre::ShaderCreateInfo &
         case uvre::ShaderStage::VERTEX:
             stage = GL_VERTEX_SHADER;
             stage_bit = GL_VERTEX_SHADER_BIT;
-            ss << "#define _VERTEX_SHADER_ 1" << std::endl;
+            code += "#define _VERTEX_SHADER_ 1\n";
             break;
         case uvre::ShaderStage::FRAGMENT:
             stage = GL_FRAGMENT_SHADER;
             stage_bit = GL_FRAGMENT_SHADER_BIT;
-            ss << "#define _FRAGMENT_SHADER_ 1" << std::endl;
+            code += "#define _FRAGMENT_SHADER_ 1\n";
+            break;
+        case uvre::ShaderStage::COMPUTE:
+            stage = GL_COMPUTE_SHADER;
+            stage_bit = GL_COMPUTE_SHADER_BIT;
+            code += "#define _COMPUTE_SHADER_ 1\n";
             break;
     }
 
-    int32_t status, info_log_length;
-    std::string info_log;
-    uint32_t shobj = glCreateShader(stage);
-    const char *source_cstr;
-    std::string source;
+    uint64_t key = uvre::gl46::hashBytes(device->driver_hash, &info.stage, sizeof(info.stage));
+    key = uvre::gl46::hashBytes(key, &info.format, sizeof(info.format));
 
+    Specialization spec = {};
     switch(info.format) {
         case uvre::ShaderFormat::BINARY_SPIRV:
-            glShaderBinary(1, &shobj, GL_SHADER_BINARY_FORMAT_SPIR_V, info.code, static_cast<GLsizei>(info.code_size));
-            glSpecializeShader(shobj, "main", 0, nullptr, nullptr);
+            code.assign(reinterpret_cast<const char *>(info.code), info.code_size);
+            spec.entry_point = info.entry_point ? info.entry_point : "main";
+            spec.constant_ids.assign(info.spec_constant_ids, info.spec_constant_ids + info.num_spec_constants);
+            spec.constant_values.assign(info.spec_constant_values, info.spec_constant_values + info.num_spec_constants);
+
+            // Every specialization is a different program
+            key = uvre::gl46::hashBytes(key, spec.entry_point.c_str(), spec.entry_point.size() + 1);
+            key = uvre::gl46::hashBytes(key, spec.constant_ids.data(), spec.constant_ids.size() * sizeof(uint32_t));
+            key = uvre::gl46::hashBytes(key, spec.constant_values.data(), spec.constant_values.size() * sizeof(uint32_t));
             break;
         case uvre::ShaderFormat::SOURCE_GLSL:
-            ss << "#define _GLSL_ 1" << std::endl;
+            code += "#define _GLSL_ 1\n";
             if(info.stage == uvre::ShaderStage::VERTEX) {
                 // For some unknown reason Khronos decided that
                 // gl_PerVertex needs to be defined manually for
                 // separate programs. I really don't know. Too bad!
-                ss << "out gl_PerVertex {" << std::endl;
-                ss << " vec4 gl_Position;" << std::endl;
-                ss << " float gl_PointSize;" << std::endl;
-                ss << " float gl_ClipDistance[];" << std::endl;
-                ss << "};" << std::endl;
+                code += "out gl_PerVertex {\n";
+                code += " vec4 gl_Position;\n";
+                code += " float gl_PointSize;\n";
+                code += " float gl_ClipDistance[];\n";
+                code += "};\n";
             }
-            source = ss.str() + reinterpret_cast<const char *>(info.code);
-            source_cstr = source.c_str();
-            glShaderSource(shobj, 1, &source_cstr, nullptr);
-            glCompileShader(shobj);
+            if(!uvre::gl46::preprocessShader(device, info, code))
+                return nullptr;
             break;
         default:
-            glDeleteShader(shobj);
             return nullptr;
     }
 
-    if(create_info.onDebugMessage) {
-        glGetShaderiv(shobj, GL_INFO_LOG_LENGTH, &info_log_length);
+    key = uvre::gl46::hashBytes(key, code.data(), code.size());
+
+    // The hash only names the program binaries,
+    // the dedupe goes by everything that went in.
+    std::string cache_key;
+    appendKey(cache_key, info.stage);
+    appendKey(cache_key, info.format);
+    cache_key.append(spec.entry_point.c_str(), spec.entry_point.size() + 1);
+    appendKey(cache_key, spec.constant_ids.size());
+    cache_key.append(reinterpret_cast<const char *>(spec.constant_ids.data()), spec.constant_ids.size() * sizeof(uint32_t));
+    cache_key.append(reinterpret_cast<const char *>(spec.constant_values.data()), spec.constant_values.size() * sizeof(uint32_t));
+    cache_key += code;
+
+    // Identical requests share the same object
+    std::unordered_map<std::string, std::weak_ptr<uvre::gl46::Shader_S>>::const_iterator it = device->shader_cache.find(cache_key);
+    if(it != device->shader_cache.cend()) {
+        uvre::Shader existing = it->second.lock();
+        if(existing)
+            return existing;
+    }
+
+    std::shared_ptr<uvre::gl46::Shader_S> shader(new uvre::gl46::Shader_S, deferDestroy(device, destroyShader));
+    shader->prog = glCreateProgram();
+    shader->stage = info.stage;
+    shader->stage_bit = stage_bit;
+    shader->key = key;
+    shader->id = ++device->next_shader_id;
+    shader->cache_key = std::move(cache_key);
+    shader->shobj = 0;
+    shader->threaded = false;
+    shader->fence = nullptr;
+
+    device->shader_cache[shader->cache_key] = shader;
+
+    glProgramParameteri(shader->prog, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    if(uvre::gl46::loadProgramBinary(device, key, shader->prog))
+        return shader;
+
+    // A program which binary has been rejected
+    // can still be linked the usual way.
+    if(!device->shader_cache_dir.empty())
+        glProgramParameteri(shader->prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    shader->shobj = glCreateShader(stage);
+
+    if(async && device->worker && !device->parallel_compile) {
+        // The worker context won't see the objects
+        // until the commands creating them are flushed.
+        glFlush();
+
+        uvre::gl46::Shader_S *shader_ptr = shader.get();
+        uvre::ShaderFormat format = info.format;
+        shader->threaded = true;
+        device->worker->push([shader_ptr, format, code, spec]() {
+            compileShader(shader_ptr, format, code.data(), code.size(), spec);
+            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+            shader_ptr->fence = fence;
+        });
+
+        return shader;
+    }
+
+    compileShader(shader.get(), info.format, code.data(), code.size(), spec);
+    return shader;
+}
+
+static bool finishShader(uvre::gl46::RenderDeviceImpl *device, uvre::gl46::Shader_S *shader, bool wait)
+{
+    if(!shader->shobj)
+        return true;
+
+    if(shader->threaded) {
+        if(wait)
+            device->worker->wait();
+        GLsync fence = shader->fence;
+        if(!fence || glClientWaitSync(fence, 0, wait ? GL_TIMEOUT_IGNORED : 0) == GL_TIMEOUT_EXPIRED)
+            return false;
+        glDeleteSync(fence);
+        shader->fence = nullptr;
+    }
+    else if(!wait && device->parallel_compile) {
+        int32_t completed;
+        glGetProgramiv(shader->prog, uvre::gl46::KHR_COMPLETION_STATUS, &completed);
+        if(!completed)
+            return false;
+    }
+
+    int32_t status, info_log_length;
+    std::string info_log;
+
+    if(device->create_info.onDebugMessage) {
+        glGetShaderiv(shader->shobj, GL_INFO_LOG_LENGTH, &info_log_length);
         if(info_log_length > 1) {
             info_log.resize(info_log_length);
-            glGetShaderInfoLog(shobj, static_cast<GLsizei>(info_log.size()), nullptr, &info_log[0]);
+            glGetShaderInfoLog(shader->shobj, static_cast<GLsizei>(info_log.size()), nullptr, &info_log[0]);
 
             uvre::DebugMessageInfo msg = {};
             msg.level = uvre::DebugMessageLevel::INFO;
             msg.text = info_log.c_str();
-            create_info.onDebugMessage(msg);
+            device->create_info.onDebugMessage(msg);
         }
-    }
-
-    glGetShaderiv(shobj, GL_COMPILE_STATUS, &status);
-    if(!status) {
-        glDeleteShader(shobj);
-        return nullptr;
-    }
 
-    uint32_t prog = glCreateProgram();
-    glProgramParameteri(prog, GL_PROGRAM_SEPARABLE, GL_TRUE);
-    glAttachShader(prog, shobj);
-    glLinkProgram(prog);
-    glDeleteShader(shobj);
-
-    if(create_info.onDebugMessage) {
-        glGetProgramiv(prog, GL_INFO_LOG_LENGTH, &info_log_length);
+        glGetProgramiv(shader->prog, GL_INFO_LOG_LENGTH, &info_log_length);
         if(info_log_length > 1) {
             info_log.resize(info_log_length);
-            glGetProgramInfoLog(prog, static_cast<GLsizei>(info_log.size()), nullptr, &info_log[0]);
+            glGetProgramInfoLog(shader->prog, static_cast<GLsizei>(info_log.size()), nullptr, &info_log[0]);
 
             uvre::DebugMessageInfo msg = {};
             msg.level = uvre::DebugMessageLevel::INFO;
             msg.text = info_log.c_str();
-            create_info.onDebugMessage(msg);
+            device->create_info.onDebugMessage(msg);
         }
     }
 
-    glGetProgramiv(prog, GL_LINK_STATUS, &status);
+    glDetachShader(shader->prog, shader->shobj);
+    glDeleteShader(shader->shobj);
+    shader->shobj = 0;
+
+    // A failed shader stays alive as an
+    // empty program so that the pipelines
+    // using it are left with an unused stage.
+    glGetProgramiv(shader->prog, GL_LINK_STATUS, &status);
     if(!status) {
-        glDeleteProgram(prog);
-        return nullptr;
+        glDeleteProgram(shader->prog);
+        shader->prog = 0;
+        return true;
     }
 
-    uvre::Shader shader(new uvre::Shader_S, destroyShader);
-    shader->prog = prog;
-    shader->stage = info.stage;
-    shader->stage_bit = stage_bit;
+    uvre::gl46::storeProgramBinary(device, shader->key, shader->prog);
+    return true;
+}
 
+uvre::Shader uvre::gl46::RenderDeviceImpl::createShader(const uvre::ShaderCreateInfo &info)
+{
+    uvre::Shader shader = startShader(this, info, false);
+    if(!shader || !finishShader(this, uvre::gl46::impl(shader), true) || !uvre::gl46::impl(shader)->prog)
+        return nullptr;
     return shader;
 }
 
+uvre::Shader uvre::gl46::RenderDeviceImpl::createShaderAsync(const uvre::ShaderCreateInfo &info)
+{
+    return startShader(this, info, true);
+}
+
+bool uvre::gl46::RenderDeviceImpl::isReady(const uvre::Shader &shader)
+{
+    return !shader || finishShader(this, uvre::gl46::impl(shader), false);
+}
+
 static inline uint32_t getBlendEquation(uvre::BlendEquation equation)
 {
     switch(equation) {
@@ -418,7 +802,7 @@ static inline uint32_t getFillMode(uvre::FillMode mode)
     }
 }
 
-static inline void setVertexFormat(uvre::VertexArray_S *vao, const uvre::Pipeline_S *pipeline)
+static inline void setVertexFormat(uvre::gl46::VertexArray_S *vao, const uvre::gl46::Pipeline_S *pipeline)
 {
     if(vao && vao != &dummy_vao) {
         for(size_t i = 0; i < pipeline->num_attributes; i++) {
@@ -438,15 +822,15 @@ static inline void setVertexFormat(uvre::VertexArray_S *vao, const uvre::Pipelin
     }
 }
 
-static inline uvre::VertexArray_S *getVertexArray(uvre::VertexArray_S **head, uint32_t index, const uvre::Pipeline_S *pipeline)
+static inline uvre::gl46::VertexArray_S *getVertexArray(uvre::gl46::VertexArray_S **head, uint32_t index, const uvre::gl46::Pipeline_S *pipeline)
 {
-    for(uvre::VertexArray_S *node = *head; node; node = node->next) {
+    for(uvre::gl46::VertexArray_S *node = *head; node; node = node->next) {
         if(index != node->index)
             continue;
         return node;
     }
 
-    uvre::VertexArray_S *next = new uvre::VertexArray_S;
+    uvre::gl46::VertexArray_S *next = new uvre::gl46::VertexArray_S;
     next->index = (*head)->index + 1;
     glCreateVertexArrays(1, &next->vaobj);
     next->vbobj = 0;
@@ -456,9 +840,88 @@ static inline uvre::VertexArray_S *getVertexArray(uvre::VertexArray_S **head, ui
     return next;
 }
 
-uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreateInfo &info)
+static bool finishPipeline(uvre::gl46::RenderDeviceImpl *device, uvre::gl46::Pipeline_S *pipeline, bool wait)
+{
+    if(!pipeline->pending)
+        return true;
+
+    for(const uvre::Shader &shader : pipeline->pending->shaders) {
+        if(!finishShader(device, uvre::gl46::impl(shader), wait))
+            return false;
+    }
+
+    for(const uvre::Shader &shader : pipeline->pending->shaders) {
+        // Use this shader stage
+        glUseProgramStages(pipeline->ppobj, uvre::gl46::impl(shader)->stage_bit, uvre::gl46::impl(shader)->prog);
+    }
+
+    delete pipeline->pending;
+    pipeline->pending = nullptr;
+    return true;
+}
+
+// Exact keys: a hash collision here
+// would silently hand out a wrong object.
+static std::string getPipelineKey(const uvre::PipelineCreateInfo &info)
+{
+    std::string key;
+    appendKey(key, info.blending.enabled);
+    appendKey(key, info.blending.equation);
+    appendKey(key, info.blending.sfactor);
+    appendKey(key, info.blending.dfactor);
+    appendKey(key, info.depth_testing.enabled);
+    appendKey(key, info.depth_testing.func);
+    appendKey(key, info.face_culling.enabled);
+    appendKey(key, info.face_culling.flags);
+    appendKey(key, info.scissor_test);
+    appendKey(key, info.index_type);
+    appendKey(key, info.primitive_mode);
+    appendKey(key, info.fill_mode);
+    appendKey(key, info.vertex_stride);
+
+    appendKey(key, info.num_vertex_attribs);
+    for(size_t i = 0; i < info.num_vertex_attribs; i++) {
+        appendKey(key, info.vertex_attribs[i].id);
+        appendKey(key, info.vertex_attribs[i].type);
+        appendKey(key, info.vertex_attribs[i].count);
+        appendKey(key, info.vertex_attribs[i].offset);
+        appendKey(key, info.vertex_attribs[i].normalized);
+    }
+
+    // Shader objects are identified by their unique
+    // id rather than by address which can be reused.
+    appendKey(key, info.num_shaders);
+    for(size_t i = 0; i < info.num_shaders; i++)
+        appendKey(key, info.shaders[i] ? uvre::gl46::impl(info.shaders[i])->id : UINT64_C(0));
+
+    return key;
+}
+
+uvre::Pipeline uvre::gl46::RenderDeviceImpl::createPipeline(const uvre::PipelineCreateInfo &info)
+{
+    uvre::Pipeline pipeline = createPipelineAsync(info);
+    finishPipeline(this, uvre::gl46::impl(pipeline), true);
+    return pipeline;
+}
+
+uvre::Pipeline uvre::gl46::RenderDeviceImpl::createPipelineAsync(const uvre::PipelineCreateInfo &info)
 {
-    uvre::Pipeline pipeline(new uvre::Pipeline_S, std::bind(destroyPipeline, std::placeholders::_1, this));
+    std::string cache_key = getPipelineKey(info);
+    std::unordered_map<std::string, uvre::gl46::CacheEntry<uvre::gl46::Pipeline_S>>::iterator it = pipeline_cache.find(cache_key);
+    if(it != pipeline_cache.end()) {
+        uvre::Pipeline existing = it->second.handle.lock();
+        if(existing)
+            return existing;
+    }
+    else {
+        it = pipeline_cache.emplace(std::move(cache_key), uvre::gl46::CacheEntry<uvre::gl46::Pipeline_S>()).first;
+    }
+
+    std::shared_ptr<uvre::gl46::Pipeline_S> pipeline(new uvre::gl46::Pipeline_S, deferDestroy(this, destroyPipeline));
+    pipeline->cache_key = &it->first;
+    it->second.users++;
+    it->second.object = pipeline.get();
+    it->second.handle = pipeline;
 
     glCreateProgramPipelines(1, &pipeline->ppobj);
 
@@ -473,6 +936,7 @@ uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreate
     pipeline->face_culling.enabled = info.face_culling.enabled;
     pipeline->face_culling.front_face = (info.face_culling.flags & uvre::CULL_CLOCKWISE) ? GL_CW : GL_CCW;
     pipeline->face_culling.cull_face = getCullFace(info.face_culling.flags & uvre::CULL_BACK, info.face_culling.flags & uvre::CULL_FRONT);
+    pipeline->scissor_test = info.scissor_test;
     pipeline->index_size = getIndexSize(info.index_type);
     pipeline->index_type = getIndexType(info.index_type);
     pipeline->primitive_mode = getPrimitiveType(info.primitive_mode);
@@ -482,21 +946,30 @@ uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreate
     pipeline->attributes = new uvre::VertexAttrib[pipeline->num_attributes];
     std::copy(info.vertex_attribs, info.vertex_attribs + info.num_vertex_attribs, pipeline->attributes);
 
-    pipeline->vaos = new uvre::VertexArray_S;
+    pipeline->vaos = new uvre::gl46::VertexArray_S;
     pipeline->vaos->index = 0;
     glCreateVertexArrays(1, &pipeline->vaos->vaobj);
     pipeline->vaos->next = nullptr;
     setVertexFormat(pipeline->vaos, pipeline.get());
 
+    pipeline->pending = nullptr;
     for(size_t i = 0; i < info.num_shaders; i++) {
         if(info.shaders[i]) {
-            // Use this shader stage
-            glUseProgramStages(pipeline->ppobj, info.shaders[i]->stage_bit, info.shaders[i]->prog);
+            if(finishShader(this, uvre::gl46::impl(info.shaders[i]), false)) {
+                // Use this shader stage
+                glUseProgramStages(pipeline->ppobj, uvre::gl46::impl(info.shaders[i])->stage_bit, uvre::gl46::impl(info.shaders[i])->prog);
+                continue;
+            }
+
+            // The stage is attached later on
+            if(!pipeline->pending)
+                pipeline->pending = new uvre::gl46::PendingPipeline_S;
+            pipeline->pending->shaders.push_back(info.shaders[i]);
         }
     }
 
     // Notify the buffers
-    for(uvre::Buffer_S *buffer : buffers) {
+    for(uvre::gl46::Buffer_S *buffer : buffers) {
         // offset is zero and that is hardcoded
         glVertexArrayVertexBuffer(getVertexArray(&pipeline->vaos, buffer->vbo->index / max_vbo_bindings, pipeline.get())->vaobj, buffer->vbo->index % max_vbo_bindings, buffer->bufobj, 0, static_cast<GLsizei>(pipeline->vertex_stride));
     }
@@ -507,15 +980,20 @@ uvre::Pipeline uvre::RenderDeviceImpl::createPipeline(const uvre::PipelineCreate
     return pipeline;
 }
 
-static uvre::VBOBinding *getFreeVBOBinding(uvre::VBOBinding **head)
+bool uvre::gl46::RenderDeviceImpl::isReady(const uvre::Pipeline &pipeline)
 {
-    for(uvre::VBOBinding *node = *head; node; node = node->next) {
+    return !pipeline || finishPipeline(this, uvre::gl46::impl(pipeline), false);
+}
+
+static uvre::gl46::VBOBinding *getFreeVBOBinding(uvre::gl46::VBOBinding **head)
+{
+    for(uvre::gl46::VBOBinding *node = *head; node; node = node->next) {
         if(!node->is_free)
             continue;
         return node;
     }
 
-    uvre::VBOBinding *next = new uvre::VBOBinding;
+    uvre::gl46::VBOBinding *next = new uvre::gl46::VBOBinding;
     next->index = (*head)->index + 1;
     next->is_free = true;
     next->next = *head;
@@ -523,21 +1001,22 @@ static uvre::VBOBinding *getFreeVBOBinding(uvre::VBOBinding **head)
     return next;
 }
 
-uvre::Buffer uvre::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &info)
+uvre::Buffer uvre::gl46::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &info)
 {
-    uvre::Buffer buffer(new uvre::Buffer_S, std::bind(destroyBuffer, std::placeholders::_1, this));
+    std::shared_ptr<uvre::gl46::Buffer_S> buffer(new uvre::gl46::Buffer_S, deferDestroy(this, destroyBuffer));
 
     glCreateBuffers(1, &buffer->bufobj);
 
     buffer->size = info.size;
     buffer->vbo = nullptr;
+    buffer->upload_serial = 0;
 
     if(info.type == uvre::BufferType::VERTEX_BUFFER) {
         buffer->vbo = getFreeVBOBinding(&vbos);
         buffer->vbo->is_free = false;
 
         // Notify the pipeline objects
-        for(uvre::Pipeline_S *pipeline : pipelines) {
+        for(uvre::gl46::Pipeline_S *pipeline : pipelines) {
             // offset is zero and that is hardcoded
             glVertexArrayVertexBuffer(getVertexArray(&pipeline->vaos, buffer->vbo->index / max_vbo_bindings, pipeline)->vaobj, buffer->vbo->index % max_vbo_bindings, buffer->bufobj, 0, static_cast<GLsizei>(pipeline->vertex_stride));
         }
@@ -547,18 +1026,42 @@ uvre::Buffer uvre::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &
     }
 
     glNamedBufferStorage(buffer->bufobj, static_cast<GLsizeiptr>(buffer->size), info.data, GL_DYNAMIC_STORAGE_BIT);
+    trackMemory(this, &uvre::MemoryStats::buffers, buffer->size);
     return buffer;
 }
 
-void uvre::RenderDeviceImpl::writeBuffer(uvre::Buffer buffer, size_t offset, size_t size, const void *data)
+void uvre::gl46::RenderDeviceImpl::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
 {
-    if(offset + size > buffer->size)
+    if(offset + size > uvre::gl46::impl(buffer)->size)
         return;
-    glNamedBufferSubData(buffer->bufobj, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+    waitUpload(this, uvre::gl46::impl(buffer)->upload_serial);
+    glNamedBufferSubData(uvre::gl46::impl(buffer)->bufobj, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+}
+
+static std::string getSamplerKey(const uvre::SamplerCreateInfo &info)
+{
+    std::string key;
+    appendKey(key, info.flags);
+    appendKey(key, info.aniso_level);
+    appendKey(key, info.min_lod);
+    appendKey(key, info.max_lod);
+    appendKey(key, info.lod_bias);
+    return key;
 }
 
-uvre::Sampler uvre::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInfo &info)
+uvre::Sampler uvre::gl46::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInfo &info)
 {
+    std::string key = getSamplerKey(info);
+    std::unordered_map<std::string, uvre::gl46::CacheEntry<uvre::gl46::Sampler_S>>::iterator it = sampler_cache.find(key);
+    if(it != sampler_cache.end()) {
+        uvre::Sampler existing = it->second.handle.lock();
+        if(existing)
+            return existing;
+    }
+    else {
+        it = sampler_cache.emplace(std::move(key), uvre::gl46::CacheEntry<uvre::gl46::Sampler_S>()).first;
+    }
+
     uint32_t ssobj;
     glCreateSamplers(1, &ssobj);
 
@@ -581,8 +1084,12 @@ uvre::Sampler uvre::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInf
     glSamplerParameterf(ssobj, GL_TEXTURE_MAX_LOD, info.max_lod);
     glSamplerParameterf(ssobj, GL_TEXTURE_LOD_BIAS, info.lod_bias);
 
-    uvre::Sampler sampler(new uvre::Sampler_S, destroySampler);
+    std::shared_ptr<uvre::gl46::Sampler_S> sampler(new uvre::gl46::Sampler_S, deferDestroy(this, destroySampler));
     sampler->ssobj = ssobj;
+    sampler->cache_key = &it->first;
+    it->second.users++;
+    it->second.object = sampler.get();
+    it->second.handle = sampler;
 
     return sampler;
 }
@@ -681,35 +1188,172 @@ static inline uint32_t getInternalFormat(uvre::PixelFormat format)
     }
 }
 
-uvre::Texture uvre::RenderDeviceImpl::createTexture(const uvre::TextureCreateInfo &info)
+static inline size_t getPixelSize(uvre::PixelFormat format)
 {
-    uint32_t texobj;
+    switch(format) {
+        case uvre::PixelFormat::R8_UNORM:
+        case uvre::PixelFormat::R8_SINT:
+        case uvre::PixelFormat::R8_UINT:
+        case uvre::PixelFormat::S8_UINT:
+            return 1;
+        case uvre::PixelFormat::R8G8_UNORM:
+        case uvre::PixelFormat::R8G8_SINT:
+        case uvre::PixelFormat::R8G8_UINT:
+        case uvre::PixelFormat::R16_UNORM:
+        case uvre::PixelFormat::R16_SINT:
+        case uvre::PixelFormat::R16_UINT:
+        case uvre::PixelFormat::R16_FLOAT:
+        case uvre::PixelFormat::D16_UNORM:
+            return 2;
+        case uvre::PixelFormat::R8G8B8_UNORM:
+        case uvre::PixelFormat::R8G8B8_SINT:
+        case uvre::PixelFormat::R8G8B8_UINT:
+            return 3;
+        case uvre::PixelFormat::R8G8B8A8_UNORM:
+        case uvre::PixelFormat::R8G8B8A8_SINT:
+        case uvre::PixelFormat::R8G8B8A8_UINT:
+        case uvre::PixelFormat::R16G16_UNORM:
+        case uvre::PixelFormat::R16G16_SINT:
+        case uvre::PixelFormat::R16G16_UINT:
+        case uvre::PixelFormat::R16G16_FLOAT:
+        case uvre::PixelFormat::R32_SINT:
+        case uvre::PixelFormat::R32_UINT:
+        case uvre::PixelFormat::R32_FLOAT:
+        case uvre::PixelFormat::D32_FLOAT:
+            return 4;
+        case uvre::PixelFormat::R16G16B16_UNORM:
+        case uvre::PixelFormat::R16G16B16_SINT:
+        case uvre::PixelFormat::R16G16B16_UINT:
+        case uvre::PixelFormat::R16G16B16_FLOAT:
+            return 6;
+        case uvre::PixelFormat::R16G16B16A16_UNORM:
+        case uvre::PixelFormat::R16G16B16A16_SINT:
+        case uvre::PixelFormat::R16G16B16A16_UINT:
+        case uvre::PixelFormat::R16G16B16A16_FLOAT:
+        case uvre::PixelFormat::R32G32_SINT:
+        case uvre::PixelFormat::R32G32_UINT:
+        case uvre::PixelFormat::R32G32_FLOAT:
+            return 8;
+        case uvre::PixelFormat::R32G32B32_SINT:
+        case uvre::PixelFormat::R32G32B32_UINT:
+        case uvre::PixelFormat::R32G32B32_FLOAT:
+            return 12;
+        case uvre::PixelFormat::R32G32B32A32_SINT:
+        case uvre::PixelFormat::R32G32B32A32_UINT:
+        case uvre::PixelFormat::R32G32B32A32_FLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+
+// Cube maps have six faces and arrays
+// have the same layer count on every level.
+static size_t getTextureSize(const uvre::TextureCreateInfo &info, size_t mip_levels)
+{
+    size_t layers = 1;
+    if(info.type == uvre::TextureType::TEXTURE_CUBE)
+        layers = 6;
+    else if(info.type == uvre::TextureType::TEXTURE_ARRAY)
+        layers = static_cast<size_t>(std::max(0, info.depth));
+
+    size_t pixels = 0;
+    int width = std::max(1, info.width);
+    int height = std::max(1, info.height);
+    for(size_t i = 0; i < mip_levels; i++) {
+        pixels += static_cast<size_t>(width) * static_cast<size_t>(height);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    return pixels * layers * getPixelSize(info.format);
+}
+
+uvre::Texture uvre::gl46::RenderDeviceImpl::createTexture(const uvre::TextureCreateInfo &info)
+{
+    uint32_t texobj, target;
     uint32_t format = getInternalFormat(info.format);
     int32_t mip_levels = std::max<int32_t>(1, static_cast<int32_t>(info.mip_levels));
 
     switch(info.type) {
         case uvre::TextureType::TEXTURE_2D:
-            glCreateTextures(GL_TEXTURE_2D, 1, &texobj);
+            target = GL_TEXTURE_2D;
+            glCreateTextures(target, 1, &texobj);
             glTextureStorage2D(texobj, mip_levels, format, info.width, info.height);
             break;
         case uvre::TextureType::TEXTURE_CUBE:
-            glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &texobj);
+            target = GL_TEXTURE_CUBE_MAP;
+            glCreateTextures(target, 1, &texobj);
             glTextureStorage2D(texobj, mip_levels, format, info.width, info.height);
             break;
         case uvre::TextureType::TEXTURE_ARRAY:
-            glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texobj);
+            target = GL_TEXTURE_2D_ARRAY;
+            glCreateTextures(target, 1, &texobj);
             glTextureStorage3D(texobj, mip_levels, format, info.width, info.height, info.depth);
             break;
         default:
             return nullptr;
     }
 
-    uvre::Texture texture(new uvre::Texture_S, destroyTexture);
+    std::shared_ptr<uvre::gl46::Texture_S> texture(new uvre::gl46::Texture_S, deferDestroy(this, destroyTexture));
     texture->texobj = texobj;
     texture->format = format;
+    texture->target = target;
     texture->width = info.width;
     texture->height = info.height;
     texture->depth = info.depth;
+    texture->upload_serial = 0;
+    texture->last_used_frame = 0;
+    texture->mip_levels = static_cast<size_t>(mip_levels);
+    texture->memory_size = getTextureSize(info, texture->mip_levels);
+    trackMemory(this, &uvre::MemoryStats::textures, texture->memory_size);
+
+    return texture;
+}
+
+uvre::Texture uvre::gl46::RenderDeviceImpl::createTextureView(const uvre::TextureViewCreateInfo &info)
+{
+    if(!info.texture)
+        return nullptr;
+
+    uint32_t target;
+    switch(info.type) {
+        case uvre::TextureType::TEXTURE_2D:
+            target = GL_TEXTURE_2D;
+            break;
+        case uvre::TextureType::TEXTURE_CUBE:
+            target = GL_TEXTURE_CUBE_MAP;
+            break;
+        case uvre::TextureType::TEXTURE_ARRAY:
+            target = GL_TEXTURE_2D_ARRAY;
+            break;
+        default:
+            return nullptr;
+    }
+
+    // glTextureView wants a name that was never
+    // bound, glCreateTextures doesn't give those.
+    const uvre::gl46::Texture_S *source = uvre::gl46::impl(info.texture);
+    const uint32_t format = getInternalFormat(info.format);
+    uint32_t texobj;
+    glGenTextures(1, &texobj);
+    glTextureView(texobj, target, source->texobj, format, static_cast<GLuint>(info.base_level), static_cast<GLuint>(info.num_levels), static_cast<GLuint>(info.base_layer), static_cast<GLuint>(info.num_layers));
+
+    // GL keeps the storage alive for as long as
+    // any view has it, so it's only one object.
+    std::shared_ptr<uvre::gl46::Texture_S> texture(new uvre::gl46::Texture_S, deferDestroy(this, destroyTexture));
+    texture->texobj = texobj;
+    texture->format = format;
+    texture->target = target;
+    texture->width = std::max(1, source->width >> info.base_level);
+    texture->height = std::max(1, source->height >> info.base_level);
+    texture->depth = static_cast<int>(info.num_layers);
+    texture->upload_serial = source->upload_serial;
+    texture->last_used_frame = 0;
+    texture->mip_levels = info.num_levels;
+    texture->memory_size = 0;
+    trackMemory(this, &uvre::MemoryStats::textures, texture->memory_size);
 
     return texture;
 }
@@ -827,62 +1471,234 @@ static bool getExternalFormat(uvre::PixelFormat format, uint32_t &fmt, uint32_t
     return true;
 }
 
-void uvre::RenderDeviceImpl::writeTexture2D(uvre::Texture texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data)
+void uvre::gl46::RenderDeviceImpl::writeTexture2D(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
 {
     uint32_t fmt, type;
     if(!getExternalFormat(format, fmt, type))
         return;
-    glTextureSubImage2D(texture->texobj, 0, x, y, w, h, fmt, type, data);
+    waitUpload(this, uvre::gl46::impl(texture)->upload_serial);
+    glTextureSubImage2D(uvre::gl46::impl(texture)->texobj, level, x, y, w, h, fmt, type, data);
 }
 
-void uvre::RenderDeviceImpl::writeTextureCube(uvre::Texture texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data)
+void uvre::gl46::RenderDeviceImpl::writeTextureCube(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
 {
     uint32_t fmt, type;
     if(!getExternalFormat(format, fmt, type))
         return;
-    glTextureSubImage3D(texture->texobj, 0, x, y, face, w, h, 1, fmt, type, data);
+    waitUpload(this, uvre::gl46::impl(texture)->upload_serial);
+    glTextureSubImage3D(uvre::gl46::impl(texture)->texobj, level, x, y, face, w, h, 1, fmt, type, data);
 }
 
-void uvre::RenderDeviceImpl::writeTextureArray(uvre::Texture texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data)
+void uvre::gl46::RenderDeviceImpl::writeTextureArray(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
 {
     uint32_t fmt, type;
     if(!getExternalFormat(format, fmt, type))
         return;
-    glTextureSubImage3D(texture->texobj, 0, x, y, z, w, h, d, fmt, type, data);
+    waitUpload(this, uvre::gl46::impl(texture)->upload_serial);
+    glTextureSubImage3D(uvre::gl46::impl(texture)->texobj, level, x, y, z, w, h, d, fmt, type, data);
+}
+
+void uvre::gl46::RenderDeviceImpl::setTextureBaseLevel(const uvre::Texture &texture, int level)
+{
+    glTextureParameteri(uvre::gl46::impl(texture)->texobj, GL_TEXTURE_BASE_LEVEL, level);
+}
+
+// The worker publishes an upload once the
+// GPU is done with it, after the ones before.
+static void queueUpload(uvre::gl46::RenderDeviceImpl *device, uint64_t &upload_serial, std::function<void()> upload)
+{
+    // The worker context won't see the objects
+    // until the commands creating them are flushed.
+    glFlush();
+
+    const uint64_t serial = ++device->uploads_queued;
+    upload_serial = serial;
+    device->worker->push([device, serial, upload = std::move(upload)]() {
+        upload();
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        device->uploads_done = serial;
+    });
+}
+
+// Rows are read 4-byte aligned, the
+// padding after the last one is not.
+static std::vector<uint8_t> copyPixels(uint32_t fmt, uint32_t type, int w, int h, int d, const void *data)
+{
+    const size_t components = (fmt == GL_RED) ? 1 : ((fmt == GL_RG) ? 2 : ((fmt == GL_RGB) ? 3 : 4));
+    const size_t component_size = (type == GL_BYTE || type == GL_UNSIGNED_BYTE) ? 1 : ((type == GL_SHORT || type == GL_UNSIGNED_SHORT) ? 2 : 4);
+    const size_t row = static_cast<size_t>(std::max(0, w)) * components * component_size;
+    const size_t rows = static_cast<size_t>(std::max(0, h)) * static_cast<size_t>(std::max(0, d));
+    if(!data || !row || !rows)
+        return std::vector<uint8_t>();
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    return std::vector<uint8_t>(bytes, bytes + ((row + 3) & ~static_cast<size_t>(3)) * (rows - 1) + row);
+}
+
+uvre::Buffer uvre::gl46::RenderDeviceImpl::createBufferAsync(const uvre::BufferCreateInfo &info)
+{
+    if(!worker || !info.data)
+        return createBuffer(info);
+
+    uvre::BufferCreateInfo storage_info = info;
+    storage_info.data = nullptr;
+
+    uvre::Buffer buffer = createBuffer(storage_info);
+    writeBufferAsync(buffer, 0, info.size, info.data);
+    return buffer;
+}
+
+void uvre::gl46::RenderDeviceImpl::writeBufferAsync(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    uvre::gl46::Buffer_S *glbuffer = uvre::gl46::impl(buffer);
+    if(!worker || offset + size > glbuffer->size) {
+        writeBuffer(buffer, offset, size, data);
+        return;
+    }
+
+    const uint32_t bufobj = glbuffer->bufobj;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    queueUpload(this, glbuffer->upload_serial, [bufobj, offset, copy = std::vector<uint8_t>(bytes, bytes + size)]() {
+        glNamedBufferSubData(bufobj, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(copy.size()), copy.data());
+    });
+}
+
+void uvre::gl46::RenderDeviceImpl::writeTexture2DAsync(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    uint32_t fmt, type;
+    if(!worker || !getExternalFormat(format, fmt, type)) {
+        writeTexture2D(texture, x, y, w, h, format, data, level);
+        return;
+    }
+
+    const uint32_t texobj = uvre::gl46::impl(texture)->texobj;
+    queueUpload(this, uvre::gl46::impl(texture)->upload_serial, [texobj, level, x, y, w, h, fmt, type, copy = copyPixels(fmt, type, w, h, 1, data)]() {
+        glTextureSubImage2D(texobj, level, x, y, w, h, fmt, type, copy.data());
+    });
+}
+
+void uvre::gl46::RenderDeviceImpl::writeTextureCubeAsync(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    uint32_t fmt, type;
+    if(!worker || !getExternalFormat(format, fmt, type)) {
+        writeTextureCube(texture, face, x, y, w, h, format, data, level);
+        return;
+    }
+
+    const uint32_t texobj = uvre::gl46::impl(texture)->texobj;
+    queueUpload(this, uvre::gl46::impl(texture)->upload_serial, [texobj, level, face, x, y, w, h, fmt, type, copy = copyPixels(fmt, type, w, h, 1, data)]() {
+        glTextureSubImage3D(texobj, level, x, y, face, w, h, 1, fmt, type, copy.data());
+    });
+}
+
+void uvre::gl46::RenderDeviceImpl::writeTextureArrayAsync(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
+{
+    uint32_t fmt, type;
+    if(!worker || !getExternalFormat(format, fmt, type)) {
+        writeTextureArray(texture, x, y, z, w, h, d, format, data, level);
+        return;
+    }
+
+    const uint32_t texobj = uvre::gl46::impl(texture)->texobj;
+    queueUpload(this, uvre::gl46::impl(texture)->upload_serial, [texobj, level, x, y, z, w, h, d, fmt, type, copy = copyPixels(fmt, type, w, h, d, data)]() {
+        glTextureSubImage3D(texobj, level, x, y, z, w, h, d, fmt, type, copy.data());
+    });
+}
+
+bool uvre::gl46::RenderDeviceImpl::isReady(const uvre::Buffer &buffer)
+{
+    return !buffer || uvre::gl46::impl(buffer)->upload_serial <= uploads_done;
+}
+
+bool uvre::gl46::RenderDeviceImpl::isReady(const uvre::Texture &texture)
+{
+    return !texture || uvre::gl46::impl(texture)->upload_serial <= uploads_done;
+}
+
+static size_t getAttachmentSize(const uvre::RenderTargetCreateInfo &info)
+{
+    size_t size = 0;
+    if(info.depth_attachment)
+        size += uvre::gl46::impl(info.depth_attachment)->memory_size;
+    if(info.stencil_attachment && info.stencil_attachment != info.depth_attachment)
+        size += uvre::gl46::impl(info.stencil_attachment)->memory_size;
+    for(size_t i = 0; i < info.num_color_attachments; i++)
+        size += uvre::gl46::impl(info.color_attachments[i].color)->memory_size;
+    return size;
 }
 
-uvre::RenderTarget uvre::RenderDeviceImpl::createRenderTarget(const uvre::RenderTargetCreateInfo &info)
+uvre::RenderTarget uvre::gl46::RenderDeviceImpl::createRenderTarget(const uvre::RenderTargetCreateInfo &info)
 {
     uint32_t fbobj;
     glCreateFramebuffers(1, &fbobj);
     if(info.depth_attachment)
-        glNamedFramebufferTexture(fbobj, GL_DEPTH_ATTACHMENT, info.depth_attachment->texobj, 0);
+        glNamedFramebufferTexture(fbobj, GL_DEPTH_ATTACHMENT, uvre::gl46::impl(info.depth_attachment)->texobj, 0);
     if(info.stencil_attachment)
-        glNamedFramebufferTexture(fbobj, GL_STENCIL_ATTACHMENT, info.stencil_attachment->texobj, 0);
+        glNamedFramebufferTexture(fbobj, GL_STENCIL_ATTACHMENT, uvre::gl46::impl(info.stencil_attachment)->texobj, 0);
     for(size_t i = 0; i < info.num_color_attachments; i++)
-        glNamedFramebufferTexture(fbobj, GL_COLOR_ATTACHMENT0 + info.color_attachments[i].id, info.color_attachments[i].color->texobj, 0);
+        glNamedFramebufferTexture(fbobj, GL_COLOR_ATTACHMENT0 + info.color_attachments[i].id, uvre::gl46::impl(info.color_attachments[i].color)->texobj, 0);
 
     if(glCheckNamedFramebufferStatus(fbobj, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         glDeleteFramebuffers(1, &fbobj);
         return nullptr;
     }
 
-    uvre::RenderTarget target(new uvre::RenderTarget_S, destroyRenderTarget);
+    std::shared_ptr<uvre::gl46::RenderTarget_S> target(new uvre::gl46::RenderTarget_S, deferDestroy(this, destroyRenderTarget));
     target->fbobj = fbobj;
+    target->memory_size = getAttachmentSize(info);
+    trackMemory(this, &uvre::MemoryStats::render_targets, target->memory_size);
 
     return target;
 }
 
-uvre::ICommandList *uvre::RenderDeviceImpl::createCommandList()
+static void addBufferRanges(uvre::gl46::ResourceSet_S *set, size_t count, const uvre::BufferRange *ranges, std::vector<uint32_t> &buffers, std::vector<GLintptr> &offsets, std::vector<GLsizeiptr> &sizes)
+{
+    for(size_t i = 0; i < count; i++) {
+        const uvre::Buffer &buffer = ranges[i].buffer;
+        const size_t size = (buffer && !ranges[i].size) ? uvre::gl46::impl(buffer)->size - ranges[i].offset : ranges[i].size;
+        buffers.push_back(buffer ? uvre::gl46::impl(buffer)->bufobj : 0);
+        offsets.push_back(static_cast<GLintptr>(ranges[i].offset));
+        sizes.push_back(static_cast<GLsizeiptr>(size));
+        set->objects.push_back(buffer);
+    }
+}
+
+uvre::ResourceSet uvre::gl46::RenderDeviceImpl::createResourceSet(const uvre::ResourceSetCreateInfo &info)
+{
+    std::shared_ptr<uvre::gl46::ResourceSet_S> set(new uvre::gl46::ResourceSet_S, deferDestroy(this, destroyResourceSet));
+
+    for(size_t i = 0; i < info.num_textures; i++) {
+        const uvre::Texture &texture = info.textures[i];
+        set->textures.push_back(texture ? uvre::gl46::impl(texture)->texobj : 0);
+        set->objects.push_back(texture);
+        if(texture)
+            set->texture_objects.push_back(uvre::gl46::impl(texture));
+    }
+
+    for(size_t i = 0; i < info.num_samplers; i++) {
+        const uvre::Sampler &sampler = info.samplers[i];
+        set->samplers.push_back(sampler ? uvre::gl46::impl(sampler)->ssobj : 0);
+        set->objects.push_back(sampler);
+    }
+
+    addBufferRanges(set.get(), info.num_uniform_buffers, info.uniform_buffers, set->uniform_buffers, set->uniform_offsets, set->uniform_sizes);
+    addBufferRanges(set.get(), info.num_storage_buffers, info.storage_buffers, set->storage_buffers, set->storage_offsets, set->storage_sizes);
+
+    return set;
+}
+
+uvre::ICommandList *uvre::gl46::RenderDeviceImpl::createCommandList()
 {
-    uvre::CommandListImpl *commands = new uvre::CommandListImpl();
+    uvre::gl46::CommandListImpl *commands = new uvre::gl46::CommandListImpl();
     commandlists.push_back(commands);
     return commands;
 }
 
-void uvre::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
+void uvre::gl46::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
 {
-    for(std::vector<uvre::CommandListImpl *>::const_iterator it = commandlists.cbegin(); it != commandlists.cend(); it++) {
+    for(std::vector<uvre::gl46::CommandListImpl *>::const_iterator it = commandlists.cbegin(); it != commandlists.cend(); it++) {
         if(*it == commands) {
             commandlists.erase(it);
             delete commands;
@@ -891,36 +1707,42 @@ void uvre::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
     }
 }
 
-void uvre::RenderDeviceImpl::startRecording(uvre::ICommandList *commands)
+void uvre::gl46::RenderDeviceImpl::startRecording(uvre::ICommandList *commands)
 {
-    uvre::CommandListImpl *glcommands = static_cast<uvre::CommandListImpl *>(commands);
+    uvre::gl46::CommandListImpl *glcommands = static_cast<uvre::gl46::CommandListImpl *>(commands);
     glcommands->num_commands = 0;
+    glcommands->used_textures.clear();
 }
 
-void uvre::RenderDeviceImpl::submit(uvre::ICommandList *commands)
+void uvre::gl46::RenderDeviceImpl::submit(uvre::ICommandList *commands)
 {
-    uvre::CommandListImpl *glcommands = static_cast<uvre::CommandListImpl *>(commands);
+    uvre::gl46::CommandListImpl *glcommands = static_cast<uvre::gl46::CommandListImpl *>(commands);
+    // Residency managers want to know this
+    for(uvre::gl46::Texture_S *texture : glcommands->used_textures)
+        texture->last_used_frame = frame_number + 1;
+
     for(size_t i = 0; i < glcommands->num_commands; i++) {
-        const uvre::Command &cmd = glcommands->commands[i];
-        uvre::VertexArray_S *vaonode = nullptr;
+        const uvre::gl46::Command &cmd = glcommands->commands[i];
+        uvre::gl46::VertexArray_S *vaonode = nullptr;
         switch(cmd.type) {
-            case uvre::CommandType::SET_SCISSOR:
+            case uvre::gl46::CommandType::SET_SCISSOR:
                 glScissor(cmd.scvp.x, cmd.scvp.y, cmd.scvp.w, cmd.scvp.h);
                 break;
-            case uvre::CommandType::SET_VIEWPORT:
+            case uvre::gl46::CommandType::SET_VIEWPORT:
                 glViewport(cmd.scvp.x, cmd.scvp.y, cmd.scvp.w, cmd.scvp.h);
                 break;
-            case uvre::CommandType::SET_CLEAR_DEPTH:
+            case uvre::gl46::CommandType::SET_CLEAR_DEPTH:
                 glClearDepth(static_cast<GLdouble>(cmd.depth));
                 break;
-            case uvre::CommandType::SET_CLEAR_COLOR:
+            case uvre::gl46::CommandType::SET_CLEAR_COLOR:
                 glClearColor(cmd.color[0], cmd.color[1], cmd.color[2], cmd.color[3]);
                 break;
-            case uvre::CommandType::CLEAR:
+            case uvre::gl46::CommandType::CLEAR:
                 glClear(cmd.clear_mask);
                 break;
-            case uvre::CommandType::BIND_PIPELINE:
-                bound_pipeline = cmd.pipeline;
+            case uvre::gl46::CommandType::BIND_PIPELINE:
+                finishPipeline(this, cmd.pipeline, true);
+                bound_pipeline = *cmd.pipeline;
                 glDisable(GL_BLEND);
                 glDisable(GL_DEPTH_TEST);
                 glDisable(GL_CULL_FACE);
@@ -944,16 +1766,16 @@ void uvre::RenderDeviceImpl::submit(uvre::ICommandList *commands)
                 glPolygonMode(GL_FRONT_AND_BACK, bound_pipeline.fill_mode);
                 glBindProgramPipeline(bound_pipeline.ppobj);
                 break;
-            case uvre::CommandType::BIND_STORAGE_BUFFER:
+            case uvre::gl46::CommandType::BIND_STORAGE_BUFFER:
                 glBindBufferBase(GL_SHADER_STORAGE_BUFFER, cmd.bind_index, cmd.object);
                 break;
-            case uvre::CommandType::BIND_UNIFORM_BUFFER:
+            case uvre::gl46::CommandType::BIND_UNIFORM_BUFFER:
                 glBindBufferBase(GL_UNIFORM_BUFFER, cmd.bind_index, cmd.object);
                 break;
-            case uvre::CommandType::BIND_INDEX_BUFFER: // OPTIMIZE
+            case uvre::gl46::CommandType::BIND_INDEX_BUFFER: // OPTIMIZE
                 bound_pipeline.bound_ibo = cmd.object;
                 break;
-            case uvre::CommandType::BIND_VERTEX_BUFFER: // OPTIMIZE
+            case uvre::gl46::CommandType::BIND_VERTEX_BUFFER: // OPTIMIZE
                 vaonode = getVertexArray(&bound_pipeline.vaos, cmd.buffer.vbo->index / max_vbo_bindings, &bound_pipeline);
                 if(vaonode->vaobj != bound_pipeline.bound_vao) {
                     bound_pipeline.bound_vao = vaonode->vaobj;
@@ -966,49 +1788,276 @@ void uvre::RenderDeviceImpl::submit(uvre::ICommandList *commands)
                     glVertexArrayElementBuffer(vaonode->vaobj, bound_pipeline.bound_ibo);
                 }
                 break;
-            case uvre::CommandType::BIND_SAMPLER:
+            case uvre::gl46::CommandType::BIND_SAMPLER:
                 glBindSampler(cmd.bind_index, cmd.object);
                 break;
-            case uvre::CommandType::BIND_TEXTURE:
+            case uvre::gl46::CommandType::BIND_TEXTURE:
                 glBindTextureUnit(cmd.bind_index, cmd.object);
                 break;
-            case uvre::CommandType::BIND_RENDER_TARGET:
+            case uvre::gl46::CommandType::BIND_RENDER_TARGET:
                 glBindFramebuffer(GL_FRAMEBUFFER, cmd.object);
                 break;
-            case uvre::CommandType::WRITE_BUFFER:
+            case uvre::gl46::CommandType::BIND_RESOURCE_SET:
+                if(!cmd.set->textures.empty())
+                    glBindTextures(cmd.bind_index, static_cast<GLsizei>(cmd.set->textures.size()), cmd.set->textures.data());
+                if(!cmd.set->samplers.empty())
+                    glBindSamplers(cmd.bind_index, static_cast<GLsizei>(cmd.set->samplers.size()), cmd.set->samplers.data());
+                if(!cmd.set->uniform_buffers.empty())
+                    glBindBuffersRange(GL_UNIFORM_BUFFER, cmd.bind_index, static_cast<GLsizei>(cmd.set->uniform_buffers.size()), cmd.set->uniform_buffers.data(), cmd.set->uniform_offsets.data(), cmd.set->uniform_sizes.data());
+                if(!cmd.set->storage_buffers.empty())
+                    glBindBuffersRange(GL_SHADER_STORAGE_BUFFER, cmd.bind_index, static_cast<GLsizei>(cmd.set->storage_buffers.size()), cmd.set->storage_buffers.data(), cmd.set->storage_offsets.data(), cmd.set->storage_sizes.data());
+                break;
+            case uvre::gl46::CommandType::BIND_STORAGE_IMAGE:
+                glBindImageTexture(cmd.bind_index, cmd.image.texture, cmd.image.level, cmd.image.layered, 0, cmd.image.access, cmd.image.format);
+                break;
+            case uvre::gl46::CommandType::WRITE_BUFFER:
                 glNamedBufferSubData(cmd.buffer_write.buffer, static_cast<GLintptr>(cmd.buffer_write.offset), static_cast<GLsizeiptr>(cmd.buffer_write.size), cmd.buffer_write.data_ptr);
                 break;
-            case uvre::CommandType::COPY_RENDER_TARGET:
+            case uvre::gl46::CommandType::COPY_RENDER_TARGET:
                 glBlitNamedFramebuffer(cmd.rt_copy.src, cmd.rt_copy.dst, cmd.rt_copy.sx0, cmd.rt_copy.sy0, cmd.rt_copy.sx1, cmd.rt_copy.sy1, cmd.rt_copy.dx0, cmd.rt_copy.dy0, cmd.rt_copy.dx1, cmd.rt_copy.dy1, cmd.rt_copy.mask, cmd.rt_copy.filter);
                 break;
-            case uvre::CommandType::DRAW:
+            case uvre::gl46::CommandType::GENERATE_MIPMAPS:
+                glGenerateTextureMipmap(cmd.object);
+                break;
+            case uvre::gl46::CommandType::MEMORY_BARRIER:
+                glMemoryBarrier(cmd.barrier_mask);
+                break;
+            case uvre::gl46::CommandType::BEGIN_QUERY:
+                glBeginQuery(cmd.query.target, cmd.query.qobj);
+                break;
+            case uvre::gl46::CommandType::END_QUERY:
+                glEndQuery(cmd.query.target);
+                break;
+            case uvre::gl46::CommandType::BEGIN_CONDITIONAL_RENDER:
+                glBeginConditionalRender(cmd.cond.qobj, cmd.cond.mode);
+                break;
+            case uvre::gl46::CommandType::END_CONDITIONAL_RENDER:
+                glEndConditionalRender();
+                break;
+            case uvre::gl46::CommandType::DRAW:
                 glDrawArraysInstancedBaseInstance(bound_pipeline.primitive_mode, cmd.draw.a.base_vertex, cmd.draw.a.vertices, cmd.draw.a.instances, cmd.draw.a.base_instance);
                 break;
-            case uvre::CommandType::IDRAW:
+            case uvre::gl46::CommandType::IDRAW:
                 glDrawElementsInstancedBaseVertexBaseInstance(bound_pipeline.primitive_mode, cmd.draw.e.indices, bound_pipeline.index_type, reinterpret_cast<const void *>(static_cast<uintptr_t>(bound_pipeline.index_size * cmd.draw.e.base_index)), cmd.draw.e.instances, cmd.draw.e.base_vertex, cmd.draw.e.base_instance);
                 break;
+            case uvre::gl46::CommandType::DISPATCH:
+                glDispatchCompute(cmd.dispatch.x, cmd.dispatch.y, cmd.dispatch.z);
+                break;
+            case uvre::gl46::CommandType::DISPATCH_INDIRECT:
+                glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, cmd.indirect.buffer);
+                glDispatchComputeIndirect(static_cast<GLintptr>(cmd.indirect.offset));
+                break;
         }
     }
+
+    // Without frames there's nothing to wait
+    // for: GL keeps objects alive while the
+    // commands using them are still running.
+    // The list still points at whatever was
+    // dropped while recording it, hence after.
+    if(!frame_number)
+        collectDropped(this);
+}
+
+uvre::Fence uvre::gl46::RenderDeviceImpl::createFence()
+{
+    std::shared_ptr<uvre::gl46::Fence_S> fence(new uvre::gl46::Fence_S, deferDestroy(this, destroyFence));
+    fence->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return fence;
+}
+
+bool uvre::gl46::RenderDeviceImpl::waitFence(const uvre::Fence &fence, uint64_t timeout)
+{
+    // Flushing makes sure we don't wait
+    // for something that never reaches the GPU.
+    GLenum result = glClientWaitSync(uvre::gl46::impl(fence)->sync, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+}
+
+uvre::Query uvre::gl46::RenderDeviceImpl::createQuery(uvre::QueryType type)
+{
+    uint32_t target;
+    switch(type) {
+        case uvre::QueryType::OCCLUSION:
+            target = GL_SAMPLES_PASSED;
+            break;
+        case uvre::QueryType::ANY_SAMPLES:
+            target = GL_ANY_SAMPLES_PASSED;
+            break;
+        default:
+            return nullptr;
+    }
+
+    std::shared_ptr<uvre::gl46::Query_S> query(new uvre::gl46::Query_S, deferDestroy(this, destroyQuery));
+    glCreateQueries(target, 1, &query->qobj);
+    query->target = target;
+
+    return query;
+}
+
+bool uvre::gl46::RenderDeviceImpl::getQueryResult(const uvre::Query &query, uint64_t &result)
+{
+    int32_t available;
+    glGetQueryObjectiv(uvre::gl46::impl(query)->qobj, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available)
+        return false;
+    glGetQueryObjectui64v(uvre::gl46::impl(query)->qobj, GL_QUERY_RESULT, &result);
+    return true;
+}
+
+static std::shared_ptr<uvre::gl46::Readback_S> createReadback(uvre::gl46::RenderDeviceImpl *device, size_t size)
+{
+    std::shared_ptr<uvre::gl46::Readback_S> readback(new uvre::gl46::Readback_S, deferDestroy(device, destroyReadback));
+    readback->size = size;
+    readback->sync = nullptr;
+    readback->mapped = nullptr;
+
+    // The smallest free buffer that fits, a new
+    // one only if none of them is large enough.
+    std::vector<uvre::gl46::PackBuffer>::iterator best = device->pack_buffers.end();
+    for(std::vector<uvre::gl46::PackBuffer>::iterator it = device->pack_buffers.begin(); it != device->pack_buffers.end(); it++) {
+        if(it->capacity >= size && (best == device->pack_buffers.end() || it->capacity < best->capacity))
+            best = it;
+    }
+
+    if(best != device->pack_buffers.end()) {
+        readback->bufobj = best->bufobj;
+        readback->capacity = best->capacity;
+        device->pack_buffers.erase(best);
+        return readback;
+    }
+
+    glCreateBuffers(1, &readback->bufobj);
+    glNamedBufferStorage(readback->bufobj, static_cast<GLsizeiptr>(size), nullptr, GL_MAP_READ_BIT | GL_CLIENT_STORAGE_BIT);
+    readback->capacity = size;
+    trackMemory(device, &uvre::MemoryStats::buffers, size);
+    return readback;
+}
+
+uvre::Readback uvre::gl46::RenderDeviceImpl::readRenderTargetAsync(const uvre::RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    uint32_t fmt, type;
+    const size_t size = static_cast<size_t>(w) * static_cast<size_t>(h) * getPixelSize(format);
+    if(!size || !getExternalFormat(format, fmt, type))
+        return nullptr;
+
+    std::shared_ptr<uvre::gl46::Readback_S> readback = createReadback(this, size);
+    const uint32_t fbobj = target ? uvre::gl46::impl(target)->fbobj : 0;
+    if(fbobj)
+        glNamedFramebufferReadBuffer(fbobj, GL_COLOR_ATTACHMENT0 + attachment);
+
+    int32_t read_fbo;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_fbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbobj);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->bufobj);
+    int32_t pack_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(x, y, w, h, fmt, type, nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(read_fbo));
+
+    readback->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return readback;
+}
+
+uvre::Readback uvre::gl46::RenderDeviceImpl::readTextureAsync(const uvre::Texture &texture, int level, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    uint32_t fmt, type;
+    const size_t size = static_cast<size_t>(w) * static_cast<size_t>(h) * getPixelSize(format);
+    if(!texture || !size || !getExternalFormat(format, fmt, type))
+        return nullptr;
+
+    std::shared_ptr<uvre::gl46::Readback_S> readback = createReadback(this, size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->bufobj);
+    int32_t pack_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glGetTextureSubImage(uvre::gl46::impl(texture)->texobj, level, x, y, 0, w, h, 1, fmt, type, static_cast<GLsizei>(size), nullptr);
+    glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback->sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    return readback;
+}
+
+const void *uvre::gl46::RenderDeviceImpl::getReadbackData(const uvre::Readback &readback)
+{
+    uvre::gl46::Readback_S *readback_s = uvre::gl46::impl(readback);
+    if(!readback_s)
+        return nullptr;
+
+    // Polling with a zero timeout still flushes,
+    // so the fence is guaranteed to come around.
+    if(!readback_s->mapped) {
+        const GLenum status = glClientWaitSync(readback_s->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return nullptr;
+        readback_s->mapped = glMapNamedBufferRange(readback_s->bufobj, 0, static_cast<GLsizeiptr>(readback_s->size), GL_MAP_READ_BIT);
+    }
+
+    return readback_s->mapped;
+}
+
+void uvre::gl46::RenderDeviceImpl::beginFrame()
+{
+    GLsync &fence = frame_fences[frame_number % frame_fences.size()];
+    if(fence) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    collectGarbage(frame_garbage[frame_number % frame_garbage.size()]);
+
+    // Nothing read back for a whole round of
+    // frames, the buffers can go for now.
+    std::vector<uvre::gl46::PackBuffer>::iterator it = pack_buffers.begin();
+    for(; it != pack_buffers.end() && it->released + frame_fences.size() < frame_number; it++)
+        deletePackBuffer(this, *it);
+    pack_buffers.erase(pack_buffers.begin(), it);
+}
+
+void uvre::gl46::RenderDeviceImpl::endFrame()
+{
+    {
+        std::lock_guard<std::mutex> lock(drop_mutex);
+        std::vector<std::function<void()>> &garbage = frame_garbage[frame_number % frame_garbage.size()];
+        garbage.insert(garbage.end(), std::make_move_iterator(dropped.begin()), std::make_move_iterator(dropped.end()));
+        dropped.clear();
+    }
+
+    GLsync &fence = frame_fences[frame_number % frame_fences.size()];
+    if(fence)
+        glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_number++;
+}
+
+size_t uvre::gl46::RenderDeviceImpl::getFrameIndex() const
+{
+    return static_cast<size_t>(frame_number % frame_fences.size());
 }
 
-void uvre::RenderDeviceImpl::prepare()
+void uvre::gl46::RenderDeviceImpl::prepare()
 {
     // Third-party overlay applications
     // can cause mayhem if this is not called.
     glUseProgram(0);
 }
 
-void uvre::RenderDeviceImpl::present()
+void uvre::gl46::RenderDeviceImpl::present()
 {
     create_info.gl.swapBuffers(create_info.gl.user_data);
 }
 
-void uvre::RenderDeviceImpl::vsync(bool enable)
+void uvre::gl46::RenderDeviceImpl::vsync(bool enable)
 {
     create_info.gl.setSwapInterval(create_info.gl.user_data, enable ? 1 : 0);
 }
 
-void uvre::RenderDeviceImpl::mode(int, int)
+void uvre::gl46::RenderDeviceImpl::mode(int, int)
 {
     // Nothing in OpenGL
 }
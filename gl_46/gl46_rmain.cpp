@@ -8,7 +8,7 @@
  */
 #include "gl46_private.hpp"
 
-UVRE_API void uvre::pollImplInfo(uvre::ImplInfo &info)
+void uvre::gl46::pollImplInfo(uvre::ImplInfo &info)
 {
     info.family = uvre::ImplFamily::OPENGL;
     info.gl.core_profile = true;
@@ -16,20 +16,17 @@ UVRE_API void uvre::pollImplInfo(uvre::ImplInfo &info)
     info.gl.version_minor = 6;
 }
 
-UVRE_API uvre::IRenderDevice *uvre::createDevice(const uvre::DeviceCreateInfo &info)
+uvre::IRenderDevice *uvre::gl46::createDevice(const uvre::DeviceCreateInfo &info)
 {
     if(!info.gl.setSwapInterval || !info.gl.swapBuffers || !info.gl.makeContextCurrent || !info.gl.getProcAddr)
         return nullptr;
 
     info.gl.makeContextCurrent(info.gl.user_data);
-    if(gladLoadGLUserPtr(reinterpret_cast<GLADuserptrloadfunc>(info.gl.getProcAddr), info.gl.user_data))
-        return new uvre::RenderDeviceImpl(info);
+    // The loader is shared with GL 3.3 now, so
+    // an older context can't sneak through here.
+    if(gladLoadGLUserPtr(reinterpret_cast<GLADuserptrloadfunc>(info.gl.getProcAddr), info.gl.user_data) && GLAD_GL_VERSION_4_6)
+        return new uvre::gl46::RenderDeviceImpl(info);
 
     // We are doomed!!!
     return nullptr;
 }
-
-UVRE_API void uvre::destroyDevice(uvre::IRenderDevice *device)
-{
-    delete device;
-}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "gl46_private.hpp"
+
+static void workerMain(uvre::gl46::Worker *worker, void *user_data, void (*makeContextCurrent)(void *user_data))
+{
+    // The worker context shares objects with
+    // the main one and lives on this thread only.
+    makeContextCurrent(user_data);
+
+    std::unique_lock<std::mutex> lock(worker->mutex);
+    for(;;) {
+        worker->job_cv.wait(lock, [worker]() { return worker->quit || !worker->jobs.empty(); });
+
+        // Jobs queued before the shutdown
+        // are still processed, objects might
+        // be waiting for them to complete.
+        if(worker->jobs.empty())
+            break;
+
+        std::function<void()> job = std::move(worker->jobs.front());
+        worker->jobs.pop_front();
+        worker->busy = true;
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        worker->busy = false;
+        worker->idle_cv.notify_all();
+    }
+}
+
+uvre::gl46::Worker::Worker(void *user_data, void (*makeContextCurrent)(void *user_data))
+    : mutex(), job_cv(), idle_cv(), jobs(), busy(false), quit(false), thread()
+{
+    thread = std::thread(workerMain, this, user_data, makeContextCurrent);
+}
+
+uvre::gl46::Worker::~Worker()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+
+    job_cv.notify_all();
+    thread.join();
+}
+
+void uvre::gl46::Worker::push(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+
+    job_cv.notify_one();
+}
+
+void uvre::gl46::Worker::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle_cv.wait(lock, [this]() { return jobs.empty() && !busy; });
+}
@@ -3,7 +3,7 @@
  *
  * Generator: C/C++
  * Specification: gl
- * Extensions: 0
+ * Extensions: 3
  *
  * APIs:
  *  - gl:core=4.6
@@ -18,10 +18,10 @@
  *  - ON_DEMAND = False
  *
  * Commandline:
- *    --api='gl:core=4.6' --extensions='' c
+ *    --api='gl:core=4.6' --extensions='GL_ARB_base_instance,GL_ARB_vertex_attrib_binding,GL_KHR_debug' c
  *
  * Online:
- *    http://glad.sh/#api=gl%3Acore%3D4.6&extensions=&generator=c&options=
+ *    http://glad.sh/#api=gl%3Acore%3D4.6&extensions=GL_ARB_base_instance%2CGL_ARB_vertex_attrib_binding%2CGL_KHR_debug&generator=c&options=
  *
  */
 
@@ -1687,6 +1687,12 @@ GLAD_API_CALL int GLAD_GL_VERSION_4_4;
 GLAD_API_CALL int GLAD_GL_VERSION_4_5;
 #define GL_VERSION_4_6 1
 GLAD_API_CALL int GLAD_GL_VERSION_4_6;
+#define GL_ARB_base_instance 1
+GLAD_API_CALL int GLAD_GL_ARB_base_instance;
+#define GL_ARB_vertex_attrib_binding 1
+GLAD_API_CALL int GLAD_GL_ARB_vertex_attrib_binding;
+#define GL_KHR_debug 1
+GLAD_API_CALL int GLAD_GL_KHR_debug;
 
 
 typedef void (GLAD_API_PTR *PFNGLACTIVESHADERPROGRAMPROC)(GLuint pipeline, GLuint program);
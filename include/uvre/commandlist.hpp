@@ -22,19 +22,34 @@ public:
     virtual void setClearColor4f(float r, float g, float b, float a) = 0;
     virtual void clear(RenderTargetMask mask) = 0;
 
-    virtual void bindPipeline(Pipeline pipeline) = 0;
-    virtual void bindStorageBuffer(Buffer buffer, uint32_t index) = 0;
-    virtual void bindUniformBuffer(Buffer buffer, uint32_t index) = 0;
-    virtual void bindIndexBuffer(Buffer buffer) = 0;
-    virtual void bindVertexBuffer(Buffer buffer) = 0;
-    virtual void bindSampler(Sampler sampler, uint32_t index) = 0;
-    virtual void bindTexture(Texture texture, uint32_t index) = 0;
-    virtual void bindRenderTarget(RenderTarget target) = 0;
-
-    virtual void writeBuffer(Buffer buffer, size_t offset, size_t size, const void *data) = 0;
-    virtual void copyRenderTarget(RenderTarget src, RenderTarget dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, RenderTargetMask mask, bool filter) = 0;
+    virtual void bindPipeline(const Pipeline &pipeline) = 0;
+    virtual void bindStorageBuffer(const Buffer &buffer, uint32_t index) = 0;
+    virtual void bindUniformBuffer(const Buffer &buffer, uint32_t index) = 0;
+    virtual void bindIndexBuffer(const Buffer &buffer) = 0;
+    virtual void bindVertexBuffer(const Buffer &buffer) = 0;
+    virtual void bindSampler(const Sampler &sampler, uint32_t index) = 0;
+    virtual void bindTexture(const Texture &texture, uint32_t index) = 0;
+    virtual void bindStorageImage(const Texture &texture, uint32_t index, int level, ImageAccess access) = 0;
+    virtual void bindRenderTarget(const RenderTarget &target) = 0;
+    virtual void bindResourceSet(const ResourceSet &set, uint32_t first) = 0;
+
+    virtual void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) = 0;
+    virtual void copyRenderTarget(const RenderTarget &src, const RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, RenderTargetMask mask, bool filter) = 0;
+
+    // Every level past the base one is filtered
+    // down from the one before. SW textures only
+    // have level zero so it does nothing there.
+    virtual void generateMipmaps(const Texture &texture) = 0;
+    virtual void memoryBarrier(BarrierFlags flags) = 0;
+
+    virtual void beginQuery(const Query &query) = 0;
+    virtual void endQuery(const Query &query) = 0;
+    virtual void beginConditionalRender(const Query &query, bool wait) = 0;
+    virtual void endConditionalRender() = 0;
 
     virtual void draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance) = 0;
     virtual void idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance) = 0;
+    virtual void dispatch(size_t x, size_t y, size_t z) = 0;
+    virtual void dispatchIndirect(const Buffer &buffer, size_t offset) = 0;
 };
 } // namespace uvre
@@ -38,7 +38,8 @@ enum class BufferType {
 
 enum class ShaderStage {
     VERTEX,
-    FRAGMENT
+    FRAGMENT,
+    COMPUTE
 };
 
 enum class ShaderFormat {
@@ -131,6 +132,17 @@ enum class DepthFunc {
     GREATER_OR_EQUAL
 };
 
+enum class ImageAccess {
+    READ_ONLY,
+    WRITE_ONLY,
+    READ_WRITE
+};
+
+enum class QueryType {
+    OCCLUSION,
+    ANY_SAMPLES
+};
+
 enum class FillMode {
     FILLED,
     POINTS,
@@ -146,7 +158,17 @@ enum class DebugMessageLevel {
 };
 
 enum class ImplFamily {
-    OPENGL
+    OPENGL,
+    SOFTWARE,
+    NONE
+};
+
+enum class ImplBackend {
+    GL_33,
+    GL_46,
+    SOFTWARE,
+    NONE,
+    NUM_IMPL_BACKENDS
 };
 
 using RenderTargetMask = uint16_t;
@@ -165,4 +187,19 @@ using CullFlags = uint16_t;
 static constexpr const CullFlags CULL_CLOCKWISE = (1 << 0);
 static constexpr const CullFlags CULL_FRONT = (1 << 1);
 static constexpr const CullFlags CULL_BACK = (1 << 2);
+
+// Tell how the data written by shaders
+// is going to be consumed afterwards.
+using BarrierFlags = uint16_t;
+static constexpr const BarrierFlags BARRIER_VERTEX_BUFFER = (1 << 0);
+static constexpr const BarrierFlags BARRIER_INDEX_BUFFER = (1 << 1);
+static constexpr const BarrierFlags BARRIER_UNIFORM_BUFFER = (1 << 2);
+static constexpr const BarrierFlags BARRIER_STORAGE_BUFFER = (1 << 3);
+static constexpr const BarrierFlags BARRIER_INDIRECT_BUFFER = (1 << 4);
+static constexpr const BarrierFlags BARRIER_BUFFER_UPDATE = (1 << 5);
+static constexpr const BarrierFlags BARRIER_TEXTURE_FETCH = (1 << 6);
+static constexpr const BarrierFlags BARRIER_TEXTURE_UPDATE = (1 << 7);
+static constexpr const BarrierFlags BARRIER_STORAGE_IMAGE = (1 << 8);
+static constexpr const BarrierFlags BARRIER_RENDER_TARGET = (1 << 9);
+static constexpr const BarrierFlags BARRIER_ALL = 0xFFFF;
 } // namespace uvre
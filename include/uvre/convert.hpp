@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB. All Rights Reserved.
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include <uvre/const.hpp>
+#include <uvre/exports.hpp>
+
+namespace uvre
+{
+// Tightly packed pixels (readback data for one) into
+// RGBA: missing channels are zero, missing alpha is one.
+// Only 8-bit UNORM and 32-bit float colors are known,
+// anything else leaves dst alone and returns false.
+UVRE_API bool convertToRGBA8(const void *src, PixelFormat format, size_t count, uint8_t *dst);
+UVRE_API bool convertToRGBA32F(const void *src, PixelFormat format, size_t count, float *dst);
+} // namespace uvre
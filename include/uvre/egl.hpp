@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB. All Rights Reserved.
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include <uvre/exports.hpp>
+#include <uvre/renderdevice.hpp>
+
+namespace uvre
+{
+struct HeadlessContext;
+
+// Creates an offscreen OpenGL context through EGL (surfaceless
+// if possible, a tiny pbuffer otherwise) for the implementation
+// reported by pollImplInfo and fills the OpenGL callbacks of the
+// device info, including the worker context ones.
+// There's no default framebuffer to speak of, so everything should
+// go to render targets; present() and vsync() do nothing.
+// The device must be destroyed before the context.
+UVRE_API HeadlessContext *createHeadlessContext(DeviceCreateInfo &info);
+UVRE_API void destroyHeadlessContext(HeadlessContext *context);
+} // namespace uvre
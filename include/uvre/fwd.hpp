@@ -9,12 +9,30 @@
 
 namespace uvre
 {
-using Shader = std::shared_ptr<struct Shader_S>;
-using Pipeline = std::shared_ptr<struct Pipeline_S>;
-using Buffer = std::shared_ptr<struct Buffer_S>;
-using Sampler = std::shared_ptr<struct Sampler_S>;
-using Texture = std::shared_ptr<struct Texture_S>;
-using RenderTarget = std::shared_ptr<struct RenderTarget_S>;
+// Every implementation derives its objects
+// from these: several of them can live in one
+// library and a handle is opaque to the rest.
+struct Shader_S {};
+struct Pipeline_S {};
+struct Buffer_S {};
+struct Sampler_S {};
+struct Texture_S {};
+struct RenderTarget_S {};
+struct ResourceSet_S {};
+struct Fence_S {};
+struct Query_S {};
+struct Readback_S {};
+
+using Shader = std::shared_ptr<Shader_S>;
+using Pipeline = std::shared_ptr<Pipeline_S>;
+using Buffer = std::shared_ptr<Buffer_S>;
+using Sampler = std::shared_ptr<Sampler_S>;
+using Texture = std::shared_ptr<Texture_S>;
+using RenderTarget = std::shared_ptr<RenderTarget_S>;
+using ResourceSet = std::shared_ptr<ResourceSet_S>;
+using Fence = std::shared_ptr<Fence_S>;
+using Query = std::shared_ptr<Query_S>;
+using Readback = std::shared_ptr<Readback_S>;
 class ICommandList;
 class IRenderDevice;
 } // namespace uvre
@@ -24,11 +24,75 @@ struct ColorAttachment final {
     Texture color;
 };
 
+struct ShaderDefine final {
+    const char *name;
+    const char *value { nullptr };
+};
+
+// The SW implementation runs shaders as plain
+// C++ callbacks. Images and buffers are the
+// CPU-side storage of the bound objects,
+// image rows go from bottom to top.
+static constexpr const size_t SW_MAX_BINDINGS = 16;
+static constexpr const size_t SW_MAX_VARYINGS = 16;
+
+struct SwImage final {
+    PixelFormat format;
+    int width;
+    int height;
+    int depth;
+    const void *pixels;
+};
+
+struct SwResources final {
+    const void *uniform_buffers[SW_MAX_BINDINGS];
+    const void *storage_buffers[SW_MAX_BINDINGS];
+    const SwImage *textures[SW_MAX_BINDINGS];
+};
+
+struct SwVertex final {
+    float position[4];
+    float varyings[SW_MAX_VARYINGS];
+};
+
+struct SwFragment final {
+    float coord[3];
+    const float *varyings;
+};
+
 struct ShaderCreateInfo final {
     ShaderStage stage;
     ShaderFormat format;
     size_t code_size { 0 };
     const void *code;
+
+    // Source formats only: extra #defines and
+    // an #include resolver. The returned string
+    // must stay alive until the create call returns,
+    // nullptr means the file was not found.
+    size_t num_defines { 0 };
+    const ShaderDefine *defines { nullptr };
+    void *include_user_data { nullptr };
+    const char *(*onInclude)(void *include_user_data, const char *path) { nullptr };
+
+    // Binary formats only: the entry point and
+    // specialization constants. Values are raw
+    // 32-bit patterns (floats must be bit-cast).
+    const char *entry_point { "main" };
+    size_t num_spec_constants { 0 };
+    const uint32_t *spec_constant_ids { nullptr };
+    const uint32_t *spec_constant_values { nullptr };
+
+    // SW implementation only, the code is ignored.
+    // Vertex callbacks get a pointer to the vertex
+    // within the vertex buffer and output a clip-space
+    // position plus num_varyings values; fragment
+    // callbacks return false to discard the fragment.
+    struct {
+        void (*vertex)(const SwResources &res, const void *vertex, uint32_t vertex_id, uint32_t instance_id, SwVertex &out) { nullptr };
+        bool (*fragment)(const SwResources &res, const SwFragment &frag, float color[4]) { nullptr };
+        size_t num_varyings { 0 };
+    } sw;
 };
 
 struct PipelineCreateInfo final {
@@ -80,6 +144,19 @@ struct TextureCreateInfo final {
     size_t mip_levels { 0 };
 };
 
+// A texture sharing the storage of another one:
+// levels and layers count from the source's and
+// the format must have the same pixel size.
+struct TextureViewCreateInfo final {
+    Texture texture;
+    TextureType type;
+    PixelFormat format;
+    size_t base_level { 0 };
+    size_t num_levels { 1 };
+    size_t base_layer { 0 };
+    size_t num_layers { 1 };
+};
+
 struct RenderTargetCreateInfo final {
     Texture depth_attachment { nullptr };
     Texture stencil_attachment { nullptr };
@@ -87,15 +164,65 @@ struct RenderTargetCreateInfo final {
     const ColorAttachment *color_attachments;
 };
 
+struct BufferRange final {
+    Buffer buffer;
+    size_t offset { 0 };
+    size_t size { 0 }; // zero means "up to the end"
+};
+
+// Every array is bound to consecutive
+// slots starting at the index passed
+// to ICommandList::bindResourceSet.
+struct ResourceSetCreateInfo final {
+    size_t num_textures { 0 };
+    const Texture *textures { nullptr };
+    size_t num_samplers { 0 };
+    const Sampler *samplers { nullptr };
+    size_t num_uniform_buffers { 0 };
+    const BufferRange *uniform_buffers { nullptr };
+    size_t num_storage_buffers { 0 };
+    const BufferRange *storage_buffers { nullptr };
+};
+
 struct DeviceInfo final {
     ImplFamily impl_family;
     int impl_version_major;
     int impl_version_minor;
     bool supports_anisotropic;
     bool supports_storage_buffers;
+    bool supports_compute;
     bool supports_shader_format[static_cast<int>(ShaderFormat::NUM_SHADER_FORMATS)];
 };
 
+// Filled by the NULL implementation on every
+// submit: GL calls are counted instead of made.
+struct NullCallStats final {
+    uint64_t num_submits;
+    uint64_t num_commands;
+    uint64_t num_gl_calls;
+    uint64_t num_draws;
+    uint64_t num_dispatches;
+};
+
+struct MemoryUsage final {
+    size_t bytes;
+    size_t peak_bytes;
+    size_t count;
+    size_t peak_count;
+};
+
+// Sizes are computed from the create infos (the
+// whole mip chain for textures), drivers may pad
+// them a bit. Render targets count the textures
+// attached to them, the total doesn't count them twice.
+struct MemoryStats final {
+    MemoryUsage buffers;
+    MemoryUsage textures;
+    MemoryUsage render_targets;
+    size_t total_bytes;
+    size_t peak_total_bytes;
+};
+
 struct DebugMessageInfo;
 struct DeviceCreateInfo final {
     struct {
@@ -104,12 +231,47 @@ struct DeviceCreateInfo final {
         void (*makeContextCurrent)(void *user_data);
         void (*setSwapInterval)(void *user_data, int interval);
         void (*swapBuffers)(void *user_data);
+        // A second context sharing objects with the
+        // main one, current on the worker thread only:
+        // async shader builds and uploads run there.
+        void *worker_user_data;
+        void (*makeWorkerContextCurrent)(void *worker_user_data);
     } gl;
+    // The SW default framebuffer is presented
+    // as R8G8B8A8 pixels, bottom row first.
+    struct {
+        void *user_data;
+        void (*present)(void *user_data, const void *pixels, int width, int height);
+        size_t num_threads { 0 }; // zero means one per core
+    } sw;
+    struct {
+        NullCallStats *stats { nullptr };
+    } null;
+    // The device lives on its own render thread:
+    // submit, present and the frame calls are queued
+    // and return right away, up to queue_depth calls
+    // ahead; everything else waits for the thread.
+    // The GL context must not be current elsewhere.
+    struct {
+        bool enabled { false };
+        size_t queue_depth { 64 };
+    } threaded;
+    // Called on the thread that created the object
+    // that put the total over the budget; the object
+    // is still created. Zero means there's no budget.
+    struct {
+        size_t budget { 0 };
+        void *user_data { nullptr };
+        void (*onBudgetExceeded)(void *user_data, const MemoryStats &stats) { nullptr };
+    } memory;
     void (*onDebugMessage)(const DebugMessageInfo &msg);
+    const char *shader_cache_dir { nullptr };
+    size_t max_frames_in_flight { 2 };
 };
 
 struct ImplInfo final {
     ImplFamily family;
+    ImplBackend backend;
     struct {
         bool core_profile;
         int version_major;
@@ -122,36 +284,126 @@ struct DebugMessageInfo final {
     const char *text;
 };
 
+struct ProbeInfo final {
+    void *user_data;
+    // Called for every implementation, fastest first:
+    // set up whatever it needs (a GL context of the
+    // version it asks for, a window surface...) and
+    // fill in the device info. False skips it.
+    bool (*prepare)(void *user_data, const ImplInfo &impl_info, DeviceCreateInfo &info);
+    // Undoes prepare if the device failed anyway.
+    void (*release)(void *user_data, const ImplInfo &impl_info) { nullptr };
+};
+
 class IRenderDevice {
 public:
     virtual ~IRenderDevice() = default;
 
     virtual const DeviceInfo &getInfo() const = 0;
+    virtual MemoryStats getMemoryStats() = 0;
+
+    // Frames are counted by endFrame starting at one:
+    // this is the frame in which a list binding the
+    // texture was last submitted, zero if never.
+    virtual uint64_t getLastUsedFrame(const Texture &texture) = 0;
 
+    // Handles can be released on any thread: the
+    // objects are destroyed by beginFrame once the
+    // frame that dropped them is done (or by submit
+    // if there are no frames). SW and NULL objects
+    // are plain memory and go away right there.
     virtual Shader createShader(const ShaderCreateInfo &info) = 0;
     virtual Pipeline createPipeline(const PipelineCreateInfo &info) = 0;
     virtual Buffer createBuffer(const BufferCreateInfo &info) = 0;
     virtual Sampler createSampler(const SamplerCreateInfo &info) = 0;
     virtual Texture createTexture(const TextureCreateInfo &info) = 0;
+    virtual Texture createTextureView(const TextureViewCreateInfo &info) = 0;
     virtual RenderTarget createRenderTarget(const RenderTargetCreateInfo &info) = 0;
+    virtual ResourceSet createResourceSet(const ResourceSetCreateInfo &info) = 0;
+
+    virtual Shader createShaderAsync(const ShaderCreateInfo &info) = 0;
+    virtual Pipeline createPipelineAsync(const PipelineCreateInfo &info) = 0;
+    virtual bool isReady(const Shader &shader) = 0;
+    virtual bool isReady(const Pipeline &pipeline) = 0;
+
+    // Uploads that run on the worker, the data is
+    // copied and the calls return right away. The
+    // contents stay undefined to the commands until
+    // isReady returns true for the object.
+    virtual Buffer createBufferAsync(const BufferCreateInfo &info) = 0;
+    virtual void writeBufferAsync(const Buffer &buffer, size_t offset, size_t size, const void *data) = 0;
+    virtual void writeTexture2DAsync(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level = 0) = 0;
+    virtual void writeTextureCubeAsync(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level = 0) = 0;
+    virtual void writeTextureArrayAsync(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level = 0) = 0;
+    virtual bool isReady(const Buffer &buffer) = 0;
+    virtual bool isReady(const Texture &texture) = 0;
+
+    // The mip level goes last so the calls that
+    // only ever write the base one can skip it.
+    virtual void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) = 0;
+    virtual void writeTexture2D(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level = 0) = 0;
+    virtual void writeTextureCube(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level = 0) = 0;
+    virtual void writeTextureArray(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level = 0) = 0;
 
-    virtual void writeBuffer(Buffer buffer, size_t offset, size_t size, const void *data) = 0;
-    virtual void writeTexture2D(Texture texture, int x, int y, int w, int h, PixelFormat format, const void *data) = 0;
-    virtual void writeTextureCube(Texture texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data) = 0;
-    virtual void writeTextureArray(Texture texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data) = 0;
+    // Levels above the base are never sampled, so
+    // a texture that only has its smaller levels
+    // written so far can already be used. SW only
+    // ever stores level zero and ignores this.
+    virtual void setTextureBaseLevel(const Texture &texture, int level) = 0;
 
     virtual ICommandList *createCommandList() = 0;
     virtual void destroyCommandList(ICommandList *commands) = 0;
     virtual void startRecording(ICommandList *commands) = 0;
     virtual void submit(ICommandList *commands) = 0;
 
-    // TODO: ISwapChain? Are we gonna support headless rendering?
+    // A fence is signaled once the GPU is done with
+    // everything submitted before it was created.
+    // Timeout is in nanoseconds, zero just polls.
+    virtual Fence createFence() = 0;
+    virtual bool waitFence(const Fence &fence, uint64_t timeout) = 0;
+
+    // getQueryResult never blocks: it returns
+    // false if the result is not available yet.
+    virtual Query createQuery(QueryType type) = 0;
+    virtual bool getQueryResult(const Query &query, uint64_t &result) = 0;
+
+    // Reads land in pack buffers that are recycled
+    // between readbacks, once the GPU is done with
+    // everything submitted before. getReadbackData
+    // returns null until then and never blocks; the
+    // data lives as long as the handle does. Rows are
+    // tightly packed and go from bottom to top.
+    virtual Readback readRenderTargetAsync(const RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, PixelFormat format) = 0;
+    virtual Readback readTextureAsync(const Texture &texture, int level, int x, int y, int w, int h, PixelFormat format) = 0;
+    virtual const void *getReadbackData(const Readback &readback) = 0;
+
+    // beginFrame blocks until the frame that used the
+    // same slot max_frames_in_flight frames ago is done.
+    // The slot index is what ring-buffered resources use.
+    virtual void beginFrame() = 0;
+    virtual void endFrame() = 0;
+    virtual size_t getFrameIndex() const = 0;
+
+    // TODO: ISwapChain? Headless rendering is
+    // done through uvre/egl.hpp for now.
     virtual void prepare() = 0;
     virtual void present() = 0;
     virtual void vsync(bool enable) = 0;
     virtual void mode(int width, int height) = 0;
 };
 
+// Several implementations can be built into the
+// library: the fastest one is selected by default,
+// the functions below work with the selected one.
+// None of this is thread-safe, do it on startup.
+UVRE_API size_t enumerateBackends(ImplBackend *backends, size_t max_backends);
+UVRE_API bool selectBackend(ImplBackend backend);
+UVRE_API ImplBackend getSelectedBackend();
+
+// Tries every implementation until a device
+// is created and keeps that one selected.
+UVRE_API IRenderDevice *probeDevice(const ProbeInfo &info);
+
 UVRE_API void pollImplInfo(ImplInfo &info);
 UVRE_API IRenderDevice *createDevice(const DeviceCreateInfo &info);
 UVRE_API void destroyDevice(IRenderDevice *device);
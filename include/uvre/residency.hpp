@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB. All Rights Reserved.
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include <uvre/exports.hpp>
+#include <uvre/renderdevice.hpp>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace uvre
+{
+// Ids are never reused so a stale one
+// simply doesn't resolve to anything.
+using ResidentTexture = uint32_t;
+static constexpr const ResidentTexture NULL_RESIDENT_TEXTURE = 0;
+
+struct ResidentTextureInfo final {
+    TextureCreateInfo texture;
+    int priority { 0 }; // lower ones go first
+    // Fills a texture the manager has (re)created:
+    // its level zero is first_level of the full one.
+    void *user_data { nullptr };
+    void (*onStream)(void *user_data, IRenderDevice *device, const Texture &texture, size_t first_level) { nullptr };
+};
+
+struct ResidencyCreateInfo final {
+    IRenderDevice *device;
+    size_t budget;
+    // Destroyed textures stay in the device stats
+    // until the frames using them are done: for that
+    // long they are counted as gone already.
+    size_t release_frames { 4 };
+};
+
+// Keeps the device within a memory budget: the least
+// recently used textures lose their top mip levels
+// first, then go away completely. getTexture streams
+// them back in and update gives the levels back once
+// there's room. None of this is thread-safe.
+class UVRE_API ResidencyManager final {
+public:
+    ResidencyManager(const ResidencyCreateInfo &info);
+
+    ResidentTexture registerTexture(const ResidentTextureInfo &info);
+    void unregisterTexture(ResidentTexture id);
+
+    // The reference is good until the
+    // next call to any of the others.
+    const Texture &getTexture(ResidentTexture id);
+
+    // Once per frame, after endFrame
+    void update();
+
+private:
+    struct Entry final {
+        ResidentTextureInfo info;
+        Texture texture;
+        size_t dropped_levels;
+        size_t size;
+        uint64_t last_used;
+    };
+
+    bool stream(Entry *entry, size_t dropped_levels);
+    void release(Entry *entry);
+    void evict(size_t excess);
+    void restore(size_t room);
+
+private:
+    ResidencyCreateInfo create_info;
+    std::unordered_map<ResidentTexture, Entry> entries;
+    ResidentTexture last_id;
+    std::deque<std::pair<uint64_t, size_t>> released;
+    size_t released_bytes;
+    uint64_t frame;
+};
+} // namespace uvre
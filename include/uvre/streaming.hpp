@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB. All Rights Reserved.
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#pragma once
+#include <uvre/exports.hpp>
+#include <uvre/renderdevice.hpp>
+#include <vector>
+
+namespace uvre
+{
+// Level data is laid out the way the matching
+// writeTexture2D call wants it and must stay
+// alive until onComplete is called (or cancel).
+struct StreamedTextureInfo final {
+    Texture texture;
+    PixelFormat format;
+    int width;
+    int height;
+    size_t num_levels;
+    const void *const *levels;
+    void *user_data { nullptr };
+    void (*onComplete)(void *user_data, const Texture &texture) { nullptr };
+};
+
+struct TextureStreamerCreateInfo final {
+    IRenderDevice *device;
+    size_t frame_budget; // bytes per update
+};
+
+// Spreads 2D texture uploads across frames: the
+// smallest levels go first so everything streamed
+// is usable early on and gets sharper each frame.
+// Only plain 2D textures can be streamed.
+class UVRE_API TextureStreamer final {
+public:
+    TextureStreamer(const TextureStreamerCreateInfo &info);
+
+    // The coarsest level is written right
+    // away, so the texture is never empty.
+    void stream(const StreamedTextureInfo &info);
+    void cancel(const Texture &texture);
+    size_t getPendingCount() const;
+
+    // Once per frame
+    void update();
+
+private:
+    struct Upload final {
+        StreamedTextureInfo info;
+        size_t remaining_levels;
+    };
+
+    size_t getLevelSize(const Upload &upload) const;
+    void writeLevel(Upload &upload);
+
+private:
+    TextureStreamerCreateInfo create_info;
+    std::vector<Upload> uploads;
+};
+} // namespace uvre
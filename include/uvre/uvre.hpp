@@ -6,5 +6,8 @@
  */
 #pragma once
 #include <uvre/commandlist.hpp>
+#include <uvre/convert.hpp>
 #include <uvre/renderdevice.hpp>
+#include <uvre/residency.hpp>
+#include <uvre/streaming.hpp>
 #include <uvre/types.hpp>
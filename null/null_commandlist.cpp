@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "null_private.hpp"
+
+static inline void pushCommand(std::vector<uvre::null::Command> &commands, const uvre::null::Command &cmd, size_t index)
+{
+    if(commands.size() <= index) {
+        commands.push_back(cmd);
+        return;
+    }
+
+    std::vector<uvre::null::Command>::iterator it = commands.begin() + index;
+    if(it->type == uvre::null::CommandType::WRITE_BUFFER)
+        delete[] it->buffer_write.data_ptr;
+    *it = cmd;
+}
+
+uvre::null::CommandListImpl::CommandListImpl()
+    : commands(), num_commands(0), used_textures()
+{
+}
+
+void uvre::null::CommandListImpl::setScissor(int x, int y, int width, int height)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::SET_SCISSOR;
+    cmd.scvp.x = x;
+    cmd.scvp.y = y;
+    cmd.scvp.w = width;
+    cmd.scvp.h = height;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::setViewport(int x, int y, int width, int height)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::SET_VIEWPORT;
+    cmd.scvp.x = x;
+    cmd.scvp.y = y;
+    cmd.scvp.w = width;
+    cmd.scvp.h = height;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::setClearDepth(float d)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::SET_CLEAR_DEPTH;
+    cmd.depth = d;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::setClearColor3f(float r, float g, float b)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::SET_CLEAR_COLOR;
+    cmd.color[0] = r;
+    cmd.color[1] = g;
+    cmd.color[2] = b;
+    cmd.color[3] = 1.0f;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::SET_CLEAR_COLOR;
+    cmd.color[0] = r;
+    cmd.color[1] = g;
+    cmd.color[2] = b;
+    cmd.color[3] = a;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::clear(uvre::RenderTargetMask mask)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::CLEAR;
+    cmd.clear_mask = mask;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindPipeline(const uvre::Pipeline &pipeline)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_PIPELINE;
+    cmd.pipeline = uvre::null::impl(pipeline);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindStorageBuffer(const uvre::Buffer &buffer, uint32_t index)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_STORAGE_BUFFER;
+    cmd.bind_index = index;
+    cmd.object = buffer ? uvre::null::impl(buffer)->bufobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindUniformBuffer(const uvre::Buffer &buffer, uint32_t index)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_UNIFORM_BUFFER;
+    cmd.bind_index = index;
+    cmd.object = buffer ? uvre::null::impl(buffer)->bufobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindIndexBuffer(const uvre::Buffer &buffer)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_INDEX_BUFFER;
+    cmd.object = buffer ? uvre::null::impl(buffer)->bufobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindVertexBuffer(const uvre::Buffer &buffer)
+{
+    if(buffer) {
+        uvre::null::Command cmd = {};
+        cmd.type = uvre::null::CommandType::BIND_VERTEX_BUFFER;
+        cmd.buffer = *uvre::null::impl(buffer);
+        pushCommand(commands, cmd, num_commands++);
+    }
+}
+
+void uvre::null::CommandListImpl::bindSampler(const uvre::Sampler &sampler, uint32_t index)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_SAMPLER;
+    cmd.bind_index = index;
+    cmd.object = sampler ? uvre::null::impl(sampler)->ssobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindTexture(const uvre::Texture &texture, uint32_t index)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_TEXTURE;
+    cmd.bind_index = index;
+    cmd.object = texture ? uvre::null::impl(texture)->texobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+
+    if(texture)
+        used_textures.push_back(uvre::null::impl(texture));
+}
+
+void uvre::null::CommandListImpl::bindStorageImage(const uvre::Texture &texture, uint32_t index, int level, uvre::ImageAccess access)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_STORAGE_IMAGE;
+    cmd.bind_index = index;
+    cmd.image.texture = texture ? uvre::null::impl(texture)->texobj : 0;
+    cmd.image.level = level;
+    cmd.image.access = static_cast<uint32_t>(access);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindRenderTarget(const uvre::RenderTarget &target)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_RENDER_TARGET;
+    cmd.object = target ? uvre::null::impl(target)->fbobj : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::bindResourceSet(const uvre::ResourceSet &set, uint32_t first)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BIND_RESOURCE_SET;
+    cmd.bind_index = first;
+    cmd.set = uvre::null::impl(set);
+    pushCommand(commands, cmd, num_commands++);
+    used_textures.insert(used_textures.end(), cmd.set->texture_objects.cbegin(), cmd.set->texture_objects.cend());
+}
+
+void uvre::null::CommandListImpl::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::WRITE_BUFFER;
+    cmd.buffer_write.buffer = uvre::null::impl(buffer)->bufobj;
+    cmd.buffer_write.offset = offset;
+    cmd.buffer_write.size = size;
+    cmd.buffer_write.data_ptr = new uint8_t[size];
+    std::copy(reinterpret_cast<const uint8_t *>(data), reinterpret_cast<const uint8_t *>(data) + size, cmd.buffer_write.data_ptr);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::copyRenderTarget(const uvre::RenderTarget &src, const uvre::RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, uvre::RenderTargetMask mask, bool filter)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::COPY_RENDER_TARGET;
+    cmd.rt_copy.src = src ? uvre::null::impl(src)->fbobj : 0;
+    cmd.rt_copy.dst = dst ? uvre::null::impl(dst)->fbobj : 0;
+    cmd.rt_copy.sx0 = sx0;
+    cmd.rt_copy.sy0 = sy0;
+    cmd.rt_copy.sx1 = sx1;
+    cmd.rt_copy.sy1 = sy1;
+    cmd.rt_copy.dx0 = dx0;
+    cmd.rt_copy.dy0 = dy0;
+    cmd.rt_copy.dx1 = dx1;
+    cmd.rt_copy.dy1 = dy1;
+    cmd.rt_copy.mask = mask;
+    cmd.rt_copy.filter = filter ? 1 : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::generateMipmaps(const uvre::Texture &texture)
+{
+    // No texture, no mipmaps
+    if(!texture)
+        return;
+
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::GENERATE_MIPMAPS;
+    cmd.object = uvre::null::impl(texture)->texobj;
+    pushCommand(commands, cmd, num_commands++);
+
+    used_textures.push_back(uvre::null::impl(texture));
+}
+
+void uvre::null::CommandListImpl::memoryBarrier(uvre::BarrierFlags flags)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::MEMORY_BARRIER;
+    cmd.barrier_mask = flags;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::beginQuery(const uvre::Query &query)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BEGIN_QUERY;
+    cmd.query.qobj = uvre::null::impl(query)->qobj;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::endQuery(const uvre::Query &query)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::END_QUERY;
+    cmd.query.qobj = uvre::null::impl(query)->qobj;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::beginConditionalRender(const uvre::Query &query, bool wait)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::BEGIN_CONDITIONAL_RENDER;
+    cmd.cond.qobj = uvre::null::impl(query)->qobj;
+    cmd.cond.mode = wait ? 1 : 0;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::endConditionalRender()
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::END_CONDITIONAL_RENDER;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::DRAW;
+    cmd.draw.a.vertices = static_cast<int32_t>(vertices);
+    cmd.draw.a.instances = static_cast<int32_t>(instances);
+    cmd.draw.a.base_vertex = static_cast<int32_t>(base_vertex);
+    cmd.draw.a.base_instance = static_cast<int32_t>(base_instance);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::IDRAW;
+    cmd.draw.e.indices = static_cast<int32_t>(indices);
+    cmd.draw.e.instances = static_cast<int32_t>(instances);
+    cmd.draw.e.base_index = static_cast<int32_t>(base_index);
+    cmd.draw.e.base_vertex = static_cast<int32_t>(base_vertex);
+    cmd.draw.e.base_instance = static_cast<int32_t>(base_instance);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::dispatch(size_t x, size_t y, size_t z)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::DISPATCH;
+    cmd.dispatch.x = static_cast<uint32_t>(x);
+    cmd.dispatch.y = static_cast<uint32_t>(y);
+    cmd.dispatch.z = static_cast<uint32_t>(z);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::null::CommandListImpl::dispatchIndirect(const uvre::Buffer &buffer, size_t offset)
+{
+    uvre::null::Command cmd = {};
+    cmd.type = uvre::null::CommandType::DISPATCH_INDIRECT;
+    cmd.indirect.buffer = uvre::null::impl(buffer)->bufobj;
+    cmd.indirect.offset = offset;
+    pushCommand(commands, cmd, num_commands++);
+}
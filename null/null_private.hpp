@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <uvre/uvre.hpp>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace uvre::null
+{
+// Object names are what OpenGL would have
+// handed out, nothing is ever allocated.
+struct Shader_S final : public uvre::Shader_S {
+    uint32_t prog;
+    ShaderStage stage;
+};
+
+struct Pipeline_S final : public uvre::Pipeline_S {
+    uint32_t ppobj;
+    bool blending;
+    bool depth_testing;
+    bool face_culling;
+    bool scissor_test;
+    size_t num_attributes;
+    uint32_t bound_ibo;
+    uint32_t bound_vbo;
+};
+
+struct Buffer_S final : public uvre::Buffer_S {
+    uint32_t bufobj;
+    size_t size;
+};
+
+struct Texture_S final : public uvre::Texture_S {
+    uint32_t texobj;
+    int width;
+    int height;
+    int depth;
+    size_t memory_size;
+    uint64_t last_used_frame;
+};
+
+struct Sampler_S final : public uvre::Sampler_S {
+    uint32_t ssobj;
+};
+
+struct ResourceSet_S final : public uvre::ResourceSet_S {
+    std::vector<Texture_S *> texture_objects;
+    size_t num_textures;
+    size_t num_samplers;
+    size_t num_uniform_buffers;
+    size_t num_storage_buffers;
+    std::vector<std::shared_ptr<void>> objects; // keeps them alive
+};
+
+struct Fence_S final : public uvre::Fence_S {
+    uint32_t sync;
+};
+
+struct Query_S final : public uvre::Query_S {
+    uint32_t qobj;
+};
+
+struct Readback_S final : public uvre::Readback_S {
+    std::vector<uint8_t> pixels;
+};
+
+struct RenderTarget_S final : public uvre::RenderTarget_S {
+    uint32_t fbobj;
+    size_t memory_size;
+};
+
+enum class CommandType {
+    SET_SCISSOR,
+    SET_VIEWPORT,
+    SET_CLEAR_COLOR,
+    SET_CLEAR_DEPTH,
+    CLEAR,
+    BIND_PIPELINE,
+    BIND_STORAGE_BUFFER,
+    BIND_UNIFORM_BUFFER,
+    BIND_INDEX_BUFFER,
+    BIND_VERTEX_BUFFER,
+    BIND_SAMPLER,
+    BIND_TEXTURE,
+    BIND_RENDER_TARGET,
+    BIND_RESOURCE_SET,
+    BIND_STORAGE_IMAGE,
+    WRITE_BUFFER,
+    COPY_RENDER_TARGET,
+    GENERATE_MIPMAPS,
+    BEGIN_QUERY,
+    END_QUERY,
+    BEGIN_CONDITIONAL_RENDER,
+    END_CONDITIONAL_RENDER,
+    MEMORY_BARRIER,
+    DRAW,
+    IDRAW,
+    DISPATCH,
+    DISPATCH_INDIRECT
+};
+
+union DrawCmd final {
+    struct {
+        int32_t vertices;
+        int32_t instances;
+        int32_t base_vertex;
+        int32_t base_instance;
+    } a;
+    struct {
+        int32_t indices;
+        int32_t instances;
+        int32_t base_index;
+        int32_t base_vertex;
+        int32_t base_instance;
+    } e;
+};
+
+struct Command final {
+    CommandType type;
+    uint32_t bind_index;
+    union {
+        struct {
+            int x, y;
+            int w, h;
+        } scvp;
+        float color[4];
+        float depth;
+        uint32_t clear_mask;
+        Pipeline_S *pipeline;
+        ResourceSet_S *set;
+        Buffer_S buffer;
+        uint32_t object;
+        struct {
+            uint32_t buffer;
+            size_t offset;
+            size_t size;
+            uint8_t *data_ptr;
+        } buffer_write;
+        struct {
+            uint32_t src, dst;
+            int sx0, sy0, sx1, sy1;
+            int dx0, dy0, dx1, dy1;
+            uint32_t mask;
+            uint32_t filter;
+        } rt_copy;
+        uint32_t barrier_mask;
+        struct {
+            uint32_t texture;
+            int level;
+            uint32_t access;
+        } image;
+        struct {
+            uint32_t x, y, z;
+        } dispatch;
+        struct {
+            uint32_t buffer;
+            size_t offset;
+        } indirect;
+        struct {
+            uint32_t qobj;
+        } query;
+        struct {
+            uint32_t qobj;
+            uint32_t mode;
+        } cond;
+        DrawCmd draw;
+    };
+};
+
+class CommandListImpl final : public ICommandList {
+public:
+    CommandListImpl();
+
+    void setScissor(int x, int y, int width, int height) override;
+    void setViewport(int x, int y, int width, int height) override;
+
+    void setClearDepth(float d) override;
+    void setClearColor3f(float r, float g, float b) override;
+    void setClearColor4f(float r, float g, float b, float a) override;
+    void clear(RenderTargetMask mask) override;
+
+    void bindPipeline(const Pipeline &pipeline) override;
+    void bindStorageBuffer(const Buffer &buffer, uint32_t index) override;
+    void bindUniformBuffer(const Buffer &buffer, uint32_t index) override;
+    void bindIndexBuffer(const Buffer &buffer) override;
+    void bindVertexBuffer(const Buffer &buffer) override;
+    void bindSampler(const Sampler &sampler, uint32_t index) override;
+    void bindTexture(const Texture &texture, uint32_t index) override;
+    void bindStorageImage(const Texture &texture, uint32_t index, int level, ImageAccess access) override;
+    void bindRenderTarget(const RenderTarget &target) override;
+    void bindResourceSet(const ResourceSet &set, uint32_t first) override;
+
+    void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void copyRenderTarget(const RenderTarget &src, const RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, RenderTargetMask mask, bool filter) override;
+    void generateMipmaps(const Texture &texture) override;
+    void memoryBarrier(BarrierFlags flags) override;
+
+    void beginQuery(const Query &query) override;
+    void endQuery(const Query &query) override;
+    void beginConditionalRender(const Query &query, bool wait) override;
+    void endConditionalRender() override;
+
+    void draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance) override;
+    void idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance) override;
+    void dispatch(size_t x, size_t y, size_t z) override;
+    void dispatchIndirect(const Buffer &buffer, size_t offset) override;
+
+public:
+    std::vector<Command> commands;
+    size_t num_commands;
+    std::vector<Texture_S *> used_textures;
+};
+
+class RenderDeviceImpl;
+
+// Handles can outlive the device, so their deleters
+// reach it through this: it's null once the device
+// is gone and the objects are then simply freed.
+struct DeviceLink final {
+    std::mutex mutex;
+    RenderDeviceImpl *device;
+};
+
+class RenderDeviceImpl final : public IRenderDevice {
+public:
+    RenderDeviceImpl(const DeviceCreateInfo &info);
+    virtual ~RenderDeviceImpl();
+
+    const DeviceInfo &getInfo() const;
+    MemoryStats getMemoryStats() override;
+    uint64_t getLastUsedFrame(const Texture &texture) override;
+
+    Shader createShader(const ShaderCreateInfo &info) override;
+    Pipeline createPipeline(const PipelineCreateInfo &info) override;
+    Buffer createBuffer(const BufferCreateInfo &info) override;
+    Sampler createSampler(const SamplerCreateInfo &info) override;
+    Texture createTexture(const TextureCreateInfo &info) override;
+    Texture createTextureView(const TextureViewCreateInfo &info) override;
+    RenderTarget createRenderTarget(const RenderTargetCreateInfo &info) override;
+    ResourceSet createResourceSet(const ResourceSetCreateInfo &info) override;
+
+    Shader createShaderAsync(const ShaderCreateInfo &info) override;
+    Pipeline createPipelineAsync(const PipelineCreateInfo &info) override;
+    bool isReady(const Shader &shader) override;
+    bool isReady(const Pipeline &pipeline) override;
+
+    Buffer createBufferAsync(const BufferCreateInfo &info) override;
+    void writeBufferAsync(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2DAsync(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCubeAsync(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArrayAsync(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    bool isReady(const Buffer &buffer) override;
+    bool isReady(const Texture &texture) override;
+
+    void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2D(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCube(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArray(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    void setTextureBaseLevel(const Texture &texture, int level) override;
+
+    ICommandList *createCommandList() override;
+    void destroyCommandList(ICommandList *commands) override;
+    void startRecording(ICommandList *commands) override;
+    void submit(ICommandList *commands) override;
+
+    Fence createFence() override;
+    bool waitFence(const Fence &fence, uint64_t timeout) override;
+
+    Query createQuery(QueryType type) override;
+    bool getQueryResult(const Query &query, uint64_t &result) override;
+
+    Readback readRenderTargetAsync(const RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, PixelFormat format) override;
+    Readback readTextureAsync(const Texture &texture, int level, int x, int y, int w, int h, PixelFormat format) override;
+    const void *getReadbackData(const Readback &readback) override;
+
+    void beginFrame() override;
+    void endFrame() override;
+    size_t getFrameIndex() const override;
+
+    void prepare() override;
+    void present() override;
+    void vsync(bool enable) override;
+    void mode(int width, int height) override;
+
+public:
+    DeviceCreateInfo create_info;
+    DeviceInfo info;
+    NullCallStats dummy_stats;
+    NullCallStats *stats;
+    uint32_t next_object;
+    size_t max_frames_in_flight;
+    uint64_t frame_number;
+    Pipeline_S bound_pipeline;
+    Pipeline_S null_pipeline;
+    std::vector<CommandListImpl *> commandlists;
+
+    // Nothing is allocated but the sizes are
+    // counted as if it was: budgets still work.
+    std::shared_ptr<DeviceLink> link;
+    std::mutex memory_mutex;
+    MemoryStats memory_stats;
+};
+
+// Handles only ever reach the device that
+// made them, so downcasting them is safe.
+static inline Shader_S *impl(const Shader &shader)
+{
+    return static_cast<Shader_S *>(shader.get());
+}
+
+static inline Pipeline_S *impl(const Pipeline &pipeline)
+{
+    return static_cast<Pipeline_S *>(pipeline.get());
+}
+
+static inline Buffer_S *impl(const Buffer &buffer)
+{
+    return static_cast<Buffer_S *>(buffer.get());
+}
+
+static inline Sampler_S *impl(const Sampler &sampler)
+{
+    return static_cast<Sampler_S *>(sampler.get());
+}
+
+static inline Texture_S *impl(const Texture &texture)
+{
+    return static_cast<Texture_S *>(texture.get());
+}
+
+static inline RenderTarget_S *impl(const RenderTarget &target)
+{
+    return static_cast<RenderTarget_S *>(target.get());
+}
+
+static inline ResourceSet_S *impl(const ResourceSet &set)
+{
+    return static_cast<ResourceSet_S *>(set.get());
+}
+
+static inline Fence_S *impl(const Fence &fence)
+{
+    return static_cast<Fence_S *>(fence.get());
+}
+
+static inline Query_S *impl(const Query &query)
+{
+    return static_cast<Query_S *>(query.get());
+}
+
+static inline Readback_S *impl(const Readback &readback)
+{
+    return static_cast<Readback_S *>(readback.get());
+}
+
+// null_rmain.cpp
+void pollImplInfo(ImplInfo &info);
+IRenderDevice *createDevice(const DeviceCreateInfo &info);
+} // namespace uvre::null
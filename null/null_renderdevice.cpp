@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "null_private.hpp"
+#include <cstring>
+
+static void trackMemory(uvre::null::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryStats &stats = device->memory_stats;
+    uvre::MemoryUsage &usage = stats.*member;
+    usage.bytes += bytes;
+    usage.peak_bytes = std::max(usage.peak_bytes, usage.bytes);
+    usage.peak_count = std::max(usage.peak_count, ++usage.count);
+
+    // Attachments are already counted as textures
+    if(member == &uvre::MemoryStats::render_targets)
+        return;
+
+    stats.total_bytes += bytes;
+    stats.peak_total_bytes = std::max(stats.peak_total_bytes, stats.total_bytes);
+
+    // Don't call back with the lock held
+    const uvre::DeviceCreateInfo &info = device->create_info;
+    if(info.memory.budget && info.memory.onBudgetExceeded && stats.total_bytes > info.memory.budget) {
+        const uvre::MemoryStats snapshot = stats;
+        lock.unlock();
+        info.memory.onBudgetExceeded(info.memory.user_data, snapshot);
+    }
+}
+
+static void untrackMemory(uvre::null::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryUsage &usage = device->memory_stats.*member;
+    usage.bytes -= bytes;
+    usage.count--;
+    if(member != &uvre::MemoryStats::render_targets)
+        device->memory_stats.total_bytes -= bytes;
+}
+
+template<typename T>
+static std::shared_ptr<T> makeTracked(uvre::null::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    trackMemory(device, member, bytes);
+    std::shared_ptr<uvre::null::DeviceLink> link = device->link;
+    return std::shared_ptr<T>(new T, [link, member, bytes](T *object) {
+        {
+            std::lock_guard<std::mutex> lock(link->mutex);
+            if(link->device)
+                untrackMemory(link->device, member, bytes);
+        }
+
+        delete object;
+    });
+}
+
+uvre::null::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_info)
+    : create_info(create_info), dummy_stats(), stats(nullptr), next_object(0), max_frames_in_flight(0), frame_number(0), bound_pipeline(), null_pipeline(), commandlists(), link(std::make_shared<uvre::null::DeviceLink>()), memory_mutex(), memory_stats()
+{
+    link->device = this;
+    // Counting always happens, it's just
+    // nobody gets to see it without a pointer.
+    stats = create_info.null.stats ? create_info.null.stats : &dummy_stats;
+    std::memset(stats, 0, sizeof(uvre::NullCallStats));
+
+    std::memset(&info, 0, sizeof(uvre::DeviceInfo));
+    info.impl_family = uvre::ImplFamily::NONE;
+    info.impl_version_major = 0;
+    info.impl_version_minor = 0;
+    info.supports_anisotropic = true;
+    info.supports_storage_buffers = true;
+    info.supports_compute = true;
+    info.supports_shader_format[static_cast<int>(uvre::ShaderFormat::BINARY_SPIRV)] = true;
+    info.supports_shader_format[static_cast<int>(uvre::ShaderFormat::SOURCE_GLSL)] = true;
+
+    std::memset(&null_pipeline, 0, sizeof(uvre::null::Pipeline_S));
+    bound_pipeline = null_pipeline;
+
+    // A zero would mean no frames at all
+    max_frames_in_flight = std::max<size_t>(1, create_info.max_frames_in_flight);
+}
+
+uvre::null::RenderDeviceImpl::~RenderDeviceImpl()
+{
+    // Stats die with the device, handles
+    // dropped after this are only freed.
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->device = nullptr;
+    }
+
+    for(uvre::null::CommandListImpl *commandlist : commandlists)
+        delete commandlist;
+    commandlists.clear();
+}
+
+const uvre::DeviceInfo &uvre::null::RenderDeviceImpl::getInfo() const
+{
+    return info;
+}
+
+uvre::MemoryStats uvre::null::RenderDeviceImpl::getMemoryStats()
+{
+    std::lock_guard<std::mutex> lock(memory_mutex);
+    return memory_stats;
+}
+
+uint64_t uvre::null::RenderDeviceImpl::getLastUsedFrame(const uvre::Texture &texture)
+{
+    return texture ? uvre::null::impl(texture)->last_used_frame : 0;
+}
+
+uvre::Shader uvre::null::RenderDeviceImpl::createShader(const uvre::ShaderCreateInfo &info)
+{
+    std::shared_ptr<uvre::null::Shader_S> shader(new uvre::null::Shader_S);
+    shader->prog = ++next_object;
+    shader->stage = info.stage;
+    return shader;
+}
+
+uvre::Shader uvre::null::RenderDeviceImpl::createShaderAsync(const uvre::ShaderCreateInfo &info)
+{
+    return createShader(info);
+}
+
+bool uvre::null::RenderDeviceImpl::isReady(const uvre::Shader &)
+{
+    return true;
+}
+
+uvre::Pipeline uvre::null::RenderDeviceImpl::createPipeline(const uvre::PipelineCreateInfo &info)
+{
+    std::shared_ptr<uvre::null::Pipeline_S> pipeline(new uvre::null::Pipeline_S);
+    pipeline->ppobj = ++next_object;
+    pipeline->blending = info.blending.enabled;
+    pipeline->depth_testing = info.depth_testing.enabled;
+    pipeline->face_culling = info.face_culling.enabled;
+    pipeline->scissor_test = info.scissor_test;
+    pipeline->num_attributes = info.num_vertex_attribs;
+    pipeline->bound_ibo = 0;
+    pipeline->bound_vbo = 0;
+    return pipeline;
+}
+
+uvre::Pipeline uvre::null::RenderDeviceImpl::createPipelineAsync(const uvre::PipelineCreateInfo &info)
+{
+    return createPipeline(info);
+}
+
+bool uvre::null::RenderDeviceImpl::isReady(const uvre::Pipeline &)
+{
+    return true;
+}
+
+uvre::Buffer uvre::null::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &info)
+{
+    std::shared_ptr<uvre::null::Buffer_S> buffer = makeTracked<uvre::null::Buffer_S>(this, &uvre::MemoryStats::buffers, info.size);
+    buffer->bufobj = ++next_object;
+    buffer->size = info.size;
+    return buffer;
+}
+
+void uvre::null::RenderDeviceImpl::writeBuffer(const uvre::Buffer &, size_t, size_t, const void *)
+{
+    stats->num_gl_calls++;
+}
+
+uvre::Sampler uvre::null::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInfo &)
+{
+    std::shared_ptr<uvre::null::Sampler_S> sampler(new uvre::null::Sampler_S);
+    sampler->ssobj = ++next_object;
+    return sampler;
+}
+
+static inline size_t getPixelSize(uvre::PixelFormat format)
+{
+    switch(format) {
+        case uvre::PixelFormat::R8_UNORM:
+        case uvre::PixelFormat::R8_SINT:
+        case uvre::PixelFormat::R8_UINT:
+        case uvre::PixelFormat::S8_UINT:
+            return 1;
+        case uvre::PixelFormat::R8G8_UNORM:
+        case uvre::PixelFormat::R8G8_SINT:
+        case uvre::PixelFormat::R8G8_UINT:
+        case uvre::PixelFormat::R16_UNORM:
+        case uvre::PixelFormat::R16_SINT:
+        case uvre::PixelFormat::R16_UINT:
+        case uvre::PixelFormat::R16_FLOAT:
+        case uvre::PixelFormat::D16_UNORM:
+            return 2;
+        case uvre::PixelFormat::R8G8B8_UNORM:
+        case uvre::PixelFormat::R8G8B8_SINT:
+        case uvre::PixelFormat::R8G8B8_UINT:
+            return 3;
+        case uvre::PixelFormat::R8G8B8A8_UNORM:
+        case uvre::PixelFormat::R8G8B8A8_SINT:
+        case uvre::PixelFormat::R8G8B8A8_UINT:
+        case uvre::PixelFormat::R16G16_UNORM:
+        case uvre::PixelFormat::R16G16_SINT:
+        case uvre::PixelFormat::R16G16_UINT:
+        case uvre::PixelFormat::R16G16_FLOAT:
+        case uvre::PixelFormat::R32_SINT:
+        case uvre::PixelFormat::R32_UINT:
+        case uvre::PixelFormat::R32_FLOAT:
+        case uvre::PixelFormat::D32_FLOAT:
+            return 4;
+        case uvre::PixelFormat::R16G16B16_UNORM:
+        case uvre::PixelFormat::R16G16B16_SINT:
+        case uvre::PixelFormat::R16G16B16_UINT:
+        case uvre::PixelFormat::R16G16B16_FLOAT:
+            return 6;
+        case uvre::PixelFormat::R16G16B16A16_UNORM:
+        case uvre::PixelFormat::R16G16B16A16_SINT:
+        case uvre::PixelFormat::R16G16B16A16_UINT:
+        case uvre::PixelFormat::R16G16B16A16_FLOAT:
+        case uvre::PixelFormat::R32G32_SINT:
+        case uvre::PixelFormat::R32G32_UINT:
+        case uvre::PixelFormat::R32G32_FLOAT:
+            return 8;
+        case uvre::PixelFormat::R32G32B32_SINT:
+        case uvre::PixelFormat::R32G32B32_UINT:
+        case uvre::PixelFormat::R32G32B32_FLOAT:
+            return 12;
+        case uvre::PixelFormat::R32G32B32A32_SINT:
+        case uvre::PixelFormat::R32G32B32A32_UINT:
+        case uvre::PixelFormat::R32G32B32A32_FLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+
+// Cube maps have six faces and arrays
+// have the same layer count on every level.
+static size_t getTextureSize(const uvre::TextureCreateInfo &info, size_t mip_levels)
+{
+    size_t layers = 1;
+    if(info.type == uvre::TextureType::TEXTURE_CUBE)
+        layers = 6;
+    else if(info.type == uvre::TextureType::TEXTURE_ARRAY)
+        layers = static_cast<size_t>(std::max(0, info.depth));
+
+    size_t pixels = 0;
+    int width = std::max(1, info.width);
+    int height = std::max(1, info.height);
+    for(size_t i = 0; i < mip_levels; i++) {
+        pixels += static_cast<size_t>(width) * static_cast<size_t>(height);
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+
+    return pixels * layers * getPixelSize(info.format);
+}
+
+uvre::Texture uvre::null::RenderDeviceImpl::createTexture(const uvre::TextureCreateInfo &info)
+{
+    const size_t size = getTextureSize(info, std::max<size_t>(1, info.mip_levels));
+    std::shared_ptr<uvre::null::Texture_S> texture = makeTracked<uvre::null::Texture_S>(this, &uvre::MemoryStats::textures, size);
+    texture->texobj = ++next_object;
+    texture->last_used_frame = 0;
+    texture->width = info.width;
+    texture->height = info.height;
+    texture->depth = info.depth;
+    texture->memory_size = size;
+    return texture;
+}
+
+uvre::Texture uvre::null::RenderDeviceImpl::createTextureView(const uvre::TextureViewCreateInfo &info)
+{
+    if(!info.texture)
+        return nullptr;
+
+    // Views share the storage of their
+    // source, they only count as objects.
+    std::shared_ptr<uvre::null::Texture_S> texture = makeTracked<uvre::null::Texture_S>(this, &uvre::MemoryStats::textures, 0);
+    texture->texobj = ++next_object;
+    texture->last_used_frame = 0;
+    texture->width = std::max(1, uvre::null::impl(info.texture)->width >> info.base_level);
+    texture->height = std::max(1, uvre::null::impl(info.texture)->height >> info.base_level);
+    texture->depth = static_cast<int>(info.num_layers);
+    texture->memory_size = 0;
+    return texture;
+}
+
+void uvre::null::RenderDeviceImpl::writeTexture2D(const uvre::Texture &, int, int, int, int, uvre::PixelFormat, const void *, int)
+{
+    stats->num_gl_calls++;
+}
+
+void uvre::null::RenderDeviceImpl::writeTextureCube(const uvre::Texture &, int, int, int, int, int, uvre::PixelFormat, const void *, int)
+{
+    stats->num_gl_calls++;
+}
+
+void uvre::null::RenderDeviceImpl::writeTextureArray(const uvre::Texture &, int, int, int, int, int, int, uvre::PixelFormat, const void *, int)
+{
+    stats->num_gl_calls++;
+}
+
+void uvre::null::RenderDeviceImpl::setTextureBaseLevel(const uvre::Texture &, int)
+{
+    stats->num_gl_calls++;
+}
+
+uvre::Buffer uvre::null::RenderDeviceImpl::createBufferAsync(const uvre::BufferCreateInfo &info)
+{
+    return createBuffer(info);
+}
+
+void uvre::null::RenderDeviceImpl::writeBufferAsync(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    writeBuffer(buffer, offset, size, data);
+}
+
+void uvre::null::RenderDeviceImpl::writeTexture2DAsync(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTexture2D(texture, x, y, w, h, format, data, level);
+}
+
+void uvre::null::RenderDeviceImpl::writeTextureCubeAsync(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTextureCube(texture, face, x, y, w, h, format, data, level);
+}
+
+void uvre::null::RenderDeviceImpl::writeTextureArrayAsync(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTextureArray(texture, x, y, z, w, h, d, format, data, level);
+}
+
+bool uvre::null::RenderDeviceImpl::isReady(const uvre::Buffer &)
+{
+    return true;
+}
+
+bool uvre::null::RenderDeviceImpl::isReady(const uvre::Texture &)
+{
+    return true;
+}
+
+static size_t getAttachmentSize(const uvre::RenderTargetCreateInfo &info)
+{
+    size_t size = 0;
+    if(info.depth_attachment)
+        size += uvre::null::impl(info.depth_attachment)->memory_size;
+    if(info.stencil_attachment && info.stencil_attachment != info.depth_attachment)
+        size += uvre::null::impl(info.stencil_attachment)->memory_size;
+    for(size_t i = 0; i < info.num_color_attachments; i++)
+        size += uvre::null::impl(info.color_attachments[i].color)->memory_size;
+    return size;
+}
+
+uvre::RenderTarget uvre::null::RenderDeviceImpl::createRenderTarget(const uvre::RenderTargetCreateInfo &info)
+{
+    const size_t size = getAttachmentSize(info);
+    std::shared_ptr<uvre::null::RenderTarget_S> target = makeTracked<uvre::null::RenderTarget_S>(this, &uvre::MemoryStats::render_targets, size);
+    target->fbobj = ++next_object;
+    target->memory_size = size;
+    return target;
+}
+
+uvre::ResourceSet uvre::null::RenderDeviceImpl::createResourceSet(const uvre::ResourceSetCreateInfo &info)
+{
+    std::shared_ptr<uvre::null::ResourceSet_S> set(new uvre::null::ResourceSet_S);
+    set->num_textures = info.num_textures;
+    set->num_samplers = info.num_samplers;
+    set->num_uniform_buffers = info.num_uniform_buffers;
+    set->num_storage_buffers = info.num_storage_buffers;
+
+    for(size_t i = 0; i < info.num_textures; i++) {
+        set->objects.push_back(info.textures[i]);
+        if(info.textures[i])
+            set->texture_objects.push_back(uvre::null::impl(info.textures[i]));
+    }
+    for(size_t i = 0; i < info.num_samplers; i++)
+        set->objects.push_back(info.samplers[i]);
+    for(size_t i = 0; i < info.num_uniform_buffers; i++)
+        set->objects.push_back(info.uniform_buffers[i].buffer);
+    for(size_t i = 0; i < info.num_storage_buffers; i++)
+        set->objects.push_back(info.storage_buffers[i].buffer);
+
+    return set;
+}
+
+uvre::ICommandList *uvre::null::RenderDeviceImpl::createCommandList()
+{
+    uvre::null::CommandListImpl *commands = new uvre::null::CommandListImpl();
+    commandlists.push_back(commands);
+    return commands;
+}
+
+void uvre::null::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
+{
+    for(std::vector<uvre::null::CommandListImpl *>::const_iterator it = commandlists.cbegin(); it != commandlists.cend(); it++) {
+        if(*it == commands) {
+            commandlists.erase(it);
+            delete commands;
+            return;
+        }
+    }
+}
+
+void uvre::null::RenderDeviceImpl::startRecording(uvre::ICommandList *commands)
+{
+    uvre::null::CommandListImpl *nullcommands = static_cast<uvre::null::CommandListImpl *>(commands);
+    nullcommands->num_commands = 0;
+    nullcommands->used_textures.clear();
+}
+
+void uvre::null::RenderDeviceImpl::submit(uvre::ICommandList *commands)
+{
+    // The numbers here mirror what the GL_46
+    // implementation would call for each command.
+    uvre::null::CommandListImpl *nullcommands = static_cast<uvre::null::CommandListImpl *>(commands);
+    // Residency managers want to know this
+    for(uvre::null::Texture_S *texture : nullcommands->used_textures)
+        texture->last_used_frame = frame_number + 1;
+
+    uint64_t num_calls = 0;
+    for(size_t i = 0; i < nullcommands->num_commands; i++) {
+        const uvre::null::Command &cmd = nullcommands->commands[i];
+        switch(cmd.type) {
+            case uvre::null::CommandType::BIND_PIPELINE:
+                bound_pipeline = *cmd.pipeline;
+                num_calls += 4; // disable everything
+                num_calls += bound_pipeline.blending ? 3 : 0;
+                num_calls += bound_pipeline.depth_testing ? 2 : 0;
+                num_calls += bound_pipeline.face_culling ? 3 : 0;
+                num_calls += bound_pipeline.scissor_test ? 1 : 0;
+                num_calls += 2; // fill mode, program pipeline
+                break;
+            case uvre::null::CommandType::BIND_INDEX_BUFFER:
+                bound_pipeline.bound_ibo = cmd.object;
+                break;
+            case uvre::null::CommandType::BIND_VERTEX_BUFFER:
+                if(bound_pipeline.bound_vbo != cmd.buffer.bufobj) {
+                    bound_pipeline.bound_vbo = cmd.buffer.bufobj;
+                    num_calls += 2 + bound_pipeline.num_attributes;
+                }
+                break;
+            case uvre::null::CommandType::BIND_RESOURCE_SET:
+                num_calls += cmd.set->num_textures ? 1 : 0;
+                num_calls += cmd.set->num_samplers ? 1 : 0;
+                num_calls += cmd.set->num_uniform_buffers ? 1 : 0;
+                num_calls += cmd.set->num_storage_buffers ? 1 : 0;
+                break;
+            case uvre::null::CommandType::DRAW:
+            case uvre::null::CommandType::IDRAW:
+                stats->num_draws++;
+                num_calls++;
+                break;
+            case uvre::null::CommandType::DISPATCH:
+                stats->num_dispatches++;
+                num_calls++;
+                break;
+            case uvre::null::CommandType::DISPATCH_INDIRECT:
+                stats->num_dispatches++;
+                num_calls += 2;
+                break;
+            default:
+                num_calls++;
+                break;
+        }
+    }
+
+    stats->num_submits++;
+    stats->num_commands += nullcommands->num_commands;
+    stats->num_gl_calls += num_calls;
+}
+
+uvre::Fence uvre::null::RenderDeviceImpl::createFence()
+{
+    std::shared_ptr<uvre::null::Fence_S> fence(new uvre::null::Fence_S);
+    fence->sync = ++next_object;
+    stats->num_gl_calls++;
+    return fence;
+}
+
+bool uvre::null::RenderDeviceImpl::waitFence(const uvre::Fence &, uint64_t)
+{
+    // Everything is always done
+    stats->num_gl_calls++;
+    return true;
+}
+
+uvre::Query uvre::null::RenderDeviceImpl::createQuery(uvre::QueryType)
+{
+    std::shared_ptr<uvre::null::Query_S> query(new uvre::null::Query_S);
+    query->qobj = ++next_object;
+    return query;
+}
+
+bool uvre::null::RenderDeviceImpl::getQueryResult(const uvre::Query &, uint64_t &result)
+{
+    stats->num_gl_calls += 2;
+    result = 0;
+    return true;
+}
+
+uvre::Readback uvre::null::RenderDeviceImpl::readRenderTargetAsync(const uvre::RenderTarget &, uint32_t, int, int, int w, int h, uvre::PixelFormat format)
+{
+    const size_t size = static_cast<size_t>(std::max(0, w)) * static_cast<size_t>(std::max(0, h)) * getPixelSize(format);
+    if(!size)
+        return nullptr;
+
+    stats->num_gl_calls += 6;
+    std::shared_ptr<uvre::null::Readback_S> readback(new uvre::null::Readback_S);
+    readback->pixels.resize(size);
+    return readback;
+}
+
+uvre::Readback uvre::null::RenderDeviceImpl::readTextureAsync(const uvre::Texture &texture, int, int, int, int w, int h, uvre::PixelFormat format)
+{
+    const size_t size = static_cast<size_t>(std::max(0, w)) * static_cast<size_t>(std::max(0, h)) * getPixelSize(format);
+    if(!texture || !size)
+        return nullptr;
+
+    stats->num_gl_calls += 4;
+    std::shared_ptr<uvre::null::Readback_S> readback(new uvre::null::Readback_S);
+    readback->pixels.resize(size);
+    return readback;
+}
+
+const void *uvre::null::RenderDeviceImpl::getReadbackData(const uvre::Readback &readback)
+{
+    if(!readback)
+        return nullptr;
+    stats->num_gl_calls += 2;
+    return uvre::null::impl(readback)->pixels.data();
+}
+
+void uvre::null::RenderDeviceImpl::beginFrame()
+{
+    // Wait and delete once the ring wraps around
+    if(frame_number >= max_frames_in_flight)
+        stats->num_gl_calls += 2;
+}
+
+void uvre::null::RenderDeviceImpl::endFrame()
+{
+    stats->num_gl_calls++;
+    frame_number++;
+}
+
+size_t uvre::null::RenderDeviceImpl::getFrameIndex() const
+{
+    return static_cast<size_t>(frame_number % max_frames_in_flight);
+}
+
+void uvre::null::RenderDeviceImpl::prepare()
+{
+    stats->num_gl_calls++;
+}
+
+void uvre::null::RenderDeviceImpl::present()
+{
+    // Nothing to present
+}
+
+void uvre::null::RenderDeviceImpl::vsync(bool)
+{
+    // Nothing to sync with
+}
+
+void uvre::null::RenderDeviceImpl::mode(int, int)
+{
+    // Nothing to resize
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "null_private.hpp"
+
+void uvre::null::pollImplInfo(uvre::ImplInfo &info)
+{
+    info.family = uvre::ImplFamily::NONE;
+    info.gl.core_profile = false;
+    info.gl.version_major = 0;
+    info.gl.version_minor = 0;
+}
+
+uvre::IRenderDevice *uvre::null::createDevice(const uvre::DeviceCreateInfo &info)
+{
+    // No context, no callbacks
+    return new uvre::null::RenderDeviceImpl(info);
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "sw_private.hpp"
+
+static inline void pushCommand(std::vector<uvre::sw::Command> &commands, const uvre::sw::Command &cmd, size_t index)
+{
+    if(commands.size() <= index) {
+        commands.push_back(cmd);
+        return;
+    }
+
+    std::vector<uvre::sw::Command>::iterator it = commands.begin() + index;
+    if(it->type == uvre::sw::CommandType::WRITE_BUFFER)
+        delete[] it->buffer_write.data_ptr;
+    *it = cmd;
+}
+
+uvre::sw::CommandListImpl::CommandListImpl()
+    : commands(), num_commands(0), used_textures()
+{
+}
+
+void uvre::sw::CommandListImpl::setScissor(int x, int y, int width, int height)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::SET_SCISSOR;
+    cmd.scvp.x = x;
+    cmd.scvp.y = y;
+    cmd.scvp.w = width;
+    cmd.scvp.h = height;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::setViewport(int x, int y, int width, int height)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::SET_VIEWPORT;
+    cmd.scvp.x = x;
+    cmd.scvp.y = y;
+    cmd.scvp.w = width;
+    cmd.scvp.h = height;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::setClearDepth(float d)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::SET_CLEAR_DEPTH;
+    cmd.depth = d;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::setClearColor3f(float r, float g, float b)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::SET_CLEAR_COLOR;
+    cmd.color[0] = r;
+    cmd.color[1] = g;
+    cmd.color[2] = b;
+    cmd.color[3] = 1.0f;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::setClearColor4f(float r, float g, float b, float a)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::SET_CLEAR_COLOR;
+    cmd.color[0] = r;
+    cmd.color[1] = g;
+    cmd.color[2] = b;
+    cmd.color[3] = a;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::clear(uvre::RenderTargetMask mask)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::CLEAR;
+    cmd.clear_mask = mask;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::bindPipeline(const uvre::Pipeline &pipeline)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_PIPELINE;
+    cmd.pipeline = uvre::sw::impl(pipeline);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::bindStorageBuffer(const uvre::Buffer &buffer, uint32_t index)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_STORAGE_BUFFER;
+    cmd.bind_index = index;
+    cmd.buffer = uvre::sw::impl(buffer);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::bindUniformBuffer(const uvre::Buffer &buffer, uint32_t index)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_UNIFORM_BUFFER;
+    cmd.bind_index = index;
+    cmd.buffer = uvre::sw::impl(buffer);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::bindIndexBuffer(const uvre::Buffer &buffer)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_INDEX_BUFFER;
+    cmd.buffer = uvre::sw::impl(buffer);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::bindVertexBuffer(const uvre::Buffer &buffer)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_VERTEX_BUFFER;
+    cmd.buffer = uvre::sw::impl(buffer);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::bindSampler(const uvre::Sampler &, uint32_t)
+{
+    // Shaders do their own sampling
+}
+
+void uvre::sw::CommandListImpl::bindTexture(const uvre::Texture &texture, uint32_t index)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_TEXTURE;
+    cmd.bind_index = index;
+    cmd.texture = uvre::sw::impl(texture);
+    pushCommand(commands, cmd, num_commands++);
+
+    if(texture)
+        used_textures.push_back(cmd.texture);
+}
+
+void uvre::sw::CommandListImpl::bindStorageImage(const uvre::Texture &, uint32_t, int, uvre::ImageAccess)
+{
+    // Compute is not supported
+}
+
+void uvre::sw::CommandListImpl::bindRenderTarget(const uvre::RenderTarget &target)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_RENDER_TARGET;
+    cmd.target = uvre::sw::impl(target);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::bindResourceSet(const uvre::ResourceSet &set, uint32_t first)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BIND_RESOURCE_SET;
+    cmd.bind_index = first;
+    cmd.set = uvre::sw::impl(set);
+    pushCommand(commands, cmd, num_commands++);
+    used_textures.insert(used_textures.end(), cmd.set->texture_objects.cbegin(), cmd.set->texture_objects.cend());
+}
+
+void uvre::sw::CommandListImpl::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::WRITE_BUFFER;
+    cmd.buffer_write.buffer = uvre::sw::impl(buffer);
+    cmd.buffer_write.offset = offset;
+    cmd.buffer_write.size = size;
+    cmd.buffer_write.data_ptr = new uint8_t[size];
+    std::copy(reinterpret_cast<const uint8_t *>(data), reinterpret_cast<const uint8_t *>(data) + size, cmd.buffer_write.data_ptr);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::copyRenderTarget(const uvre::RenderTarget &src, const uvre::RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, uvre::RenderTargetMask mask, bool)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::COPY_RENDER_TARGET;
+    cmd.rt_copy.src = uvre::sw::impl(src);
+    cmd.rt_copy.dst = uvre::sw::impl(dst);
+    cmd.rt_copy.sx0 = sx0;
+    cmd.rt_copy.sy0 = sy0;
+    cmd.rt_copy.sx1 = sx1;
+    cmd.rt_copy.sy1 = sy1;
+    cmd.rt_copy.dx0 = dx0;
+    cmd.rt_copy.dy0 = dy0;
+    cmd.rt_copy.dx1 = dx1;
+    cmd.rt_copy.dy1 = dy1;
+    cmd.rt_copy.mask = mask;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::generateMipmaps(const uvre::Texture &)
+{
+}
+
+void uvre::sw::CommandListImpl::memoryBarrier(uvre::BarrierFlags)
+{
+    // Everything is coherent already
+}
+
+void uvre::sw::CommandListImpl::beginQuery(const uvre::Query &query)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BEGIN_QUERY;
+    cmd.query = uvre::sw::impl(query);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::endQuery(const uvre::Query &query)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::END_QUERY;
+    cmd.query = uvre::sw::impl(query);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::beginConditionalRender(const uvre::Query &query, bool wait)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::BEGIN_CONDITIONAL_RENDER;
+    cmd.cond.query = uvre::sw::impl(query);
+    cmd.cond.wait = wait;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::endConditionalRender()
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::END_CONDITIONAL_RENDER;
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::DRAW;
+    cmd.draw.a.vertices = static_cast<int32_t>(vertices);
+    cmd.draw.a.instances = static_cast<int32_t>(instances);
+    cmd.draw.a.base_vertex = static_cast<int32_t>(base_vertex);
+    cmd.draw.a.base_instance = static_cast<int32_t>(base_instance);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance)
+{
+    uvre::sw::Command cmd = {};
+    cmd.type = uvre::sw::CommandType::IDRAW;
+    cmd.draw.e.indices = static_cast<int32_t>(indices);
+    cmd.draw.e.instances = static_cast<int32_t>(instances);
+    cmd.draw.e.base_index = static_cast<int32_t>(base_index);
+    cmd.draw.e.base_vertex = static_cast<int32_t>(base_vertex);
+    cmd.draw.e.base_instance = static_cast<int32_t>(base_instance);
+    pushCommand(commands, cmd, num_commands++);
+}
+
+void uvre::sw::CommandListImpl::dispatch(size_t, size_t, size_t)
+{
+    // Compute is not supported
+}
+
+void uvre::sw::CommandListImpl::dispatchIndirect(const uvre::Buffer &, size_t)
+{
+    // Compute is not supported
+}
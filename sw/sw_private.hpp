@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include <uvre/uvre.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace uvre::sw
+{
+using SwVertexFunc = void (*)(const SwResources &res, const void *vertex, uint32_t vertex_id, uint32_t instance_id, SwVertex &out);
+using SwFragmentFunc = bool (*)(const SwResources &res, const SwFragment &frag, float color[4]);
+
+struct Shader_S final : public uvre::Shader_S {
+    ShaderStage stage;
+    SwVertexFunc vertex;
+    SwFragmentFunc fragment;
+    size_t num_varyings;
+};
+
+struct Pipeline_S final : public uvre::Pipeline_S {
+    struct {
+        bool enabled;
+        BlendEquation equation;
+        BlendFunc sfactor;
+        BlendFunc dfactor;
+    } blending;
+    struct {
+        bool enabled;
+        DepthFunc func;
+    } depth_testing;
+    struct {
+        bool enabled;
+        bool clockwise;
+        bool cull_front;
+        bool cull_back;
+    } face_culling;
+    bool scissor_test;
+    size_t index_size;
+    PrimitiveMode primitive_mode;
+    size_t vertex_stride;
+    size_t num_varyings;
+    SwVertexFunc vertex;
+    SwFragmentFunc fragment;
+    std::vector<Shader> shaders; // keeps them alive
+};
+
+struct Buffer_S final : public uvre::Buffer_S {
+    std::vector<uint8_t> data;
+};
+
+struct Sampler_S final : public uvre::Sampler_S {
+    SamplerFlags flags;
+};
+
+// Views have no pixels of their own: data
+// points into the source they keep alive.
+struct Texture_S final : public uvre::Texture_S {
+    size_t bpp;
+    std::vector<uint8_t> pixels;
+    uint8_t *data;
+    Texture source;
+    SwImage image;
+    uint64_t last_used_frame;
+};
+
+// Only the first color attachment is ever
+// rendered to, there's one color output.
+struct RenderTarget_S final : public uvre::RenderTarget_S {
+    Texture color;
+    Texture depth;
+};
+
+struct ResourceSet_S final : public uvre::ResourceSet_S {
+    std::vector<Texture_S *> texture_objects;
+    std::vector<const SwImage *> textures;
+    std::vector<const void *> uniform_buffers;
+    std::vector<const void *> storage_buffers;
+    std::vector<std::shared_ptr<void>> objects; // keeps them alive
+};
+
+// Everything is done by the time
+// submit returns, nothing to wait for.
+struct Fence_S final : public uvre::Fence_S {
+    uint64_t frame;
+};
+
+struct Query_S final : public uvre::Query_S {
+    QueryType type;
+    std::atomic<uint64_t> samples;
+};
+
+// Reads are copied out right away,
+// the data is ready once it's returned.
+struct Readback_S final : public uvre::Readback_S {
+    std::vector<uint8_t> pixels;
+};
+
+// Color is R8G8B8A8, depth is
+// a float per pixel, rows go up.
+struct Framebuffer final {
+    uint8_t *color;
+    float *depth;
+    int width;
+    int height;
+};
+
+struct DrawState final {
+    const Pipeline_S *pipeline;
+    const SwResources *resources;
+    Framebuffer target;
+    int viewport[4];
+    int scissor[4];
+    Query_S *query;
+};
+
+class ThreadPool final {
+public:
+    ThreadPool(size_t num_threads);
+    ~ThreadPool();
+
+    // Calls func for every index in [0, count)
+    // and returns once all of them are done.
+    // The calling thread takes part in it too.
+    void run(size_t count, const std::function<void(size_t)> &func);
+
+public:
+    std::mutex mutex;
+    std::condition_variable job_cv;
+    std::condition_variable done_cv;
+    const std::function<void(size_t)> *func;
+    size_t count;
+    std::atomic<size_t> next;
+    size_t num_busy;
+    uint64_t generation;
+    bool quit;
+    std::vector<std::thread> threads;
+};
+
+struct Triangle final {
+    uint32_t vertices[3];
+    int64_t edge_a[3];
+    int64_t edge_b[3];
+    int64_t edge_c[3];
+    int32_t bias[3];
+    int64_t area;
+    float z[3];
+    float inv_w[3];
+    int min_x, min_y;
+    int max_x, max_y;
+};
+
+class Rasterizer final {
+public:
+    Rasterizer(ThreadPool *pool);
+
+    // Indices are either nullptr, 16-bit or 32-bit
+    // as the pipeline says. False means the draw
+    // tried to read past the vertex buffer.
+    bool draw(const DrawState &state, const Buffer_S *vbo, const void *indices, size_t count, int32_t base_vertex, uint32_t instance);
+
+public:
+    ThreadPool *pool;
+    std::vector<SwVertex> vertices;
+    std::vector<uint32_t> primitives;
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> bins;
+};
+
+enum class CommandType {
+    SET_SCISSOR,
+    SET_VIEWPORT,
+    SET_CLEAR_COLOR,
+    SET_CLEAR_DEPTH,
+    CLEAR,
+    BIND_PIPELINE,
+    BIND_STORAGE_BUFFER,
+    BIND_UNIFORM_BUFFER,
+    BIND_INDEX_BUFFER,
+    BIND_VERTEX_BUFFER,
+    BIND_TEXTURE,
+    BIND_RENDER_TARGET,
+    BIND_RESOURCE_SET,
+    WRITE_BUFFER,
+    COPY_RENDER_TARGET,
+    BEGIN_QUERY,
+    END_QUERY,
+    BEGIN_CONDITIONAL_RENDER,
+    END_CONDITIONAL_RENDER,
+    DRAW,
+    IDRAW
+};
+
+union DrawCmd final {
+    struct {
+        int32_t vertices;
+        int32_t instances;
+        int32_t base_vertex;
+        int32_t base_instance;
+    } a;
+    struct {
+        int32_t indices;
+        int32_t instances;
+        int32_t base_index;
+        int32_t base_vertex;
+        int32_t base_instance;
+    } e;
+};
+
+struct Command final {
+    CommandType type;
+    uint32_t bind_index;
+    union {
+        struct {
+            int x, y;
+            int w, h;
+        } scvp;
+        float color[4];
+        float depth;
+        uint32_t clear_mask;
+        Pipeline_S *pipeline;
+        ResourceSet_S *set;
+        Buffer_S *buffer;
+        Texture_S *texture;
+        RenderTarget_S *target;
+        Query_S *query;
+        struct {
+            Buffer_S *buffer;
+            size_t offset;
+            size_t size;
+            uint8_t *data_ptr;
+        } buffer_write;
+        struct {
+            RenderTarget_S *src, *dst;
+            int sx0, sy0, sx1, sy1;
+            int dx0, dy0, dx1, dy1;
+            uint32_t mask;
+        } rt_copy;
+        struct {
+            Query_S *query;
+            bool wait;
+        } cond;
+        DrawCmd draw;
+    };
+};
+
+class CommandListImpl final : public ICommandList {
+public:
+    CommandListImpl();
+
+    void setScissor(int x, int y, int width, int height) override;
+    void setViewport(int x, int y, int width, int height) override;
+
+    void setClearDepth(float d) override;
+    void setClearColor3f(float r, float g, float b) override;
+    void setClearColor4f(float r, float g, float b, float a) override;
+    void clear(RenderTargetMask mask) override;
+
+    void bindPipeline(const Pipeline &pipeline) override;
+    void bindStorageBuffer(const Buffer &buffer, uint32_t index) override;
+    void bindUniformBuffer(const Buffer &buffer, uint32_t index) override;
+    void bindIndexBuffer(const Buffer &buffer) override;
+    void bindVertexBuffer(const Buffer &buffer) override;
+    void bindSampler(const Sampler &sampler, uint32_t index) override;
+    void bindTexture(const Texture &texture, uint32_t index) override;
+    void bindStorageImage(const Texture &texture, uint32_t index, int level, ImageAccess access) override;
+    void bindRenderTarget(const RenderTarget &target) override;
+    void bindResourceSet(const ResourceSet &set, uint32_t first) override;
+
+    void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void copyRenderTarget(const RenderTarget &src, const RenderTarget &dst, int sx0, int sy0, int sx1, int sy1, int dx0, int dy0, int dx1, int dy1, RenderTargetMask mask, bool filter) override;
+    void generateMipmaps(const Texture &texture) override;
+    void memoryBarrier(BarrierFlags flags) override;
+
+    void beginQuery(const Query &query) override;
+    void endQuery(const Query &query) override;
+    void beginConditionalRender(const Query &query, bool wait) override;
+    void endConditionalRender() override;
+
+    void draw(size_t vertices, size_t instances, size_t base_vertex, size_t base_instance) override;
+    void idraw(size_t indices, size_t instances, size_t base_index, size_t base_vertex, size_t base_instance) override;
+    void dispatch(size_t x, size_t y, size_t z) override;
+    void dispatchIndirect(const Buffer &buffer, size_t offset) override;
+
+public:
+    std::vector<Command> commands;
+    size_t num_commands;
+    std::vector<Texture_S *> used_textures;
+};
+
+class RenderDeviceImpl;
+
+// Handles can outlive the device, so their deleters
+// reach it through this: it's null once the device
+// is gone and the objects are then simply freed.
+struct DeviceLink final {
+    std::mutex mutex;
+    RenderDeviceImpl *device;
+};
+
+class RenderDeviceImpl final : public IRenderDevice {
+public:
+    RenderDeviceImpl(const DeviceCreateInfo &info);
+    virtual ~RenderDeviceImpl();
+
+    const DeviceInfo &getInfo() const;
+    MemoryStats getMemoryStats() override;
+    uint64_t getLastUsedFrame(const Texture &texture) override;
+
+    Shader createShader(const ShaderCreateInfo &info) override;
+    Pipeline createPipeline(const PipelineCreateInfo &info) override;
+    Buffer createBuffer(const BufferCreateInfo &info) override;
+    Sampler createSampler(const SamplerCreateInfo &info) override;
+    Texture createTexture(const TextureCreateInfo &info) override;
+    Texture createTextureView(const TextureViewCreateInfo &info) override;
+    RenderTarget createRenderTarget(const RenderTargetCreateInfo &info) override;
+    ResourceSet createResourceSet(const ResourceSetCreateInfo &info) override;
+
+    Shader createShaderAsync(const ShaderCreateInfo &info) override;
+    Pipeline createPipelineAsync(const PipelineCreateInfo &info) override;
+    bool isReady(const Shader &shader) override;
+    bool isReady(const Pipeline &pipeline) override;
+
+    Buffer createBufferAsync(const BufferCreateInfo &info) override;
+    void writeBufferAsync(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2DAsync(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCubeAsync(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArrayAsync(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    bool isReady(const Buffer &buffer) override;
+    bool isReady(const Texture &texture) override;
+
+    void writeBuffer(const Buffer &buffer, size_t offset, size_t size, const void *data) override;
+    void writeTexture2D(const Texture &texture, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureCube(const Texture &texture, int face, int x, int y, int w, int h, PixelFormat format, const void *data, int level) override;
+    void writeTextureArray(const Texture &texture, int x, int y, int z, int w, int h, int d, PixelFormat format, const void *data, int level) override;
+    void setTextureBaseLevel(const Texture &texture, int level) override;
+
+    ICommandList *createCommandList() override;
+    void destroyCommandList(ICommandList *commands) override;
+    void startRecording(ICommandList *commands) override;
+    void submit(ICommandList *commands) override;
+
+    Fence createFence() override;
+    bool waitFence(const Fence &fence, uint64_t timeout) override;
+
+    Query createQuery(QueryType type) override;
+    bool getQueryResult(const Query &query, uint64_t &result) override;
+
+    Readback readRenderTargetAsync(const RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, PixelFormat format) override;
+    Readback readTextureAsync(const Texture &texture, int level, int x, int y, int w, int h, PixelFormat format) override;
+    const void *getReadbackData(const Readback &readback) override;
+
+    void beginFrame() override;
+    void endFrame() override;
+    size_t getFrameIndex() const override;
+
+    void prepare() override;
+    void present() override;
+    void vsync(bool enable) override;
+    void mode(int width, int height) override;
+
+public:
+    DeviceCreateInfo create_info;
+    DeviceInfo info;
+    ThreadPool *pool;
+    Rasterizer *rasterizer;
+    size_t max_frames_in_flight;
+    uint64_t frame_number;
+    std::vector<uint8_t> color_buffer;
+    std::vector<float> depth_buffer;
+    Framebuffer default_target;
+    Pipeline_S null_pipeline;
+    DrawState state;
+    SwResources resources;
+    const Buffer_S *bound_vbo;
+    const Buffer_S *bound_ibo;
+    const Query_S *condition;
+    float clear_color[4];
+    float clear_depth;
+    std::vector<CommandListImpl *> commandlists;
+
+    // Objects are freed on whatever thread
+    // releases them last, stats included.
+    std::shared_ptr<DeviceLink> link;
+    std::mutex memory_mutex;
+    MemoryStats memory_stats;
+};
+
+// Handles only ever reach the device that
+// made them, so downcasting them is safe.
+static inline Shader_S *impl(const Shader &shader)
+{
+    return static_cast<Shader_S *>(shader.get());
+}
+
+static inline Pipeline_S *impl(const Pipeline &pipeline)
+{
+    return static_cast<Pipeline_S *>(pipeline.get());
+}
+
+static inline Buffer_S *impl(const Buffer &buffer)
+{
+    return static_cast<Buffer_S *>(buffer.get());
+}
+
+static inline Sampler_S *impl(const Sampler &sampler)
+{
+    return static_cast<Sampler_S *>(sampler.get());
+}
+
+static inline Texture_S *impl(const Texture &texture)
+{
+    return static_cast<Texture_S *>(texture.get());
+}
+
+static inline RenderTarget_S *impl(const RenderTarget &target)
+{
+    return static_cast<RenderTarget_S *>(target.get());
+}
+
+static inline ResourceSet_S *impl(const ResourceSet &set)
+{
+    return static_cast<ResourceSet_S *>(set.get());
+}
+
+static inline Fence_S *impl(const Fence &fence)
+{
+    return static_cast<Fence_S *>(fence.get());
+}
+
+static inline Query_S *impl(const Query &query)
+{
+    return static_cast<Query_S *>(query.get());
+}
+
+static inline Readback_S *impl(const Readback &readback)
+{
+    return static_cast<Readback_S *>(readback.get());
+}
+
+// sw_rmain.cpp
+void pollImplInfo(ImplInfo &info);
+IRenderDevice *createDevice(const DeviceCreateInfo &info);
+} // namespace uvre::sw
@@ -0,0 +1,681 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "sw_private.hpp"
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UVRE_SW_SSE2 1
+#endif
+
+constexpr static const int TILE_SIZE = 64;
+constexpr static const int SUBPIXEL_BITS = 4;
+constexpr static const int64_t SUBPIXEL_ONE = INT64_C(1) << SUBPIXEL_BITS;
+constexpr static const int64_t SUBPIXEL_HALF = SUBPIXEL_ONE / 2;
+constexpr static const size_t VERTEX_BATCH = 256;
+constexpr static const size_t MAX_CLIP_VERTICES = 16;
+
+// Triangles are only clipped against the sides
+// when they go this far out of the viewport (in NDC),
+// the rest is handled by the scissor rectangle.
+// This also keeps edge functions within 32 bits.
+constexpr static const float GUARD_BAND = 2.0f;
+constexpr static const float MIN_W = 1.0e-5f;
+constexpr static const int NUM_CLIP_PLANES = 7;
+
+uvre::sw::Rasterizer::Rasterizer(uvre::sw::ThreadPool *pool)
+    : pool(pool), vertices(), primitives(), triangles(), bins()
+{
+}
+
+static inline uint32_t getIndex(const void *indices, size_t index_size, size_t i)
+{
+    if(index_size == sizeof(uvre::Index16))
+        return reinterpret_cast<const uvre::Index16 *>(indices)[i];
+    return reinterpret_cast<const uvre::Index32 *>(indices)[i];
+}
+
+static inline float getPlaneDistance(const uvre::SwVertex &vertex, int plane)
+{
+    const float *pos = vertex.position;
+    switch(plane) {
+        case 0:
+            return pos[3] + pos[2];
+        case 1:
+            return pos[3] - pos[2];
+        case 2:
+            return GUARD_BAND * pos[3] + pos[0];
+        case 3:
+            return GUARD_BAND * pos[3] - pos[0];
+        case 4:
+            return GUARD_BAND * pos[3] + pos[1];
+        case 5:
+            return GUARD_BAND * pos[3] - pos[1];
+        default:
+            return pos[3] - MIN_W;
+    }
+}
+
+static void setupTriangle(uvre::sw::Rasterizer *rasterizer, const uvre::sw::DrawState &state, const int clip[4], uint32_t i0, uint32_t i1, uint32_t i2)
+{
+    const uvre::sw::Pipeline_S *pipeline = state.pipeline;
+    const uint32_t indices[3] = { i0, i1, i2 };
+
+    uvre::sw::Triangle tri;
+    int64_t x[3], y[3];
+    for(int i = 0; i < 3; i++) {
+        const float *pos = rasterizer->vertices[indices[i]].position;
+        const float inv_w = 1.0f / pos[3];
+        const float fx = static_cast<float>(state.viewport[0]) + (pos[0] * inv_w * 0.5f + 0.5f) * static_cast<float>(state.viewport[2]);
+        const float fy = static_cast<float>(state.viewport[1]) + (pos[1] * inv_w * 0.5f + 0.5f) * static_cast<float>(state.viewport[3]);
+        x[i] = std::llround(fx * static_cast<float>(SUBPIXEL_ONE));
+        y[i] = std::llround(fy * static_cast<float>(SUBPIXEL_ONE));
+        tri.vertices[i] = indices[i];
+        tri.z[i] = pos[2] * inv_w * 0.5f + 0.5f;
+        tri.inv_w[i] = inv_w;
+    }
+
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if(area == 0)
+        return;
+
+    // Window coordinates go up so positive
+    // areas are counter-clockwise.
+    const bool front = pipeline->face_culling.clockwise ? (area < 0) : (area > 0);
+    if(pipeline->face_culling.enabled && ((front && pipeline->face_culling.cull_front) || (!front && pipeline->face_culling.cull_back)))
+        return;
+
+    if(area < 0) {
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        std::swap(tri.vertices[1], tri.vertices[2]);
+        std::swap(tri.z[1], tri.z[2]);
+        std::swap(tri.inv_w[1], tri.inv_w[2]);
+        area = -area;
+    }
+
+    // Edge k is the one opposite to vertex k,
+    // so its value divided by the area is the
+    // barycentric weight of that vertex.
+    for(int k = 0; k < 3; k++) {
+        const int i = (k + 1) % 3;
+        const int j = (k + 2) % 3;
+        tri.edge_a[k] = y[i] - y[j];
+        tri.edge_b[k] = x[j] - x[i];
+        tri.edge_c[k] = x[i] * y[j] - y[i] * x[j];
+
+        // Top-left rule: pixels exactly on a shared
+        // edge belong to only one of the triangles.
+        tri.bias[k] = (tri.edge_a[k] > 0 || (tri.edge_a[k] == 0 && tri.edge_b[k] > 0)) ? 0 : -1;
+    }
+
+    tri.area = area;
+
+    // Pixel centers are at half-pixel offsets
+    const int64_t min_x = std::min(x[0], std::min(x[1], x[2]));
+    const int64_t min_y = std::min(y[0], std::min(y[1], y[2]));
+    const int64_t max_x = std::max(x[0], std::max(x[1], x[2]));
+    const int64_t max_y = std::max(y[0], std::max(y[1], y[2]));
+    tri.min_x = std::max(clip[0], static_cast<int>((min_x - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    tri.min_y = std::max(clip[1], static_cast<int>((min_y - SUBPIXEL_HALF + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    tri.max_x = std::min(clip[2], static_cast<int>((max_x - SUBPIXEL_HALF) >> SUBPIXEL_BITS));
+    tri.max_y = std::min(clip[3], static_cast<int>((max_y - SUBPIXEL_HALF) >> SUBPIXEL_BITS));
+    if(tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+        return;
+
+    rasterizer->triangles.push_back(tri);
+}
+
+static void clipTriangle(uvre::sw::Rasterizer *rasterizer, const uvre::sw::DrawState &state, const int clip[4], uint32_t i0, uint32_t i1, uint32_t i2)
+{
+    int outside = 0;
+    for(int plane = 0; plane < NUM_CLIP_PLANES; plane++) {
+        const int mask = (getPlaneDistance(rasterizer->vertices[i0], plane) < 0.0f ? 1 : 0) | (getPlaneDistance(rasterizer->vertices[i1], plane) < 0.0f ? 2 : 0) | (getPlaneDistance(rasterizer->vertices[i2], plane) < 0.0f ? 4 : 0);
+        if(mask == 7)
+            return;
+        if(mask)
+            outside |= 1 << plane;
+    }
+
+    if(!outside) {
+        setupTriangle(rasterizer, state, clip, i0, i1, i2);
+        return;
+    }
+
+    // Sutherland-Hodgman against the planes
+    // that actually cut through the triangle.
+    const size_t num_varyings = state.pipeline->num_varyings;
+    uint32_t polygon[2][MAX_CLIP_VERTICES] = { { i0, i1, i2 } };
+    size_t count = 3;
+    int src = 0;
+    for(int plane = 0; plane < NUM_CLIP_PLANES && count >= 3; plane++) {
+        if(!(outside & (1 << plane)))
+            continue;
+
+        const int dst = src ^ 1;
+        size_t new_count = 0;
+        for(size_t i = 0; i < count; i++) {
+            const uint32_t a = polygon[src][i];
+            const uint32_t b = polygon[src][(i + 1) % count];
+            const float da = getPlaneDistance(rasterizer->vertices[a], plane);
+            const float db = getPlaneDistance(rasterizer->vertices[b], plane);
+            if(da >= 0.0f)
+                polygon[dst][new_count++] = a;
+            if((da >= 0.0f) != (db >= 0.0f)) {
+                const float t = da / (da - db);
+                const uvre::SwVertex &va = rasterizer->vertices[a];
+                const uvre::SwVertex &vb = rasterizer->vertices[b];
+                uvre::SwVertex vertex;
+                for(size_t j = 0; j < 4; j++)
+                    vertex.position[j] = va.position[j] + (vb.position[j] - va.position[j]) * t;
+                for(size_t j = 0; j < num_varyings; j++)
+                    vertex.varyings[j] = va.varyings[j] + (vb.varyings[j] - va.varyings[j]) * t;
+                polygon[dst][new_count++] = static_cast<uint32_t>(rasterizer->vertices.size());
+                rasterizer->vertices.push_back(vertex);
+            }
+        }
+
+        count = new_count;
+        src = dst;
+    }
+
+    for(size_t i = 2; i < count; i++)
+        setupTriangle(rasterizer, state, clip, polygon[src][0], polygon[src][i - 1], polygon[src][i]);
+}
+
+static inline bool testDepth(uvre::DepthFunc func, float z, float depth)
+{
+    switch(func) {
+        case uvre::DepthFunc::NEVER:
+            return false;
+        case uvre::DepthFunc::ALWAYS:
+            return true;
+        case uvre::DepthFunc::EQUAL:
+            return z == depth;
+        case uvre::DepthFunc::NOT_EQUAL:
+            return z != depth;
+        case uvre::DepthFunc::LESS:
+            return z < depth;
+        case uvre::DepthFunc::LESS_OR_EQUAL:
+            return z <= depth;
+        case uvre::DepthFunc::GREATER:
+            return z > depth;
+        case uvre::DepthFunc::GREATER_OR_EQUAL:
+            return z >= depth;
+        default:
+            return true;
+    }
+}
+
+#if defined(UVRE_SW_SSE2)
+static inline int testDepth4(uvre::DepthFunc func, __m128 z, __m128 depth)
+{
+    switch(func) {
+        case uvre::DepthFunc::NEVER:
+            return 0x0;
+        case uvre::DepthFunc::ALWAYS:
+            return 0xF;
+        case uvre::DepthFunc::EQUAL:
+            return _mm_movemask_ps(_mm_cmpeq_ps(z, depth));
+        case uvre::DepthFunc::NOT_EQUAL:
+            return _mm_movemask_ps(_mm_cmpneq_ps(z, depth));
+        case uvre::DepthFunc::LESS:
+            return _mm_movemask_ps(_mm_cmplt_ps(z, depth));
+        case uvre::DepthFunc::LESS_OR_EQUAL:
+            return _mm_movemask_ps(_mm_cmple_ps(z, depth));
+        case uvre::DepthFunc::GREATER:
+            return _mm_movemask_ps(_mm_cmpgt_ps(z, depth));
+        case uvre::DepthFunc::GREATER_OR_EQUAL:
+            return _mm_movemask_ps(_mm_cmpge_ps(z, depth));
+        default:
+            return 0xF;
+    }
+}
+
+static inline __m128 getBlendFactor(uvre::BlendFunc func, __m128 src, __m128 dst)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    switch(func) {
+        case uvre::BlendFunc::ZERO:
+            return _mm_setzero_ps();
+        case uvre::BlendFunc::ONE:
+            return one;
+        case uvre::BlendFunc::SRC_COLOR:
+            return src;
+        case uvre::BlendFunc::ONE_MINUS_SRC_COLOR:
+            return _mm_sub_ps(one, src);
+        case uvre::BlendFunc::SRC_ALPHA:
+            return _mm_shuffle_ps(src, src, _MM_SHUFFLE(3, 3, 3, 3));
+        case uvre::BlendFunc::ONE_MINUS_SRC_ALPHA:
+            return _mm_sub_ps(one, _mm_shuffle_ps(src, src, _MM_SHUFFLE(3, 3, 3, 3)));
+        case uvre::BlendFunc::DST_COLOR:
+            return dst;
+        case uvre::BlendFunc::ONE_MINUS_DST_COLOR:
+            return _mm_sub_ps(one, dst);
+        case uvre::BlendFunc::DST_ALPHA:
+            return _mm_shuffle_ps(dst, dst, _MM_SHUFFLE(3, 3, 3, 3));
+        case uvre::BlendFunc::ONE_MINUS_DST_ALPHA:
+            return _mm_sub_ps(one, _mm_shuffle_ps(dst, dst, _MM_SHUFFLE(3, 3, 3, 3)));
+        default:
+            return one;
+    }
+}
+
+static inline void writeColor(const uvre::sw::Pipeline_S *pipeline, uint8_t *pixel, const float color[4])
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 scale = _mm_set1_ps(255.0f);
+    __m128 src = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(color), zero), one);
+
+    if(pipeline->blending.enabled) {
+        int32_t packed;
+        std::memcpy(&packed, pixel, sizeof(packed));
+        const __m128i zeroi = _mm_setzero_si128();
+        const __m128i dsti = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zeroi), zeroi);
+        const __m128 dst = _mm_mul_ps(_mm_cvtepi32_ps(dsti), _mm_set1_ps(1.0f / 255.0f));
+        const __m128 s = _mm_mul_ps(src, getBlendFactor(pipeline->blending.sfactor, src, dst));
+        const __m128 d = _mm_mul_ps(dst, getBlendFactor(pipeline->blending.dfactor, src, dst));
+        switch(pipeline->blending.equation) {
+            case uvre::BlendEquation::ADD:
+                src = _mm_add_ps(s, d);
+                break;
+            case uvre::BlendEquation::SUBTRACT:
+                src = _mm_sub_ps(s, d);
+                break;
+            case uvre::BlendEquation::REVERSE_SUBTRACT:
+                src = _mm_sub_ps(d, s);
+                break;
+            case uvre::BlendEquation::MIN:
+                src = _mm_min_ps(src, dst);
+                break;
+            case uvre::BlendEquation::MAX:
+                src = _mm_max_ps(src, dst);
+                break;
+        }
+
+        src = _mm_min_ps(_mm_max_ps(src, zero), one);
+    }
+
+    const __m128i result = _mm_cvtps_epi32(_mm_mul_ps(src, scale));
+    const __m128i packed16 = _mm_packs_epi32(result, result);
+    const int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(packed16, packed16));
+    std::memcpy(pixel, &packed, sizeof(packed));
+}
+#else
+static inline float getBlendFactor(uvre::BlendFunc func, const float src[4], const float dst[4], int c)
+{
+    switch(func) {
+        case uvre::BlendFunc::ZERO:
+            return 0.0f;
+        case uvre::BlendFunc::ONE:
+            return 1.0f;
+        case uvre::BlendFunc::SRC_COLOR:
+            return src[c];
+        case uvre::BlendFunc::ONE_MINUS_SRC_COLOR:
+            return 1.0f - src[c];
+        case uvre::BlendFunc::SRC_ALPHA:
+            return src[3];
+        case uvre::BlendFunc::ONE_MINUS_SRC_ALPHA:
+            return 1.0f - src[3];
+        case uvre::BlendFunc::DST_COLOR:
+            return dst[c];
+        case uvre::BlendFunc::ONE_MINUS_DST_COLOR:
+            return 1.0f - dst[c];
+        case uvre::BlendFunc::DST_ALPHA:
+            return dst[3];
+        case uvre::BlendFunc::ONE_MINUS_DST_ALPHA:
+            return 1.0f - dst[3];
+        default:
+            return 1.0f;
+    }
+}
+
+static inline void writeColor(const uvre::sw::Pipeline_S *pipeline, uint8_t *pixel, const float color[4])
+{
+    float src[4], dst[4];
+    for(int c = 0; c < 4; c++) {
+        src[c] = std::min(std::max(color[c], 0.0f), 1.0f);
+        dst[c] = static_cast<float>(pixel[c]) / 255.0f;
+    }
+
+    for(int c = 0; c < 4; c++) {
+        float value = src[c];
+        if(pipeline->blending.enabled) {
+            const float s = src[c] * getBlendFactor(pipeline->blending.sfactor, src, dst, c);
+            const float d = dst[c] * getBlendFactor(pipeline->blending.dfactor, src, dst, c);
+            switch(pipeline->blending.equation) {
+                case uvre::BlendEquation::ADD:
+                    value = s + d;
+                    break;
+                case uvre::BlendEquation::SUBTRACT:
+                    value = s - d;
+                    break;
+                case uvre::BlendEquation::REVERSE_SUBTRACT:
+                    value = d - s;
+                    break;
+                case uvre::BlendEquation::MIN:
+                    value = std::min(src[c], dst[c]);
+                    break;
+                case uvre::BlendEquation::MAX:
+                    value = std::max(src[c], dst[c]);
+                    break;
+            }
+
+            value = std::min(std::max(value, 0.0f), 1.0f);
+        }
+
+        pixel[c] = static_cast<uint8_t>(std::lround(value * 255.0f));
+    }
+}
+#endif
+
+static void rasterizeTriangle(const uvre::sw::Rasterizer *rasterizer, const uvre::sw::DrawState &state, const uvre::sw::Triangle &tri, int x0, int y0, int x1, int y1, uint64_t &samples)
+{
+    const uvre::sw::Pipeline_S *pipeline = state.pipeline;
+    const int64_t sx = static_cast<int64_t>(x0) * SUBPIXEL_ONE + SUBPIXEL_HALF;
+    const int64_t sy = static_cast<int64_t>(y0) * SUBPIXEL_ONE + SUBPIXEL_HALF;
+
+    // Edges that are entirely inside of the rectangle
+    // are zeroed out, the rest stays small enough to
+    // be stepped through with 32-bit integers.
+    int32_t edge_row[3], step_x[3], step_y[3];
+    for(int k = 0; k < 3; k++) {
+        const int64_t e = tri.edge_a[k] * sx + tri.edge_b[k] * sy + tri.edge_c[k] + tri.bias[k];
+        const int64_t dx = tri.edge_a[k] * SUBPIXEL_ONE * (x1 - x0);
+        const int64_t dy = tri.edge_b[k] * SUBPIXEL_ONE * (y1 - y0);
+        if(e + std::max<int64_t>(0, dx) + std::max<int64_t>(0, dy) < 0)
+            return;
+        if(e + std::min<int64_t>(0, dx) + std::min<int64_t>(0, dy) >= 0) {
+            edge_row[k] = 0;
+            step_x[k] = 0;
+            step_y[k] = 0;
+            continue;
+        }
+
+        edge_row[k] = static_cast<int32_t>(e);
+        step_x[k] = static_cast<int32_t>(tri.edge_a[k] * SUBPIXEL_ONE);
+        step_y[k] = static_cast<int32_t>(tri.edge_b[k] * SUBPIXEL_ONE);
+    }
+
+    // Interpolation goes through floats relative to
+    // the corner, precision is not an issue there.
+    const double inv_area = 1.0 / static_cast<double>(tri.area);
+    float bary_row[3], bary_dx[3], bary_dy[3];
+    for(int k = 1; k < 3; k++) {
+        bary_row[k] = static_cast<float>(static_cast<double>(tri.edge_a[k] * sx + tri.edge_b[k] * sy + tri.edge_c[k]) * inv_area);
+        bary_dx[k] = static_cast<float>(static_cast<double>(tri.edge_a[k] * SUBPIXEL_ONE) * inv_area);
+        bary_dy[k] = static_cast<float>(static_cast<double>(tri.edge_b[k] * SUBPIXEL_ONE) * inv_area);
+    }
+
+    const float dz1 = tri.z[1] - tri.z[0];
+    const float dz2 = tri.z[2] - tri.z[0];
+    const bool depth_test = pipeline->depth_testing.enabled && state.target.depth;
+    const size_t num_varyings = pipeline->num_varyings;
+    const float *varyings[3];
+    for(int k = 0; k < 3; k++)
+        varyings[k] = rasterizer->vertices[tri.vertices[k]].varyings;
+
+#if defined(UVRE_SW_SSE2)
+    const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    __m128i edge_lanes[3], edge_step4[3];
+    for(int k = 0; k < 3; k++) {
+        edge_lanes[k] = _mm_setr_epi32(0, step_x[k], step_x[k] * 2, step_x[k] * 3);
+        edge_step4[k] = _mm_set1_epi32(step_x[k] * 4);
+    }
+#endif
+
+    for(int y = y0; y <= y1; y++) {
+        float *depth_row = state.target.depth ? state.target.depth + static_cast<size_t>(y) * state.target.width : nullptr;
+        uint8_t *color_row = state.target.color ? state.target.color + static_cast<size_t>(y) * state.target.width * 4 : nullptr;
+
+#if defined(UVRE_SW_SSE2)
+        __m128i edges[3];
+        for(int k = 0; k < 3; k++)
+            edges[k] = _mm_add_epi32(_mm_set1_epi32(edge_row[k]), edge_lanes[k]);
+#else
+        int32_t edges[3] = { edge_row[0], edge_row[1], edge_row[2] };
+#endif
+
+        for(int x = x0; x <= x1; x += 4) {
+            const int num_lanes = std::min(4, x1 - x + 1);
+            float l1[4], l2[4], z[4];
+            int mask;
+
+#if defined(UVRE_SW_SSE2)
+            // A lane is covered when none of
+            // the edges has its sign bit set.
+            const __m128i any_negative = _mm_or_si128(_mm_or_si128(edges[0], edges[1]), edges[2]);
+            mask = ~_mm_movemask_ps(_mm_castsi128_ps(any_negative)) & ((1 << num_lanes) - 1);
+            for(int k = 0; k < 3; k++)
+                edges[k] = _mm_add_epi32(edges[k], edge_step4[k]);
+
+            if(!mask)
+                continue;
+
+            const float offset = static_cast<float>(x - x0);
+            const __m128 l1v = _mm_add_ps(_mm_set1_ps(bary_row[1] + bary_dx[1] * offset), _mm_mul_ps(lanes, _mm_set1_ps(bary_dx[1])));
+            const __m128 l2v = _mm_add_ps(_mm_set1_ps(bary_row[2] + bary_dx[2] * offset), _mm_mul_ps(lanes, _mm_set1_ps(bary_dx[2])));
+            __m128 zv = _mm_add_ps(_mm_set1_ps(tri.z[0]), _mm_add_ps(_mm_mul_ps(l1v, _mm_set1_ps(dz1)), _mm_mul_ps(l2v, _mm_set1_ps(dz2))));
+            zv = _mm_min_ps(_mm_max_ps(zv, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+
+            if(depth_test) {
+                __m128 depth;
+                if(num_lanes == 4) {
+                    depth = _mm_loadu_ps(depth_row + x);
+                }
+                else {
+                    float tail[4] = {};
+                    std::copy(depth_row + x, depth_row + x + num_lanes, tail);
+                    depth = _mm_loadu_ps(tail);
+                }
+
+                mask &= testDepth4(pipeline->depth_testing.func, zv, depth);
+                if(!mask)
+                    continue;
+            }
+
+            _mm_storeu_ps(l1, l1v);
+            _mm_storeu_ps(l2, l2v);
+            _mm_storeu_ps(z, zv);
+#else
+            mask = 0;
+            for(int i = 0; i < num_lanes; i++) {
+                const float offset = static_cast<float>(x - x0 + i);
+                if((edges[0] | edges[1] | edges[2]) >= 0) {
+                    l1[i] = bary_row[1] + bary_dx[1] * offset;
+                    l2[i] = bary_row[2] + bary_dx[2] * offset;
+                    z[i] = std::min(std::max(tri.z[0] + l1[i] * dz1 + l2[i] * dz2, 0.0f), 1.0f);
+                    if(!depth_test || testDepth(pipeline->depth_testing.func, z[i], depth_row[x + i]))
+                        mask |= 1 << i;
+                }
+
+                for(int k = 0; k < 3; k++)
+                    edges[k] += step_x[k];
+            }
+
+            if(!mask)
+                continue;
+#endif
+
+            // Shaders are callbacks so the
+            // rest has to go one pixel at a time.
+            for(int i = 0; i < num_lanes; i++) {
+                if(!(mask & (1 << i)))
+                    continue;
+
+                const int px = x + i;
+                float color[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+                if(pipeline->fragment) {
+                    // Perspective-correct interpolation
+                    const float w0 = (1.0f - l1[i] - l2[i]) * tri.inv_w[0];
+                    const float w1 = l1[i] * tri.inv_w[1];
+                    const float w2 = l2[i] * tri.inv_w[2];
+                    const float inv_sum = 1.0f / (w0 + w1 + w2);
+
+                    float values[uvre::SW_MAX_VARYINGS];
+                    for(size_t j = 0; j < num_varyings; j++)
+                        values[j] = (w0 * varyings[0][j] + w1 * varyings[1][j] + w2 * varyings[2][j]) * inv_sum;
+
+                    uvre::SwFragment frag;
+                    frag.coord[0] = static_cast<float>(px) + 0.5f;
+                    frag.coord[1] = static_cast<float>(y) + 0.5f;
+                    frag.coord[2] = z[i];
+                    frag.varyings = values;
+                    if(!pipeline->fragment(*state.resources, frag, color))
+                        continue;
+                }
+
+                if(depth_test)
+                    depth_row[px] = z[i];
+                if(pipeline->fragment && color_row)
+                    writeColor(pipeline, color_row + px * 4, color);
+                samples++;
+            }
+        }
+
+        for(int k = 0; k < 3; k++)
+            edge_row[k] += step_y[k];
+        for(int k = 1; k < 3; k++)
+            bary_row[k] += bary_dy[k];
+    }
+}
+
+static bool shadeVertices(uvre::sw::Rasterizer *rasterizer, const uvre::sw::DrawState &state, const uvre::sw::Buffer_S *vbo, uint32_t first, size_t count, uint32_t instance)
+{
+    const uvre::sw::Pipeline_S *pipeline = state.pipeline;
+    const size_t stride = pipeline->vertex_stride;
+    if(vbo && stride && (first + count) * stride > vbo->data.size())
+        return false;
+
+    rasterizer->vertices.resize(count);
+    rasterizer->pool->run((count + VERTEX_BATCH - 1) / VERTEX_BATCH, [rasterizer, &state, pipeline, vbo, stride, first, count, instance](size_t batch) {
+        const size_t end = std::min(count, (batch + 1) * VERTEX_BATCH);
+        for(size_t i = batch * VERTEX_BATCH; i < end; i++) {
+            const uint32_t id = first + static_cast<uint32_t>(i);
+            const void *vertex = vbo ? vbo->data.data() + id * stride : nullptr;
+            pipeline->vertex(*state.resources, vertex, id, instance, rasterizer->vertices[i]);
+        }
+    });
+
+    return true;
+}
+
+bool uvre::sw::Rasterizer::draw(const uvre::sw::DrawState &state, const uvre::sw::Buffer_S *vbo, const void *indices, size_t count, int32_t base_vertex, uint32_t instance)
+{
+    const uvre::sw::Pipeline_S *pipeline = state.pipeline;
+    if(!pipeline->vertex || count < 3)
+        return true;
+
+    // Indexed draws only shade the range
+    // of vertices the indices refer to.
+    int64_t first = base_vertex;
+    int64_t last = first + static_cast<int64_t>(count) - 1;
+    if(indices) {
+        uint32_t min_index = UINT32_MAX, max_index = 0;
+        for(size_t i = 0; i < count; i++) {
+            const uint32_t index = getIndex(indices, pipeline->index_size, i);
+            min_index = std::min(min_index, index);
+            max_index = std::max(max_index, index);
+        }
+
+        first = base_vertex + static_cast<int64_t>(min_index);
+        last = base_vertex + static_cast<int64_t>(max_index);
+    }
+
+    if(first < 0 || last >= INT32_MAX)
+        return false;
+    if(!shadeVertices(this, state, vbo, static_cast<uint32_t>(first), static_cast<size_t>(last - first + 1), instance))
+        return false;
+
+    primitives.clear();
+    for(size_t i = 0; i < count; i++)
+        primitives.push_back(indices ? static_cast<uint32_t>(base_vertex + static_cast<int64_t>(getIndex(indices, pipeline->index_size, i)) - first) : static_cast<uint32_t>(i));
+
+    int clip[4];
+    clip[0] = std::max(0, state.viewport[0]);
+    clip[1] = std::max(0, state.viewport[1]);
+    clip[2] = std::min(state.target.width, state.viewport[0] + state.viewport[2]) - 1;
+    clip[3] = std::min(state.target.height, state.viewport[1] + state.viewport[3]) - 1;
+    if(pipeline->scissor_test) {
+        clip[0] = std::max(clip[0], state.scissor[0]);
+        clip[1] = std::max(clip[1], state.scissor[1]);
+        clip[2] = std::min(clip[2], state.scissor[0] + state.scissor[2] - 1);
+        clip[3] = std::min(clip[3], state.scissor[1] + state.scissor[3] - 1);
+    }
+
+    if(clip[0] > clip[2] || clip[1] > clip[3])
+        return true;
+
+    triangles.clear();
+    switch(pipeline->primitive_mode) {
+        case uvre::PrimitiveMode::TRIANGLES:
+            for(size_t i = 2; i < count; i += 3)
+                clipTriangle(this, state, clip, primitives[i - 2], primitives[i - 1], primitives[i]);
+            break;
+        case uvre::PrimitiveMode::TRIANGLE_STRIP:
+            for(size_t i = 2; i < count; i++) {
+                // Every other triangle is flipped
+                // to keep the winding consistent.
+                if(i % 2)
+                    clipTriangle(this, state, clip, primitives[i - 1], primitives[i - 2], primitives[i]);
+                else
+                    clipTriangle(this, state, clip, primitives[i - 2], primitives[i - 1], primitives[i]);
+            }
+            break;
+        case uvre::PrimitiveMode::TRIANGLE_FAN:
+            for(size_t i = 2; i < count; i++)
+                clipTriangle(this, state, clip, primitives[0], primitives[i - 1], primitives[i]);
+            break;
+        default:
+            break;
+    }
+
+    if(triangles.empty())
+        return true;
+
+    // Bin the triangles into screen tiles; tiles
+    // are independent from each other so they go
+    // to different threads while each one still
+    // draws its triangles in the submission order.
+    const int tiles_x = (state.target.width + TILE_SIZE - 1) / TILE_SIZE;
+    const int tiles_y = (state.target.height + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t num_tiles = static_cast<size_t>(tiles_x) * static_cast<size_t>(tiles_y);
+    if(bins.size() < num_tiles)
+        bins.resize(num_tiles);
+    for(size_t i = 0; i < num_tiles; i++)
+        bins[i].clear();
+
+    for(size_t i = 0; i < triangles.size(); i++) {
+        const uvre::sw::Triangle &tri = triangles[i];
+        for(int ty = tri.min_y / TILE_SIZE; ty <= tri.max_y / TILE_SIZE; ty++) {
+            for(int tx = tri.min_x / TILE_SIZE; tx <= tri.max_x / TILE_SIZE; tx++)
+                bins[ty * tiles_x + tx].push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    pool->run(num_tiles, [this, &state, tiles_x](size_t tile) {
+        const int x0 = static_cast<int>(tile % tiles_x) * TILE_SIZE;
+        const int y0 = static_cast<int>(tile / tiles_x) * TILE_SIZE;
+        const int x1 = std::min(x0 + TILE_SIZE, state.target.width) - 1;
+        const int y1 = std::min(y0 + TILE_SIZE, state.target.height) - 1;
+
+        uint64_t samples = 0;
+        for(uint32_t index : bins[tile]) {
+            const uvre::sw::Triangle &tri = triangles[index];
+            rasterizeTriangle(this, state, tri, std::max(x0, tri.min_x), std::max(y0, tri.min_y), std::min(x1, tri.max_x), std::min(y1, tri.max_y), samples);
+        }
+
+        if(state.query && samples)
+            state.query->samples += samples;
+    });
+
+    return true;
+}
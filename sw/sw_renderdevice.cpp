@@ -0,0 +1,877 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "sw_private.hpp"
+#include <cmath>
+#include <cstring>
+
+static void reportError(uvre::sw::RenderDeviceImpl *device, const std::string &text)
+{
+    if(device->create_info.onDebugMessage) {
+        uvre::DebugMessageInfo msg = {};
+        msg.level = uvre::DebugMessageLevel::ERROR;
+        msg.text = text.c_str();
+        device->create_info.onDebugMessage(msg);
+    }
+}
+
+static void trackMemory(uvre::sw::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::unique_lock<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryStats &stats = device->memory_stats;
+    uvre::MemoryUsage &usage = stats.*member;
+    usage.bytes += bytes;
+    usage.peak_bytes = std::max(usage.peak_bytes, usage.bytes);
+    usage.peak_count = std::max(usage.peak_count, ++usage.count);
+
+    // Attachments are already counted as textures
+    if(member == &uvre::MemoryStats::render_targets)
+        return;
+
+    stats.total_bytes += bytes;
+    stats.peak_total_bytes = std::max(stats.peak_total_bytes, stats.total_bytes);
+
+    // Don't call back with the lock held
+    const uvre::DeviceCreateInfo &info = device->create_info;
+    if(info.memory.budget && info.memory.onBudgetExceeded && stats.total_bytes > info.memory.budget) {
+        const uvre::MemoryStats snapshot = stats;
+        lock.unlock();
+        info.memory.onBudgetExceeded(info.memory.user_data, snapshot);
+    }
+}
+
+static void untrackMemory(uvre::sw::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(device->memory_mutex);
+    uvre::MemoryUsage &usage = device->memory_stats.*member;
+    usage.bytes -= bytes;
+    usage.count--;
+    if(member != &uvre::MemoryStats::render_targets)
+        device->memory_stats.total_bytes -= bytes;
+}
+
+// Objects are plain memory and go away right
+// there, the deleter only has to uncount them.
+template<typename T>
+static std::shared_ptr<T> makeTracked(uvre::sw::RenderDeviceImpl *device, uvre::MemoryUsage uvre::MemoryStats::*member, size_t bytes)
+{
+    trackMemory(device, member, bytes);
+    std::shared_ptr<uvre::sw::DeviceLink> link = device->link;
+    return std::shared_ptr<T>(new T, [link, member, bytes](T *object) {
+        {
+            std::lock_guard<std::mutex> lock(link->mutex);
+            if(link->device)
+                untrackMemory(link->device, member, bytes);
+        }
+
+        delete object;
+    });
+}
+
+uvre::sw::RenderDeviceImpl::RenderDeviceImpl(const uvre::DeviceCreateInfo &create_info)
+    : create_info(create_info), pool(nullptr), rasterizer(nullptr), max_frames_in_flight(0), frame_number(0), color_buffer(), depth_buffer(), null_pipeline(), bound_vbo(nullptr), bound_ibo(nullptr), condition(nullptr), clear_depth(1.0f), commandlists(), link(std::make_shared<uvre::sw::DeviceLink>()), memory_mutex(), memory_stats()
+{
+    link->device = this;
+
+    size_t num_threads = create_info.sw.num_threads;
+    if(!num_threads)
+        num_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    pool = new uvre::sw::ThreadPool(num_threads);
+    rasterizer = new uvre::sw::Rasterizer(pool);
+
+    std::memset(&info, 0, sizeof(uvre::DeviceInfo));
+    info.impl_family = uvre::ImplFamily::SOFTWARE;
+    info.impl_version_major = 1;
+    info.impl_version_minor = 0;
+    info.supports_anisotropic = false;
+    info.supports_storage_buffers = true;
+    info.supports_compute = false;
+
+    // The code is never looked at anyway
+    info.supports_shader_format[static_cast<int>(uvre::ShaderFormat::BINARY_SPIRV)] = true;
+    info.supports_shader_format[static_cast<int>(uvre::ShaderFormat::SOURCE_GLSL)] = true;
+
+    null_pipeline.blending.enabled = false;
+    null_pipeline.depth_testing.enabled = false;
+    null_pipeline.face_culling.enabled = false;
+    null_pipeline.scissor_test = false;
+    null_pipeline.index_size = sizeof(uvre::Index16);
+    null_pipeline.primitive_mode = uvre::PrimitiveMode::TRIANGLES;
+    null_pipeline.vertex_stride = 0;
+    null_pipeline.num_varyings = 0;
+    null_pipeline.vertex = nullptr;
+    null_pipeline.fragment = nullptr;
+
+    std::memset(&default_target, 0, sizeof(uvre::sw::Framebuffer));
+    std::memset(&resources, 0, sizeof(uvre::SwResources));
+    std::memset(&state, 0, sizeof(uvre::sw::DrawState));
+    state.pipeline = &null_pipeline;
+    state.resources = &resources;
+    std::fill(clear_color, clear_color + 4, 0.0f);
+
+    // A zero would mean no frames at all
+    max_frames_in_flight = std::max<size_t>(1, create_info.max_frames_in_flight);
+}
+
+uvre::sw::RenderDeviceImpl::~RenderDeviceImpl()
+{
+    // Stats die with the device, handles
+    // dropped after this are only freed.
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->device = nullptr;
+    }
+
+    for(uvre::sw::CommandListImpl *commandlist : commandlists)
+        delete commandlist;
+    commandlists.clear();
+
+    delete rasterizer;
+    delete pool;
+}
+
+const uvre::DeviceInfo &uvre::sw::RenderDeviceImpl::getInfo() const
+{
+    return info;
+}
+
+uvre::MemoryStats uvre::sw::RenderDeviceImpl::getMemoryStats()
+{
+    std::lock_guard<std::mutex> lock(memory_mutex);
+    return memory_stats;
+}
+
+uint64_t uvre::sw::RenderDeviceImpl::getLastUsedFrame(const uvre::Texture &texture)
+{
+    return texture ? uvre::sw::impl(texture)->last_used_frame : 0;
+}
+
+uvre::Shader uvre::sw::RenderDeviceImpl::createShader(const uvre::ShaderCreateInfo &info)
+{
+    if(info.stage == uvre::ShaderStage::COMPUTE) {
+        reportError(this, "SW: compute shaders are not supported");
+        return nullptr;
+    }
+
+    if((info.stage == uvre::ShaderStage::VERTEX && !info.sw.vertex) || (info.stage == uvre::ShaderStage::FRAGMENT && !info.sw.fragment)) {
+        reportError(this, "SW: shader has no callback");
+        return nullptr;
+    }
+
+    if(info.sw.num_varyings > uvre::SW_MAX_VARYINGS) {
+        reportError(this, "SW: too many varyings");
+        return nullptr;
+    }
+
+    std::shared_ptr<uvre::sw::Shader_S> shader(new uvre::sw::Shader_S);
+    shader->stage = info.stage;
+    shader->vertex = info.sw.vertex;
+    shader->fragment = info.sw.fragment;
+    shader->num_varyings = info.sw.num_varyings;
+    return shader;
+}
+
+uvre::Shader uvre::sw::RenderDeviceImpl::createShaderAsync(const uvre::ShaderCreateInfo &info)
+{
+    // Nothing to compile
+    return createShader(info);
+}
+
+bool uvre::sw::RenderDeviceImpl::isReady(const uvre::Shader &)
+{
+    return true;
+}
+
+uvre::Pipeline uvre::sw::RenderDeviceImpl::createPipeline(const uvre::PipelineCreateInfo &info)
+{
+    if(info.primitive_mode != uvre::PrimitiveMode::TRIANGLES && info.primitive_mode != uvre::PrimitiveMode::TRIANGLE_STRIP && info.primitive_mode != uvre::PrimitiveMode::TRIANGLE_FAN) {
+        reportError(this, "SW: only triangles are supported");
+        return nullptr;
+    }
+
+    if(info.fill_mode != uvre::FillMode::FILLED) {
+        reportError(this, "SW: only filled polygons are supported");
+        return nullptr;
+    }
+
+    std::shared_ptr<uvre::sw::Pipeline_S> pipeline(new uvre::sw::Pipeline_S);
+    pipeline->blending.enabled = info.blending.enabled;
+    pipeline->blending.equation = info.blending.equation;
+    pipeline->blending.sfactor = info.blending.sfactor;
+    pipeline->blending.dfactor = info.blending.dfactor;
+    pipeline->depth_testing.enabled = info.depth_testing.enabled;
+    pipeline->depth_testing.func = info.depth_testing.func;
+    pipeline->face_culling.enabled = info.face_culling.enabled;
+    pipeline->face_culling.clockwise = (info.face_culling.flags & uvre::CULL_CLOCKWISE);
+    pipeline->face_culling.cull_front = (info.face_culling.flags & uvre::CULL_FRONT);
+    pipeline->face_culling.cull_back = (info.face_culling.flags & uvre::CULL_BACK) || !(info.face_culling.flags & uvre::CULL_FRONT);
+    pipeline->scissor_test = info.scissor_test;
+    pipeline->index_size = (info.index_type == uvre::IndexType::INDEX32) ? sizeof(uvre::Index32) : sizeof(uvre::Index16);
+    pipeline->primitive_mode = info.primitive_mode;
+    pipeline->vertex_stride = info.vertex_stride;
+    pipeline->num_varyings = 0;
+    pipeline->vertex = nullptr;
+    pipeline->fragment = nullptr;
+
+    for(size_t i = 0; i < info.num_shaders; i++) {
+        const uvre::Shader &shader = info.shaders[i];
+        if(!shader)
+            continue;
+        if(uvre::sw::impl(shader)->stage == uvre::ShaderStage::VERTEX) {
+            pipeline->vertex = uvre::sw::impl(shader)->vertex;
+            pipeline->num_varyings = uvre::sw::impl(shader)->num_varyings;
+        }
+        if(uvre::sw::impl(shader)->stage == uvre::ShaderStage::FRAGMENT)
+            pipeline->fragment = uvre::sw::impl(shader)->fragment;
+        pipeline->shaders.push_back(shader);
+    }
+
+    if(!pipeline->vertex) {
+        reportError(this, "SW: pipeline has no vertex shader");
+        return nullptr;
+    }
+
+    return pipeline;
+}
+
+uvre::Pipeline uvre::sw::RenderDeviceImpl::createPipelineAsync(const uvre::PipelineCreateInfo &info)
+{
+    // Nothing to link
+    return createPipeline(info);
+}
+
+bool uvre::sw::RenderDeviceImpl::isReady(const uvre::Pipeline &)
+{
+    return true;
+}
+
+uvre::Buffer uvre::sw::RenderDeviceImpl::createBuffer(const uvre::BufferCreateInfo &info)
+{
+    std::shared_ptr<uvre::sw::Buffer_S> buffer = makeTracked<uvre::sw::Buffer_S>(this, &uvre::MemoryStats::buffers, info.size);
+    buffer->data.resize(info.size, 0);
+    if(info.data)
+        std::memcpy(buffer->data.data(), info.data, info.size);
+    return buffer;
+}
+
+void uvre::sw::RenderDeviceImpl::writeBuffer(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    if(offset + size <= uvre::sw::impl(buffer)->data.size())
+        std::memcpy(uvre::sw::impl(buffer)->data.data() + offset, data, size);
+}
+
+uvre::Sampler uvre::sw::RenderDeviceImpl::createSampler(const uvre::SamplerCreateInfo &info)
+{
+    std::shared_ptr<uvre::sw::Sampler_S> sampler(new uvre::sw::Sampler_S);
+    sampler->flags = info.flags;
+    return sampler;
+}
+
+static inline size_t getPixelSize(uvre::PixelFormat format)
+{
+    switch(format) {
+        case uvre::PixelFormat::R8_UNORM:
+        case uvre::PixelFormat::R8_SINT:
+        case uvre::PixelFormat::R8_UINT:
+        case uvre::PixelFormat::S8_UINT:
+            return 1;
+        case uvre::PixelFormat::R8G8_UNORM:
+        case uvre::PixelFormat::R8G8_SINT:
+        case uvre::PixelFormat::R8G8_UINT:
+        case uvre::PixelFormat::R16_UNORM:
+        case uvre::PixelFormat::R16_SINT:
+        case uvre::PixelFormat::R16_UINT:
+        case uvre::PixelFormat::R16_FLOAT:
+        case uvre::PixelFormat::D16_UNORM:
+            return 2;
+        case uvre::PixelFormat::R8G8B8_UNORM:
+        case uvre::PixelFormat::R8G8B8_SINT:
+        case uvre::PixelFormat::R8G8B8_UINT:
+            return 3;
+        case uvre::PixelFormat::R8G8B8A8_UNORM:
+        case uvre::PixelFormat::R8G8B8A8_SINT:
+        case uvre::PixelFormat::R8G8B8A8_UINT:
+        case uvre::PixelFormat::R16G16_UNORM:
+        case uvre::PixelFormat::R16G16_SINT:
+        case uvre::PixelFormat::R16G16_UINT:
+        case uvre::PixelFormat::R16G16_FLOAT:
+        case uvre::PixelFormat::R32_SINT:
+        case uvre::PixelFormat::R32_UINT:
+        case uvre::PixelFormat::R32_FLOAT:
+        case uvre::PixelFormat::D32_FLOAT:
+            return 4;
+        case uvre::PixelFormat::R16G16B16_UNORM:
+        case uvre::PixelFormat::R16G16B16_SINT:
+        case uvre::PixelFormat::R16G16B16_UINT:
+        case uvre::PixelFormat::R16G16B16_FLOAT:
+            return 6;
+        case uvre::PixelFormat::R16G16B16A16_UNORM:
+        case uvre::PixelFormat::R16G16B16A16_SINT:
+        case uvre::PixelFormat::R16G16B16A16_UINT:
+        case uvre::PixelFormat::R16G16B16A16_FLOAT:
+        case uvre::PixelFormat::R32G32_SINT:
+        case uvre::PixelFormat::R32G32_UINT:
+        case uvre::PixelFormat::R32G32_FLOAT:
+            return 8;
+        case uvre::PixelFormat::R32G32B32_SINT:
+        case uvre::PixelFormat::R32G32B32_UINT:
+        case uvre::PixelFormat::R32G32B32_FLOAT:
+            return 12;
+        case uvre::PixelFormat::R32G32B32A32_SINT:
+        case uvre::PixelFormat::R32G32B32A32_UINT:
+        case uvre::PixelFormat::R32G32B32A32_FLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+uvre::Texture uvre::sw::RenderDeviceImpl::createTexture(const uvre::TextureCreateInfo &info)
+{
+    int layers = 1;
+    if(info.type == uvre::TextureType::TEXTURE_CUBE)
+        layers = 6;
+    else if(info.type == uvre::TextureType::TEXTURE_ARRAY)
+        layers = info.depth;
+
+    const size_t bpp = getPixelSize(info.format);
+    if(!bpp || info.width <= 0 || info.height <= 0 || layers <= 0)
+        return nullptr;
+
+    // Only the base level is ever stored
+    const size_t size = bpp * info.width * info.height * layers;
+    std::shared_ptr<uvre::sw::Texture_S> texture = makeTracked<uvre::sw::Texture_S>(this, &uvre::MemoryStats::textures, size);
+    texture->bpp = bpp;
+    texture->last_used_frame = 0;
+    texture->pixels.resize(size, 0);
+    texture->data = texture->pixels.data();
+    texture->source = nullptr;
+    texture->image.format = info.format;
+    texture->image.width = info.width;
+    texture->image.height = info.height;
+    texture->image.depth = layers;
+    texture->image.pixels = texture->data;
+    return texture;
+}
+
+uvre::Texture uvre::sw::RenderDeviceImpl::createTextureView(const uvre::TextureViewCreateInfo &info)
+{
+    if(!info.texture)
+        return nullptr;
+
+    const uvre::sw::Texture_S *source = uvre::sw::impl(info.texture);
+    if(info.base_level != 0) {
+        reportError(this, "SW: only level zero of a texture is stored");
+        return nullptr;
+    }
+
+    if(getPixelSize(info.format) != source->bpp || info.base_layer + info.num_layers > static_cast<size_t>(source->image.depth)) {
+        reportError(this, "SW: texture view doesn't fit its source");
+        return nullptr;
+    }
+
+    // Views share the storage of their
+    // source, they only count as objects.
+    std::shared_ptr<uvre::sw::Texture_S> texture = makeTracked<uvre::sw::Texture_S>(this, &uvre::MemoryStats::textures, 0);
+    texture->bpp = source->bpp;
+    texture->last_used_frame = 0;
+    texture->data = source->data + source->bpp * source->image.width * source->image.height * info.base_layer;
+    texture->source = info.texture;
+    texture->image.format = info.format;
+    texture->image.width = source->image.width;
+    texture->image.height = source->image.height;
+    texture->image.depth = static_cast<int>(info.num_layers);
+    texture->image.pixels = texture->data;
+    return texture;
+}
+
+static void writeTexture(uvre::sw::RenderDeviceImpl *device, uvre::sw::Texture_S *texture, int level, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data)
+{
+    // No conversions, the data must
+    // come in the format of the texture.
+    if(format != texture->image.format) {
+        reportError(device, "SW: pixel format conversions are not supported");
+        return;
+    }
+
+    // The other levels aren't stored
+    if(level != 0)
+        return;
+
+    if(x < 0 || y < 0 || z < 0 || x + w > texture->image.width || y + h > texture->image.height || z + d > texture->image.depth)
+        return;
+
+    const size_t row_size = texture->bpp * w;
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+    for(int layer = z; layer < z + d; layer++) {
+        for(int row = y; row < y + h; row++) {
+            uint8_t *dst = texture->data + texture->bpp * ((static_cast<size_t>(layer) * texture->image.height + row) * texture->image.width + x);
+            std::memcpy(dst, src, row_size);
+            src += row_size;
+        }
+    }
+}
+
+void uvre::sw::RenderDeviceImpl::writeTexture2D(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTexture(this, uvre::sw::impl(texture), level, x, y, 0, w, h, 1, format, data);
+}
+
+void uvre::sw::RenderDeviceImpl::writeTextureCube(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTexture(this, uvre::sw::impl(texture), level, x, y, face, w, h, 1, format, data);
+}
+
+void uvre::sw::RenderDeviceImpl::writeTextureArray(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTexture(this, uvre::sw::impl(texture), level, x, y, z, w, h, d, format, data);
+}
+
+void uvre::sw::RenderDeviceImpl::setTextureBaseLevel(const uvre::Texture &, int)
+{
+}
+
+// Writes are plain memory copies and submit
+// is done with everything once it returns.
+uvre::Buffer uvre::sw::RenderDeviceImpl::createBufferAsync(const uvre::BufferCreateInfo &info)
+{
+    return createBuffer(info);
+}
+
+void uvre::sw::RenderDeviceImpl::writeBufferAsync(const uvre::Buffer &buffer, size_t offset, size_t size, const void *data)
+{
+    writeBuffer(buffer, offset, size, data);
+}
+
+void uvre::sw::RenderDeviceImpl::writeTexture2DAsync(const uvre::Texture &texture, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTexture2D(texture, x, y, w, h, format, data, level);
+}
+
+void uvre::sw::RenderDeviceImpl::writeTextureCubeAsync(const uvre::Texture &texture, int face, int x, int y, int w, int h, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTextureCube(texture, face, x, y, w, h, format, data, level);
+}
+
+void uvre::sw::RenderDeviceImpl::writeTextureArrayAsync(const uvre::Texture &texture, int x, int y, int z, int w, int h, int d, uvre::PixelFormat format, const void *data, int level)
+{
+    writeTextureArray(texture, x, y, z, w, h, d, format, data, level);
+}
+
+bool uvre::sw::RenderDeviceImpl::isReady(const uvre::Buffer &)
+{
+    return true;
+}
+
+bool uvre::sw::RenderDeviceImpl::isReady(const uvre::Texture &)
+{
+    return true;
+}
+
+uvre::RenderTarget uvre::sw::RenderDeviceImpl::createRenderTarget(const uvre::RenderTargetCreateInfo &info)
+{
+    size_t size = info.depth_attachment ? uvre::sw::impl(info.depth_attachment)->pixels.size() : 0;
+    for(size_t i = 0; i < info.num_color_attachments; i++)
+        size += uvre::sw::impl(info.color_attachments[i].color)->pixels.size();
+
+    std::shared_ptr<uvre::sw::RenderTarget_S> target = makeTracked<uvre::sw::RenderTarget_S>(this, &uvre::MemoryStats::render_targets, size);
+    target->color = nullptr;
+    target->depth = info.depth_attachment;
+
+    for(size_t i = 0; i < info.num_color_attachments; i++) {
+        if(info.color_attachments[i].id == 0)
+            target->color = info.color_attachments[i].color;
+    }
+
+    if(target->color && uvre::sw::impl(target->color)->image.format != uvre::PixelFormat::R8G8B8A8_UNORM) {
+        reportError(this, "SW: color attachments must be R8G8B8A8_UNORM");
+        return nullptr;
+    }
+
+    if(target->depth && uvre::sw::impl(target->depth)->image.format != uvre::PixelFormat::D32_FLOAT) {
+        reportError(this, "SW: depth attachments must be D32_FLOAT");
+        return nullptr;
+    }
+
+    if(target->color && target->depth && (uvre::sw::impl(target->color)->image.width != uvre::sw::impl(target->depth)->image.width || uvre::sw::impl(target->color)->image.height != uvre::sw::impl(target->depth)->image.height)) {
+        reportError(this, "SW: attachments must be of the same size");
+        return nullptr;
+    }
+
+    return target;
+}
+
+uvre::ResourceSet uvre::sw::RenderDeviceImpl::createResourceSet(const uvre::ResourceSetCreateInfo &info)
+{
+    std::shared_ptr<uvre::sw::ResourceSet_S> set(new uvre::sw::ResourceSet_S);
+
+    for(size_t i = 0; i < info.num_textures; i++) {
+        const uvre::Texture &texture = info.textures[i];
+        set->textures.push_back(texture ? &uvre::sw::impl(texture)->image : nullptr);
+        set->objects.push_back(texture);
+        if(texture)
+            set->texture_objects.push_back(uvre::sw::impl(texture));
+    }
+
+    // Samplers mean nothing, shaders sample on their own
+    for(size_t i = 0; i < info.num_samplers; i++)
+        set->objects.push_back(info.samplers[i]);
+
+    for(size_t i = 0; i < info.num_uniform_buffers; i++) {
+        const uvre::BufferRange &range = info.uniform_buffers[i];
+        set->uniform_buffers.push_back(range.buffer ? uvre::sw::impl(range.buffer)->data.data() + range.offset : nullptr);
+        set->objects.push_back(range.buffer);
+    }
+
+    for(size_t i = 0; i < info.num_storage_buffers; i++) {
+        const uvre::BufferRange &range = info.storage_buffers[i];
+        set->storage_buffers.push_back(range.buffer ? uvre::sw::impl(range.buffer)->data.data() + range.offset : nullptr);
+        set->objects.push_back(range.buffer);
+    }
+
+    return set;
+}
+
+uvre::ICommandList *uvre::sw::RenderDeviceImpl::createCommandList()
+{
+    uvre::sw::CommandListImpl *commands = new uvre::sw::CommandListImpl();
+    commandlists.push_back(commands);
+    return commands;
+}
+
+void uvre::sw::RenderDeviceImpl::destroyCommandList(uvre::ICommandList *commands)
+{
+    for(std::vector<uvre::sw::CommandListImpl *>::const_iterator it = commandlists.cbegin(); it != commandlists.cend(); it++) {
+        if(*it == commands) {
+            commandlists.erase(it);
+            delete commands;
+            return;
+        }
+    }
+}
+
+void uvre::sw::RenderDeviceImpl::startRecording(uvre::ICommandList *commands)
+{
+    uvre::sw::CommandListImpl *swcommands = static_cast<uvre::sw::CommandListImpl *>(commands);
+    swcommands->num_commands = 0;
+    swcommands->used_textures.clear();
+}
+
+static uvre::sw::Framebuffer getFramebuffer(uvre::sw::RenderDeviceImpl *device, const uvre::sw::RenderTarget_S *target)
+{
+    if(!target)
+        return device->default_target;
+
+    uvre::sw::Framebuffer framebuffer = {};
+    if(target->color) {
+        framebuffer.color = uvre::sw::impl(target->color)->data;
+        framebuffer.width = uvre::sw::impl(target->color)->image.width;
+        framebuffer.height = uvre::sw::impl(target->color)->image.height;
+    }
+
+    if(target->depth) {
+        framebuffer.depth = reinterpret_cast<float *>(uvre::sw::impl(target->depth)->data);
+        framebuffer.width = uvre::sw::impl(target->depth)->image.width;
+        framebuffer.height = uvre::sw::impl(target->depth)->image.height;
+    }
+
+    return framebuffer;
+}
+
+static void clearFramebuffer(uvre::sw::RenderDeviceImpl *device, uvre::RenderTargetMask mask)
+{
+    const uvre::sw::Framebuffer &target = device->state.target;
+    int x0 = 0, y0 = 0, x1 = target.width, y1 = target.height;
+    if(device->state.pipeline->scissor_test) {
+        x0 = std::max(x0, device->state.scissor[0]);
+        y0 = std::max(y0, device->state.scissor[1]);
+        x1 = std::min(x1, device->state.scissor[0] + device->state.scissor[2]);
+        y1 = std::min(y1, device->state.scissor[1] + device->state.scissor[3]);
+    }
+
+    uint8_t color[4];
+    for(int i = 0; i < 4; i++)
+        color[i] = static_cast<uint8_t>(std::lround(std::min(std::max(device->clear_color[i], 0.0f), 1.0f) * 255.0f));
+
+    for(int y = y0; y < y1; y++) {
+        const size_t row = static_cast<size_t>(y) * target.width;
+        if((mask & uvre::RT_COLOR_BUFFER) && target.color) {
+            for(int x = x0; x < x1; x++)
+                std::memcpy(target.color + (row + x) * 4, color, sizeof(color));
+        }
+
+        if((mask & uvre::RT_DEPTH_BUFFER) && target.depth && x1 > x0)
+            std::fill(target.depth + row + x0, target.depth + row + x1, device->clear_depth);
+    }
+}
+
+static void copyFramebuffer(uvre::sw::RenderDeviceImpl *device, const uvre::sw::Command &cmd)
+{
+    const uvre::sw::Framebuffer src = getFramebuffer(device, cmd.rt_copy.src);
+    const uvre::sw::Framebuffer dst = getFramebuffer(device, cmd.rt_copy.dst);
+    const int dw = cmd.rt_copy.dx1 - cmd.rt_copy.dx0;
+    const int dh = cmd.rt_copy.dy1 - cmd.rt_copy.dy0;
+    if(!dw || !dh)
+        return;
+
+    // Always nearest, a linear filter
+    // would only matter for scaled copies.
+    for(int y = std::min(cmd.rt_copy.dy0, cmd.rt_copy.dy1); y < std::max(cmd.rt_copy.dy0, cmd.rt_copy.dy1); y++) {
+        if(y < 0 || y >= dst.height)
+            continue;
+        const int sy = cmd.rt_copy.sy0 + static_cast<int>((y - cmd.rt_copy.dy0 + 0.5f) * (cmd.rt_copy.sy1 - cmd.rt_copy.sy0) / dh);
+        if(sy < 0 || sy >= src.height)
+            continue;
+
+        for(int x = std::min(cmd.rt_copy.dx0, cmd.rt_copy.dx1); x < std::max(cmd.rt_copy.dx0, cmd.rt_copy.dx1); x++) {
+            if(x < 0 || x >= dst.width)
+                continue;
+            const int sx = cmd.rt_copy.sx0 + static_cast<int>((x - cmd.rt_copy.dx0 + 0.5f) * (cmd.rt_copy.sx1 - cmd.rt_copy.sx0) / dw);
+            if(sx < 0 || sx >= src.width)
+                continue;
+
+            const size_t src_index = static_cast<size_t>(sy) * src.width + sx;
+            const size_t dst_index = static_cast<size_t>(y) * dst.width + x;
+            if((cmd.rt_copy.mask & uvre::RT_COLOR_BUFFER) && src.color && dst.color)
+                std::memcpy(dst.color + dst_index * 4, src.color + src_index * 4, 4);
+            if((cmd.rt_copy.mask & uvre::RT_DEPTH_BUFFER) && src.depth && dst.depth)
+                dst.depth[dst_index] = src.depth[src_index];
+        }
+    }
+}
+
+void uvre::sw::RenderDeviceImpl::submit(uvre::ICommandList *commands)
+{
+    uvre::sw::CommandListImpl *swcommands = static_cast<uvre::sw::CommandListImpl *>(commands);
+    // Residency managers want to know this
+    for(uvre::sw::Texture_S *texture : swcommands->used_textures)
+        texture->last_used_frame = frame_number + 1;
+
+    for(size_t i = 0; i < swcommands->num_commands; i++) {
+        const uvre::sw::Command &cmd = swcommands->commands[i];
+        switch(cmd.type) {
+            case uvre::sw::CommandType::SET_SCISSOR:
+                state.scissor[0] = cmd.scvp.x;
+                state.scissor[1] = cmd.scvp.y;
+                state.scissor[2] = cmd.scvp.w;
+                state.scissor[3] = cmd.scvp.h;
+                break;
+            case uvre::sw::CommandType::SET_VIEWPORT:
+                state.viewport[0] = cmd.scvp.x;
+                state.viewport[1] = cmd.scvp.y;
+                state.viewport[2] = cmd.scvp.w;
+                state.viewport[3] = cmd.scvp.h;
+                break;
+            case uvre::sw::CommandType::SET_CLEAR_DEPTH:
+                clear_depth = cmd.depth;
+                break;
+            case uvre::sw::CommandType::SET_CLEAR_COLOR:
+                std::copy(cmd.color, cmd.color + 4, clear_color);
+                break;
+            case uvre::sw::CommandType::CLEAR:
+                clearFramebuffer(this, static_cast<uvre::RenderTargetMask>(cmd.clear_mask));
+                break;
+            case uvre::sw::CommandType::BIND_PIPELINE:
+                state.pipeline = cmd.pipeline ? cmd.pipeline : &null_pipeline;
+                break;
+            case uvre::sw::CommandType::BIND_STORAGE_BUFFER:
+                if(cmd.bind_index < uvre::SW_MAX_BINDINGS)
+                    resources.storage_buffers[cmd.bind_index] = cmd.buffer ? cmd.buffer->data.data() : nullptr;
+                break;
+            case uvre::sw::CommandType::BIND_UNIFORM_BUFFER:
+                if(cmd.bind_index < uvre::SW_MAX_BINDINGS)
+                    resources.uniform_buffers[cmd.bind_index] = cmd.buffer ? cmd.buffer->data.data() : nullptr;
+                break;
+            case uvre::sw::CommandType::BIND_INDEX_BUFFER:
+                bound_ibo = cmd.buffer;
+                break;
+            case uvre::sw::CommandType::BIND_VERTEX_BUFFER:
+                bound_vbo = cmd.buffer;
+                break;
+            case uvre::sw::CommandType::BIND_TEXTURE:
+                if(cmd.bind_index < uvre::SW_MAX_BINDINGS)
+                    resources.textures[cmd.bind_index] = cmd.texture ? &cmd.texture->image : nullptr;
+                break;
+            case uvre::sw::CommandType::BIND_RENDER_TARGET:
+                state.target = getFramebuffer(this, cmd.target);
+                break;
+            case uvre::sw::CommandType::BIND_RESOURCE_SET:
+                for(size_t j = 0; j < cmd.set->textures.size() && cmd.bind_index + j < uvre::SW_MAX_BINDINGS; j++)
+                    resources.textures[cmd.bind_index + j] = cmd.set->textures[j];
+                for(size_t j = 0; j < cmd.set->uniform_buffers.size() && cmd.bind_index + j < uvre::SW_MAX_BINDINGS; j++)
+                    resources.uniform_buffers[cmd.bind_index + j] = cmd.set->uniform_buffers[j];
+                for(size_t j = 0; j < cmd.set->storage_buffers.size() && cmd.bind_index + j < uvre::SW_MAX_BINDINGS; j++)
+                    resources.storage_buffers[cmd.bind_index + j] = cmd.set->storage_buffers[j];
+                break;
+            case uvre::sw::CommandType::WRITE_BUFFER:
+                if(cmd.buffer_write.offset + cmd.buffer_write.size <= cmd.buffer_write.buffer->data.size())
+                    std::memcpy(cmd.buffer_write.buffer->data.data() + cmd.buffer_write.offset, cmd.buffer_write.data_ptr, cmd.buffer_write.size);
+                break;
+            case uvre::sw::CommandType::COPY_RENDER_TARGET:
+                copyFramebuffer(this, cmd);
+                break;
+            case uvre::sw::CommandType::BEGIN_QUERY:
+                cmd.query->samples = 0;
+                state.query = cmd.query;
+                break;
+            case uvre::sw::CommandType::END_QUERY:
+                state.query = nullptr;
+                break;
+            case uvre::sw::CommandType::BEGIN_CONDITIONAL_RENDER:
+                // Queries are always done by the
+                // time anyone can look at them.
+                condition = cmd.cond.query;
+                break;
+            case uvre::sw::CommandType::END_CONDITIONAL_RENDER:
+                condition = nullptr;
+                break;
+            case uvre::sw::CommandType::DRAW:
+                if(condition && !condition->samples)
+                    break;
+                for(int32_t j = 0; j < cmd.draw.a.instances; j++) {
+                    if(!rasterizer->draw(state, bound_vbo, nullptr, static_cast<size_t>(cmd.draw.a.vertices), cmd.draw.a.base_vertex, static_cast<uint32_t>(cmd.draw.a.base_instance + j))) {
+                        reportError(this, "SW: draw reads past the vertex buffer");
+                        break;
+                    }
+                }
+                break;
+            case uvre::sw::CommandType::IDRAW:
+                if(condition && !condition->samples)
+                    break;
+                if(!bound_ibo || (static_cast<size_t>(cmd.draw.e.base_index) + static_cast<size_t>(cmd.draw.e.indices)) * state.pipeline->index_size > bound_ibo->data.size()) {
+                    reportError(this, "SW: draw reads past the index buffer");
+                    break;
+                }
+                for(int32_t j = 0; j < cmd.draw.e.instances; j++) {
+                    const uint8_t *indices = bound_ibo->data.data() + cmd.draw.e.base_index * state.pipeline->index_size;
+                    if(!rasterizer->draw(state, bound_vbo, indices, static_cast<size_t>(cmd.draw.e.indices), cmd.draw.e.base_vertex, static_cast<uint32_t>(cmd.draw.e.base_instance + j))) {
+                        reportError(this, "SW: draw reads past the vertex buffer");
+                        break;
+                    }
+                }
+                break;
+        }
+    }
+}
+
+uvre::Fence uvre::sw::RenderDeviceImpl::createFence()
+{
+    std::shared_ptr<uvre::sw::Fence_S> fence(new uvre::sw::Fence_S);
+    fence->frame = frame_number;
+    return fence;
+}
+
+bool uvre::sw::RenderDeviceImpl::waitFence(const uvre::Fence &, uint64_t)
+{
+    // Everything is done in submit()
+    return true;
+}
+
+uvre::Query uvre::sw::RenderDeviceImpl::createQuery(uvre::QueryType type)
+{
+    std::shared_ptr<uvre::sw::Query_S> query(new uvre::sw::Query_S);
+    query->type = type;
+    query->samples = 0;
+    return query;
+}
+
+bool uvre::sw::RenderDeviceImpl::getQueryResult(const uvre::Query &query, uint64_t &result)
+{
+    result = uvre::sw::impl(query)->samples;
+    if(uvre::sw::impl(query)->type == uvre::QueryType::ANY_SAMPLES)
+        result = result ? 1 : 0;
+    return true;
+}
+
+static std::shared_ptr<uvre::sw::Readback_S> copyPixels(const uint8_t *pixels, size_t bpp, int width, int height, int x, int y, int w, int h)
+{
+    if(!pixels || x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > width || y + h > height)
+        return nullptr;
+
+    const size_t row_size = bpp * static_cast<size_t>(w);
+    std::shared_ptr<uvre::sw::Readback_S> readback(new uvre::sw::Readback_S);
+    readback->pixels.resize(row_size * static_cast<size_t>(h));
+    for(int i = 0; i < h; i++)
+        std::memcpy(readback->pixels.data() + row_size * i, pixels + bpp * (static_cast<size_t>(y + i) * width + x), row_size);
+    return readback;
+}
+
+uvre::Readback uvre::sw::RenderDeviceImpl::readRenderTargetAsync(const uvre::RenderTarget &target, uint32_t attachment, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    if(attachment != 0 || getPixelSize(format) != 4) {
+        reportError(this, "SW: only the R8G8B8A8 color output can be read");
+        return nullptr;
+    }
+
+    const uvre::sw::Framebuffer framebuffer = getFramebuffer(this, uvre::sw::impl(target));
+    return copyPixels(framebuffer.color, 4, framebuffer.width, framebuffer.height, x, y, w, h);
+}
+
+uvre::Readback uvre::sw::RenderDeviceImpl::readTextureAsync(const uvre::Texture &texture, int level, int x, int y, int w, int h, uvre::PixelFormat format)
+{
+    if(!texture)
+        return nullptr;
+
+    const uvre::sw::Texture_S *texture_s = uvre::sw::impl(texture);
+    if(level != 0 || getPixelSize(format) != texture_s->bpp) {
+        reportError(this, "SW: texture reads can't convert or pick levels");
+        return nullptr;
+    }
+
+    return copyPixels(texture_s->data, texture_s->bpp, texture_s->image.width, texture_s->image.height, x, y, w, h);
+}
+
+const void *uvre::sw::RenderDeviceImpl::getReadbackData(const uvre::Readback &readback)
+{
+    return readback ? uvre::sw::impl(readback)->pixels.data() : nullptr;
+}
+
+void uvre::sw::RenderDeviceImpl::beginFrame()
+{
+    // Nothing to wait for
+}
+
+void uvre::sw::RenderDeviceImpl::endFrame()
+{
+    frame_number++;
+}
+
+size_t uvre::sw::RenderDeviceImpl::getFrameIndex() const
+{
+    return static_cast<size_t>(frame_number % max_frames_in_flight);
+}
+
+void uvre::sw::RenderDeviceImpl::prepare()
+{
+    // Nothing to reset
+}
+
+void uvre::sw::RenderDeviceImpl::present()
+{
+    if(create_info.sw.present)
+        create_info.sw.present(create_info.sw.user_data, color_buffer.data(), default_target.width, default_target.height);
+}
+
+void uvre::sw::RenderDeviceImpl::vsync(bool)
+{
+    // Up to whoever presents
+}
+
+void uvre::sw::RenderDeviceImpl::mode(int width, int height)
+{
+    // The default framebuffer only exists after this
+    const bool bound = (state.target.color == default_target.color && state.target.depth == default_target.depth);
+    color_buffer.assign(static_cast<size_t>(std::max(0, width)) * std::max(0, height) * 4, 0);
+    depth_buffer.assign(static_cast<size_t>(std::max(0, width)) * std::max(0, height), 1.0f);
+    default_target.color = color_buffer.data();
+    default_target.depth = depth_buffer.data();
+    default_target.width = std::max(0, width);
+    default_target.height = std::max(0, height);
+    if(bound)
+        state.target = default_target;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021, Kirill GPRB.
+ * All Rights Reserved.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+#include "sw_private.hpp"
+
+static void takeJobs(uvre::sw::ThreadPool *pool)
+{
+    // Jobs are handed out one index at a time
+    // so fast threads simply end up doing more.
+    for(size_t i = pool->next++; i < pool->count; i = pool->next++)
+        (*pool->func)(i);
+}
+
+static void workerMain(uvre::sw::ThreadPool *pool)
+{
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    for(;;) {
+        pool->job_cv.wait(lock, [pool, generation]() { return pool->quit || pool->generation != generation; });
+        if(pool->quit)
+            break;
+        generation = pool->generation;
+
+        lock.unlock();
+        takeJobs(pool);
+        lock.lock();
+
+        if(!--pool->num_busy)
+            pool->done_cv.notify_all();
+    }
+}
+
+uvre::sw::ThreadPool::ThreadPool(size_t num_threads)
+    : mutex(), job_cv(), done_cv(), func(nullptr), count(0), next(0), num_busy(0), generation(0), quit(false), threads()
+{
+    // The caller of run() is a thread too
+    for(size_t i = 1; i < num_threads; i++)
+        threads.emplace_back(workerMain, this);
+}
+
+uvre::sw::ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+
+    job_cv.notify_all();
+    for(std::thread &thread : threads)
+        thread.join();
+}
+
+void uvre::sw::ThreadPool::run(size_t count, const std::function<void(size_t)> &func)
+{
+    if(threads.empty() || count < 2) {
+        for(size_t i = 0; i < count; i++)
+            func(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->func = &func;
+        this->count = count;
+        next = 0;
+        num_busy = threads.size();
+        generation++;
+    }
+
+    job_cv.notify_all();
+    takeJobs(this);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [this]() { return num_busy == 0; });
+}